@@ -7,6 +7,9 @@ layout (location = 3) in vec2 inUV1;
 layout (location = 4) in vec4 inJoint0;
 layout (location = 5) in vec4 inWeight0;
 
+// Set by the renderer when the vertex layout stores normals as two snorm16 with an octahedral mapping
+layout (constant_id = 0) const bool OCTAHEDRAL_NORMALS = false;
+
 layout (set = 0, binding = 0) uniform UBO 
 {
 	mat4 projection;
@@ -15,41 +18,103 @@ layout (set = 0, binding = 0) uniform UBO
 	vec3 camPos;
 } ubo;
 
+#ifdef INDIRECT
+
+// Compiled a second time with -DINDIRECT into pbr_indirect.vert.spv
+// Every instance of an indirect draw command looks up its draw data in the instance list, the node matrix
+// and the joint matrices of all meshes are in one buffer
+
+struct DrawData {
+	uint transform;
+	uint jointCount;
+	uint material;
+	uint command;
+	uint firstInstance;
+};
+
+layout (std430, set = 2, binding = 0) readonly buffer Transforms {
+	mat4 transforms[];
+};
+
+layout (std430, set = 2, binding = 1) readonly buffer Draws {
+	DrawData draws[];
+};
+
+layout (std430, set = 2, binding = 2) readonly buffer Instances {
+	uint instances[];
+};
+
+#define DRAW draws[instances[gl_InstanceIndex]]
+#define NODE_MATRIX transforms[DRAW.transform]
+#define JOINT_MATRIX(i) transforms[DRAW.transform + 1 + (i)]
+#define JOINT_COUNT DRAW.jointCount
+
+#else
+
+// The node matrices of all meshes are in one buffer per frame, bound at the offset of the mesh
+// Only the joint matrices of the skin are written, the ones behind them belong to the next mesh
 #define MAX_NUM_JOINTS 128
 layout (set = 2, binding = 0) uniform UBONode {
 	mat4 matrix;
-	mat4 jointMatrix[MAX_NUM_JOINTS];
 	float jointCount;
+	mat4 jointMatrix[MAX_NUM_JOINTS];
 } node;
 
+#define NODE_MATRIX node.matrix
+#define JOINT_MATRIX(i) node.jointMatrix[i]
+#define JOINT_COUNT node.jointCount
+
+#endif
+
 layout (location = 0) out vec3 outWorldPos;
 layout (location = 1) out vec3 outNormal;
 layout (location = 2) out vec2 outUV0;
 layout (location = 3) out vec2 outUV1;
+#ifdef INDIRECT
+layout (location = 4) flat out int outMaterialIndex;
+#endif
 
 out gl_PerVertex
 {
 	vec4 gl_Position;
 };
 
+vec3 decodeNormal()
+{
+	if (!OCTAHEDRAL_NORMALS) {
+		return inNormal;
+	}
+	vec2 e = inNormal.xy;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
 void main() 
 {
 	vec4 locPos;
+	vec3 normal = decodeNormal();
     vec3 Pos = {0.3, 0.2, 0.1};
-	if (node.jointCount > 0.0) {
+	mat4 nodeMatrix = NODE_MATRIX;
+	if (JOINT_COUNT > 0) {
 		// Mesh is skinned
 		mat4 skinMat = 
-			inWeight0.x * node.jointMatrix[int(inJoint0.x)] +
-			inWeight0.y * node.jointMatrix[int(inJoint0.y)] +
-			inWeight0.z * node.jointMatrix[int(inJoint0.z)] +
-			inWeight0.w * node.jointMatrix[int(inJoint0.w)];
+			inWeight0.x * JOINT_MATRIX(int(inJoint0.x)) +
+			inWeight0.y * JOINT_MATRIX(int(inJoint0.y)) +
+			inWeight0.z * JOINT_MATRIX(int(inJoint0.z)) +
+			inWeight0.w * JOINT_MATRIX(int(inJoint0.w));
 
-		locPos = ubo.model * node.matrix * skinMat * vec4(inPos + Pos, 1.0);
-		outNormal = normalize(transpose(inverse(mat3(ubo.model * node.matrix * skinMat))) * inNormal);
+		locPos = ubo.model * nodeMatrix * skinMat * vec4(inPos + Pos, 1.0);
+		outNormal = normalize(transpose(inverse(mat3(ubo.model * nodeMatrix * skinMat))) * normal);
 	} else {
-		locPos = ubo.model * node.matrix * vec4(inPos, 1.0);
-		outNormal = normalize(transpose(inverse(mat3(ubo.model * node.matrix))) * inNormal);
+		locPos = ubo.model * nodeMatrix * vec4(inPos, 1.0);
+		outNormal = normalize(transpose(inverse(mat3(ubo.model * nodeMatrix))) * normal);
 	}
+#ifdef INDIRECT
+	outMaterialIndex = int(DRAW.material);
+#endif
 	locPos.y = -locPos.y;
 	outWorldPos = locPos.xyz / locPos.w;
 	outUV0 = inUV0;
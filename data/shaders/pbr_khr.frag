@@ -34,6 +34,67 @@ layout (set = 0, binding = 4) uniform sampler2D samplerBRDFLUT;
 
 // Material bindings
 
+#ifdef BINDLESS
+
+// Compiled a second time with -DBINDLESS into pbr_khr_bindless.frag.spv
+// All textures of the model are in one array, the materials are read from a storage buffer by an index
+// pushed per draw, the index is the same for the whole draw so plain dynamic indexing is enough
+
+layout (constant_id = 0) const int MATERIAL_TEXTURE_COUNT = 1;
+
+layout (set = 1, binding = 0) uniform sampler2D materialTextures[MATERIAL_TEXTURE_COUNT];
+
+struct MaterialData {
+	vec4 baseColorFactor;
+	vec4 emissiveFactor;
+	vec4 diffuseFactor;
+	vec4 specularFactor;
+	float workflow;
+	int baseColorTextureSet;
+	int physicalDescriptorTextureSet;
+	int normalTextureSet;
+	int occlusionTextureSet;
+	int emissiveTextureSet;
+	float metallicFactor;
+	float roughnessFactor;
+	float alphaMask;
+	float alphaMaskCutoff;
+	int colorTexture;
+	int physicalDescriptorTexture;
+	int normalTexture;
+	int occlusionTexture;
+	int emissiveTexture;
+};
+
+layout (std430, set = 1, binding = 1) readonly buffer Materials {
+	MaterialData materials[];
+};
+
+#ifdef INDIRECT
+
+// Compiled a third time with -DBINDLESS -DINDIRECT into pbr_khr_indirect.frag.spv
+// Indirect draws get their material index from the draw data read by the vertex shader
+layout (location = 4) flat in int inMaterialIndex;
+
+#define material materials[inMaterialIndex]
+
+#else
+
+layout (push_constant) uniform PushConsts {
+	int materialIndex;
+} pushConsts;
+
+#define material materials[pushConsts.materialIndex]
+
+#endif
+#define colorMap materialTextures[material.colorTexture]
+#define physicalDescriptorMap materialTextures[material.physicalDescriptorTexture]
+#define normalMap materialTextures[material.normalTexture]
+#define aoMap materialTextures[material.occlusionTexture]
+#define emissiveMap materialTextures[material.emissiveTexture]
+
+#else
+
 layout (set = 1, binding = 0) uniform sampler2D colorMap;
 layout (set = 1, binding = 1) uniform sampler2D physicalDescriptorMap;
 layout (set = 1, binding = 2) uniform sampler2D normalMap;
@@ -57,6 +118,8 @@ layout (push_constant) uniform Material {
 	float alphaMaskCutoff;
 } material;
 
+#endif
+
 layout (location = 0) out vec4 outColor;
 
 // Encapsulate the various inputs used by the various functions in the shading equation
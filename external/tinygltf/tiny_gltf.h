@@ -1322,13 +1322,14 @@ class TinyGLTF {
 
   ///
   /// Loads glTF binary asset from memory.
-  /// `length` = strlen(str);
+  /// `length` = size of `bytes`, may exceed 4 GB (e.g. a memory mapped file);
+  /// only the part covered by the GLB header length is parsed.
   /// Set warning message to `warn` for example it fails to load asserts.
   /// Returns false and set error string to `err` if there's an error.
   ///
   bool LoadBinaryFromMemory(Model *model, std::string *err, std::string *warn,
                             const unsigned char *bytes,
-                            const unsigned int length,
+                            const size_t length,
                             const std::string &base_dir = "",
                             unsigned int check_sections = REQUIRE_VERSION);
 
@@ -1403,6 +1404,27 @@ class TinyGLTF {
 
   bool GetPreserveImageChannels() const { return preserve_image_channels_; }
 
+  ///
+  /// Specify whether the embedded BIN chunk of a glTF Binary is copied into
+  /// `Buffer::data` or not. When disabled the buffer is left empty and the
+  /// caller reads its bufferViews straight from the memory given to
+  /// LoadBinaryFromMemory(), which must outlive the parsed model.
+  /// Images stored in bufferViews are still passed to the LoadImageData
+  /// callback. Needs SetDecodeDraco(false) for KHR_draco_mesh_compression.
+  ///
+  void SetCopyBinaryChunk(bool onoff) { copy_binary_chunk_ = onoff; }
+
+  bool GetCopyBinaryChunk() const { return copy_binary_chunk_; }
+
+  ///
+  /// Specify whether KHR_draco_mesh_compression primitives are decoded while
+  /// parsing (requires TINYGLTF_ENABLE_DRACO). When disabled the primitives
+  /// are left untouched and the caller decodes the compressed bufferViews.
+  ///
+  void SetDecodeDraco(bool onoff) { decode_draco_ = onoff; }
+
+  bool GetDecodeDraco() const { return decode_draco_; }
+
  private:
   ///
   /// Loads glTF asset from string(memory).
@@ -1425,6 +1447,12 @@ class TinyGLTF {
   bool preserve_image_channels_ = false;  /// Default false(expand channels to
                                           /// RGBA) for backward compatibility.
 
+  bool copy_binary_chunk_ = true;  /// Default true(copy the BIN chunk into
+                                   /// Buffer::data).
+
+  bool decode_draco_ = true;  /// Default true(decode Draco primitives while
+                              /// parsing).
+
   FsCallbacks fs = {
 #ifndef TINYGLTF_NO_FS
       &tinygltf::FileExists, &tinygltf::ExpandFilePath,
@@ -4021,7 +4049,7 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
                         FsCallbacks *fs, const std::string &basedir,
                         bool is_binary = false,
                         const unsigned char *bin_data = nullptr,
-                        size_t bin_size = 0) {
+                        size_t bin_size = 0, bool copy_bin = true) {
   size_t byteLength;
   if (!ParseUnsignedProperty(&byteLength, err, o, "byteLength", true,
                              "Buffer")) {
@@ -4093,9 +4121,12 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
         return false;
       }
 
-      // Read buffer data
-      buffer->data.resize(static_cast<size_t>(byteLength));
-      memcpy(&(buffer->data.at(0)), bin_data, static_cast<size_t>(byteLength));
+      // Read buffer data, unless the caller reads the BIN chunk in place
+      if (copy_bin) {
+        buffer->data.resize(static_cast<size_t>(byteLength));
+        memcpy(&(buffer->data.at(0)), bin_data,
+               static_cast<size_t>(byteLength));
+      }
     }
 
   } else {
@@ -4572,7 +4603,8 @@ static bool ParseDracoExtension(Primitive *primitive, Model *model,
 
 static bool ParsePrimitive(Primitive *primitive, Model *model, std::string *err,
                            const json &o,
-                           bool store_original_json_for_extras_and_extensions) {
+                           bool store_original_json_for_extras_and_extensions,
+                           bool decode_draco = true) {
   int material = -1;
   ParseIntegerProperty(&material, err, o, "material", false);
   primitive->material = material;
@@ -4634,18 +4666,20 @@ static bool ParsePrimitive(Primitive *primitive, Model *model, std::string *err,
 #ifdef TINYGLTF_ENABLE_DRACO
   auto dracoExtension =
       primitive->extensions.find("KHR_draco_mesh_compression");
-  if (dracoExtension != primitive->extensions.end()) {
+  if (decode_draco && dracoExtension != primitive->extensions.end()) {
     ParseDracoExtension(primitive, model, err, dracoExtension->second);
   }
 #else
   (void)model;
+  (void)decode_draco;
 #endif
 
   return true;
 }
 
 static bool ParseMesh(Mesh *mesh, Model *model, std::string *err, const json &o,
-                      bool store_original_json_for_extras_and_extensions) {
+                      bool store_original_json_for_extras_and_extensions,
+                      bool decode_draco = true) {
   ParseStringProperty(&mesh->name, err, o, "name", false);
 
   mesh->primitives.clear();
@@ -4657,7 +4691,8 @@ static bool ParseMesh(Mesh *mesh, Model *model, std::string *err, const json &o,
          i != primEnd; ++i) {
       Primitive primitive;
       if (ParsePrimitive(&primitive, model, err, *i,
-                         store_original_json_for_extras_and_extensions)) {
+                         store_original_json_for_extras_and_extensions,
+                         decode_draco)) {
         // Only add the primitive if the parsing succeeds.
         mesh->primitives.emplace_back(std::move(primitive));
       }
@@ -5650,7 +5685,8 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, std::string *warn,
       Buffer buffer;
       if (!ParseBuffer(&buffer, err, o,
                        store_original_json_for_extras_and_extensions_, &fs,
-                       base_dir, is_binary_, bin_data_, bin_size_)) {
+                       base_dir, is_binary_, bin_data_, bin_size_,
+                       copy_binary_chunk_)) {
         return false;
       }
 
@@ -5721,7 +5757,8 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, std::string *warn,
       }
       Mesh mesh;
       if (!ParseMesh(&mesh, model, err, o,
-                     store_original_json_for_extras_and_extensions_)) {
+                     store_original_json_for_extras_and_extensions_,
+                     decode_draco_)) {
         return false;
       }
 
@@ -5751,7 +5788,13 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, std::string *warn,
 
         auto bufferView =
             model->accessors[size_t(primitive.indices)].bufferView;
-        if (bufferView < 0 || size_t(bufferView) >= model->bufferViews.size()) {
+        // Draco compressed accessors have no bufferView until they are
+        // decoded, which is left to the caller with SetDecodeDraco(false)
+        bool dracoDeferred =
+            bufferView < 0 && !decode_draco_ &&
+            primitive.extensions.count("KHR_draco_mesh_compression");
+        if (!dracoDeferred && (bufferView < 0 || size_t(bufferView) >=
+                                                   model->bufferViews.size())) {
           if (err) {
             (*err) += "accessor[" + std::to_string(primitive.indices) +
                       "] invalid bufferView";
@@ -5759,17 +5802,21 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, std::string *warn,
           return false;
         }
 
-        model->bufferViews[size_t(bufferView)].target =
-            TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+        if (!dracoDeferred) {
+          model->bufferViews[size_t(bufferView)].target =
+              TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+        }
         // we could optionally check if acessors' bufferView type is Scalar, as
         // it should be
       }
 
       for (auto &attribute : primitive.attributes) {
-        model
-            ->bufferViews[size_t(
-                model->accessors[size_t(attribute.second)].bufferView)]
-            .target = TINYGLTF_TARGET_ARRAY_BUFFER;
+        auto bufferView =
+            model->accessors[size_t(attribute.second)].bufferView;
+        if (bufferView >= 0) {
+          model->bufferViews[size_t(bufferView)].target =
+              TINYGLTF_TARGET_ARRAY_BUFFER;
+        }
       }
 
       for (auto &target : primitive.targets) {
@@ -5942,6 +5989,11 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, std::string *warn,
           return false;
         }
         const Buffer &buffer = model->buffers[size_t(bufferView.buffer)];
+        // The BIN chunk was not copied, images are read from it in place
+        const unsigned char *buffer_data =
+            (is_binary_ && buffer.data.empty() && buffer.uri.empty())
+                ? bin_data_
+                : buffer.data.data();
 
         if (*LoadImageData == nullptr) {
           if (err) {
@@ -5951,7 +6003,7 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, std::string *warn,
         }
         bool ret = LoadImageData(
             &image, idx, err, warn, image.width, image.height,
-            &buffer.data[bufferView.byteOffset],
+            buffer_data + bufferView.byteOffset,
             static_cast<int>(bufferView.byteLength), load_image_user_data);
         if (!ret) {
           return false;
@@ -6198,7 +6250,7 @@ bool TinyGLTF::LoadASCIIFromFile(Model *model, std::string *err,
 bool TinyGLTF::LoadBinaryFromMemory(Model *model, std::string *err,
                                     std::string *warn,
                                     const unsigned char *bytes,
-                                    unsigned int size,
+                                    size_t size,
                                     const std::string &base_dir,
                                     unsigned int check_sections) {
   if (size < 20) {
@@ -6236,8 +6288,11 @@ bool TinyGLTF::LoadBinaryFromMemory(Model *model, std::string *err,
   // In case the Bin buffer is not present, the size is exactly 20 + size of
   // JSON contents,
   // so use "greater than" operator.
-  if ((20 + model_length > size) || (model_length < 1) || (length > size) ||
-      (20 + model_length > length) ||
+  // 64-bit arithmetic: `size` may be larger than 4 GB and `20 + model_length`
+  // must not wrap around.
+  const uint64_t header_and_json = 20 + uint64_t(model_length);
+  if ((header_and_json > size) || (model_length < 1) ||
+      (uint64_t(length) > size) || (header_and_json > length) ||
       (model_format != 0x4E4F534A)) {  // 0x4E4F534A = JSON format.
     if (err) {
       (*err) = "Invalid glTF binary.";
@@ -6252,8 +6307,8 @@ bool TinyGLTF::LoadBinaryFromMemory(Model *model, std::string *err,
   is_binary_ = true;
   bin_data_ = bytes + 20 + model_length +
               8;  // 4 bytes (buffer_length) + 4 bytes(buffer_format)
-  bin_size_ =
-      length - (20 + model_length);  // extract header + JSON scene data.
+  bin_size_ = size_t(uint64_t(length) -
+                     header_and_json);  // extract header + JSON scene data.
 
   bool ret = LoadFromString(model, err, warn,
                             reinterpret_cast<const char *>(&bytes[20]),
@@ -6294,8 +6349,7 @@ bool TinyGLTF::LoadBinaryFromFile(Model *model, std::string *err,
 
   std::string basedir = GetBaseDir(filename);
 
-  bool ret = LoadBinaryFromMemory(model, err, warn, &data.at(0),
-                                  static_cast<unsigned int>(data.size()),
+  bool ret = LoadBinaryFromMemory(model, err, warn, &data.at(0), data.size(),
                                   basedir, check_sections);
 
   return ret;
@@ -0,0 +1,286 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Compressed key streams of the glTF animations, sampled in batches
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include "animationtracks.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "model.h"
+#include "threadpool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ANIMATION_TRACKS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace vkglTF
+{
+
+    // Tracks sampled together, a batch never mixes vec3 and rotation tracks
+    static const uint32_t batchSize = 256;
+    // Below this many tracks handing batches to the workers costs more than it saves
+    static const uint32_t parallelTracks = 4096;
+
+    /*
+        out = a + (b - a) * u
+    */
+    static void lerp(const float *a, const float *b, const float *u, float *out, size_t count)
+    {
+        size_t i = 0;
+#if defined(ANIMATION_TRACKS_SSE2)
+        for (; i + 4 <= count; i += 4) {
+            __m128 va = _mm_loadu_ps(a + i);
+            __m128 vb = _mm_loadu_ps(b + i);
+            __m128 vu = _mm_loadu_ps(u + i);
+            _mm_storeu_ps(out + i, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), vu)));
+        }
+#endif
+        for (; i < count; i++) {
+            out[i] = a[i] + (b[i] - a[i]) * u[i];
+        }
+    }
+
+    static void normalize4(float *x, float *y, float *z, float *w, size_t count)
+    {
+        size_t i = 0;
+#if defined(ANIMATION_TRACKS_SSE2)
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4) {
+            __m128 vx = _mm_loadu_ps(x + i);
+            __m128 vy = _mm_loadu_ps(y + i);
+            __m128 vz = _mm_loadu_ps(z + i);
+            __m128 vw = _mm_loadu_ps(w + i);
+            __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+                _mm_add_ps(_mm_mul_ps(vz, vz), _mm_mul_ps(vw, vw)));
+            __m128 valid = _mm_cmpgt_ps(len2, zero);
+            __m128 inv = _mm_and_ps(valid, _mm_div_ps(one, _mm_sqrt_ps(len2)));
+            _mm_storeu_ps(x + i, _mm_mul_ps(vx, inv));
+            _mm_storeu_ps(y + i, _mm_mul_ps(vy, inv));
+            _mm_storeu_ps(z + i, _mm_mul_ps(vz, inv));
+            _mm_storeu_ps(w + i, _mm_mul_ps(vw, inv));
+        }
+#endif
+        for (; i < count; i++) {
+            float len2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i] + w[i] * w[i];
+            float inv = len2 > 0.0f ? 1.0f / std::sqrt(len2) : 0.0f;
+            x[i] *= inv;
+            y[i] *= inv;
+            z[i] *= inv;
+            w[i] *= inv;
+        }
+    }
+
+    void AnimationTracks::build(const Animation &animation, const Tolerances &tolerances)
+    {
+        tracks.clear();
+        quantized.clear();
+        raw.clear();
+        sourceKeyBytes = 0;
+
+        std::vector<Track> rotationTracks;
+        std::vector<glm::vec4> keys;
+        for (size_t c = 0; c < animation.channels.size(); c++) {
+            const AnimationChannel &channel = animation.channels[c];
+            const AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
+            const size_t keyCount = sampler.inputs.size();
+            // Morph target weights are no node transform, updateAnimation samples them
+            if (channel.path == AnimationChannel::PathType::WEIGHTS || keyCount < 2 || keyCount > sampler.outputsVec4.size()) {
+                continue;
+            }
+
+            Track track{};
+            track.channel = static_cast<uint32_t>(c);
+            track.timeline = sampler.timeline;
+            float tolerance = tolerances.translation;
+            track.components = 3;
+            if (channel.path == AnimationChannel::PathType::ROTATION) {
+                tolerance = tolerances.rotation;
+                track.components = 4;
+            } else if (channel.path == AnimationChannel::PathType::SCALE) {
+                tolerance = tolerances.scale;
+            }
+            sourceKeyBytes += keyCount * sizeof(glm::vec4);
+
+            keys.assign(sampler.outputsVec4.begin(), sampler.outputsVec4.begin() + keyCount);
+            if (track.components == 4) {
+                // q and -q are the same rotation, the linear interpolation needs the short way
+                for (size_t k = 1; k < keyCount; k++) {
+                    if (glm::dot(keys[k - 1], keys[k]) < 0.0f) {
+                        keys[k] = -keys[k];
+                    }
+                }
+            }
+
+            glm::vec4 minimum = keys[0];
+            glm::vec4 maximum = keys[0];
+            for (const glm::vec4 &key : keys) {
+                minimum = glm::min(minimum, key);
+                maximum = glm::max(maximum, key);
+            }
+            bool constant = true;
+            for (uint32_t i = 0; i < track.components; i++) {
+                constant = constant && maximum[i] - minimum[i] <= tolerance;
+            }
+
+            if (constant) {
+                track.encoding = CONSTANT;
+                track.offset = static_cast<uint32_t>(raw.size());
+                for (uint32_t i = 0; i < track.components; i++) {
+                    raw.push_back(keys[0][i]);
+                }
+            } else {
+                track.encoding = QUANTIZED;
+                track.offset = static_cast<uint32_t>(quantized.size());
+                track.minimum = minimum;
+                track.step = (maximum - minimum) / 65535.0f;
+                for (const glm::vec4 &key : keys) {
+                    for (uint32_t i = 0; i < track.components; i++) {
+                        float q = track.step[i] > 0.0f ? std::round((key[i] - minimum[i]) / track.step[i]) : 0.0f;
+                        q = std::min(std::max(q, 0.0f), 65535.0f);
+                        if (std::abs(minimum[i] + q * track.step[i] - key[i]) > tolerance) {
+                            track.encoding = RAW;
+                        }
+                        quantized.push_back(static_cast<uint16_t>(q));
+                    }
+                }
+                if (track.encoding == RAW) {
+                    quantized.resize(track.offset);
+                    track.offset = static_cast<uint32_t>(raw.size());
+                    for (const glm::vec4 &key : keys) {
+                        for (uint32_t i = 0; i < track.components; i++) {
+                            raw.push_back(key[i]);
+                        }
+                    }
+                }
+            }
+
+            if (track.components == 4) {
+                rotationTracks.push_back(track);
+            } else {
+                tracks.push_back(track);
+            }
+        }
+        rotationBegin = static_cast<uint32_t>(tracks.size());
+        tracks.insert(tracks.end(), rotationTracks.begin(), rotationTracks.end());
+    }
+
+    void AnimationTracks::sampleBatch(const Animation &animation, uint32_t begin, uint32_t end, Pose &pose) const
+    {
+        float a[4][batchSize];
+        float b[4][batchSize];
+        float u[batchSize];
+
+        const uint32_t components = tracks[begin].components;
+        for (uint32_t t = begin; t < end; t++) {
+            const Track &track = tracks[t];
+            const AnimationSampler &key = animation.samplers[track.timeline];
+            const uint32_t j = t - begin;
+            pose.active[t] = key.active ? 1 : 0;
+            size_t first = 0;
+            size_t second = 0;
+            u[j] = 0.0f;
+            if (key.active && track.encoding != CONSTANT) {
+                first = key.cursor;
+                second = key.cursor + 1;
+                u[j] = key.u;
+            }
+            if (track.encoding == QUANTIZED) {
+                const uint16_t *qa = &quantized[track.offset + first * components];
+                const uint16_t *qb = &quantized[track.offset + second * components];
+                for (uint32_t i = 0; i < components; i++) {
+                    a[i][j] = track.minimum[i] + qa[i] * track.step[i];
+                    b[i][j] = track.minimum[i] + qb[i] * track.step[i];
+                }
+            } else {
+                const float *ra = &raw[track.offset + first * components];
+                const float *rb = &raw[track.offset + second * components];
+                for (uint32_t i = 0; i < components; i++) {
+                    a[i][j] = ra[i];
+                    b[i][j] = rb[i];
+                }
+            }
+        }
+
+        const size_t count = end - begin;
+        float *columns[4] = { pose.x.data() + begin, pose.y.data() + begin, pose.z.data() + begin, pose.w.data() + begin };
+        for (uint32_t i = 0; i < components; i++) {
+            lerp(a[i], b[i], u, columns[i], count);
+        }
+        if (components == 4) {
+            normalize4(columns[0], columns[1], columns[2], columns[3], count);
+        }
+    }
+
+    void AnimationTracks::sample(const Animation &animation, Pose &pose) const
+    {
+        const uint32_t trackCount = static_cast<uint32_t>(tracks.size());
+        pose.x.resize(trackCount);
+        pose.y.resize(trackCount);
+        pose.z.resize(trackCount);
+        pose.w.resize(trackCount);
+        pose.active.resize(trackCount);
+
+        const uint32_t vec3Batches = (rotationBegin + batchSize - 1) / batchSize;
+        const uint32_t rotationBatches = (trackCount - rotationBegin + batchSize - 1) / batchSize;
+        auto batch = [&](size_t index) {
+            uint32_t begin = static_cast<uint32_t>(index) * batchSize;
+            uint32_t end = std::min(begin + batchSize, rotationBegin);
+            if (index >= vec3Batches) {
+                begin = rotationBegin + static_cast<uint32_t>(index - vec3Batches) * batchSize;
+                end = std::min(begin + batchSize, trackCount);
+            }
+            sampleBatch(animation, begin, end, pose);
+        };
+
+        const size_t batchCount = vec3Batches + rotationBatches;
+        if (trackCount >= parallelTracks) {
+            xy::ThreadPool::shared().parallelFor(batchCount, batch);
+        } else {
+            for (size_t i = 0; i < batchCount; i++) {
+                batch(i);
+            }
+        }
+    }
+
+    bool AnimationTracks::apply(const Animation &animation, const Pose &pose, TransformHierarchy &transforms) const
+    {
+        bool updated = false;
+        for (size_t t = 0; t < tracks.size(); t++) {
+            if (!pose.active[t]) {
+                continue;
+            }
+            const AnimationChannel &channel = animation.channels[tracks[t].channel];
+            const uint32_t slot = channel.node->transform;
+            switch (channel.path) {
+            case AnimationChannel::PathType::TRANSLATION:
+                transforms.setTranslation(slot, glm::vec3(pose.x[t], pose.y[t], pose.z[t]));
+                break;
+            case AnimationChannel::PathType::SCALE:
+                transforms.setScale(slot, glm::vec3(pose.x[t], pose.y[t], pose.z[t]));
+                break;
+            case AnimationChannel::PathType::ROTATION:
+                transforms.setRotation(slot, glm::quat(pose.w[t], pose.x[t], pose.y[t], pose.z[t]));
+                break;
+            case AnimationChannel::PathType::WEIGHTS:
+                continue;
+            }
+            updated = true;
+        }
+        return updated;
+    }
+
+    size_t AnimationTracks::keyBytes() const
+    {
+        return quantized.size() * sizeof(uint16_t) + raw.size() * sizeof(float);
+    }
+
+}
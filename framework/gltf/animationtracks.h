@@ -0,0 +1,101 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Compressed key streams of the glTF animations, sampled in batches
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace vkglTF
+{
+
+    struct Animation;
+    class TransformHierarchy;
+
+    /*
+        Keys of the channels of one animation, the translation and scale tracks first, the rotation tracks after
+        Every component is quantized to 16 bit inside the range of its track, a track keeps its float keys when
+        that misses the tolerance and a single key when all keys stay within the tolerance of the first one
+        Rotation keys are flipped into the hemisphere of the key before, interpolated linearly and normalized
+        The sampler outputs stay the editable source, build again after changing them
+    */
+    class AnimationTracks
+    {
+    public:
+        /*
+            Largest difference of a decoded key component to the source key
+        */
+        struct Tolerances {
+            float translation = 1e-4f;
+            float rotation = 1e-4f;
+            float scale = 1e-4f;
+        };
+
+        /*
+            Sampled values in track order, a track whose time is outside its inputs is not active
+        */
+        struct Pose {
+            std::vector<float>      x;
+            std::vector<float>      y;
+            std::vector<float>      z;
+            std::vector<float>      w;
+            std::vector<uint8_t>    active;
+        };
+
+        void build(const Animation &animation, const Tolerances &tolerances);
+        void build(const Animation &animation) { build(animation, Tolerances()); }
+
+        /*
+            Sample every track at the key intervals found by the timeline samplers of the animation
+            Batches of tracks go to the shared thread pool when there are enough of them
+        */
+        void sample(const Animation &animation, Pose &pose) const;
+
+        /*
+            Write the active tracks of a pose into the local transforms, returns true when any was written
+        */
+        bool apply(const Animation &animation, const Pose &pose, TransformHierarchy &transforms) const;
+
+        size_t size() const { return tracks.size(); }
+
+        /*
+            Size of the stored keys and of the float keys of the sampler outputs they came from
+        */
+        size_t keyBytes() const;
+        size_t sourceBytes() const { return sourceKeyBytes; }
+
+    private:
+        enum Encoding : uint8_t { CONSTANT, QUANTIZED, RAW };
+
+        struct Track {
+            uint32_t    channel;
+            // Sampler which looks up the key interval
+            uint32_t    timeline;
+            uint32_t    components;
+            Encoding    encoding;
+            // First key in the quantized or float stream
+            uint32_t    offset;
+            // Quantized component = (value - minimum) / step
+            glm::vec4   minimum;
+            glm::vec4   step;
+        };
+
+        std::vector<Track>      tracks;
+        uint32_t                rotationBegin = 0;
+        std::vector<uint16_t>   quantized;
+        std::vector<float>      raw;
+        size_t                  sourceKeyBytes = 0;
+
+        void sampleBatch(const Animation &animation, uint32_t begin, uint32_t end, Pose &pose) const;
+    };
+
+}
@@ -0,0 +1,388 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Depth pyramid for the occlusion culling of the GLTF Model
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include "gltf/depthpyramid.h"
+
+#include <algorithm>
+#include <array>
+
+#include "logger.h"
+#include "vulkan/utils.h"
+#include "vulkan/macros.h"
+
+namespace xy
+{
+
+    static uint32_t previousPowerOfTwo(uint32_t value)
+    {
+        uint32_t result = 1;
+        while (result * 2 <= value) {
+            result *= 2;
+        }
+        return result;
+    }
+
+    void DepthPyramid::init(VulkanDevice *vulkanDevice, VkPipelineCache pipelineCache)
+    {
+        this->vulkanDevice = vulkanDevice;
+        this->device = vulkanDevice->logicalDevice;
+
+        // The depth is sampled by the reduction, D16 supports that on every device
+        depthFormat = VK_FORMAT_D16_UNORM;
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(vulkanDevice->physicalDevice, VK_FORMAT_D32_SFLOAT, &formatProperties);
+        const VkFormatFeatureFlags depthFeatures = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+        if ((formatProperties.optimalTilingFeatures & depthFeatures) == depthFeatures) {
+            depthFormat = VK_FORMAT_D32_SFLOAT;
+        }
+
+        /*
+            Render pass
+        */
+        VkAttachmentDescription attachment{};
+        attachment.format = depthFormat;
+        attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+        VkAttachmentReference depthReference = { 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.pDepthStencilAttachment = &depthReference;
+
+        // The reduction of the previous frame reads the depth before it is cleared, the one of this frame after it is written
+        std::array<VkSubpassDependency, 2> dependencies{};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask = 0;
+        dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        VkRenderPassCreateInfo renderPassCI{};
+        renderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassCI.attachmentCount = 1;
+        renderPassCI.pAttachments = &attachment;
+        renderPassCI.subpassCount = 1;
+        renderPassCI.pSubpasses = &subpass;
+        renderPassCI.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassCI.pDependencies = dependencies.data();
+        VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCI, nullptr, &renderPass));
+
+        /*
+            Sampler, the reduction and the culling pass only fetch texels
+        */
+        VkSamplerCreateInfo samplerCI{};
+        samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerCI.magFilter = VK_FILTER_NEAREST;
+        samplerCI.minFilter = VK_FILTER_NEAREST;
+        samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCI.compareOp = VK_COMPARE_OP_NEVER;
+        samplerCI.minLod = 0.0f;
+        samplerCI.maxLod = VK_LOD_CLAMP_NONE;
+        samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        VK_CHECK_RESULT(vkCreateSampler(device, &samplerCI, nullptr, &sampler));
+
+        /*
+            Reduction pipeline, one set per level reads the level below and writes the level
+        */
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+            { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+            { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+        descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
+        descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+        VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(PushConstBlockReduce);
+        VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+        pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCI.setLayoutCount = 1;
+        pipelineLayoutCI.pSetLayouts = &descriptorSetLayout;
+        pipelineLayoutCI.pushConstantRangeCount = 1;
+        pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+        VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
+
+        VkComputePipelineCreateInfo computePipelineCI{};
+        computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        computePipelineCI.layout = pipelineLayout;
+        computePipelineCI.stage = loadShader(device, "depthpyramid.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+        VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, &pipeline));
+        vkDestroyShaderModule(device, computePipelineCI.stage.module, nullptr);
+    }
+
+    void DepthPyramid::resize(uint32_t width, uint32_t height)
+    {
+        destroyTargets();
+        this->width = std::max(width, 1u);
+        this->height = std::max(height, 1u);
+
+        /*
+            Depth target
+        */
+        VkImageCreateInfo imageCI{};
+        imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCI.imageType = VK_IMAGE_TYPE_2D;
+        imageCI.format = depthFormat;
+        imageCI.extent = { this->width, this->height, 1 };
+        imageCI.mipLevels = 1;
+        imageCI.arrayLayers = 1;
+        imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &depthImage));
+        VK_CHECK_RESULT(vulkanDevice->allocator.allocateImage(depthImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            MemoryUsage::ATTACHMENT, depthMemory));
+
+        VkImageViewCreateInfo imageViewCI{};
+        imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        imageViewCI.image = depthImage;
+        imageViewCI.format = depthFormat;
+        imageViewCI.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+        VK_CHECK_RESULT(vkCreateImageView(device, &imageViewCI, nullptr, &depthView));
+
+        VkFramebufferCreateInfo framebufferCI{};
+        framebufferCI.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferCI.renderPass = renderPass;
+        framebufferCI.attachmentCount = 1;
+        framebufferCI.pAttachments = &depthView;
+        framebufferCI.width = this->width;
+        framebufferCI.height = this->height;
+        framebufferCI.layers = 1;
+        VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferCI, nullptr, &framebuffer));
+
+        /*
+            Pyramid
+        */
+        const uint32_t pyramidWidth = previousPowerOfTwo(this->width);
+        const uint32_t pyramidHeight = previousPowerOfTwo(this->height);
+        levelCount = 1;
+        while ((std::max(pyramidWidth, pyramidHeight) >> levelCount) > 0) {
+            levelCount++;
+        }
+
+        imageCI.format = VK_FORMAT_R32_SFLOAT;
+        imageCI.extent = { pyramidWidth, pyramidHeight, 1 };
+        imageCI.mipLevels = levelCount;
+        imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &pyramidImage));
+        VK_CHECK_RESULT(vulkanDevice->allocator.allocateImage(pyramidImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            MemoryUsage::ATTACHMENT, pyramidMemory));
+
+        imageViewCI.image = pyramidImage;
+        imageViewCI.format = VK_FORMAT_R32_SFLOAT;
+        imageViewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+        VK_CHECK_RESULT(vkCreateImageView(device, &imageViewCI, nullptr, &pyramidView));
+
+        descriptor.sampler = sampler;
+        descriptor.imageView = pyramidView;
+        descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        /*
+            Descriptor sets of the reduction
+        */
+        std::vector<VkDescriptorPoolSize> poolSizes = {
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelCount },
+            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelCount }
+        };
+        VkDescriptorPoolCreateInfo descriptorPoolCI{};
+        descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        descriptorPoolCI.pPoolSizes = poolSizes.data();
+        descriptorPoolCI.maxSets = levelCount;
+        VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &descriptorPool));
+
+        levels.resize(levelCount);
+        for (uint32_t i = 0; i < levelCount; i++) {
+            Level &level = levels[i];
+            level.width = std::max(pyramidWidth >> i, 1u);
+            level.height = std::max(pyramidHeight >> i, 1u);
+
+            imageViewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+            VK_CHECK_RESULT(vkCreateImageView(device, &imageViewCI, nullptr, &level.view));
+
+            VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+            descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            descriptorSetAllocInfo.descriptorPool = descriptorPool;
+            descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
+            descriptorSetAllocInfo.descriptorSetCount = 1;
+            VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &level.descriptorSet));
+
+            // Level 0 reduces the depth target, every other level the one below it
+            const VkDescriptorImageInfo source = i == 0 ?
+                VkDescriptorImageInfo{ sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL } :
+                VkDescriptorImageInfo{ sampler, levels[i - 1].view, VK_IMAGE_LAYOUT_GENERAL };
+            const VkDescriptorImageInfo destination = { VK_NULL_HANDLE, level.view, VK_IMAGE_LAYOUT_GENERAL };
+
+            std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+            writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writeDescriptorSets[0].descriptorCount = 1;
+            writeDescriptorSets[0].dstSet = level.descriptorSet;
+            writeDescriptorSets[0].dstBinding = 0;
+            writeDescriptorSets[0].pImageInfo = &source;
+
+            writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writeDescriptorSets[1].descriptorCount = 1;
+            writeDescriptorSets[1].dstSet = level.descriptorSet;
+            writeDescriptorSets[1].dstBinding = 1;
+            writeDescriptorSets[1].pImageInfo = &destination;
+
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+        }
+        LOGI("Depth pyramid: {}x{} depth, {}x{} in {} levels", this->width, this->height, pyramidWidth, pyramidHeight, levelCount);
+    }
+
+    void DepthPyramid::destroyTargets()
+    {
+        if (!device) {
+            return;
+        }
+        for (Level &level : levels) {
+            vkDestroyImageView(device, level.view, nullptr);
+        }
+        levels.clear();
+        if (descriptorPool) {
+            vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+            descriptorPool = VK_NULL_HANDLE;
+        }
+        if (framebuffer) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+            framebuffer = VK_NULL_HANDLE;
+        }
+        if (depthImage) {
+            vkDestroyImageView(device, depthView, nullptr);
+            vkDestroyImage(device, depthImage, nullptr);
+            vulkanDevice->allocator.free(depthMemory);
+            depthView = VK_NULL_HANDLE;
+            depthImage = VK_NULL_HANDLE;
+        }
+        if (pyramidImage) {
+            vkDestroyImageView(device, pyramidView, nullptr);
+            vkDestroyImage(device, pyramidImage, nullptr);
+            vulkanDevice->allocator.free(pyramidMemory);
+            pyramidView = VK_NULL_HANDLE;
+            pyramidImage = VK_NULL_HANDLE;
+        }
+        descriptor = {};
+        levelCount = 0;
+    }
+
+    void DepthPyramid::destroy()
+    {
+        if (!device) {
+            return;
+        }
+        destroyTargets();
+        vkDestroyPipeline(device, pipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+        vkDestroySampler(device, sampler, nullptr);
+        vkDestroyRenderPass(device, renderPass, nullptr);
+        pipeline = VK_NULL_HANDLE;
+        pipelineLayout = VK_NULL_HANDLE;
+        descriptorSetLayout = VK_NULL_HANDLE;
+        sampler = VK_NULL_HANDLE;
+        renderPass = VK_NULL_HANDLE;
+        device = VK_NULL_HANDLE;
+    }
+
+    void DepthPyramid::beginDepthPass(VkCommandBuffer commandBuffer)
+    {
+        VkClearValue clearValue{};
+        clearValue.depthStencil = { 1.0f, 0 };
+
+        VkRenderPassBeginInfo renderPassBeginInfo{};
+        renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassBeginInfo.renderPass = renderPass;
+        renderPassBeginInfo.framebuffer = framebuffer;
+        renderPassBeginInfo.renderArea.extent = { width, height };
+        renderPassBeginInfo.clearValueCount = 1;
+        renderPassBeginInfo.pClearValues = &clearValue;
+        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport viewport{};
+        viewport.width = static_cast<float>(width);
+        viewport.height = static_cast<float>(height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.extent = { width, height };
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    }
+
+    void DepthPyramid::build(VkCommandBuffer commandBuffer)
+    {
+        // Every level is written again, the previous content is discarded once the culling of the previous frame read it
+        VkImageMemoryBarrier imageBarrier{};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.srcAccessMask = 0;
+        imageBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = pyramidImage;
+        imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        uint32_t sourceWidth = width;
+        uint32_t sourceHeight = height;
+        for (uint32_t i = 0; i < levelCount; i++) {
+            const Level &level = levels[i];
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &level.descriptorSet, 0, nullptr);
+            const PushConstBlockReduce pushConstBlock = {
+                static_cast<int32_t>(sourceWidth), static_cast<int32_t>(sourceHeight),
+                static_cast<int32_t>(level.width), static_cast<int32_t>(level.height)
+            };
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstBlock), &pushConstBlock);
+            vkCmdDispatch(commandBuffer, (level.width + 7) / 8, (level.height + 7) / 8, 1);
+
+            // The next level, or the culling pass after the last one, reads this level
+            imageBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            imageBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+            imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+            sourceWidth = level.width;
+            sourceHeight = level.height;
+        }
+    }
+
+}
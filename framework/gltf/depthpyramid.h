@@ -0,0 +1,101 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Depth pyramid for the occlusion culling of the GLTF Model
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vulkan/allocator.h"
+#include "vulkan/device.h"
+
+namespace xy
+{
+
+    /*
+        Depth of the occluders drawn in front of the main render pass and its hierarchical-Z pyramid
+        Level 0 of the pyramid has the power of two size below the depth target, every texel of a level holds
+        the farthest depth of the texels it covers in the level below, a box whose nearest depth is behind the
+        pyramid texels covering its screen rectangle is hidden by the occluders
+        The depth target and the pyramid are shared by all frames, the frames are submitted to one queue
+    */
+    class DepthPyramid
+    {
+    public:
+        VkRenderPass    renderPass{VK_NULL_HANDLE};
+        VkFramebuffer   framebuffer{VK_NULL_HANDLE};
+        uint32_t        width = 0;
+        uint32_t        height = 0;
+        uint32_t        levelCount = 0;
+        // All levels of the pyramid in the general layout with a nearest sampler
+        VkDescriptorImageInfo descriptor{};
+
+        /*
+            Create the render pass and the reduction pipeline, they do not depend on the size
+        */
+        void init(VulkanDevice *vulkanDevice, VkPipelineCache pipelineCache);
+
+        /*
+            Create the depth target and the pyramid for a view of width x height, the device must be idle
+        */
+        void resize(uint32_t width, uint32_t height);
+
+        void destroy();
+
+        bool valid() const { return framebuffer != VK_NULL_HANDLE; }
+
+        /*
+            Begin the depth only render pass with the viewport and scissor set to the depth target
+        */
+        void beginDepthPass(VkCommandBuffer commandBuffer);
+
+        /*
+            Reduce the depth of the finished depth pass into the pyramid, it is ready for compute shader reads after
+        */
+        void build(VkCommandBuffer commandBuffer);
+
+    private:
+        struct Level {
+            VkImageView view{VK_NULL_HANDLE};
+            VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+            uint32_t width;
+            uint32_t height;
+        };
+
+        struct PushConstBlockReduce {
+            int32_t sourceWidth;
+            int32_t sourceHeight;
+            int32_t width;
+            int32_t height;
+        };
+
+        VulkanDevice   *vulkanDevice = nullptr;
+        VkDevice        device = VK_NULL_HANDLE;
+        VkFormat        depthFormat = VK_FORMAT_UNDEFINED;
+
+        VkImage         depthImage{VK_NULL_HANDLE};
+        Allocation      depthMemory;
+        VkImageView     depthView{VK_NULL_HANDLE};
+        VkImage         pyramidImage{VK_NULL_HANDLE};
+        Allocation      pyramidMemory;
+        VkImageView     pyramidView{VK_NULL_HANDLE};
+        VkSampler       sampler{VK_NULL_HANDLE};
+        std::vector<Level> levels;
+
+        VkDescriptorSetLayout   descriptorSetLayout{VK_NULL_HANDLE};
+        VkDescriptorPool        descriptorPool{VK_NULL_HANDLE};
+        VkPipelineLayout        pipelineLayout{VK_NULL_HANDLE};
+        VkPipeline              pipeline{VK_NULL_HANDLE};
+
+        void destroyTargets();
+    };
+
+}
@@ -10,8 +10,26 @@
 
 #include "model.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
 #include "vulkan/macros.h"
 #include "logger.h"
+#include "mappedfile.h"
+#include "modelcache.h"
+#include "threadpool.h"
+#include "vertexstreams.h"
+
+// stb_image is implemented along with tinygltf, only the declarations are needed here
+#undef STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#if defined(TINYGLTF_ENABLE_DRACO)
+#include "draco/compression/decode.h"
+#include "draco/core/decoder_buffer.h"
+#endif
 
 namespace vkglTF
 {
@@ -49,6 +67,46 @@ namespace vkglTF
         return BoundingBox(min, max);
     }
 
+    /*
+        View frustum
+    */
+    Frustum::Frustum(const glm::mat4 &clip)
+    {
+        const glm::vec4 row0(clip[0][0], clip[1][0], clip[2][0], clip[3][0]);
+        const glm::vec4 row1(clip[0][1], clip[1][1], clip[2][1], clip[3][1]);
+        const glm::vec4 row2(clip[0][2], clip[1][2], clip[2][2], clip[3][2]);
+        const glm::vec4 row3(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+        for (glm::vec4 &plane : planes) {
+            const float length = glm::length(glm::vec3(plane));
+            if (length > 0.0f) {
+                plane /= length;
+            }
+        }
+    }
+
+    Frustum::Result Frustum::test(const BoundingBox &box) const
+    {
+        Result result = INSIDE;
+        for (const glm::vec4 &plane : planes) {
+            // Corners of the box furthest along and furthest against the plane normal
+            const glm::vec3 positive = glm::mix(box.min, box.max, glm::greaterThan(glm::vec3(plane), glm::vec3(0.0f)));
+            const glm::vec3 negative = glm::mix(box.max, box.min, glm::greaterThan(glm::vec3(plane), glm::vec3(0.0f)));
+            if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) {
+                return OUTSIDE;
+            }
+            if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f) {
+                result = INTERSECTS;
+            }
+        }
+        return result;
+    }
+
     /*
         glTF texture loading class
     */
@@ -61,76 +119,62 @@ namespace vkglTF
 
     void Texture::destroy()
     {
+        // Streamed textures which were never loaded
+        if (!device) {
+            return;
+        }
         vkDestroyImageView(device->logicalDevice, view, nullptr);
         vkDestroyImage(device->logicalDevice, image, nullptr);
-        vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+        device->allocator.free(deviceMemory);
         vkDestroySampler(device->logicalDevice, sampler, nullptr);
     }
 
     void Texture::fromglTfImage(tinygltf::Image &gltfimage, TextureSampler textureSampler, xy::VulkanDevice *device, VkQueue copyQueue)
     {
-        this->device = device;
+        createImage(gltfimage.width, gltfimage.height, device);
 
-        unsigned char* buffer = nullptr;
-        VkDeviceSize bufferSize = 0;
-        bool deleteBuffer = false;
+        // Most devices don't support RGB only on Vulkan, RGB images are expanded while staging
+        // TODO: Check actual format support and transform only if required
+        const size_t pixelCount = static_cast<size_t>(gltfimage.width) * gltfimage.height;
+        xy::StagingRing::Batch batch(device, copyQueue);
+        xy::StagingRing::Region staging = batch.allocate(pixelCount * 4);
         if (gltfimage.component == 3) {
-            // Most devices don't support RGB only on Vulkan so convert if necessary
-            // TODO: Check actual format support and transform only if required
-            bufferSize = gltfimage.width * gltfimage.height * 4;
-            buffer = new unsigned char[bufferSize];
-            unsigned char* rgba = buffer;
-            unsigned char* rgb = &gltfimage.image[0];
-            for (int32_t i = 0; i< gltfimage.width * gltfimage.height; ++i) {
+            unsigned char* rgba = staging.data;
+            const unsigned char* rgb = &gltfimage.image[0];
+            for (size_t i = 0; i < pixelCount; ++i) {
                 for (int32_t j = 0; j < 3; ++j) {
                     rgba[j] = rgb[j];
                 }
+                rgba[3] = 255;
                 rgba += 4;
                 rgb += 3;
             }
-            deleteBuffer = true;
         }
         else {
-            buffer = &gltfimage.image[0];
-            bufferSize = gltfimage.image.size();
+            memcpy(staging.data, &gltfimage.image[0], pixelCount * 4);
         }
 
-        VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+        recordUpload(batch.commandBuffer(), batch.graphicsCommandBuffer(), staging.buffer, staging.offset);
+        batch.flush();
 
-        VkFormatProperties formatProperties;
+        createSamplerAndView(textureSampler);
+    }
 
-        width = gltfimage.width;
-        height = gltfimage.height;
+    void Texture::createImage(uint32_t width, uint32_t height, xy::VulkanDevice *device)
+    {
+        this->device = device;
+        this->width = width;
+        this->height = height;
         mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
+        layerCount = 1;
+
+        VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
 
+        VkFormatProperties formatProperties;
         vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
         assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
         assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
 
-        VkMemoryAllocateInfo memAllocInfo{};
-        memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        VkMemoryRequirements memReqs{};
-
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingMemory;
-
-        VkBufferCreateInfo bufferCreateInfo{};
-        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferCreateInfo.size = bufferSize;
-        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-        vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-        memAllocInfo.allocationSize = memReqs.size;
-        memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-        VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-        uint8_t *data;
-        VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-        memcpy(data, buffer, bufferSize);
-        vkUnmapMemory(device->logicalDevice, stagingMemory);
-
         VkImageCreateInfo imageCreateInfo{};
         imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -139,20 +183,17 @@ namespace vkglTF
         imageCreateInfo.arrayLayers = 1;
         imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
         imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         imageCreateInfo.extent = { width, height, 1 };
         imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
         VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-        vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-        memAllocInfo.allocationSize = memReqs.size;
-        memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-        VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
-        VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        VK_CHECK_RESULT(device->allocator.allocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, xy::MemoryUsage::TEXTURE, deviceMemory));
+    }
 
+    void Texture::recordUpload(VkCommandBuffer copyCmd, VkCommandBuffer mipCmd, VkBuffer stagingBuffer, VkDeviceSize stagingOffset)
+    {
         VkImageSubresourceRange subresourceRange = {};
         subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         subresourceRange.levelCount = 1;
@@ -171,6 +212,7 @@ namespace vkglTF
         }
 
         VkBufferImageCopy bufferCopyRegion = {};
+        bufferCopyRegion.bufferOffset = stagingOffset;
         bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         bufferCopyRegion.imageSubresource.mipLevel = 0;
         bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
@@ -181,40 +223,26 @@ namespace vkglTF
 
         vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
 
-        {
-            VkImageMemoryBarrier imageMemoryBarrier{};
-            imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            imageMemoryBarrier.image = image;
-            imageMemoryBarrier.subresourceRange = subresourceRange;
-            vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-        }
-
-        device->flushCommandBuffer(copyCmd, copyQueue, true);
-
-        vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-        vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+        // Blits need a graphics queue, the base level moves over to the graphics family for the mip chain
+        device->transferImageOwnership(copyCmd, mipCmd, image, subresourceRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
 
         // Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
-        VkCommandBuffer blitCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
         for (uint32_t i = 1; i < mipLevels; i++) {
             VkImageBlit imageBlit{};
 
             imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
             imageBlit.srcSubresource.layerCount = 1;
             imageBlit.srcSubresource.mipLevel = i - 1;
-            imageBlit.srcOffsets[1].x = int32_t(width >> (i - 1));
-            imageBlit.srcOffsets[1].y = int32_t(height >> (i - 1));
+            imageBlit.srcOffsets[1].x = std::max(int32_t(width >> (i - 1)), 1);
+            imageBlit.srcOffsets[1].y = std::max(int32_t(height >> (i - 1)), 1);
             imageBlit.srcOffsets[1].z = 1;
 
             imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
             imageBlit.dstSubresource.layerCount = 1;
             imageBlit.dstSubresource.mipLevel = i;
-            imageBlit.dstOffsets[1].x = int32_t(width >> i);
-            imageBlit.dstOffsets[1].y = int32_t(height >> i);
+            imageBlit.dstOffsets[1].x = std::max(int32_t(width >> i), 1);
+            imageBlit.dstOffsets[1].y = std::max(int32_t(height >> i), 1);
             imageBlit.dstOffsets[1].z = 1;
 
             VkImageSubresourceRange mipSubRange = {};
@@ -232,10 +260,10 @@ namespace vkglTF
                 imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
                 imageMemoryBarrier.image = image;
                 imageMemoryBarrier.subresourceRange = mipSubRange;
-                vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+                vkCmdPipelineBarrier(mipCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
             }
 
-            vkCmdBlitImage(blitCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+            vkCmdBlitImage(mipCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
 
             {
                 VkImageMemoryBarrier imageMemoryBarrier{};
@@ -246,7 +274,7 @@ namespace vkglTF
                 imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
                 imageMemoryBarrier.image = image;
                 imageMemoryBarrier.subresourceRange = mipSubRange;
-                vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+                vkCmdPipelineBarrier(mipCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
             }
         }
 
@@ -259,13 +287,100 @@ namespace vkglTF
             imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
             imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
             imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
             imageMemoryBarrier.image = image;
             imageMemoryBarrier.subresourceRange = subresourceRange;
-            vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+            vkCmdPipelineBarrier(mipCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
         }
+    }
+
+    VkDeviceSize Texture::mipChainSize() const
+    {
+        VkDeviceSize size = 0;
+        for (uint32_t i = 0; i < mipLevels; i++) {
+            size += static_cast<VkDeviceSize>(std::max(width >> i, 1u)) * std::max(height >> i, 1u) * 4;
+        }
+        return size;
+    }
+
+    /*
+        Copy regions of a tightly packed mip chain
+    */
+    static std::vector<VkBufferImageCopy> mipChainRegions(const Texture &texture, VkDeviceSize offset)
+    {
+        std::vector<VkBufferImageCopy> regions(texture.mipLevels);
+        for (uint32_t i = 0; i < texture.mipLevels; i++) {
+            VkBufferImageCopy &region = regions[i];
+            region = {};
+            region.bufferOffset = offset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = i;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent.width = std::max(texture.width >> i, 1u);
+            region.imageExtent.height = std::max(texture.height >> i, 1u);
+            region.imageExtent.depth = 1;
+            offset += static_cast<VkDeviceSize>(region.imageExtent.width) * region.imageExtent.height * 4;
+        }
+        return regions;
+    }
+
+    void Texture::recordUploadMipChain(VkCommandBuffer copyCmd, VkCommandBuffer acquireCmd, VkBuffer stagingBuffer, VkDeviceSize stagingOffset)
+    {
+        VkImageSubresourceRange subresourceRange = {};
+        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresourceRange.levelCount = mipLevels;
+        subresourceRange.layerCount = 1;
+
+        VkImageMemoryBarrier imageMemoryBarrier{};
+        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageMemoryBarrier.srcAccessMask = 0;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageMemoryBarrier.image = image;
+        imageMemoryBarrier.subresourceRange = subresourceRange;
+        vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+        std::vector<VkBufferImageCopy> regions = mipChainRegions(*this, stagingOffset);
+        vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(regions.size()), regions.data());
 
-        device->flushCommandBuffer(blitCmd, copyQueue, true);
+        imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        device->transferImageOwnership(copyCmd, acquireCmd, image, subresourceRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    }
+
+    void Texture::recordReadback(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset) const
+    {
+        VkImageSubresourceRange subresourceRange = {};
+        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresourceRange.levelCount = mipLevels;
+        subresourceRange.layerCount = 1;
+
+        VkImageMemoryBarrier imageMemoryBarrier{};
+        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageMemoryBarrier.oldLayout = imageLayout;
+        imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        imageMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        imageMemoryBarrier.image = image;
+        imageMemoryBarrier.subresourceRange = subresourceRange;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+        std::vector<VkBufferImageCopy> regions = mipChainRegions(*this, offset);
+        vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer,
+            static_cast<uint32_t>(regions.size()), regions.data());
+
+        imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        imageMemoryBarrier.newLayout = imageLayout;
+        imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+    }
+
+    void Texture::createSamplerAndView(TextureSampler textureSampler)
+    {
+        this->textureSampler = textureSampler;
 
         VkSamplerCreateInfo samplerInfo{};
         samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -288,7 +403,7 @@ namespace vkglTF
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         viewInfo.image = image;
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewInfo.format = format;
+        viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
         viewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
         viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         viewInfo.subresourceRange.layerCount = 1;
@@ -298,10 +413,121 @@ namespace vkglTF
         descriptor.sampler = sampler;
         descriptor.imageView = view;
         descriptor.imageLayout = imageLayout;
+    }
+
+    /*
+        Vertex layout
+    */
+    const uint32_t VertexLayout::componentCounts[ATTRIBUTE_COUNT] = { 3, 3, 2, 2, 4, 4 };
 
-        if (deleteBuffer)
-            delete[] buffer;
+    void VertexLayout::finalize(bool separateSkinStream)
+    {
+        for (uint32_t b = 0; b < BINDING_COUNT; b++) {
+            strides[b] = 0;
+        }
+        for (uint32_t a = 0; a < ATTRIBUTE_COUNT; a++) {
+            AttributeFormat &format = attributes[a];
+            if (!format.present) {
+                // Constant default, zero for everything except the first joint weight
+                format.encoding = streams::Encoding::FLOAT32;
+                format.binding = BINDING_DEFAULTS;
+                format.offset = a == WEIGHT0 ? defaultWeightOffset : defaultsOffset;
+                continue;
+            }
+            const bool skinAttribute = (a == JOINT0 || a == WEIGHT0);
+            format.binding = (skinAttribute && separateSkinStream) ? BINDING_SKIN : BINDING_MAIN;
+            format.offset = strides[format.binding];
+            strides[format.binding] += attributeSize(static_cast<Attribute>(a));
+        }
+    }
 
+    uint32_t VertexLayout::attributeSize(Attribute attribute) const
+    {
+        const AttributeFormat &format = attributes[attribute];
+        uint32_t components = componentCounts[attribute];
+        if (format.encoding == streams::Encoding::OCTAHEDRAL16) {
+            return 4;
+        }
+        // 8 and 16 bit vec3 use the four component formats, the padding component is zero
+        if (components == 3 && streams::componentSize(format.encoding) < 4) {
+            components = 4;
+        }
+        uint32_t size = components * streams::componentSize(format.encoding);
+        return (size + 3) & ~3u;
+    }
+
+    VkFormat VertexLayout::format(Attribute attribute) const
+    {
+        using streams::Encoding;
+        const uint32_t components = componentCounts[attribute];
+        const bool pair = components == 2;
+        switch (attributes[attribute].encoding) {
+        case Encoding::FLOAT16:
+            return pair ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT;
+        case Encoding::SNORM8:
+            return pair ? VK_FORMAT_R8G8_SNORM : VK_FORMAT_R8G8B8A8_SNORM;
+        case Encoding::UNORM8:
+            return pair ? VK_FORMAT_R8G8_UNORM : VK_FORMAT_R8G8B8A8_UNORM;
+        case Encoding::SNORM16:
+            return pair ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R16G16B16A16_SNORM;
+        case Encoding::UNORM16:
+            return pair ? VK_FORMAT_R16G16_UNORM : VK_FORMAT_R16G16B16A16_UNORM;
+        case Encoding::SSCALED8:
+            return pair ? VK_FORMAT_R8G8_SSCALED : VK_FORMAT_R8G8B8A8_SSCALED;
+        case Encoding::USCALED8:
+            return pair ? VK_FORMAT_R8G8_USCALED : VK_FORMAT_R8G8B8A8_USCALED;
+        case Encoding::SSCALED16:
+            return pair ? VK_FORMAT_R16G16_SSCALED : VK_FORMAT_R16G16B16A16_SSCALED;
+        case Encoding::USCALED16:
+            return pair ? VK_FORMAT_R16G16_USCALED : VK_FORMAT_R16G16B16A16_USCALED;
+        case Encoding::OCTAHEDRAL16:
+            return VK_FORMAT_R16G16_SNORM;
+        default:
+            switch (components) {
+            case 2:
+                return VK_FORMAT_R32G32_SFLOAT;
+            case 3:
+                return VK_FORMAT_R32G32B32_SFLOAT;
+            default:
+                return VK_FORMAT_R32G32B32A32_SFLOAT;
+            }
+        }
+    }
+
+    bool VertexLayout::sameFormat(const VertexLayout &other) const
+    {
+        for (uint32_t a = 0; a < ATTRIBUTE_COUNT; a++) {
+            if (attributes[a].present != other.attributes[a].present ||
+                attributes[a].encoding != other.attributes[a].encoding ||
+                attributes[a].binding != other.attributes[a].binding) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<VkVertexInputBindingDescription> VertexLayout::inputBindings() const
+    {
+        bool used[BINDING_COUNT] = {};
+        for (uint32_t a = 0; a < ATTRIBUTE_COUNT; a++) {
+            used[attributes[a].binding] = true;
+        }
+        std::vector<VkVertexInputBindingDescription> inputBindings;
+        for (uint32_t b = 0; b < BINDING_COUNT; b++) {
+            if (used[b]) {
+                inputBindings.push_back({ b, strides[b], VK_VERTEX_INPUT_RATE_VERTEX });
+            }
+        }
+        return inputBindings;
+    }
+
+    std::vector<VkVertexInputAttributeDescription> VertexLayout::inputAttributes() const
+    {
+        std::vector<VkVertexInputAttributeDescription> inputAttributes;
+        for (uint32_t a = 0; a < ATTRIBUTE_COUNT; a++) {
+            inputAttributes.push_back({ a, attributes[a].binding, format(static_cast<Attribute>(a)), attributes[a].offset });
+        }
+        return inputAttributes;
     }
 
     /*
@@ -323,23 +549,11 @@ namespace vkglTF
     /*
         glTF mesh
     */
-    Mesh::Mesh(xy::VulkanDevice *device, glm::mat4 matrix) {
-        this->device = device;
+    Mesh::Mesh(glm::mat4 matrix) {
         this->uniformBlock.matrix = matrix;
-        VK_CHECK_RESULT(device->createBuffer(
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            sizeof(uniformBlock),
-            &uniformBuffer.buffer,
-            &uniformBuffer.memory,
-            &uniformBlock));
-        VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, uniformBuffer.memory, 0, sizeof(uniformBlock), 0, &uniformBuffer.mapped));
-        uniformBuffer.descriptor = { uniformBuffer.buffer, 0, sizeof(uniformBlock) };
     };
 
     Mesh::~Mesh() {
-        vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
-        vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
         for (Primitive* p : primitives)
             delete p;
     }
@@ -351,74 +565,358 @@ namespace vkglTF
     }
 
 
+
+    Node::~Node()
+    {
+        if (mesh) {
+            delete mesh;
+        }
+        for (auto& child : children) {
+            delete child;
+        }
+    }
+
     /*
-        glTF node
+        Image loader callback for tinygltf, only stores the encoded bytes
+        loadTextures decodes them to 8 bit RGBA, 16 bit images keep the most significant byte of each channel
     */
-    glm::mat4 Node::localMatrix()
+    static bool deferImageDecode(tinygltf::Image *image, const int imageIndex, std::string *error,
+        std::string *warning, int reqWidth, int reqHeight, const unsigned char *bytes, int size, void *userData)
     {
-        return glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
+        (void)imageIndex;
+        (void)error;
+        (void)warning;
+        (void)reqWidth;
+        (void)reqHeight;
+        (void)userData;
+        image->image.assign(bytes, bytes + size);
+        image->as_is = true;
+        return true;
     }
 
-    glm::mat4 Node::getMatrix()
+    /*
+        Strided view of one vertex attribute in the glTF buffers
+    */
+    struct AttributeSource {
+        const uint8_t *data = nullptr;
+        size_t byteStride = 0;
+        int componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+        bool normalized = false;
+    };
+
+    static const char *attributeNames[VertexLayout::ATTRIBUTE_COUNT] = {
+        "POSITION", "NORMAL", "TEXCOORD_0", "TEXCOORD_1", "JOINTS_0", "WEIGHTS_0"
+    };
+
+    /*
+        Set the first weight of vertices without any weight to 1.0 in the quantized domain
+    */
+    static void fixQuantizedWeights(uint8_t *dst, size_t stride, streams::Encoding encoding, size_t count)
     {
-        glm::mat4 m = localMatrix();
-        vkglTF::Node *p = parent;
-        while (p) {
-            m = p->localMatrix() * m;
-            p = p->parent;
+        static const uint8_t zeros[8] = {};
+        const size_t size = 4 * streams::componentSize(encoding);
+        const uint16_t one = size == 4 ? 0xFF : 0xFFFF;
+        for (size_t i = 0; i < count; i++) {
+            uint8_t *weight = dst + i * stride;
+            if (memcmp(weight, zeros, size) == 0) {
+                if (size == 4) {
+                    weight[0] = static_cast<uint8_t>(one);
+                } else {
+                    memcpy(weight, &one, sizeof(one));
+                }
+            }
         }
-        return m;
     }
 
-    void Node::update()
+    /*
+        Convert the attributes of a primitive into the vertex streams of its layout, block by block
+        Attributes whose encoding matches the accessor are copied as they are, all others are gathered
+        into float columns, their normals and weights fixed up and encoded into the layout format
+        Each finished block is streamed into the (write combined) staging memory
+    */
+    static void convertVertices(const AttributeSource (&sources)[VertexLayout::ATTRIBUTE_COUNT], const VertexLayout &layout,
+        size_t count, uint8_t *mainDst, uint8_t *skinDst)
     {
-        if (mesh) {
-            glm::mat4 m = getMatrix();
-            if (skin) {
-                mesh->uniformBlock.matrix = m;
-                // Update join matrices
-                glm::mat4 inverseTransform = glm::inverse(m);
-                size_t numJoints = std::min((uint32_t)skin->joints.size(), MAX_NUM_JOINTS);
-                for (size_t i = 0; i < numJoints; i++) {
-                    vkglTF::Node *jointNode = skin->joints[i];
-                    glm::mat4 jointMat = jointNode->getMatrix() * skin->inverseBindMatrices[i];
-                    jointMat = inverseTransform * jointMat;
-                    mesh->uniformBlock.jointMatrix[i] = jointMat;
+        float columnData[4][streams::BlockSize];
+        float *columns[4] = { columnData[0], columnData[1], columnData[2], columnData[3] };
+        alignas(16) uint8_t mainBlock[streams::BlockSize * sizeof(Model::Vertex)];
+        alignas(16) uint8_t skinBlock[streams::BlockSize * 2 * sizeof(glm::vec4)];
+        uint8_t *blocks[VertexLayout::BINDING_DEFAULTS] = { mainBlock, skinBlock };
+        uint8_t *dst[VertexLayout::BINDING_DEFAULTS] = { mainDst, skinDst };
+        assert(layout.strides[VertexLayout::BINDING_MAIN] <= sizeof(Model::Vertex));
+        assert(layout.strides[VertexLayout::BINDING_SKIN] <= 2 * sizeof(glm::vec4));
+
+        for (size_t first = 0; first < count; first += streams::BlockSize) {
+            const size_t blockCount = std::min(streams::BlockSize, count - first);
+            for (uint32_t b = 0; b < VertexLayout::BINDING_DEFAULTS; b++) {
+                memset(blocks[b], 0, blockCount * layout.strides[b]);
+            }
+            for (uint32_t a = 0; a < VertexLayout::ATTRIBUTE_COUNT; a++) {
+                const VertexLayout::AttributeFormat &format = layout.attributes[a];
+                if (!format.present) {
+                    continue;
+                }
+                const AttributeSource &source = sources[a];
+                const uint32_t components = VertexLayout::componentCounts[a];
+                const uint32_t stride = layout.strides[format.binding];
+                const uint8_t *src = source.data ? source.data + first * source.byteStride : nullptr;
+                uint8_t *out = blocks[format.binding] + format.offset;
+
+                // Float normals and weights still need their fix ups
+                const bool fixUp = format.encoding == streams::Encoding::FLOAT32 &&
+                    (a == VertexLayout::NORMAL || a == VertexLayout::WEIGHT0);
+                if (src && !fixUp && format.encoding == streams::encodingOf(source.componentType, source.normalized)) {
+                    streams::copyElements(src, source.byteStride, out, stride,
+                        components * tinygltf::GetComponentSizeInBytes(source.componentType), blockCount);
+                    if (a == VertexLayout::WEIGHT0) {
+                        fixQuantizedWeights(out, stride, format.encoding, blockCount);
+                    }
+                    continue;
+                }
+                if (!src || !streams::gather(src, source.byteStride, source.componentType, source.normalized,
+                        components, blockCount, columns)) {
+                    for (uint32_t c = 0; c < components; c++) {
+                        streams::fill(0.0f, blockCount, columns[c]);
+                    }
+                }
+                if (a == VertexLayout::NORMAL) {
+                    streams::normalize3(columns[0], columns[1], columns[2], blockCount);
+                }
+                if (a == VertexLayout::WEIGHT0) {
+                    // Fix for all zero weights
+                    streams::fixWeights(columns[0], columns[1], columns[2], columns[3], blockCount);
+                }
+                streams::encode(columns, components, blockCount, out, stride, format.encoding);
+            }
+            for (uint32_t b = 0; b < VertexLayout::BINDING_DEFAULTS; b++) {
+                if (layout.strides[b] > 0) {
+                    streams::streamCopy(dst[b] + first * layout.strides[b], blocks[b], blockCount * layout.strides[b]);
                 }
-                mesh->uniformBlock.jointcount = (float)numJoints;
-                memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-            } else {
-                memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
             }
         }
+        streams::streamFence();
+    }
 
-        for (auto& child : children) {
-            child->update();
+    /*
+        Range of all components of an attribute
+    */
+    static void attributeRange(const AttributeSource &source, uint32_t components, size_t count, float &minValue, float &maxValue)
+    {
+        float columnData[4][streams::BlockSize];
+        float *columns[4] = { columnData[0], columnData[1], columnData[2], columnData[3] };
+        minValue = std::numeric_limits<float>::max();
+        maxValue = -std::numeric_limits<float>::max();
+        for (size_t first = 0; first < count; first += streams::BlockSize) {
+            const size_t blockCount = std::min(streams::BlockSize, count - first);
+            streams::gather(source.data + first * source.byteStride, source.byteStride, source.componentType,
+                source.normalized, components, blockCount, columns);
+            for (uint32_t c = 0; c < components; c++) {
+                for (size_t i = 0; i < blockCount; i++) {
+                    minValue = std::min(minValue, columns[c][i]);
+                    maxValue = std::max(maxValue, columns[c][i]);
+                }
+            }
         }
     }
 
-    Node::~Node()
+    static AttributeSource findAttribute(Model &owner, const tinygltf::Model &model, const tinygltf::Primitive &primitive,
+        const char *name)
     {
-        if (mesh) {
-            delete mesh;
+        AttributeSource source{};
+        auto it = primitive.attributes.find(name);
+        if (it != primitive.attributes.end()) {
+            const tinygltf::Accessor &accessor = model.accessors[it->second];
+            if (accessor.bufferView > -1) {
+                const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
+                source.data = owner.bufferViewData(model, view) + accessor.byteOffset;
+                source.byteStride = accessor.ByteStride(view);
+                source.componentType = accessor.componentType;
+                source.normalized = accessor.normalized;
+            }
         }
-        for (auto& child : children) {
-            delete child;
+        return source;
+    }
+
+    /*
+        Accessor bounds of normalized attributes may be given in integer or normalized form
+    */
+    static float dequantize(double value, int componentType, bool normalized)
+    {
+        if (!normalized || std::abs(value) <= 1.0) {
+            return static_cast<float>(value);
         }
+        switch (componentType) {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+            return std::max(static_cast<float>(value) / 127.0f, -1.0f);
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return static_cast<float>(value) / 255.0f;
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+            return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return static_cast<float>(value) / 65535.0f;
+        default:
+            return static_cast<float>(value);
+        }
+    }
+
+    /*
+        Locate the BIN chunk of a glTF binary, returns nullptr if the file has none
+    */
+    static const unsigned char *glbBinaryChunk(const unsigned char *bytes, size_t size)
+    {
+        if (size < 20 || memcmp(bytes, "glTF", 4) != 0) {
+            return nullptr;
+        }
+        uint32_t jsonLength;
+        memcpy(&jsonLength, bytes + 12, 4);
+        size_t binHeader = 20 + static_cast<size_t>(jsonLength);
+        if (binHeader + 8 > size) {
+            return nullptr;
+        }
+        uint32_t binType;
+        memcpy(&binType, bytes + binHeader + 4, 4);
+        // 0x004E4942 = "BIN\0"
+        return binType == 0x004E4942 ? bytes + binHeader + 8 : nullptr;
     }
 
+#if defined(TINYGLTF_ENABLE_DRACO)
+    /*
+        Decoded indices and attributes of one Draco compressed primitive
+    */
+    struct DracoPrimitive {
+        tinygltf::Primitive *primitive = nullptr;
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+        bool decoded = false;
+        size_t indexCount = 0;
+        size_t pointCount = 0;
+        std::vector<unsigned char> indices;
+        std::vector<std::pair<int, std::vector<unsigned char>>> attributes;
+    };
+
+    static bool dracoDataType(int componentType, draco::DataType &dataType)
+    {
+        switch (componentType) {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:              dataType = draco::DT_INT8; return true;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:     dataType = draco::DT_UINT8; return true;
+        case TINYGLTF_COMPONENT_TYPE_SHORT:             dataType = draco::DT_INT16; return true;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:    dataType = draco::DT_UINT16; return true;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:      dataType = draco::DT_UINT32; return true;
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:             dataType = draco::DT_FLOAT32; return true;
+        }
+        return false;
+    }
+
+    template <typename T>
+    static bool convertDracoAttribute(const draco::Mesh &mesh, const draco::PointAttribute &attribute,
+        uint32_t components, unsigned char *dst)
+    {
+        T values[4] = {};
+        for (draco::PointIndex i(0); i < mesh.num_points(); ++i) {
+            if (!attribute.ConvertValue<T>(attribute.mapped_index(i), static_cast<int8_t>(components), values)) {
+                return false;
+            }
+            memcpy(dst, values, sizeof(T) * components);
+            dst += sizeof(T) * components;
+        }
+        return true;
+    }
+
+    /*
+        Write the values of a Draco attribute for every point as tightly packed glTF accessor data
+    */
+    static bool readDracoAttribute(const draco::Mesh &mesh, const draco::PointAttribute &attribute,
+        int componentType, uint32_t components, unsigned char *dst)
+    {
+        const size_t elementSize = components * tinygltf::GetComponentSizeInBytes(componentType);
+        draco::DataType dataType;
+        const bool sameType = dracoDataType(componentType, dataType) && attribute.data_type() == dataType &&
+            static_cast<uint32_t>(attribute.num_components()) == components;
+        if (sameType) {
+            if (attribute.is_mapping_identity() && attribute.byte_stride() == static_cast<int64_t>(elementSize)) {
+                // Points map one to one onto the stored values, one copy for the whole attribute
+                memcpy(dst, attribute.GetAddress(draco::AttributeValueIndex(0)), elementSize * mesh.num_points());
+            } else {
+                for (draco::PointIndex i(0); i < mesh.num_points(); ++i) {
+                    memcpy(dst, attribute.GetAddress(attribute.mapped_index(i)), elementSize);
+                    dst += elementSize;
+                }
+            }
+            return true;
+        }
+        switch (componentType) {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:              return convertDracoAttribute<int8_t>(mesh, attribute, components, dst);
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:     return convertDracoAttribute<uint8_t>(mesh, attribute, components, dst);
+        case TINYGLTF_COMPONENT_TYPE_SHORT:             return convertDracoAttribute<int16_t>(mesh, attribute, components, dst);
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:    return convertDracoAttribute<uint16_t>(mesh, attribute, components, dst);
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:      return convertDracoAttribute<uint32_t>(mesh, attribute, components, dst);
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:             return convertDracoAttribute<float>(mesh, attribute, components, dst);
+        }
+        return false;
+    }
+
+    static void decodeDracoPrimitive(const tinygltf::Model &model, DracoPrimitive &target)
+    {
+        draco::DecoderBuffer decoderBuffer;
+        decoderBuffer.Init(reinterpret_cast<const char*>(target.data), target.size);
+        draco::Decoder decoder;
+        auto decodeResult = decoder.DecodeMeshFromBuffer(&decoderBuffer);
+        if (!decodeResult.ok()) {
+            return;
+        }
+        const std::unique_ptr<draco::Mesh> &mesh = decodeResult.value();
+        const tinygltf::Primitive &primitive = *target.primitive;
+
+        // Indices are widened to 32 bit right away, the loader stores them that way anyway
+        if (primitive.indices > -1) {
+            target.indexCount = static_cast<size_t>(mesh->num_faces()) * 3;
+            target.indices.resize(target.indexCount * sizeof(uint32_t));
+            static_assert(sizeof(draco::PointIndex) == sizeof(uint32_t), "Draco point indices are expected to be 32 bit");
+            if (mesh->num_faces() > 0) {
+                memcpy(target.indices.data(), &mesh->face(draco::FaceIndex(0))[0], target.indices.size());
+            }
+        }
+
+        target.pointCount = mesh->num_points();
+        const tinygltf::Value &attributes = primitive.extensions.at("KHR_draco_mesh_compression").Get("attributes");
+        for (const std::string &name : attributes.Keys()) {
+            auto primitiveAttribute = primitive.attributes.find(name);
+            const tinygltf::Value &id = attributes.Get(name);
+            if (primitiveAttribute == primitive.attributes.end() || !id.IsInt()) {
+                return;
+            }
+            const draco::PointAttribute *attribute = mesh->GetAttributeByUniqueId(id.Get<int>());
+            const tinygltf::Accessor &accessor = model.accessors[primitiveAttribute->second];
+            const uint32_t components = static_cast<uint32_t>(tinygltf::GetNumComponentsInType(accessor.type));
+            const int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+            if (!attribute || components > 4 || componentSize <= 0) {
+                return;
+            }
+            std::vector<unsigned char> data(target.pointCount * components * componentSize);
+            if (!readDracoAttribute(*mesh, *attribute, accessor.componentType, components, data.data())) {
+                return;
+            }
+            target.attributes.emplace_back(primitiveAttribute->second, std::move(data));
+        }
+        target.decoded = true;
+    }
+#endif
+
     /*
         glTF model loading and rendering class
     */
     void Model::destroy(VkDevice device)
     {
+        stopStreaming();
         if (vertices.buffer != VK_NULL_HANDLE) {
             vkDestroyBuffer(device, vertices.buffer, nullptr);
-            vkFreeMemory(device, vertices.memory, nullptr);
+            this->device->allocator.free(vertices.memory);
+            vertices.buffer = VK_NULL_HANDLE;
         }
         if (indices.buffer != VK_NULL_HANDLE) {
             vkDestroyBuffer(device, indices.buffer, nullptr);
-            vkFreeMemory(device, indices.memory, nullptr);
+            this->device->allocator.free(indices.memory);
+            indices.buffer = VK_NULL_HANDLE;
         }
         for (auto texture : textures) {
             texture.destroy();
@@ -437,11 +935,353 @@ namespace vkglTF
             delete skin;
         }
         skins.resize(0);
+        morphTargets.clear();
+        morphDeltas.clear();
+        vertexLayouts.clear();
     };
 
+    const unsigned char *Model::bufferViewData(const tinygltf::Model &model, const tinygltf::BufferView &bufferView)
+    {
+        const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+        if (buffer.data.empty() && buffer.uri.empty() && binaryChunk) {
+            return binaryChunk + bufferView.byteOffset;
+        }
+        return buffer.data.data() + bufferView.byteOffset;
+    }
+
+    bool Model::bufferViewContains(const tinygltf::Model &model, int bufferView, size_t byteOffset, size_t byteSize) const
+    {
+        if (bufferView < 0 || bufferView >= static_cast<int>(model.bufferViews.size())) {
+            return false;
+        }
+        const tinygltf::BufferView &view = model.bufferViews[bufferView];
+        if (view.buffer < 0 || view.buffer >= static_cast<int>(model.buffers.size()) ||
+            byteOffset > view.byteLength || byteSize > view.byteLength - byteOffset) {
+            return false;
+        }
+        const tinygltf::Buffer &buffer = model.buffers[view.buffer];
+        const size_t bufferSize = buffer.data.empty() && buffer.uri.empty() && binaryChunk ? binaryChunkSize : buffer.data.size();
+        return view.byteOffset <= bufferSize && view.byteLength <= bufferSize - view.byteOffset;
+    }
+
+    void Model::decodeDracoPrimitives(tinygltf::Model &gltfModel)
+    {
+#if defined(TINYGLTF_ENABLE_DRACO)
+        std::vector<DracoPrimitive> targets;
+        for (tinygltf::Mesh &mesh : gltfModel.meshes) {
+            for (tinygltf::Primitive &primitive : mesh.primitives) {
+                auto extension = primitive.extensions.find("KHR_draco_mesh_compression");
+                if (extension == primitive.extensions.end()) {
+                    continue;
+                }
+                const tinygltf::Value &bufferView = extension->second.Get("bufferView");
+                if (!bufferView.IsInt() || !extension->second.Get("attributes").IsObject() ||
+                    bufferView.Get<int>() < 0 || bufferView.Get<int>() >= static_cast<int>(gltfModel.bufferViews.size())) {
+                    LOGW("Invalid KHR_draco_mesh_compression extension in mesh \"{}\"", mesh.name);
+                    continue;
+                }
+                const tinygltf::BufferView &view = gltfModel.bufferViews[bufferView.Get<int>()];
+                DracoPrimitive target;
+                target.primitive = &primitive;
+                target.data = bufferViewData(gltfModel, view);
+                target.size = view.byteLength;
+                targets.push_back(std::move(target));
+            }
+        }
+        if (targets.empty()) {
+            return;
+        }
+        auto tStart = std::chrono::high_resolution_clock::now();
+
+        // One task per compressed primitive, the decoders only read the model
+        xy::ThreadPool &pool = xy::ThreadPool::shared();
+        pool.parallelFor(targets.size(), [&](size_t i) {
+            decodeDracoPrimitive(gltfModel, targets[i]);
+        });
+
+        // Hand the decoded data over as new buffers, loadNode reads them like any other accessor
+        size_t decodedCount = 0;
+        for (DracoPrimitive &target : targets) {
+            if (!target.decoded) {
+                /*
+                    The accessors still point at no data, with the counts of the compressed mesh. Zero counts size
+                    the primitive to no vertices and no indices, loadMesh keeps it and the renderers skip it
+                */
+                LOGW("Draco decoding failed for a primitive, it is not drawn");
+                if (target.primitive->indices > -1) {
+                    gltfModel.accessors[target.primitive->indices].count = 0;
+                }
+                for (auto &attribute : target.primitive->attributes) {
+                    gltfModel.accessors[attribute.second].count = 0;
+                }
+                continue;
+            }
+            auto addAccessorData = [&gltfModel](tinygltf::Accessor &accessor, std::vector<unsigned char> &&data, size_t count) {
+                tinygltf::Buffer buffer;
+                buffer.data = std::move(data);
+                tinygltf::BufferView view;
+                view.buffer = static_cast<int>(gltfModel.buffers.size());
+                view.byteLength = buffer.data.size();
+                view.dracoDecoded = true;
+                gltfModel.buffers.push_back(std::move(buffer));
+                gltfModel.bufferViews.push_back(std::move(view));
+                accessor.bufferView = static_cast<int>(gltfModel.bufferViews.size() - 1);
+                accessor.byteOffset = 0;
+                accessor.count = count;
+            };
+            if (target.primitive->indices > -1) {
+                tinygltf::Accessor &accessor = gltfModel.accessors[target.primitive->indices];
+                accessor.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+                addAccessorData(accessor, std::move(target.indices), target.indexCount);
+            }
+            for (auto &attribute : target.attributes) {
+                addAccessorData(gltfModel.accessors[attribute.first], std::move(attribute.second), target.pointCount);
+            }
+            decodedCount++;
+        }
+        auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        LOGI("Decoded {} Draco primitives on {} workers in {:.2f} ms", decodedCount, pool.size(), tDiff);
+#else
+        (void)gltfModel;
+#endif
+    }
+
+    uint32_t Model::choosePrimitiveLayout(const tinygltf::Model &model, const tinygltf::Primitive &primitive)
+    {
+        using streams::Encoding;
+        const VertexLayoutOptions &options = vertexLayoutOptions;
+
+        AttributeSource sources[VertexLayout::ATTRIBUTE_COUNT];
+        for (uint32_t a = 0; a < VertexLayout::ATTRIBUTE_COUNT; a++) {
+            sources[a] = findAttribute(*this, model, primitive, attributeNames[a]);
+        }
+        const bool hasSkin = sources[VertexLayout::JOINT0].data && sources[VertexLayout::WEIGHT0].data;
+        size_t count = 0;
+        auto posAttribute = primitive.attributes.find("POSITION");
+        if (posAttribute != primitive.attributes.end()) {
+            count = model.accessors[posAttribute->second].count;
+        }
+
+        VertexLayout layout{};
+        for (uint32_t a = 0; a < VertexLayout::ATTRIBUTE_COUNT; a++) {
+            const AttributeSource &source = sources[a];
+            VertexLayout::AttributeFormat &format = layout.attributes[a];
+            const bool skinAttribute = (a == VertexLayout::JOINT0 || a == VertexLayout::WEIGHT0);
+            if (!source.data || (skinAttribute && !hasSkin)) {
+                continue;
+            }
+            format.present = true;
+            format.encoding = streams::encodingOf(source.componentType, source.normalized);
+            // Quantized accessors are kept as they are, only joint indices may shrink further
+            if (format.encoding != Encoding::FLOAT32 && a != VertexLayout::JOINT0) {
+                continue;
+            }
+            float minValue, maxValue;
+            switch (a) {
+            case VertexLayout::NORMAL:
+                if (options.octahedralNormals) {
+                    format.encoding = Encoding::OCTAHEDRAL16;
+                } else if (options.compactNormals) {
+                    format.encoding = Encoding::SNORM16;
+                }
+                break;
+            case VertexLayout::UV0:
+            case VertexLayout::UV1:
+                if (options.compactTexCoords && count > 0) {
+                    attributeRange(source, 2, count, minValue, maxValue);
+                    if (minValue >= 0.0f && maxValue <= 1.0f) {
+                        format.encoding = Encoding::UNORM16;
+                    } else if (minValue >= -2.0f && maxValue <= 2.0f) {
+                        // Half floats keep at least 1/1024 precision in this range
+                        format.encoding = Encoding::FLOAT16;
+                    }
+                }
+                break;
+            case VertexLayout::JOINT0:
+                if (options.compactSkin && count > 0 && format.encoding != Encoding::USCALED8) {
+                    attributeRange(source, 4, count, minValue, maxValue);
+                    format.encoding = maxValue < 256.0f ? Encoding::USCALED8 : Encoding::USCALED16;
+                }
+                break;
+            case VertexLayout::WEIGHT0:
+                if (options.compactSkin) {
+                    format.encoding = Encoding::UNORM16;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        // Scaled and half formats are optional for vertex buffers, fall back to float where they are missing
+        for (uint32_t a = 0; a < VertexLayout::ATTRIBUTE_COUNT; a++) {
+            VertexLayout::AttributeFormat &format = layout.attributes[a];
+            if (format.present && format.encoding != Encoding::FLOAT32) {
+                VkFormatProperties properties;
+                vkGetPhysicalDeviceFormatProperties(device->physicalDevice, layout.format(static_cast<VertexLayout::Attribute>(a)), &properties);
+                if (!(properties.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT)) {
+                    format.encoding = Encoding::FLOAT32;
+                }
+            }
+        }
+        layout.finalize(options.separateSkinStream);
+
+        for (uint32_t i = 0; i < vertexLayouts.size(); i++) {
+            if (vertexLayouts[i].sameFormat(layout)) {
+                return i;
+            }
+        }
+        vertexLayouts.push_back(layout);
+        return static_cast<uint32_t>(vertexLayouts.size() - 1);
+    }
+
+    bool Model::narrowIndexType(size_t vertexCount) const
+    {
+        // Primitive restart is never enabled, so 0xffff is an ordinary index
+        return vertexLayoutOptions.narrowIndices && vertexCount <= 65536;
+    }
+
+    /*
+        Nodes without a skin share the geometry of a mesh without morph targets, the other meshes are deformed per node
+        by the compute pass and keep a copy each
+    */
+    static bool sharedGeometry(const tinygltf::Model &model, const tinygltf::Node &node)
+    {
+        if (node.skin > -1) {
+            return false;
+        }
+        for (const tinygltf::Primitive &primitive : model.meshes[node.mesh].primitives) {
+            if (!primitive.targets.empty()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+        Accessor of an EXT_mesh_gpu_instancing attribute of a node, -1 when absent
+    */
+    static int instanceAttribute(const tinygltf::Model &model, const tinygltf::Node &node, const char *name)
+    {
+        auto extension = node.extensions.find("EXT_mesh_gpu_instancing");
+        if (extension == node.extensions.end()) {
+            return -1;
+        }
+        const tinygltf::Value &attributes = extension->second.Get("attributes");
+        if (!attributes.IsObject() || !attributes.Has(name)) {
+            return -1;
+        }
+        const int accessor = attributes.Get(name).GetNumberAsInt();
+        return accessor > -1 && static_cast<size_t>(accessor) < model.accessors.size() ? accessor : -1;
+    }
+
+    /*
+        Number of EXT_mesh_gpu_instancing instances of a node, zero without the extension
+    */
+    static size_t instanceCount(const tinygltf::Model &model, const tinygltf::Node &node)
+    {
+        size_t count = 0;
+        for (const char *name : { "TRANSLATION", "ROTATION", "SCALE" }) {
+            const int accessor = instanceAttribute(model, node, name);
+            if (accessor > -1) {
+                count = std::max(count, model.accessors[accessor].count);
+            }
+        }
+        return count;
+    }
+
+    struct MeshInstance {
+        glm::vec3 translation{ 0.0f };
+        glm::quat rotation{ 1.0f, 0.0f, 0.0f, 0.0f };
+        glm::vec3 scale{ 1.0f };
+    };
+
+    /*
+        Read the instance transforms of EXT_mesh_gpu_instancing, absent or invalid attributes keep the identity
+    */
+    static std::vector<MeshInstance> loadInstances(Model &owner, const tinygltf::Model &model, const tinygltf::Node &node)
+    {
+        const size_t count = instanceCount(model, node);
+        std::vector<MeshInstance> instances(count);
+        std::vector<float> columns[4];
+        for (std::vector<float> &column : columns) {
+            column.resize(count);
+        }
+        float *dst[4] = { columns[0].data(), columns[1].data(), columns[2].data(), columns[3].data() };
+        auto read = [&](const char *name, int type) {
+            const int index = instanceAttribute(model, node, name);
+            if (index < 0) {
+                return false;
+            }
+            const tinygltf::Accessor &accessor = model.accessors[index];
+            if (accessor.type == type && accessor.count == count && accessor.bufferView > -1) {
+                const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
+                const uint8_t *src = owner.bufferViewData(model, view) + accessor.byteOffset;
+                if (streams::gather(src, accessor.ByteStride(view), accessor.componentType, accessor.normalized,
+                        tinygltf::GetNumComponentsInType(type), count, dst)) {
+                    return true;
+                }
+            }
+            LOGW("Invalid EXT_mesh_gpu_instancing attribute {} in node \"{}\"", name, node.name);
+            return false;
+        };
+        if (read("TRANSLATION", TINYGLTF_TYPE_VEC3)) {
+            for (size_t i = 0; i < count; i++) {
+                instances[i].translation = glm::vec3(columns[0][i], columns[1][i], columns[2][i]);
+            }
+        }
+        if (read("ROTATION", TINYGLTF_TYPE_VEC4)) {
+            for (size_t i = 0; i < count; i++) {
+                instances[i].rotation = glm::quat(columns[3][i], columns[0][i], columns[1][i], columns[2][i]);
+            }
+        }
+        if (read("SCALE", TINYGLTF_TYPE_VEC3)) {
+            for (size_t i = 0; i < count; i++) {
+                instances[i].scale = glm::vec3(columns[0][i], columns[1][i], columns[2][i]);
+            }
+        }
+        return instances;
+    }
+
+    void Model::getNodeProps(const tinygltf::Node &node, const tinygltf::Model &model, LoaderInfo &loaderInfo,
+        size_t &vertexCount, size_t &indexCount, size_t &narrowIndexCount)
+    {
+        for (size_t i = 0; i < node.children.size(); i++) {
+            getNodeProps(model.nodes[node.children[i]], model, loaderInfo, vertexCount, indexCount, narrowIndexCount);
+        }
+        if (node.mesh > -1) {
+            const tinygltf::Mesh &mesh = model.meshes[node.mesh];
+            std::vector<uint32_t> &layouts = loaderInfo.primitiveLayouts[node.mesh];
+            if (layouts.size() != mesh.primitives.size()) {
+                for (const tinygltf::Primitive &primitive : mesh.primitives) {
+                    layouts.push_back(choosePrimitiveLayout(model, primitive));
+                }
+            }
+            // Shared geometry is placed once, every instance of a skinned or morphed mesh gets a copy
+            size_t copies = std::max<size_t>(instanceCount(model, node), 1);
+            if (sharedGeometry(model, node)) {
+                copies = loaderInfo.sharedMeshCounted[node.mesh] ? 0 : 1;
+                loaderInfo.sharedMeshCounted[node.mesh] = true;
+            }
+            for (size_t j = 0; j < mesh.primitives.size(); j++) {
+                const tinygltf::Primitive &primitive = mesh.primitives[j];
+                auto posAttribute = primitive.attributes.find("POSITION");
+                size_t primitiveVertexCount = 0;
+                if (posAttribute != primitive.attributes.end()) {
+                    primitiveVertexCount = model.accessors[posAttribute->second].count;
+                    vertexLayouts[layouts[j]].vertexCount += static_cast<uint32_t>(primitiveVertexCount * copies);
+                    vertexCount += primitiveVertexCount * copies;
+                }
+                if (primitive.indices > -1) {
+                    (narrowIndexType(primitiveVertexCount) ? narrowIndexCount : indexCount) +=
+                        model.accessors[primitive.indices].count * copies;
+                }
+            }
+        }
+    }
+
     void Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, uint32_t nodeIndex,
-        const tinygltf::Model &model, std::vector<uint32_t>& indexBuffer,
-        std::vector<Vertex>& vertexBuffer, float globalscale)
+        const tinygltf::Model &model, LoaderInfo &loaderInfo, float globalscale)
     {
         vkglTF::Node *newNode = new Node{};
         newNode->index = nodeIndex;
@@ -477,169 +1317,393 @@ namespace vkglTF
         // Node with children
         if (node.children.size() > 0) {
             for (size_t i = 0; i < node.children.size(); i++) {
-                loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, indexBuffer, vertexBuffer, globalscale);
+                loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, loaderInfo, globalscale);
             }
         }
 
         // Node contains mesh data
         if (node.mesh > -1) {
-            const tinygltf::Mesh mesh = model.meshes[node.mesh];
-            Mesh *newMesh = new Mesh(device, newNode->matrix);
-            for (size_t j = 0; j < mesh.primitives.size(); j++) {
-                const tinygltf::Primitive &primitive = mesh.primitives[j];
-                uint32_t indexStart = static_cast<uint32_t>(indexBuffer.size());
-                uint32_t vertexStart = static_cast<uint32_t>(vertexBuffer.size());
-                uint32_t indexCount = 0;
-                uint32_t vertexCount = 0;
-                glm::vec3 posMin{};
-                glm::vec3 posMax{};
-                bool hasSkin = false;
-                bool hasIndices = primitive.indices > -1;
-                // Vertices
-                {
-                    const float *bufferPos = nullptr;
-                    const float *bufferNormals = nullptr;
-                    const float *bufferTexCoordSet0 = nullptr;
-                    const float *bufferTexCoordSet1 = nullptr;
-                    const uint16_t *bufferJoints = nullptr;
-                    const float *bufferWeights = nullptr;
-
-                    int posByteStride;
-                    int normByteStride;
-                    int uv0ByteStride;
-                    int uv1ByteStride;
-                    int jointByteStride;
-                    int weightByteStride;
-
-                    // Position attribute is required
-                    assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
-
-                    const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-                    const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
-                    bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
-                    posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
-                    posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
-                    vertexCount = static_cast<uint32_t>(posAccessor.count);
-                    posByteStride = posAccessor.ByteStride(posView) ? (posAccessor.ByteStride(posView) / sizeof(float)) :
-                        tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
-
-                    if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-                        const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
-                        const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
-                        bufferNormals = reinterpret_cast<const float *>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
-                        normByteStride = normAccessor.ByteStride(normView) ? (normAccessor.ByteStride(normView) / sizeof(float)) :
-                            tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
-                    }
+            std::vector<MeshInstance> instances = loadInstances(*this, model, node);
+            if (instances.empty()) {
+                newNode->mesh = loadMesh(model, node, newNode->matrix, loaderInfo);
+            }
+            // EXT_mesh_gpu_instancing: every instance is a child node drawing the mesh, the node itself draws nothing
+            for (size_t i = 0; i < instances.size(); i++) {
+                vkglTF::Node *instance = new Node{};
+                instance->index = loaderInfo.nextNodeIndex++;
+                instance->parent = newNode;
+                instance->name = newNode->name + "_instance_" + std::to_string(i);
+                instance->matrix = glm::mat4(1.0f);
+                instance->translation = instances[i].translation;
+                instance->rotation = instances[i].rotation;
+                instance->scale = instances[i].scale;
+                instance->mesh = loadMesh(model, node, instance->matrix, loaderInfo);
+                newNode->children.push_back(instance);
+                linearNodes.push_back(instance);
+            }
+        }
+        if (parent) {
+            parent->children.push_back(newNode);
+        } else {
+            nodes.push_back(newNode);
+        }
+        linearNodes.push_back(newNode);
+    }
 
-                    if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-                        const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-                        const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-                        bufferTexCoordSet0 = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-                        uv0ByteStride = uvAccessor.ByteStride(uvView) ? (uvAccessor.ByteStride(uvView) / sizeof(float)) :
-                            tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC2);
-                    }
-                    if (primitive.attributes.find("TEXCOORD_1") != primitive.attributes.end()) {
-                        const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_1")->second];
-                        const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-                        bufferTexCoordSet1 = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-                        uv1ByteStride = uvAccessor.ByteStride(uvView) ? (uvAccessor.ByteStride(uvView) / sizeof(float)) :
-                            tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC2);
-                    }
+    Mesh *Model::loadMesh(const tinygltf::Model &model, const tinygltf::Node &node, const glm::mat4 &matrix, LoaderInfo &loaderInfo)
+    {
+        const tinygltf::Mesh &mesh = model.meshes[node.mesh];
+        const bool shared = sharedGeometry(model, node);
+        Mesh *newMesh = new Mesh(matrix);
+
+        // Another node placed the geometry already, draw its vertices and indices
+        Mesh *owner = shared ? loaderInfo.sharedMeshes[node.mesh] : nullptr;
+        if (owner) {
+            for (const Primitive *primitive : owner->primitives) {
+                newMesh->primitives.push_back(new Primitive(*primitive));
+            }
+            newMesh->bb = owner->bb;
+            newMesh->resident = owner->resident;
+            newMesh->geometry = owner;
+            loaderInfo.sharedMeshCount++;
+            return newMesh;
+        }
 
-                    // Skinning
-                    // Joints
-                    if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
-                        const tinygltf::Accessor &jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
-                        const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
-                        bufferJoints = reinterpret_cast<const uint16_t *>(&(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
-                        jointByteStride = jointAccessor.ByteStride(jointView) ? (jointAccessor.ByteStride(jointView) / sizeof(bufferJoints[0])) :
-                            tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC4);
-                    }
+        uint32_t targetCount = 0;
+        for (size_t j = 0; j < mesh.primitives.size(); j++) {
+            const tinygltf::Primitive &primitive = mesh.primitives[j];
+            const uint32_t layoutIndex = loaderInfo.primitiveLayouts[node.mesh][j];
+            const VertexLayout &layout = vertexLayouts[layoutIndex];
+            const uint32_t firstVertex = loaderInfo.layoutVertexPos[layoutIndex];
+            uint32_t indexCount = 0;
+            uint32_t vertexCount = 0;
+            glm::vec3 posMin{};
+            glm::vec3 posMax{};
+            bool hasIndices = primitive.indices > -1;
+
+            // Position attribute is required
+            assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
+
+            const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+            for (int c = 0; c < 3; c++) {
+                posMin[c] = dequantize(posAccessor.minValues[c], posAccessor.componentType, posAccessor.normalized);
+                posMax[c] = dequantize(posAccessor.maxValues[c], posAccessor.componentType, posAccessor.normalized);
+            }
+            vertexCount = static_cast<uint32_t>(posAccessor.count);
+            if (hasIndices) {
+                indexCount = static_cast<uint32_t>(model.accessors[primitive.indices].count);
+            }
+            // Indices stay relative to the primitive, the draw passes firstVertex as vertex offset
+            const bool narrow = narrowIndexType(vertexCount);
+            size_t &indexPos = narrow ? loaderInfo.narrowIndexPos : loaderInfo.indexPos;
+            const uint32_t indexStart = static_cast<uint32_t>(indexPos);
+            loaderInfo.layoutVertexPos[layoutIndex] += vertexCount;
+            loaderInfo.vertexPos += vertexCount;
+            indexPos += indexCount;
+
+            Primitive *newPrimitive = new Primitive(indexStart, indexCount, vertexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
+            newPrimitive->setBoundingBox(posMin, posMax);
+            newPrimitive->layout = layoutIndex;
+            newPrimitive->firstVertex = firstVertex;
+            newPrimitive->indexType = narrow ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+            newMesh->primitives.push_back(newPrimitive);
+
+            // Morph targets are small once sparse and loaded right away, also for deferred geometry
+            std::vector<uint32_t> &morphTargetCache = loaderInfo.primitiveMorphTargets[node.mesh];
+            morphTargetCache.resize(mesh.primitives.size(), UINT32_MAX);
+            loadMorphTargets(model, primitive, *newPrimitive, morphTargetCache[j]);
+            targetCount = std::max(targetCount, newPrimitive->morphTargetCount);
+
+            if (!loaderInfo.deferGeometry) {
+                uint8_t *mainStream = loaderInfo.vertexBuffer + layout.bufferOffsets[VertexLayout::BINDING_MAIN] +
+                    firstVertex * layout.strides[VertexLayout::BINDING_MAIN];
+                uint8_t *skinStream = loaderInfo.vertexBuffer + layout.bufferOffsets[VertexLayout::BINDING_SKIN] +
+                    firstVertex * layout.strides[VertexLayout::BINDING_SKIN];
+                loadPrimitiveData(model, primitive, *newPrimitive, mainStream, skinStream,
+                    loaderInfo.indexBuffer + indexOffset(*newPrimitive));
+            }
+        }
+        // Weights of the node override the default weights of the mesh
+        const std::vector<double> &weights = node.weights.empty() ? mesh.weights : node.weights;
+        newMesh->morphWeights.assign(targetCount, 0.0f);
+        for (size_t t = 0; t < std::min<size_t>(targetCount, weights.size()); t++) {
+            newMesh->morphWeights[t] = static_cast<float>(weights[t]);
+        }
+        if (loaderInfo.deferGeometry) {
+            newMesh->resident = false;
+            loaderInfo.deferredMeshes.emplace_back(newMesh, node.mesh);
+        }
+        // Mesh BB from BBs of primitives
+        for (auto p : newMesh->primitives) {
+            if (p->bb.valid && !newMesh->bb.valid) {
+                newMesh->bb = p->bb;
+                newMesh->bb.valid = true;
+            }
+            newMesh->bb.min = glm::min(newMesh->bb.min, p->bb.min);
+            newMesh->bb.max = glm::max(newMesh->bb.max, p->bb.max);
+        }
+        if (shared) {
+            loaderInfo.sharedMeshes[node.mesh] = newMesh;
+        }
+        return newMesh;
+    }
 
-                    if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
-                        const tinygltf::Accessor &weightAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
-                        const tinygltf::BufferView &weightView = model.bufferViews[weightAccessor.bufferView];
-                        bufferWeights = reinterpret_cast<const float *>(&(model.buffers[weightView.buffer].data[weightAccessor.byteOffset + weightView.byteOffset]));
-                        weightByteStride = weightAccessor.ByteStride(weightView) ? (weightAccessor.ByteStride(weightView) / sizeof(float)) :
-                            tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC4);
-                    }
+    /*
+        Copy indices of any glTF component type into indices of type Index, the caller made sure they fit
+    */
+    template<typename Index>
+    static bool convertIndices(const void *src, int componentType, size_t count, Index *dst)
+    {
+        switch (componentType) {
+        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
+            const uint32_t *buf = static_cast<const uint32_t*>(src);
+            for (size_t index = 0; index < count; index++) {
+                dst[index] = static_cast<Index>(buf[index]);
+            }
+            break;
+        }
+        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
+            const uint16_t *buf = static_cast<const uint16_t*>(src);
+            if (sizeof(Index) == sizeof(uint16_t)) {
+                memcpy(dst, buf, count * sizeof(uint16_t));
+                break;
+            }
+            for (size_t index = 0; index < count; index++) {
+                dst[index] = buf[index];
+            }
+            break;
+        }
+        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
+            const uint8_t *buf = static_cast<const uint8_t*>(src);
+            for (size_t index = 0; index < count; index++) {
+                dst[index] = buf[index];
+            }
+            break;
+        }
+        default:
+            LOGI("Index component type {} not supported!", componentType);
+            return false;
+        }
+        return true;
+    }
 
-                    hasSkin = (bufferJoints && bufferWeights);
+    /*
+        Nonzero displacement of one vertex by a morph target attribute
+    */
+    struct MorphAttributeDelta {
+        uint32_t vertex;
+        glm::vec3 value;
+    };
 
-                    for (size_t v = 0; v < posAccessor.count; v++) {
-                        Vertex vert{};
-                        vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * posByteStride]), 1.0f);
-                        vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * normByteStride]) : glm::vec3(0.0f)));
-                        vert.uv0 = bufferTexCoordSet0 ? glm::make_vec2(&bufferTexCoordSet0[v * uv0ByteStride]) : glm::vec3(0.0f);
-                        vert.uv1 = bufferTexCoordSet1 ? glm::make_vec2(&bufferTexCoordSet1[v * uv1ByteStride]) : glm::vec3(0.0f);
+    /*
+        Read the sparse indices and values of a vec3 accessor, the values into x, y and z columns
+    */
+    static bool readSparseMorphValues(Model &owner, const tinygltf::Model &model, const tinygltf::Accessor &accessor,
+        std::vector<uint32_t> &indices, std::vector<float> (&values)[3])
+    {
+        const size_t sparseCount = static_cast<size_t>(accessor.sparse.count);
+        const int indexSize = tinygltf::GetComponentSizeInBytes(accessor.sparse.indices.componentType);
+        const int valueSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+        if (indexSize <= 0 || valueSize <= 0 ||
+            !owner.bufferViewContains(model, accessor.sparse.indices.bufferView, accessor.sparse.indices.byteOffset,
+                sparseCount * indexSize) ||
+            !owner.bufferViewContains(model, accessor.sparse.values.bufferView, accessor.sparse.values.byteOffset,
+                sparseCount * 3 * valueSize)) {
+            return false;
+        }
+        indices.resize(sparseCount);
+        const tinygltf::BufferView &indexView = model.bufferViews[accessor.sparse.indices.bufferView];
+        if (!convertIndices(owner.bufferViewData(model, indexView) + accessor.sparse.indices.byteOffset,
+                accessor.sparse.indices.componentType, sparseCount, indices.data())) {
+            return false;
+        }
+        for (std::vector<float> &column : values) {
+            column.resize(sparseCount);
+        }
+        float *valueColumns[3] = { values[0].data(), values[1].data(), values[2].data() };
+        const tinygltf::BufferView &valueView = model.bufferViews[accessor.sparse.values.bufferView];
+        return streams::gather(owner.bufferViewData(model, valueView) + accessor.sparse.values.byteOffset,
+            3 * valueSize, accessor.componentType, accessor.normalized, 3, sparseCount, valueColumns);
+    }
 
-                        vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * jointByteStride])) : glm::vec4(0.0f);
-                        vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * weightByteStride]) : glm::vec4(0.0f);
-                        // Fix for all zero weights
-                        if (glm::length(vert.weight0) == 0.0f) {
-                            vert.weight0 = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
-                        }
-                        vertexBuffer.push_back(vert);
-                    }
+    /*
+        Read the nonzero displacements of a vec3 morph target attribute sorted by vertex
+        Sparse accessors without a buffer view are read from their indices and values alone, the others are
+        expanded into count values first since their base data may move every vertex
+    */
+    static bool readMorphAttribute(Model &owner, const tinygltf::Model &model, const tinygltf::Accessor &accessor,
+        size_t count, std::vector<MorphAttributeDelta> &deltas)
+    {
+        deltas.clear();
+        if (accessor.type != TINYGLTF_TYPE_VEC3 || accessor.count != count) {
+            return false;
+        }
+        const bool sparse = accessor.sparse.isSparse && accessor.sparse.count > 0;
+        std::vector<uint32_t> sparseIndices;
+        std::vector<float> sparseValues[3];
+        if (sparse && !readSparseMorphValues(owner, model, accessor, sparseIndices, sparseValues)) {
+            return false;
+        }
+        for (uint32_t index : sparseIndices) {
+            if (index >= count) {
+                return false;
+            }
+        }
+
+        if (accessor.bufferView < 0) {
+            deltas.reserve(sparseIndices.size());
+            for (size_t i = 0; i < sparseIndices.size(); i++) {
+                const glm::vec3 value(sparseValues[0][i], sparseValues[1][i], sparseValues[2][i]);
+                if (value != glm::vec3(0.0f)) {
+                    deltas.push_back({ sparseIndices[i], value });
                 }
-                // Indices
-                if (hasIndices)
-                {
-                    const tinygltf::Accessor &accessor = model.accessors[primitive.indices > -1 ? primitive.indices : 0];
-                    const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-                    const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+            }
+            // glTF requires increasing sparse indices, a repeated index keeps its last value
+            std::stable_sort(deltas.begin(), deltas.end(),
+                [](const MorphAttributeDelta &a, const MorphAttributeDelta &b) { return a.vertex < b.vertex; });
+            size_t unique = 0;
+            for (size_t i = 0; i < deltas.size(); i++) {
+                if (unique > 0 && deltas[unique - 1].vertex == deltas[i].vertex) {
+                    deltas[unique - 1] = deltas[i];
+                } else {
+                    deltas[unique++] = deltas[i];
+                }
+            }
+            deltas.resize(unique);
+            return true;
+        }
 
-                    indexCount = static_cast<uint32_t>(accessor.count);
-                    const void *dataPtr = &(buffer.data[accessor.byteOffset + bufferView.byteOffset]);
+        std::vector<float> columns[3];
+        for (std::vector<float> &column : columns) {
+            column.resize(count);
+        }
+        float *dst[3] = { columns[0].data(), columns[1].data(), columns[2].data() };
+        const int valueSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+        if (valueSize <= 0 || accessor.bufferView >= static_cast<int>(model.bufferViews.size())) {
+            return false;
+        }
+        const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
+        const int stride = accessor.ByteStride(view);
+        if (stride <= 0 || (count > 0 && !owner.bufferViewContains(model, accessor.bufferView, accessor.byteOffset,
+                (count - 1) * stride + 3 * valueSize))) {
+            return false;
+        }
+        const uint8_t *src = owner.bufferViewData(model, view) + accessor.byteOffset;
+        if (!streams::gather(src, stride, accessor.componentType, accessor.normalized, 3, count, dst)) {
+            return false;
+        }
+        for (size_t i = 0; i < sparseIndices.size(); i++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                columns[c][sparseIndices[i]] = sparseValues[c][i];
+            }
+        }
+        for (size_t v = 0; v < count; v++) {
+            const glm::vec3 value(columns[0][v], columns[1][v], columns[2][v]);
+            if (value != glm::vec3(0.0f)) {
+                deltas.push_back({ static_cast<uint32_t>(v), value });
+            }
+        }
+        return true;
+    }
 
-                    switch (accessor.componentType) {
-                    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-                        const uint32_t *buf = static_cast<const uint32_t*>(dataPtr);
-                        for (size_t index = 0; index < accessor.count; index++) {
-                            indexBuffer.push_back(buf[index] + vertexStart);
-                        }
-                        break;
-                    }
-                    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-                        const uint16_t *buf = static_cast<const uint16_t*>(dataPtr);
-                        for (size_t index = 0; index < accessor.count; index++) {
-                            indexBuffer.push_back(buf[index] + vertexStart);
-                        }
-                        break;
-                    }
-                    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-                        const uint8_t *buf = static_cast<const uint8_t*>(dataPtr);
-                        for (size_t index = 0; index < accessor.count; index++) {
-                            indexBuffer.push_back(buf[index] + vertexStart);
-                        }
-                        break;
+    void Model::loadMorphTargets(const tinygltf::Model &model, const tinygltf::Primitive &primitive, Primitive &target,
+        uint32_t &firstMorphTarget)
+    {
+        if (primitive.targets.empty()) {
+            return;
+        }
+        // Another node instancing the mesh loaded the targets already
+        if (firstMorphTarget == UINT32_MAX) {
+            firstMorphTarget = static_cast<uint32_t>(morphTargets.size());
+            const size_t count = target.vertexCount;
+            std::vector<MorphAttributeDelta> positions;
+            std::vector<MorphAttributeDelta> normals;
+            auto readAttribute = [&](const std::map<std::string, int> &attributes, const char *name,
+                std::vector<MorphAttributeDelta> &deltas) {
+                deltas.clear();
+                auto attribute = attributes.find(name);
+                return attribute == attributes.end() || (attribute->second >= 0 &&
+                    attribute->second < static_cast<int>(model.accessors.size()) &&
+                    readMorphAttribute(*this, model, model.accessors[attribute->second], count, deltas));
+            };
+            for (size_t t = 0; t < primitive.targets.size(); t++) {
+                MorphTarget morphTarget{ static_cast<uint32_t>(morphDeltas.size()), 0 };
+                if (!readAttribute(primitive.targets[t], "POSITION", positions) ||
+                    !readAttribute(primitive.targets[t], "NORMAL", normals)) {
+                    // The target stays in the list with no deltas, so the weights keep their indices
+                    LOGW("Morph target {} has invalid accessor data, it is skipped", t);
+                    positions.clear();
+                    normals.clear();
+                }
+                // Merge both attributes by vertex, vertices the target does not move are left out and the compute pass
+                // searches the rest
+                size_t p = 0;
+                size_t n = 0;
+                while (p < positions.size() || n < normals.size()) {
+                    MorphDelta delta{};
+                    const uint32_t positionVertex = p < positions.size() ? positions[p].vertex : UINT32_MAX;
+                    const uint32_t normalVertex = n < normals.size() ? normals[n].vertex : UINT32_MAX;
+                    delta.vertex = std::min(positionVertex, normalVertex);
+                    if (positionVertex == delta.vertex) {
+                        delta.position = positions[p++].value;
                     }
-                    default:
-                        LOGI("Index component type {} not supported!", accessor.componentType);
-                        return;
+                    if (normalVertex == delta.vertex) {
+                        delta.normal = normals[n++].value;
                     }
-                }                    
-                Primitive *newPrimitive = new Primitive(indexStart, indexCount, vertexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
-                newPrimitive->setBoundingBox(posMin, posMax);
-                newMesh->primitives.push_back(newPrimitive);
-            }
-            // Mesh BB from BBs of primitives
-            for (auto p : newMesh->primitives) {
-                if (p->bb.valid && !newMesh->bb.valid) {
-                    newMesh->bb = p->bb;
-                    newMesh->bb.valid = true;
+                    morphDeltas.push_back(delta);
                 }
-                newMesh->bb.min = glm::min(newMesh->bb.min, p->bb.min);
-                newMesh->bb.max = glm::max(newMesh->bb.max, p->bb.max);
+                morphTarget.deltaCount = static_cast<uint32_t>(morphDeltas.size()) - morphTarget.firstDelta;
+                morphTargets.push_back(morphTarget);
             }
-            newNode->mesh = newMesh;
         }
-        if (parent) {
-            parent->children.push_back(newNode);
-        } else {
-            nodes.push_back(newNode);
+        target.firstMorphTarget = firstMorphTarget;
+        target.morphTargetCount = static_cast<uint32_t>(primitive.targets.size());
+
+        // Every target may add its smallest and largest displacement, assuming weights in [0, 1]
+        // glTF does not limit the weights, larger or negative ones can move vertices outside these bounds
+        if (!target.bb.valid) {
+            return;
         }
-        linearNodes.push_back(newNode);
+        glm::vec3 posMin = target.bb.min;
+        glm::vec3 posMax = target.bb.max;
+        for (uint32_t t = 0; t < target.morphTargetCount; t++) {
+            const MorphTarget &morphTarget = morphTargets[target.firstMorphTarget + t];
+            glm::vec3 deltaMin(0.0f);
+            glm::vec3 deltaMax(0.0f);
+            for (uint32_t d = 0; d < morphTarget.deltaCount; d++) {
+                deltaMin = glm::min(deltaMin, morphDeltas[morphTarget.firstDelta + d].position);
+                deltaMax = glm::max(deltaMax, morphDeltas[morphTarget.firstDelta + d].position);
+            }
+            posMin += deltaMin;
+            posMax += deltaMax;
+        }
+        target.setBoundingBox(posMin, posMax);
+    }
+
+    bool Model::loadPrimitiveData(const tinygltf::Model &model, const tinygltf::Primitive &primitive, const Primitive &target,
+        uint8_t *mainStream, uint8_t *skinStream, uint8_t *indexDst)
+    {
+        AttributeSource sources[VertexLayout::ATTRIBUTE_COUNT];
+        for (uint32_t a = 0; a < VertexLayout::ATTRIBUTE_COUNT; a++) {
+            sources[a] = findAttribute(*this, model, primitive, attributeNames[a]);
+        }
+        convertVertices(sources, vertexLayouts[target.layout], target.vertexCount, mainStream, skinStream);
+
+        if (!target.hasIndices) {
+            return true;
+        }
+        const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
+        if (accessor.bufferView < 0) {
+            return accessor.count == 0;
+        }
+        const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+        const void *dataPtr = bufferViewData(model, bufferView) + accessor.byteOffset;
+
+        // Straight from the accessor into the width of the index region
+        if (target.indexType == VK_INDEX_TYPE_UINT16) {
+            return convertIndices(dataPtr, accessor.componentType, accessor.count, reinterpret_cast<uint16_t*>(indexDst));
+        }
+        return convertIndices(dataPtr, accessor.componentType, accessor.count, reinterpret_cast<uint32_t*>(indexDst));
     }
 
     void Model::loadSkins(tinygltf::Model &gltfModel)
@@ -661,23 +1725,204 @@ namespace vkglTF
                 }
             }
 
-            // Get inverse bind matrices from buffer
-            if (source.inverseBindMatrices > -1) {
-                const tinygltf::Accessor &accessor = gltfModel.accessors[source.inverseBindMatrices];
-                const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-                const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
-                newSkin->inverseBindMatrices.resize(accessor.count);
-                memcpy(newSkin->inverseBindMatrices.data(), &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::mat4));
+            // Get inverse bind matrices from buffer
+            if (source.inverseBindMatrices > -1) {
+                const tinygltf::Accessor &accessor = gltfModel.accessors[source.inverseBindMatrices];
+                const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
+                newSkin->inverseBindMatrices.resize(accessor.count);
+                memcpy(newSkin->inverseBindMatrices.data(), bufferViewData(gltfModel, bufferView) + accessor.byteOffset, accessor.count * sizeof(glm::mat4));
+            }
+
+            skins.push_back(newSkin);
+        }
+    }
+
+    void Model::loadTextures(tinygltf::Model &gltfModel, xy::VulkanDevice *device, VkQueue transferQueue,
+        const std::vector<uint32_t> &textureIndices)
+    {
+        if (textureIndices.empty()) {
+            return;
+        }
+        auto tStart = std::chrono::high_resolution_clock::now();
+
+        // Source image of every texture, the image index past the end stands for a blank image
+        // used by textures without a usable source
+        const size_t blankImage = gltfModel.images.size();
+        std::vector<size_t> sources(textureIndices.size());
+        std::vector<size_t> imageUploads(gltfModel.images.size() + 1, SIZE_MAX);
+        std::vector<size_t> uploadImages;
+        for (size_t t = 0; t < textureIndices.size(); t++) {
+            int source = gltfModel.textures[textureIndices[t]].source;
+            size_t image = (source > -1 && source < static_cast<int>(gltfModel.images.size())) ? source : blankImage;
+            if (imageUploads[image] == SIZE_MAX) {
+                imageUploads[image] = uploadImages.size();
+                uploadImages.push_back(image);
+            }
+            sources[t] = imageUploads[image];
+        }
+
+        // Read the image dimensions first, so the staging ranges can be laid out before anything is decoded
+        struct ImageUpload {
+            int width = 1;
+            int height = 1;
+            VkDeviceSize offset = 0;
+            bool valid = false;
+        };
+        std::vector<ImageUpload> uploads(uploadImages.size());
+        for (size_t i = 0; i < uploads.size(); i++) {
+            ImageUpload &upload = uploads[i];
+            if (uploadImages[i] == blankImage) {
+                continue;
+            }
+            const tinygltf::Image &gltfimage = gltfModel.images[uploadImages[i]];
+            if (gltfimage.as_is) {
+                int comp;
+                upload.valid = !gltfimage.image.empty() && stbi_info_from_memory(gltfimage.image.data(),
+                    static_cast<int>(gltfimage.image.size()), &upload.width, &upload.height, &comp);
+            } else {
+                upload.valid = !gltfimage.image.empty() && gltfimage.width > 0 && gltfimage.height > 0;
+                upload.width = gltfimage.width;
+                upload.height = gltfimage.height;
+            }
+            if (!upload.valid) {
+                LOGW("Image {} \"{}\" could not be read, using a blank texture", uploadImages[i], gltfimage.uri);
+                upload.width = 1;
+                upload.height = 1;
+            }
+        }
+
+        /*
+            Images are staged in groups the ring serves without a buffer of its own, each group is decoded, copied
+            and submitted before the next one reuses the ring. Only an image larger than that is staged alone in a
+            temporary buffer, so the host memory of the upload stays bounded by the ring and the largest image
+        */
+        const VkDeviceSize groupLimit = device->staging.maxAllocation();
+        std::vector<size_t> groupStarts;
+        std::vector<VkDeviceSize> groupSizes;
+        for (size_t i = 0; i < uploads.size(); i++) {
+            const VkDeviceSize size = static_cast<VkDeviceSize>(uploads[i].width) * uploads[i].height * 4;
+            if (groupStarts.empty() || (groupSizes.back() > 0 && groupSizes.back() + size > groupLimit)) {
+                groupStarts.push_back(i);
+                groupSizes.push_back(0);
+            }
+            uploads[i].offset = groupSizes.back();
+            groupSizes.back() += size;
+        }
+        groupStarts.push_back(uploads.size());
+        std::vector<size_t> uploadGroups(uploads.size());
+        for (size_t g = 0; g < groupSizes.size(); g++) {
+            std::fill(uploadGroups.begin() + groupStarts[g], uploadGroups.begin() + groupStarts[g + 1], g);
+        }
+        std::vector<std::vector<size_t>> groupTextures(groupSizes.size());
+        for (size_t t = 0; t < textureIndices.size(); t++) {
+            groupTextures[uploadGroups[sources[t]]].push_back(t);
+        }
+
+        // Decode and convert an image to RGBA straight into its staging range
+        // Every texture is R8G8B8A8, 16 bit images are reduced to the most significant byte of each channel, which
+        // stb_image does as well when it decodes them to 8 bit
+        auto decodeImage = [&](size_t i, uint8_t *dst) {
+            const ImageUpload &upload = uploads[i];
+            size_t dstSize = static_cast<size_t>(upload.width) * upload.height * 4;
+            if (uploadImages[i] == blankImage) {
+                memset(dst, 0xff, dstSize);
+                return;
+            }
+            tinygltf::Image &gltfimage = gltfModel.images[uploadImages[i]];
+            bool decoded = false;
+            if (upload.valid && gltfimage.as_is) {
+                int w, h, comp;
+                stbi_uc *pixels = stbi_load_from_memory(gltfimage.image.data(), static_cast<int>(gltfimage.image.size()), &w, &h, &comp, 4);
+                if (pixels) {
+                    memcpy(dst, pixels, dstSize);
+                    stbi_image_free(pixels);
+                    decoded = true;
+                }
+            } else if (upload.valid) {
+                // Already decoded by tinygltf, expand to 8 bit RGBA
+                const int component = gltfimage.component;
+                const int bytes = gltfimage.bits == 16 ? 2 : 1;
+                const uint8_t *src = gltfimage.image.data();
+                for (size_t p = 0; p < static_cast<size_t>(upload.width) * upload.height; p++) {
+                    for (int c = 0; c < 4; c++) {
+                        // Use the most significant byte of 16 bit channels, alpha defaults to opaque
+                        const int srcChannel = component > 2 ? c : (c < 3 ? 0 : 1);
+                        dst[p * 4 + c] = (c == 3 && component != 2 && component != 4) ? 255 :
+                            src[(p * component + srcChannel) * bytes + (bytes - 1)];
+                    }
+                }
+                decoded = true;
+            }
+            if (!decoded) {
+                memset(dst, 0xff, dstSize);
+            }
+            // The encoded data is not needed anymore, release it early to lower the peak memory
+            std::vector<unsigned char>().swap(gltfimage.image);
+        };
+
+        // Create the images, several textures may share the same source image
+        for (size_t t = 0; t < textureIndices.size(); t++) {
+            textures[textureIndices[t]].createImage(uploads[sources[t]].width, uploads[sources[t]].height, device);
+        }
+
+        // Record the copies and mip blits of a group into a few batches, each batch has its own pools so they are
+        // recorded in parallel. The copies go to the transfer family, the blits need the graphics family, both are
+        // the same pool without a dedicated transfer queue
+        xy::ThreadPool &pool = xy::ThreadPool::shared();
+        const bool dedicatedTransfer = device->dedicatedTransferQueue();
+        auto uploadGroup = [&](const std::vector<size_t> &groupTextureSlots, const xy::StagingRing::Region &staging) {
+            const size_t batchSize = std::max<size_t>(1, (groupTextureSlots.size() + pool.size() - 1) / pool.size());
+            const size_t batchCount = (groupTextureSlots.size() + batchSize - 1) / batchSize;
+            std::vector<VkCommandPool> commandPools(dedicatedTransfer ? batchCount * 2 : batchCount);
+            std::vector<VkCommandBuffer> copyCommandBuffers(batchCount);
+            std::vector<VkCommandBuffer> mipCommandBuffers(dedicatedTransfer ? batchCount : 0);
+            auto beginCommandBuffer = [&](size_t p, uint32_t queueFamilyIndex, VkCommandBuffer &commandBuffer) {
+                commandPools[p] = device->createCommandPool(queueFamilyIndex, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+                VkCommandBufferAllocateInfo cmdBufAllocateInfo{};
+                cmdBufAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                cmdBufAllocateInfo.commandPool = commandPools[p];
+                cmdBufAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+                cmdBufAllocateInfo.commandBufferCount = 1;
+                VK_CHECK_RESULT(vkAllocateCommandBuffers(device->logicalDevice, &cmdBufAllocateInfo, &commandBuffer));
+                device->beginCommandBuffer(commandBuffer);
+            };
+            pool.parallelFor(batchCount, [&](size_t b) {
+                beginCommandBuffer(b, device->queueFamilyIndices.transfer, copyCommandBuffers[b]);
+                VkCommandBuffer mipCmd = copyCommandBuffers[b];
+                if (dedicatedTransfer) {
+                    beginCommandBuffer(batchCount + b, device->queueFamilyIndices.graphics, mipCommandBuffers[b]);
+                    mipCmd = mipCommandBuffers[b];
+                }
+                for (size_t i = b * batchSize; i < std::min(groupTextureSlots.size(), (b + 1) * batchSize); i++) {
+                    const size_t t = groupTextureSlots[i];
+                    textures[textureIndices[t]].recordUpload(copyCommandBuffers[b], mipCmd, staging.buffer,
+                        staging.offset + uploads[sources[t]].offset);
+                }
+            });
+
+            device->flushUploadCommandBuffers(copyCommandBuffers, mipCommandBuffers, transferQueue);
+
+            for (auto commandPool : commandPools) {
+                vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
             }
+        };
 
-            skins.push_back(newSkin);
+        // The batch only holds the staging range of a group until its copies finished, the next group waits for it
+        // when the ring is full
+        xy::StagingRing::Batch batch(device, transferQueue);
+        for (size_t g = 0; g < groupSizes.size(); g++) {
+            xy::StagingRing::Region staging = batch.allocate(groupSizes[g]);
+            const size_t first = groupStarts[g];
+            pool.parallelFor(groupStarts[g + 1] - first, [&](size_t i) {
+                decodeImage(first + i, staging.data + uploads[first + i].offset);
+            });
+            uploadGroup(groupTextures[g], staging);
+            batch.submit();
         }
-    }
+        batch.flush();
 
-    void Model::loadTextures(tinygltf::Model &gltfModel, xy::VulkanDevice *device, VkQueue transferQueue)
-    {
-        for (tinygltf::Texture &tex : gltfModel.textures) {
-            tinygltf::Image image = gltfModel.images[tex.source];
+        for (uint32_t t : textureIndices) {
+            const tinygltf::Texture &tex = gltfModel.textures[t];
             vkglTF::TextureSampler textureSampler;
             if (tex.sampler == -1) {
                 // No sampler specified, use a default one
@@ -690,10 +1935,12 @@ namespace vkglTF
             else {
                 textureSampler = textureSamplers[tex.sampler];
             }
-            vkglTF::Texture texture;
-            texture.fromglTfImage(image, textureSampler, device, transferQueue);
-            textures.push_back(texture);
+            textures[t].createSamplerAndView(textureSampler);
         }
+
+        auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        LOGI("Loaded {} textures from {} images in {} staging groups on {} workers in {:.2f} ms", textureIndices.size(),
+            uploadImages.size(), groupSizes.size(), pool.size(), tDiff);
     }
 
     VkSamplerAddressMode Model::getVkWrapMode(int32_t wrapMode) 
@@ -856,11 +2103,10 @@ namespace vkglTF
                 {
                     const tinygltf::Accessor &accessor = gltfModel.accessors[samp.input];
                     const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-                    const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
 
                     assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
-                    const void *dataPtr = &buffer.data[accessor.byteOffset + bufferView.byteOffset];
+                    const void *dataPtr = bufferViewData(gltfModel, bufferView) + accessor.byteOffset;
                     const float *buf = static_cast<const float*>(dataPtr);
                     for (size_t index = 0; index < accessor.count; index++) {
                         sampler.inputs.push_back(buf[index]);
@@ -880,11 +2126,10 @@ namespace vkglTF
                 {
                     const tinygltf::Accessor &accessor = gltfModel.accessors[samp.output];
                     const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-                    const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
 
                     assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
-                    const void *dataPtr = &buffer.data[accessor.byteOffset + bufferView.byteOffset];
+                    const void *dataPtr = bufferViewData(gltfModel, bufferView) + accessor.byteOffset;
 
                     switch (accessor.type) {
                     case TINYGLTF_TYPE_VEC3: {
@@ -901,6 +2146,12 @@ namespace vkglTF
                         }
                         break;
                     }
+                    case TINYGLTF_TYPE_SCALAR: {
+                        // Morph target weights
+                        const float *buf = static_cast<const float*>(dataPtr);
+                        sampler.outputs.assign(buf, buf + accessor.count);
+                        break;
+                    }
                     default: {
                         LOGI("unknown type");
                         break;
@@ -908,6 +2159,15 @@ namespace vkglTF
                     }
                 }
 
+                // Samplers reading the same input accessor share the key lookup
+                sampler.timeline = static_cast<uint32_t>(animation.samplers.size());
+                for (size_t i = 0; i < animation.samplers.size(); i++) {
+                    if (anim.samplers[i].input == samp.input) {
+                        sampler.timeline = static_cast<uint32_t>(i);
+                        break;
+                    }
+                }
+
                 animation.samplers.push_back(sampler);
             }
 
@@ -925,40 +2185,154 @@ namespace vkglTF
                     channel.path = AnimationChannel::PathType::SCALE;
                 }
                 if (source.target_path == "weights") {
-                    LOGI("weights not yet supported, skipping channel");
-                    continue;
+                    channel.path = AnimationChannel::PathType::WEIGHTS;
                 }
                 channel.samplerIndex = source.sampler;
                 channel.node = nodeFromIndex(source.target_node);
                 if (!channel.node) {
                     continue;
                 }
+                // Weights need a mesh with morph targets to go to
+                if (channel.path == AnimationChannel::PathType::WEIGHTS &&
+                    (!channel.node->mesh || channel.node->mesh->morphWeights.empty())) {
+                    continue;
+                }
 
                 animation.channels.push_back(channel);
             }
 
+            animation.tracks.build(animation);
             animations.push_back(animation);
         }
+
+        size_t trackCount = 0;
+        size_t keyBytes = 0;
+        size_t sourceBytes = 0;
+        for (const Animation &animation : animations) {
+            trackCount += animation.tracks.size();
+            keyBytes += animation.tracks.keyBytes();
+            sourceBytes += animation.tracks.sourceBytes();
+        }
+        LOGI("Animations: {} tracks, keys compressed from {:.2f} KB to {:.2f} KB", trackCount,
+            sourceBytes / 1024.0, keyBytes / 1024.0);
+    }
+
+    /*
+        What the streaming job of a progressively loaded model keeps from loadFromFile
+    */
+    struct Model::StreamingSource {
+        tinygltf::Model gltfModel;
+        xy::MappedFile mappedFile;
+        VkQueue transferQueue = VK_NULL_HANDLE;
+        // Meshes without data with their glTF mesh, and their world space bounds in the initial pose
+        std::vector<std::pair<Mesh*, int>> meshes;
+        std::vector<BoundingBox> bounds;
+        std::chrono::high_resolution_clock::time_point start;
+        uint64_t cacheKey = 0;
+        std::string cacheFile;
+    };
+
+    // Constant attribute values read by the vertex streams a layout does not have
+    static const glm::vec4 vertexDefaults[2] = { glm::vec4(0.0f), glm::vec4(1.0f, 0.0f, 0.0f, 0.0f) };
+
+    /*
+        External buffers and images of a model, a change to any of them invalidates its cache file
+    */
+    static std::vector<std::string> cacheDependencies(const tinygltf::Model &gltfModel)
+    {
+        std::vector<std::string> dependencies;
+        for (const tinygltf::Buffer &buffer : gltfModel.buffers) {
+            if (!buffer.uri.empty() && buffer.uri.compare(0, 5, "data:") != 0) {
+                dependencies.push_back(buffer.uri);
+            }
+        }
+        for (const tinygltf::Image &image : gltfModel.images) {
+            if (!image.uri.empty() && image.uri.compare(0, 5, "data:") != 0) {
+                dependencies.push_back(image.uri);
+            }
+        }
+        return dependencies;
+    }
+
+    /*
+        Apparent size of the bounding sphere of a mesh seen from the viewpoint, larger and closer meshes come first
+    */
+    static float streamingPriority(const BoundingBox &bounds, const glm::vec3 &viewpoint)
+    {
+        if (!bounds.valid) {
+            return 0.0f;
+        }
+        const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+        const float radius = glm::length(bounds.max - bounds.min) * 0.5f;
+        const float distance = glm::length(center - viewpoint) - radius;
+        return radius / std::max(distance, 1e-4f);
     }
 
     void Model::loadFromFile(std::string filename, xy::VulkanDevice *device, VkQueue transferQueue, float scale)
     {
-        tinygltf::Model gltfModel;
+        // The parsed glTF and the mapped file outlive this call when the model is streamed in
+        auto source = std::make_shared<StreamingSource>();
+        tinygltf::Model &gltfModel = source->gltfModel;
         tinygltf::TinyGLTF gltfContext;
         std::string error;
         std::string warning;
 
+        auto tStart = std::chrono::high_resolution_clock::now();
+
         this->name   = filename;
         this->device = device;
+        this->vertexLayouts.clear();
+
+        // Processed models are cached by content, a hit skips parsing, decoding, conversion and mip generation
+        uint64_t cacheKey = 0;
+        std::string cacheFile;
+        if (!cacheDirectory.empty()) {
+            progress.set("Reading cache", 0.0f);
+            xy::MappedFile sourceFile;
+            if (sourceFile.open(filename)) {
+                cacheKey = ModelCache::key(sourceFile.data(), sourceFile.size(), vertexLayoutOptions);
+                cacheFile = ModelCache::path(cacheDirectory, cacheKey);
+            }
+            if (!cacheFile.empty() && ModelCache::load(*this, cacheFile, cacheKey, device, transferQueue)) {
+                return;
+            }
+        }
 
+        progress.set("Parsing", 0.05f);
         bool binary = false;
         size_t extpos = filename.rfind('.', filename.length());
         if (extpos != std::string::npos) {
             binary = (filename.substr(extpos + 1, filename.length() - extpos) == "glb");
         }
 
-        bool fileLoaded = binary ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, filename.c_str()) :
-            gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename.c_str());
+        // Keep the images encoded while parsing, they are decoded in parallel by loadTextures
+        gltfContext.SetImageLoader(deferImageDecode, nullptr);
+        // Same for Draco compressed primitives, decodeDracoPrimitives runs one task per primitive
+        gltfContext.SetDecodeDraco(false);
+
+        // Binary files are memory mapped and the accessors read the BIN chunk in place,
+        // so the only other full copy of the geometry is the one in the staging buffers
+        xy::MappedFile &mappedFile = source->mappedFile;
+        bool fileLoaded = false;
+        if (binary) {
+            if (!mappedFile.open(filename)) {
+                error = "Failed to map file: " + filename;
+            } else {
+                const unsigned char *chunk = glbBinaryChunk(mappedFile.data(), mappedFile.size());
+                bool inPlace = chunk != nullptr;
+                gltfContext.SetCopyBinaryChunk(!inPlace);
+                size_t sep = filename.find_last_of("/\\");
+                std::string baseDir = sep != std::string::npos ? filename.substr(0, sep) : "";
+                fileLoaded = gltfContext.LoadBinaryFromMemory(&gltfModel, &error, &warning, mappedFile.data(),
+                    mappedFile.size(), baseDir);
+                if (fileLoaded && inPlace) {
+                    binaryChunk = chunk;
+                    binaryChunkSize = static_cast<size_t>(mappedFile.data() + mappedFile.size() - chunk);
+                }
+            }
+        } else {
+            fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename.c_str());
+        }
         LOGI("{}  loaded.", filename);
 
         if (!error.empty()) {
@@ -967,8 +2341,13 @@ namespace vkglTF
         if (!warning.empty()) {
             LOGW("WARNING:{}", warning);
         }
-        std::vector<uint32_t> indexBuffer;
-        std::vector<Vertex> vertexBuffer;
+
+        // Geometry is converted straight into the staging ring, large models get buffers of their own
+        xy::StagingRing::Batch batch(device, transferQueue);
+        xy::StagingRing::Region vertexStaging, indexStaging;
+
+        size_t vertexBufferSize = 0;
+        size_t indexBufferSize = 0;
 
         if (fileLoaded) {
             //Read Asset message
@@ -976,18 +2355,97 @@ namespace vkglTF
             asset.generator  = gltfModel.asset.generator;
             asset.version    = gltfModel.asset.version;
             asset.minVersion = gltfModel.asset.minVersion;
+            progress.set("Decoding meshes", 0.2f);
+            decodeDracoPrimitives(gltfModel);
             //Load Texture and Meterials
+            progress.set("Loading textures", 0.3f);
             loadTextureSamplers(gltfModel);
-            loadTextures(gltfModel, device, transferQueue);
+            textures.resize(gltfModel.textures.size());
+            if (progressiveLoading) {
+                for (Texture &texture : textures) {
+                    texture.resident = false;
+                }
+            } else {
+                std::vector<uint32_t> textureIndices(textures.size());
+                for (size_t t = 0; t < textureIndices.size(); t++) {
+                    textureIndices[t] = static_cast<uint32_t>(t);
+                }
+                loadTextures(gltfModel, device, transferQueue, textureIndices);
+            }
             loadMaterials(gltfModel);
+            progress.set("Converting vertices", 0.6f);
             // TODO: scene handling with no default scene
             const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+
+            // Size the staging buffers up front so loadNode can write the vertices straight into them
+            LoaderInfo loaderInfo{};
+            loaderInfo.primitiveLayouts.resize(gltfModel.meshes.size());
+            loaderInfo.primitiveMorphTargets.resize(gltfModel.meshes.size());
+            loaderInfo.sharedMeshes.resize(gltfModel.meshes.size(), nullptr);
+            loaderInfo.sharedMeshCounted.resize(gltfModel.meshes.size(), false);
+            loaderInfo.nextNodeIndex = static_cast<uint32_t>(gltfModel.nodes.size());
+            size_t vertexCount = 0;
+            size_t indexCount = 0;
+            size_t narrowIndexCount = 0;
+            for (size_t i = 0; i < scene.nodes.size(); i++) {
+                getNodeProps(gltfModel.nodes[scene.nodes[i]], gltfModel, loaderInfo, vertexCount, indexCount, narrowIndexCount);
+            }
+            /*
+                Vertex buffer layout: the constant defaults read by absent attributes,
+                then the main and skin streams of every vertex layout
+            */
+            vertexBufferSize = VertexLayout::defaultsSize;
+            for (VertexLayout &layout : vertexLayouts) {
+                for (uint32_t b = 0; b < VertexLayout::BINDING_DEFAULTS; b++) {
+                    vertexBufferSize = (vertexBufferSize + 15) & ~static_cast<size_t>(15);
+                    layout.bufferOffsets[b] = vertexBufferSize;
+                    vertexBufferSize += layout.vertexCount * layout.strides[b];
+                }
+            }
+            loaderInfo.layoutVertexPos.resize(vertexLayouts.size(), 0);
+            indices.count = static_cast<int>(indexCount);
+            indices.narrowCount = static_cast<int>(narrowIndexCount);
+            indices.narrowOffset = indexCount * sizeof(uint32_t);
+            indexBufferSize = indices.size();
+            LOGI("Indices: {} 32-bit and {} 16-bit, {:.2f} KB saved by narrowing", indexCount, narrowIndexCount,
+                narrowIndexCount * sizeof(uint16_t) / 1024.0);
+
+            assert(vertexCount > 0);
+
+            // Streamed meshes are only placed here, their data goes through small staging buffers later
+            loaderInfo.deferGeometry = progressiveLoading;
+            if (!progressiveLoading) {
+                vertexStaging = batch.allocate(vertexBufferSize);
+                loaderInfo.vertexBuffer = vertexStaging.data;
+                memcpy(loaderInfo.vertexBuffer + VertexLayout::defaultsOffset, vertexDefaults, sizeof(vertexDefaults));
+                if (indexBufferSize > 0) {
+                    indexStaging = batch.allocate(indexBufferSize);
+                    loaderInfo.indexBuffer = indexStaging.data;
+                }
+            }
+
+            auto tNodes = std::chrono::high_resolution_clock::now();
             for (size_t i = 0; i < scene.nodes.size(); i++) {
-                const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
+                const tinygltf::Node &node = gltfModel.nodes[scene.nodes[i]];
                 LOGI("Begin loadNode {} ... {}", i, scene.nodes.size());
-                loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
+                loadNode(nullptr, node, scene.nodes[i], gltfModel, loaderInfo, scale);
+            }
+            auto tNodesEnd = std::chrono::high_resolution_clock::now();
+            LOGI("End loadNode {}, {} vertices converted in {:.2f} ms ({} kernels, {} vertex layouts, {:.1f} bytes per vertex)",
+                scene.nodes.size(), loaderInfo.vertexPos, std::chrono::duration<double, std::milli>(tNodesEnd - tNodes).count(),
+                streams::instructionSet(), vertexLayouts.size(),
+                static_cast<double>(vertexBufferSize) / static_cast<double>(std::max<size_t>(loaderInfo.vertexPos, 1)));
+
+            if (loaderInfo.sharedMeshCount > 0) {
+                LOGI("Shared geometry: {} meshes draw the vertices and indices of another node", loaderInfo.sharedMeshCount);
             }
-            LOGI("End loadNode {}", scene.nodes.size());
+            if (!morphTargets.empty()) {
+                LOGI("Morph targets: {} targets move {} vertices, {:.2f} KB of sparse deltas", morphTargets.size(),
+                    morphDeltas.size(), morphDeltas.size() * sizeof(MorphDelta) / 1024.0);
+            }
+
+            source->meshes = std::move(loaderInfo.deferredMeshes);
+
             if (gltfModel.animations.size() > 0) {
                 LOGI("Begin loadAnimations...");
                 loadAnimations(gltfModel);
@@ -995,16 +2453,14 @@ namespace vkglTF
             LOGI("Begin loadSkins...");
             loadSkins(gltfModel);
 
+            // Assign skins
             for (auto node : linearNodes) {
-                // Assign skins
                 if (node->skinIndex > -1) {
                     node->skin = skins[node->skinIndex];
                 }
-                // Initial pose
-                if (node->mesh) {
-                    node->update();
-                }
             }
+            // Initial pose
+            buildTransformHierarchy();
         }
         else {
             // TODO: throw
@@ -1012,44 +2468,24 @@ namespace vkglTF
             return;
         }
 
+        // Nothing but the streaming job reads from the mapped file past this point
+        if (!progressiveLoading) {
+            binaryChunk = nullptr;
+            binaryChunkSize = 0;
+            mappedFile.close();
+        }
+
         extensions = gltfModel.extensionsUsed;
         extensionsRequired = gltfModel.extensionsRequired;
 
-        size_t vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
-        size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
-        indices.count = static_cast<uint32_t>(indexBuffer.size());
-
-        assert(vertexBufferSize > 0);
-
-        struct StagingBuffer {
-            VkBuffer buffer;
-            VkDeviceMemory memory;
-        } vertexStaging, indexStaging;
-
-        // Create staging buffers
-        // Vertex data
-        VK_CHECK_RESULT(device->createBuffer(
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            vertexBufferSize,
-            &vertexStaging.buffer,
-            &vertexStaging.memory,
-            vertexBuffer.data()));
-        // Index data
-        if (indexBufferSize > 0) {
-            VK_CHECK_RESULT(device->createBuffer(
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                indexBufferSize,
-                &indexStaging.buffer,
-                &indexStaging.memory,
-                indexBuffer.data()));
-        }
-
-        // Create device local buffers
+        progress.set("Uploading geometry", 0.8f);
+        // Create device local buffers, the model cache reads them back
         // Vertex buffer
+        vertices.size = vertexBufferSize;
+        // The compute skinning reads the vertex streams as a storage buffer
         VK_CHECK_RESULT(device->createBuffer(
-            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             vertexBufferSize,
             &vertices.buffer,
@@ -1057,96 +2493,504 @@ namespace vkglTF
         // Index buffer
         if (indexBufferSize > 0) {
             VK_CHECK_RESULT(device->createBuffer(
-                VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                 indexBufferSize,
                 &indices.buffer,
                 &indices.memory));
         }
 
-        // Copy from staging buffers
-        VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        // Copy from the staging ring
+        VkCommandBuffer copyCmd = batch.commandBuffer();
 
-        VkBufferCopy copyRegion = {};
+        if (progressiveLoading) {
+            // Only the constant defaults exist yet, the meshes follow batch by batch
+            vkCmdUpdateBuffer(copyCmd, vertices.buffer, VertexLayout::defaultsOffset, sizeof(vertexDefaults), vertexDefaults);
+        } else {
+            VkBufferCopy copyRegion = {};
 
-        copyRegion.size = vertexBufferSize;
-        vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
+            copyRegion.srcOffset = vertexStaging.offset;
+            copyRegion.size = vertexBufferSize;
+            vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
 
-        if (indexBufferSize > 0) {
-            copyRegion.size = indexBufferSize;
-            vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
+            if (indexBufferSize > 0) {
+                copyRegion.srcOffset = indexStaging.offset;
+                copyRegion.size = indexBufferSize;
+                vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
+            }
         }
 
-        device->flushCommandBuffer(copyCmd, transferQueue, true);
+        batch.flush();
 
-        vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-        vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-        if (indexBufferSize > 0) {
-            vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-            vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+        getSceneDimensions();
+
+        if (progressiveLoading) {
+            // Bounds in the initial pose, the streaming order does not follow animations
+            for (const auto &mesh : source->meshes) {
+                BoundingBox bounds;
+                for (Node *node : linearNodes) {
+                    if (node->mesh == mesh.first && mesh.first->bb.valid) {
+                        bounds = mesh.first->bb.getAABB(transforms.worldMatrices[node->transform]);
+                        bounds.valid = true;
+                        break;
+                    }
+                }
+                source->bounds.push_back(bounds);
+            }
+            source->transferQueue = transferQueue;
+            source->start = tStart;
+            source->cacheKey = cacheKey;
+            source->cacheFile = cacheFile;
+            setStreamingViewpoint((dimensions.min + dimensions.max) * 0.5f);
+            LOGI("Placed {} with {} meshes to stream in {:.2f} ms", filename, source->meshes.size(),
+                std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count());
+
+            streamingCancelled = false;
+            auto job = std::make_shared<std::packaged_task<void()>>([this, source]() { streamResources(source); });
+            streamingDone = job->get_future();
+            xy::ThreadPool::shared().enqueue([job]() { (*job)(); });
+            return;
         }
 
-        getSceneDimensions();
+        const double loadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        LOGI("Loaded {} from source in {:.2f} ms", filename, loadTime);
+
+        if (!cacheFile.empty()) {
+            progress.set("Writing cache", 0.9f);
+            ModelCache::store(*this, cacheFile, cacheKey, cacheDependencies(gltfModel), loadTime, transferQueue);
+        }
+    }
+
+    void Model::streamResources(std::shared_ptr<StreamingSource> source)
+    {
+        // Meshes are converted and uploaded in batches of roughly this many bytes
+        const VkDeviceSize batchSize = 32 * 1024 * 1024;
+
+        tinygltf::Model &gltfModel = source->gltfModel;
+        const size_t meshCount = source->meshes.size();
+
+        std::vector<VkDeviceSize> meshSizes(meshCount, 0);
+        for (size_t m = 0; m < meshCount; m++) {
+            for (const Primitive *primitive : source->meshes[m].first->primitives) {
+                const VertexLayout &layout = vertexLayouts[primitive->layout];
+                meshSizes[m] += primitive->vertexCount * (layout.strides[VertexLayout::BINDING_MAIN] + layout.strides[VertexLayout::BINDING_SKIN]) +
+                    primitive->indexCount * primitive->indexSize();
+            }
+        }
+
+        // Textures sharing a source image are requested together, loadTextures releases the encoded image once decoded
+        std::vector<std::vector<uint32_t>> imageTextures(gltfModel.images.size());
+        for (size_t t = 0; t < gltfModel.textures.size(); t++) {
+            int image = gltfModel.textures[t].source;
+            if (image > -1 && image < static_cast<int>(imageTextures.size())) {
+                imageTextures[image].push_back(static_cast<uint32_t>(t));
+            }
+        }
+        std::vector<bool> textureRequested(textures.size(), false);
+        auto requestTexture = [&](const Texture *texture, std::vector<uint32_t> &requests) {
+            if (!texture) {
+                return;
+            }
+            const uint32_t t = static_cast<uint32_t>(texture - textures.data());
+            if (textureRequested[t]) {
+                return;
+            }
+            int image = gltfModel.textures[t].source;
+            if (image > -1 && image < static_cast<int>(imageTextures.size())) {
+                for (uint32_t shared : imageTextures[image]) {
+                    textureRequested[shared] = true;
+                    requests.push_back(shared);
+                }
+            } else {
+                textureRequested[t] = true;
+                requests.push_back(t);
+            }
+        };
+        auto publishTextures = [this](const std::vector<uint32_t> &loaded) {
+            std::lock_guard<std::mutex> lock(streamingUpdates.mutex);
+            streamingUpdates.textures.insert(streamingUpdates.textures.end(), loaded.begin(), loaded.end());
+        };
+
+        std::vector<size_t> remaining(meshCount);
+        for (size_t m = 0; m < meshCount; m++) {
+            remaining[m] = m;
+        }
+        std::vector<float> priorities(meshCount, 0.0f);
+        while (!remaining.empty() && !streamingCancelled) {
+            glm::vec3 viewpoint;
+            {
+                std::lock_guard<std::mutex> lock(streamingUpdates.mutex);
+                viewpoint = streamingUpdates.viewpoint;
+            }
+            // The viewpoint moves while streaming, so the order is decided again for every batch
+            for (size_t m : remaining) {
+                priorities[m] = streamingPriority(source->bounds[m], viewpoint);
+            }
+            std::sort(remaining.begin(), remaining.end(), [&priorities](size_t a, size_t b) { return priorities[a] < priorities[b]; });
+
+            // Take the most important meshes off the back, a batch holds at least one mesh however large
+            std::vector<std::pair<Mesh*, int>> batch;
+            VkDeviceSize size = 0;
+            while (!remaining.empty() && (batch.empty() || size + meshSizes[remaining.back()] <= batchSize)) {
+                batch.push_back(source->meshes[remaining.back()]);
+                size += meshSizes[remaining.back()];
+                remaining.pop_back();
+            }
+            uploadMeshes(gltfModel, batch, source->transferQueue);
+            {
+                std::lock_guard<std::mutex> lock(streamingUpdates.mutex);
+                for (const auto &mesh : batch) {
+                    streamingUpdates.meshes.push_back(mesh.first);
+                }
+            }
+
+            // Meshes are drawn with placeholder materials until their textures follow
+            std::vector<uint32_t> requests;
+            for (const auto &mesh : batch) {
+                for (const Primitive *primitive : mesh.first->primitives) {
+                    const Material &material = primitive->material;
+                    requestTexture(material.baseColorTexture, requests);
+                    requestTexture(material.metallicRoughnessTexture, requests);
+                    requestTexture(material.normalTexture, requests);
+                    requestTexture(material.occlusionTexture, requests);
+                    requestTexture(material.emissiveTexture, requests);
+                    requestTexture(material.extension.specularGlossinessTexture, requests);
+                    requestTexture(material.extension.diffuseTexture, requests);
+                }
+            }
+            loadTextures(gltfModel, device, source->transferQueue, requests);
+            publishTextures(requests);
+
+            progress.set("Streaming", static_cast<float>(meshCount - remaining.size()) / static_cast<float>(meshCount));
+        }
+
+        if (!streamingCancelled) {
+            // Textures no streamed mesh refers to
+            std::vector<uint32_t> requests;
+            for (size_t t = 0; t < textures.size(); t++) {
+                requestTexture(&textures[t], requests);
+            }
+            loadTextures(gltfModel, device, source->transferQueue, requests);
+            publishTextures(requests);
+        }
+
+        binaryChunk = nullptr;
+        binaryChunkSize = 0;
+        source->mappedFile.close();
+        if (streamingCancelled) {
+            return;
+        }
+
+        const double loadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - source->start).count();
+        LOGI("Streamed {} meshes and {} textures of {} in {:.2f} ms", meshCount, textures.size(), name, loadTime);
+
+        // Animations already move the nodes on the render thread, their current pose must not end up in the cache
+        if (!source->cacheFile.empty() && animations.empty()) {
+            ModelCache::store(*this, source->cacheFile, source->cacheKey, cacheDependencies(gltfModel), loadTime, source->transferQueue);
+        }
+        progress.set("Done", 1.0f);
+    }
+
+    void Model::uploadMeshes(const tinygltf::Model &gltfModel, const std::vector<std::pair<Mesh*, int>> &batch,
+        VkQueue transferQueue)
+    {
+        // Place the streams and indices of every primitive in the staging buffer, 16 byte aligned like the vertex buffer
+        struct PrimitiveUpload {
+            const tinygltf::Primitive *source;
+            const Primitive *target;
+            VkDeviceSize offsets[VertexLayout::BINDING_DEFAULTS];
+            VkDeviceSize indexOffset;
+        };
+        std::vector<PrimitiveUpload> uploads;
+        VkDeviceSize stagingSize = 0;
+        auto reserve = [&stagingSize](VkDeviceSize size) {
+            const VkDeviceSize offset = stagingSize;
+            stagingSize = (stagingSize + size + 15) & ~static_cast<VkDeviceSize>(15);
+            return offset;
+        };
+        for (const auto &mesh : batch) {
+            const tinygltf::Mesh &gltfMesh = gltfModel.meshes[mesh.second];
+            for (size_t p = 0; p < mesh.first->primitives.size(); p++) {
+                const Primitive *primitive = mesh.first->primitives[p];
+                const VertexLayout &layout = vertexLayouts[primitive->layout];
+                PrimitiveUpload upload{};
+                upload.source = &gltfMesh.primitives[p];
+                upload.target = primitive;
+                for (uint32_t b = 0; b < VertexLayout::BINDING_DEFAULTS; b++) {
+                    upload.offsets[b] = reserve(primitive->vertexCount * layout.strides[b]);
+                }
+                upload.indexOffset = reserve(primitive->indexCount * primitive->indexSize());
+                uploads.push_back(upload);
+            }
+        }
+        if (stagingSize == 0) {
+            return;
+        }
+
+        xy::StagingRing::Batch stagingBatch(device, transferQueue);
+        xy::StagingRing::Region staging = stagingBatch.allocate(stagingSize);
+        uint8_t *data = staging.data;
+
+        xy::ThreadPool::shared().parallelFor(uploads.size(), [&](size_t u) {
+            const PrimitiveUpload &upload = uploads[u];
+            loadPrimitiveData(gltfModel, *upload.source, *upload.target,
+                data + upload.offsets[VertexLayout::BINDING_MAIN], data + upload.offsets[VertexLayout::BINDING_SKIN],
+                data + upload.indexOffset);
+        });
+
+        std::vector<VkBufferCopy> vertexCopies;
+        std::vector<VkBufferCopy> indexCopies;
+        for (const PrimitiveUpload &upload : uploads) {
+            const Primitive &primitive = *upload.target;
+            const VertexLayout &layout = vertexLayouts[primitive.layout];
+            for (uint32_t b = 0; b < VertexLayout::BINDING_DEFAULTS; b++) {
+                const VkDeviceSize size = primitive.vertexCount * layout.strides[b];
+                if (size > 0) {
+                    vertexCopies.push_back({ staging.offset + upload.offsets[b],
+                        layout.bufferOffsets[b] + primitive.firstVertex * layout.strides[b], size });
+                }
+            }
+            if (primitive.indexCount > 0) {
+                indexCopies.push_back({ staging.offset + upload.indexOffset, indexOffset(primitive),
+                    primitive.indexCount * primitive.indexSize() });
+            }
+        }
+
+        VkCommandBuffer copyCmd = stagingBatch.commandBuffer();
+        if (!vertexCopies.empty()) {
+            vkCmdCopyBuffer(copyCmd, staging.buffer, vertices.buffer, static_cast<uint32_t>(vertexCopies.size()), vertexCopies.data());
+        }
+        if (!indexCopies.empty()) {
+            vkCmdCopyBuffer(copyCmd, staging.buffer, indices.buffer, static_cast<uint32_t>(indexCopies.size()), indexCopies.data());
+        }
+        // No barrier here, the copy queue may be transfer only: the frames drawing these meshes are submitted after
+        // the fence of this batch signaled, which submitUpload only signals once the copies finished
+        stagingBatch.flush();
+    }
+
+    void Model::stopStreaming()
+    {
+        if (!streamingDone.valid()) {
+            return;
+        }
+        streamingCancelled = true;
+        streamingDone.wait();
+        streamingDone = std::future<void>();
+        streamingCancelled = false;
+    }
+
+    void Model::setStreamingViewpoint(const glm::vec3 &position)
+    {
+        std::lock_guard<std::mutex> lock(streamingUpdates.mutex);
+        streamingUpdates.viewpoint = position;
+    }
+
+    bool Model::updateResidency()
+    {
+        std::vector<Mesh*> meshes;
+        std::vector<uint32_t> streamedTextures;
+        {
+            std::lock_guard<std::mutex> lock(streamingUpdates.mutex);
+            meshes.swap(streamingUpdates.meshes);
+            streamedTextures.swap(streamingUpdates.textures);
+        }
+        for (Mesh *mesh : meshes) {
+            mesh->resident = true;
+        }
+        // Nodes sharing the geometry of a streamed mesh are drawn from now on as well
+        if (!meshes.empty()) {
+            for (Node *node : linearNodes) {
+                if (node->mesh && node->mesh->geometry && node->mesh->geometry->resident) {
+                    node->mesh->resident = true;
+                }
+            }
+        }
+        for (uint32_t t : streamedTextures) {
+            textures[t].resident = true;
+        }
+        return !meshes.empty() || !streamedTextures.empty();
+    }
+
+    void Model::bindVertexBuffers(VkCommandBuffer commandBuffer, uint32_t layout)
+    {
+        const VertexLayout &vertexLayout = vertexLayouts[layout];
+        const VkBuffer buffers[VertexLayout::BINDING_COUNT] = { vertices.buffer, vertices.buffer, vertices.buffer };
+        // Unused streams point at the defaults, an empty region may start at the very end of the buffer
+        VkDeviceSize offsets[VertexLayout::BINDING_COUNT];
+        for (uint32_t b = 0; b < VertexLayout::BINDING_COUNT; b++) {
+            offsets[b] = (b < VertexLayout::BINDING_DEFAULTS && vertexLayout.strides[b] > 0) ?
+                vertexLayout.bufferOffsets[b] : VertexLayout::defaultsOffset;
+        }
+        vkCmdBindVertexBuffers(commandBuffer, 0, VertexLayout::BINDING_COUNT, buffers, offsets);
     }
 
-    void Model::drawNode(Node *node, VkCommandBuffer commandBuffer)
+    VkDeviceSize Model::indexOffset(const Primitive &primitive) const
     {
-        if (node->mesh) {
+        return (primitive.indexType == VK_INDEX_TYPE_UINT16 ? indices.narrowOffset : 0) +
+            static_cast<VkDeviceSize>(primitive.firstIndex) * primitive.indexSize();
+    }
+
+    void Model::bindIndexBuffer(VkCommandBuffer commandBuffer, VkIndexType indexType)
+    {
+        vkCmdBindIndexBuffer(commandBuffer, indices.buffer, indexType == VK_INDEX_TYPE_UINT16 ? indices.narrowOffset : 0, indexType);
+    }
+
+    void Model::drawNode(Node *node, VkCommandBuffer commandBuffer, uint32_t &boundLayout, VkIndexType &boundIndexType)
+    {
+        if (node->mesh && node->mesh->resident) {
             for (Primitive *primitive : node->mesh->primitives) {
-                vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+                if (primitive->vertexCount == 0) {
+                    continue;
+                }
+                if (primitive->layout != boundLayout) {
+                    bindVertexBuffers(commandBuffer, primitive->layout);
+                    boundLayout = primitive->layout;
+                }
+                if (primitive->hasIndices && primitive->indexType != boundIndexType) {
+                    bindIndexBuffer(commandBuffer, primitive->indexType);
+                    boundIndexType = primitive->indexType;
+                }
+                if (primitive->hasIndices) {
+                    vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, primitive->firstVertex, 0);
+                } else {
+                    vkCmdDraw(commandBuffer, primitive->vertexCount, 1, primitive->firstVertex, 0);
+                }
             }
         }
         for (auto& child : node->children) {
-            drawNode(child, commandBuffer);
+            drawNode(child, commandBuffer, boundLayout, boundIndexType);
         }
     }
 
     void Model::draw(VkCommandBuffer commandBuffer)
     {
-        const VkDeviceSize offsets[1] = { 0 };
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
-        vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+        uint32_t boundLayout = UINT32_MAX;
+        VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
         for (auto& node : nodes) {
-            drawNode(node, commandBuffer);
+            drawNode(node, commandBuffer, boundLayout, boundIndexType);
         }
     }
 
-    void Model::calculateBoundingBox(Node *node, Node *parent) {
-        BoundingBox parentBvh = parent ? parent->bvh : BoundingBox(dimensions.min, dimensions.max);
+    void Model::buildTransformHierarchy()
+    {
+        transforms.clear();
+        transformNodes.clear();
+        transforms.reserve(linearNodes.size());
+        transformNodes.reserve(linearNodes.size());
+
+        // Depth first without recursion, skeletons can be deep
+        std::vector<std::pair<Node*, int32_t>> stack;
+        for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+            stack.push_back({ *it, -1 });
+        }
+        while (!stack.empty()) {
+            const std::pair<Node*, int32_t> entry = stack.back();
+            stack.pop_back();
+            Node *node = entry.first;
+            node->transform = transforms.add(entry.second, node->translation, node->rotation, node->scale, node->matrix);
+            transformNodes.push_back(node);
+            for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+                stack.push_back({ *it, static_cast<int32_t>(node->transform) });
+            }
+        }
+        updateTransforms();
+    }
 
-        if (node->mesh) {
-            if (node->mesh->bb.valid) {
-                node->aabb = node->mesh->bb.getAABB(node->getMatrix());
-                if (node->children.size() == 0) {
-                    node->bvh.min = node->aabb.min;
-                    node->bvh.max = node->aabb.max;
-                    node->bvh.valid = true;
+    bool Model::updateTransforms()
+    {
+        if (!transforms.update()) {
+            return false;
+        }
+        const std::vector<uint8_t> &moved = transforms.moved;
+        for (Skin *skin : skins) {
+            bool jointsMoved = skin->jointMatrices.size() != skin->joints.size();
+            for (size_t i = 0; i < skin->joints.size() && !jointsMoved; i++) {
+                jointsMoved = moved[skin->joints[i]->transform] != 0;
+            }
+            if (!jointsMoved) {
+                continue;
+            }
+            skin->jointMatrices.resize(skin->joints.size());
+            for (size_t i = 0; i < skin->joints.size(); i++) {
+                const glm::mat4 &world = transforms.worldMatrices[skin->joints[i]->transform];
+                skin->jointMatrices[i] = i < skin->inverseBindMatrices.size() ? world * skin->inverseBindMatrices[i] : world;
+            }
+        }
+        for (Node *node : transformNodes) {
+            Mesh *mesh = node->mesh;
+            if (!mesh) {
+                continue;
+            }
+            const glm::mat4 &m = transforms.worldMatrices[node->transform];
+            if (node->skin) {
+                // Joints are not necessarily below the skinned node
+                const size_t numJoints = std::min((uint32_t)node->skin->joints.size(), MAX_NUM_JOINTS);
+                bool jointsMoved = moved[node->transform] != 0;
+                for (size_t i = 0; i < numJoints && !jointsMoved; i++) {
+                    jointsMoved = moved[node->skin->joints[i]->transform] != 0;
+                }
+                if (!jointsMoved) {
+                    continue;
+                }
+                mesh->uniformBlock.matrix = m;
+                const glm::mat4 inverseTransform = glm::inverse(m);
+                for (size_t i = 0; i < numJoints; i++) {
+                    const Node *jointNode = node->skin->joints[i];
+                    mesh->uniformBlock.jointMatrix[i] = inverseTransform * transforms.worldMatrices[jointNode->transform] *
+                        node->skin->inverseBindMatrices[i];
                 }
+                mesh->uniformBlock.jointcount = (float)numJoints;
+            } else if (moved[node->transform]) {
+                mesh->uniformBlock.matrix = m;
             }
         }
+        updateBounds();
+        return true;
+    }
 
-        parentBvh.min = glm::min(parentBvh.min, node->bvh.min);
-        parentBvh.max = glm::min(parentBvh.max, node->bvh.max);
+    void Model::updateBounds()
+    {
+        // Children come after their parents, walking backwards finishes every child before its parent
+        for (auto it = transformNodes.rbegin(); it != transformNodes.rend(); ++it) {
+            Node *node = *it;
+            node->aabb = BoundingBox();
+            node->bvh = BoundingBox();
+            if (node->mesh) {
+                if (node->mesh->bb.valid) {
+                    node->aabb = node->mesh->bb.getAABB(transforms.worldMatrices[node->transform]);
+                    node->aabb.valid = true;
+                }
+                node->bvh = (node->aabb.valid && !node->skin) ? node->aabb : BoundingBox(glm::vec3(-FLT_MAX), glm::vec3(FLT_MAX));
+                node->bvh.valid = true;
+            }
 
-        for (auto &child : node->children) {
-            calculateBoundingBox(child, node);
+            // The volume of a node encloses the volumes of all its children
+            for (auto &child : node->children) {
+                if (!child->bvh.valid) {
+                    continue;
+                }
+                if (node->bvh.valid) {
+                    node->bvh.min = glm::min(node->bvh.min, child->bvh.min);
+                    node->bvh.max = glm::max(node->bvh.max, child->bvh.max);
+                } else {
+                    node->bvh = child->bvh;
+                }
+            }
         }
     }
 
     void Model::getSceneDimensions()
     {
         // Calculate binary volume hierarchy for all nodes in the scene
-        for (auto node : linearNodes) {
-            calculateBoundingBox(node, nullptr);
-        }
+        updateBounds();
 
         dimensions.min = glm::vec3(FLT_MAX);
         dimensions.max = glm::vec3(-FLT_MAX);
 
         for (auto node : linearNodes) {
-            if (node->bvh.valid) {
-                dimensions.min = glm::min(dimensions.min, node->bvh.min);
-                dimensions.max = glm::max(dimensions.max, node->bvh.max);
+            if (node->aabb.valid) {
+                dimensions.min = glm::min(dimensions.min, node->aabb.min);
+                dimensions.max = glm::max(dimensions.max, node->aabb.max);
             }
         }
 
@@ -1157,6 +3001,69 @@ namespace vkglTF
         aabb[3][2] = dimensions.min[2];
     }
 
+    void AnimationSampler::findKey(float time)
+    {
+        active = inputs.size() >= 2 && time >= inputs.front() && time <= inputs.back();
+        if (!active) {
+            return;
+        }
+        const size_t last = inputs.size() - 2;
+        cursor = std::min(cursor, last);
+        if (time < inputs[cursor] || time > inputs[cursor + 1]) {
+            if (cursor < last && time >= inputs[cursor + 1] && time <= inputs[cursor + 2]) {
+                cursor++;
+            } else {
+                // First key after time, the interval ends there
+                const size_t next = std::upper_bound(inputs.begin(), inputs.end(), time) - inputs.begin();
+                cursor = std::min(next, last + 1) - 1;
+            }
+        }
+        const float duration = inputs[cursor + 1] - inputs[cursor];
+        u = duration > 0.0f ? std::min(std::max(0.0f, time - inputs[cursor]) / duration, 1.0f) : 0.0f;
+    }
+
+    bool AnimationSampler::sampleWeights(size_t cursor, float u, std::vector<float> &weights) const
+    {
+        // Outputs hold the weights of all targets per key, cubic splines with an in and out tangent around them
+        const size_t keyStride = interpolation == CUBICSPLINE ? 3 : 1;
+        const size_t keyCount = inputs.size();
+        if (keyCount < 2 || cursor + 1 >= keyCount || outputs.size() % (keyCount * keyStride) != 0) {
+            return false;
+        }
+        const size_t targetCount = outputs.size() / (keyCount * keyStride);
+        const size_t count = std::min(targetCount, weights.size());
+        const float *key0 = outputs.data() + cursor * keyStride * targetCount;
+        const float *key1 = key0 + keyStride * targetCount;
+        bool changed = false;
+        for (size_t t = 0; t < count; t++) {
+            float weight;
+            switch (interpolation) {
+            case STEP:
+                weight = key0[t];
+                break;
+            case CUBICSPLINE: {
+                // Hermite spline through the values, the tangents are scaled by the length of the interval
+                const float duration = inputs[cursor + 1] - inputs[cursor];
+                const float u2 = u * u;
+                const float u3 = u2 * u;
+                const float p0 = key0[targetCount + t];
+                const float m0 = key0[2 * targetCount + t] * duration;
+                const float p1 = key1[targetCount + t];
+                const float m1 = key1[t] * duration;
+                weight = (2.0f * u3 - 3.0f * u2 + 1.0f) * p0 + (u3 - 2.0f * u2 + u) * m0 +
+                    (-2.0f * u3 + 3.0f * u2) * p1 + (u3 - u2) * m1;
+                break;
+            }
+            default:
+                weight = key0[t] + (key1[t] - key0[t]) * u;
+                break;
+            }
+            changed |= weights[t] != weight;
+            weights[t] = weight;
+        }
+        return changed;
+    }
+
     void Model::updateAnimation(uint32_t index, float time) 
     {
         if (animations.empty()) {
@@ -1169,52 +3076,30 @@ namespace vkglTF
         }
         Animation &animation = animations[index];
 
-        bool updated = false;
-        for (auto& channel : animation.channels) {
-            vkglTF::AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
-            if (sampler.inputs.size() > sampler.outputsVec4.size()) {
-                continue;
+        for (size_t i = 0; i < animation.samplers.size(); i++) {
+            vkglTF::AnimationSampler &sampler = animation.samplers[i];
+            if (sampler.timeline == i) {
+                sampler.findKey(time);
             }
+        }
 
-            for (size_t i = 0; i < sampler.inputs.size() - 1; i++) {
-                if ((time >= sampler.inputs[i]) && (time <= sampler.inputs[i + 1])) {
-                    float u = std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]);
-                    if (u <= 1.0f) {
-                        switch (channel.path) {
-                        case vkglTF::AnimationChannel::PathType::TRANSLATION: {
-                            glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-                            channel.node->translation = glm::vec3(trans);
-                            break;
-                        }
-                        case vkglTF::AnimationChannel::PathType::SCALE: {
-                            glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-                            channel.node->scale = glm::vec3(trans);
-                            break;
-                        }
-                        case vkglTF::AnimationChannel::PathType::ROTATION: {
-                            glm::quat q1;
-                            q1.x = sampler.outputsVec4[i].x;
-                            q1.y = sampler.outputsVec4[i].y;
-                            q1.z = sampler.outputsVec4[i].z;
-                            q1.w = sampler.outputsVec4[i].w;
-                            glm::quat q2;
-                            q2.x = sampler.outputsVec4[i + 1].x;
-                            q2.y = sampler.outputsVec4[i + 1].y;
-                            q2.z = sampler.outputsVec4[i + 1].z;
-                            q2.w = sampler.outputsVec4[i + 1].w;
-                            channel.node->rotation = glm::normalize(glm::slerp(q1, q2, u));
-                            break;
-                        }
-                        }
-                        updated = true;
-                    }
-                }
+        animation.tracks.sample(animation, animationPose);
+        const bool updated = animation.tracks.apply(animation, animationPose, transforms);
+
+        // Morph target weights go straight to their mesh, the compute pass reads them with the next frame
+        for (const AnimationChannel &channel : animation.channels) {
+            if (channel.path != AnimationChannel::PathType::WEIGHTS) {
+                continue;
+            }
+            const AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
+            const AnimationSampler &timeline = animation.samplers[sampler.timeline];
+            if (timeline.active) {
+                sampler.sampleWeights(timeline.cursor, timeline.u, channel.node->mesh->morphWeights);
             }
         }
+        // Culling follows the animated nodes
         if (updated) {
-            for (auto &node : nodes) {
-                node->update();
-            }
+            updateTransforms();
         }
     }
 
@@ -10,11 +10,18 @@
 
 #pragma once
 
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "vulkan/vulkan.h"
 #include "vulkan/device.h"
+#include "vertexstreams.h"
+#include "transformhierarchy.h"
+#include "animationtracks.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -49,6 +56,24 @@ namespace vkglTF
         BoundingBox getAABB(glm::mat4 m);
     };
 
+    /*
+        View frustum as six planes facing inwards, extracted from the transform of a space to clip space
+        The near plane is the one of a -1..1 depth range, which keeps it conservative for 0..1
+    */
+    struct Frustum {
+        enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+        glm::vec4 planes[6];
+
+        Frustum() = default;
+        explicit Frustum(const glm::mat4 &clip);
+
+        /*
+            Test a box in the space the frustum was extracted for
+        */
+        Result test(const BoundingBox &box) const;
+    };
+
     /*
         glTF texture sampler
     */
@@ -64,16 +89,19 @@ namespace vkglTF
         glTF texture loading class
     */
     struct Texture {
-        xy::VulkanDevice *device;
-        VkImage image;
+        xy::VulkanDevice *device = nullptr;
+        VkImage image = VK_NULL_HANDLE;
         VkImageLayout imageLayout;
-        VkDeviceMemory deviceMemory;
-        VkImageView view;
+        xy::Allocation deviceMemory;
+        VkImageView view = VK_NULL_HANDLE;
         uint32_t width, height;
         uint32_t mipLevels;
         uint32_t layerCount;
         VkDescriptorImageInfo descriptor;
-        VkSampler sampler;
+        VkSampler sampler = VK_NULL_HANDLE;
+        TextureSampler textureSampler;
+        // Owned by the render thread, false until a progressively loaded texture has been uploaded
+        bool resident = true;
 
         void updateDescriptor();
 
@@ -85,6 +113,39 @@ namespace vkglTF
         */
         void fromglTfImage(tinygltf::Image &gltfimage, TextureSampler textureSampler,
             xy::VulkanDevice *device, VkQueue copyQueue);
+
+        /*
+            Create the RGBA8 image with room for the full mip chain, no data is uploaded yet
+        */
+        void createImage(uint32_t width, uint32_t height, xy::VulkanDevice *device);
+
+        /*
+            Record the copy of the base level from a staging buffer into copyCmd of the transfer family and the blits
+            generating the mip chain into mipCmd of the graphics family, which acquires the base level first,
+            the image ends up in SHADER_READ_ONLY_OPTIMAL layout once both command buffers have executed
+        */
+        void recordUpload(VkCommandBuffer copyCmd, VkCommandBuffer mipCmd, VkBuffer stagingBuffer, VkDeviceSize stagingOffset);
+
+        /*
+            Size of the RGBA8 mip chain with all levels tightly packed one after another
+        */
+        VkDeviceSize mipChainSize() const;
+
+        /*
+            Record the copy of a complete, tightly packed mip chain from a staging buffer into copyCmd of the transfer family,
+            acquireCmd of the graphics family takes the image over in SHADER_READ_ONLY_OPTIMAL layout
+        */
+        void recordUploadMipChain(VkCommandBuffer copyCmd, VkCommandBuffer acquireCmd, VkBuffer stagingBuffer, VkDeviceSize stagingOffset);
+
+        /*
+            Record the copy of the complete mip chain into a buffer, the image is back in SHADER_READ_ONLY_OPTIMAL afterwards
+        */
+        void recordReadback(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset) const;
+
+        /*
+            Create the sampler and image view and fill in the descriptor
+        */
+        void createSamplerAndView(TextureSampler textureSampler);
     };
 
     /*
@@ -124,6 +185,77 @@ namespace vkglTF
         VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
     };
 
+    /*
+        Options for the vertex layouts chosen by the loader, quantized accessors are always kept as they are
+    */
+    struct VertexLayoutOptions {
+        // Float normals as 4 x snorm16
+        bool compactNormals = true;
+        // Normals as 2 x snorm16 octahedral, needs pbr.vert built with the OCTAHEDRAL_NORMALS constant
+        bool octahedralNormals = false;
+        // Float texture coordinates as unorm16 when inside [0, 1], half float otherwise
+        bool compactTexCoords = true;
+        // u8 joints where the indices allow it and unorm16 weights
+        bool compactSkin = true;
+        // Joints and weights in their own vertex stream
+        bool separateSkinStream = true;
+        // 16-bit indices for primitives with at most 65536 vertices
+        bool narrowIndices = true;
+    };
+
+    /*
+        Vertex attribute layout of a primitive
+        The attributes are fed to the same float shader inputs, integer encodings are expanded by the vertex fetch
+        Missing attributes read constant defaults through a zero stride binding
+    */
+    struct VertexLayout {
+        enum Attribute { POSITION, NORMAL, UV0, UV1, JOINT0, WEIGHT0, ATTRIBUTE_COUNT };
+
+        enum Binding { BINDING_MAIN, BINDING_SKIN, BINDING_DEFAULTS, BINDING_COUNT };
+
+        struct AttributeFormat {
+            bool present = false;
+            streams::Encoding encoding = streams::Encoding::FLOAT32;
+            uint32_t binding = BINDING_MAIN;
+            uint32_t offset = 0;
+        };
+
+        AttributeFormat attributes[ATTRIBUTE_COUNT];
+        uint32_t strides[BINDING_COUNT] = {};
+
+        // Where the streams of this layout start in the model vertex buffer and how many vertices they hold
+        VkDeviceSize bufferOffsets[BINDING_DEFAULTS] = {};
+        uint32_t vertexCount = 0;
+
+        static const uint32_t componentCounts[ATTRIBUTE_COUNT];
+
+        // Byte offsets of the constant defaults at the start of the vertex buffer
+        static const uint32_t defaultsOffset = 0;
+        static const uint32_t defaultWeightOffset = 16;
+        static const uint32_t defaultsSize = 32;
+
+        /*
+            Assign the bindings and offsets of the present attributes and compute the strides
+        */
+        void finalize(bool separateSkinStream);
+
+        /*
+            Bytes taken by one attribute, padded to 4 bytes as required by glTF for vertex attributes
+        */
+        uint32_t attributeSize(Attribute attribute) const;
+
+        VkFormat format(Attribute attribute) const;
+
+        /*
+            Two layouts can share a pipeline and vertex buffer region when their encodings match
+        */
+        bool sameFormat(const VertexLayout &other) const;
+
+        std::vector<VkVertexInputBindingDescription> inputBindings() const;
+
+        std::vector<VkVertexInputAttributeDescription> inputAttributes() const;
+    };
+
     /*
         glTF primitive
     */
@@ -133,6 +265,14 @@ namespace vkglTF
         uint32_t vertexCount;
         Material &material;
         bool hasIndices;
+        // Vertex layout and first vertex inside the vertex streams of that layout
+        uint32_t layout = 0;
+        uint32_t firstVertex = 0;
+        // Indices are relative to firstVertex, firstIndex counts from the start of the index region of this type
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+        // Morph targets of the primitive in Model::morphTargets, in the order of the weights of the mesh
+        uint32_t firstMorphTarget = 0;
+        uint32_t morphTargetCount = 0;
 
         BoundingBox bb;
 
@@ -140,40 +280,66 @@ namespace vkglTF
             Material &material);
 
         void setBoundingBox(glm::vec3 min, glm::vec3 max);
+
+        uint32_t indexSize() const { return indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4; }
     };
 
     /*
         glTF mesh
     */
     struct Mesh {
-        xy::VulkanDevice *device;
-
         std::vector<Primitive*> primitives;
 
+        // Owned by the render thread, false until the vertices and indices of a progressively loaded mesh are uploaded
+        bool resident = true;
+        // Mesh of another node whose vertices and indices this one draws, it becomes resident together with it
+        Mesh *geometry = nullptr;
+
         BoundingBox bb;
         BoundingBox aabb;
 
-        struct UniformBuffer {
-            VkBuffer buffer;
-            VkDeviceMemory memory;
-            VkDescriptorBufferInfo descriptor;
-            VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-            void *mapped;
-        } uniformBuffer;
+        // Byte offset of the matrices of the mesh in the node arena of the renderer, set by the renderer
+        uint32_t uniformOffset = 0;
 
+        // Weight of every morph target of the primitives, from the node or the mesh and animated by weight channels
+        std::vector<float> morphWeights;
+
+        /*
+            Node and joint matrices written by Node::update, the renderer copies them into the buffers of a frame
+            once the frame is no longer in flight
+        */
         struct UniformBlock {
             glm::mat4 matrix;
             glm::mat4 jointMatrix[MAX_NUM_JOINTS]{};
             float jointcount { 0 };
         } uniformBlock;
 
-        Mesh(xy::VulkanDevice *device, glm::mat4 matrix);
+        Mesh(glm::mat4 matrix);
 
         ~Mesh();
 
         void setBoundingBox(glm::vec3 min, glm::vec3 max);
     };
 
+    /*
+        Morph target of a primitive, only the vertices it moves are stored as deltas in Model::morphDeltas
+    */
+    struct MorphTarget {
+        uint32_t firstDelta;
+        uint32_t deltaCount;
+    };
+
+    /*
+        Displacement of one vertex by a morph target, the std430 layout of MorphDelta in skinning.comp
+        vertex is relative to the first vertex of the primitive, the deltas of a target are sorted by it
+    */
+    struct MorphDelta {
+        glm::vec3 position;
+        uint32_t vertex;
+        glm::vec3 normal;
+        float padding;
+    };
+
     /*
         glTF skin
     */
@@ -182,6 +348,11 @@ namespace vkglTF
         Node *skeletonRoot = nullptr;
         std::vector<glm::mat4> inverseBindMatrices;
         std::vector<Node*> joints;
+        /*
+            World matrix of every joint times its inverse bind matrix, written by Model::updateTransforms
+            Not limited to MAX_NUM_JOINTS, the compute skinning reads all of them
+        */
+        std::vector<glm::mat4> jointMatrices;
     };
 
     /*
@@ -197,18 +368,15 @@ namespace vkglTF
         Mesh *mesh;
         Skin *skin;
         int32_t skinIndex = -1;
+        // Transform as loaded, the current pose is in the transform hierarchy of the model at slot transform
         glm::vec3 translation{};
         glm::vec3 scale{ 1.0f };
         glm::quat rotation{};
+        uint32_t transform = 0;
+        // Model space bounds of the node with all its descendants and of its mesh
         BoundingBox bvh;
         BoundingBox aabb;
 
-        glm::mat4 localMatrix();
-
-        glm::mat4 getMatrix();
-
-        void update();
-
         ~Node();
     };
 
@@ -216,7 +384,7 @@ namespace vkglTF
         glTF animation channel
     */
     struct AnimationChannel {
-        enum PathType { TRANSLATION, ROTATION, SCALE };
+        enum PathType { TRANSLATION, ROTATION, SCALE, WEIGHTS };
         PathType path;
         Node *node;
         uint32_t samplerIndex;
@@ -230,6 +398,27 @@ namespace vkglTF
         InterpolationType interpolation;
         std::vector<float> inputs;
         std::vector<glm::vec4> outputsVec4;
+        // Scalar outputs of morph target weights, one value per target and key, three with cubic splines
+        std::vector<float> outputs;
+        // First sampler of the animation with the same inputs, only that one looks up the key interval
+        uint32_t timeline = 0;
+        // Key interval of the last lookup and the position inside it, playback mostly stays in it or moves
+        // to the next one
+        size_t cursor = 0;
+        float u = 0.0f;
+        bool active = false;
+
+        /*
+            Find the interval of inputs containing time starting from the cached cursor, binary search when
+            time left the cursor and the interval after it, active is false when time is outside the inputs
+        */
+        void findKey(float time);
+
+        /*
+            Interpolate the weights of the key interval at cursor, u is the position inside it
+            Returns true when any weight changed
+        */
+        bool sampleWeights(size_t cursor, float u, std::vector<float> &weights) const;
     };
 
     /*
@@ -241,6 +430,8 @@ namespace vkglTF
         std::vector<AnimationChannel> channels;
         float start = std::numeric_limits<float>::max();
         float end = std::numeric_limits<float>::min();
+        // What updateAnimation samples, built from the samplers and channels
+        AnimationTracks tracks;
     };
 
     /*
@@ -252,6 +443,9 @@ namespace vkglTF
 
         xy::VulkanDevice *device;
 
+        /*
+            Vertex with every attribute stored as float, the largest vertex any layout can produce
+        */
         struct Vertex {
             glm::vec3 pos;
             glm::vec3 normal;
@@ -261,6 +455,47 @@ namespace vkglTF
             glm::vec4 weight0;
         };
 
+        VertexLayoutOptions vertexLayoutOptions;
+        std::vector<VertexLayout> vertexLayouts;
+
+        /*
+            Directory of the processed model cache, caching is disabled when empty
+        */
+        std::string cacheDirectory;
+
+        /*
+            Loading progress, written by the thread running loadFromFile and polled by the UI
+        */
+        struct LoadingProgress {
+            std::atomic<const char*> stage{"Waiting"};
+            std::atomic<float> fraction{0.0f};
+
+            void set(const char *stage, float fraction)
+            {
+                this->stage = stage;
+                this->fraction = fraction;
+            }
+        } progress;
+
+        /*
+            Progressive loading: loadFromFile returns as soon as the hierarchy, bounding boxes, materials and
+            animations are known, vertices, indices and textures are then streamed in by a background job
+            Meshes which look largest from the streaming viewpoint come first, updateResidency hands them to the renderer
+        */
+        bool progressiveLoading = false;
+
+        struct StreamingSource;
+
+        struct StreamingUpdates {
+            std::mutex mutex;
+            glm::vec3 viewpoint = glm::vec3(0.0f);
+            std::vector<Mesh*> meshes;
+            std::vector<uint32_t> textures;
+        } streamingUpdates;
+
+        std::future<void> streamingDone;
+        std::atomic<bool> streamingCancelled{false};
+
         struct {
             std::string copyright;
             std::string generator;
@@ -270,13 +505,21 @@ namespace vkglTF
 
         struct Vertices {
             VkBuffer buffer = VK_NULL_HANDLE;
-            VkDeviceMemory memory;
+            xy::Allocation memory;
+            VkDeviceSize size = 0;
         } vertices;
 
+        /*
+            One index buffer, the 32-bit indices first and then the 16-bit indices starting at narrowOffset
+        */
         struct Indices {
             int count;
+            int narrowCount = 0;
+            VkDeviceSize narrowOffset = 0;
             VkBuffer buffer = VK_NULL_HANDLE;
-            VkDeviceMemory memory;
+            xy::Allocation memory;
+
+            VkDeviceSize size() const { return narrowOffset + static_cast<VkDeviceSize>(narrowCount) * sizeof(uint16_t); }
         } indices;
 
         glm::mat4 aabb;
@@ -284,12 +527,22 @@ namespace vkglTF
         std::vector<Node*> nodes;
         std::vector<Node*> linearNodes;
 
+        // Current pose of the nodes, animations and edits go through it, transformNodes holds the node of each slot
+        TransformHierarchy transforms;
+        std::vector<Node*> transformNodes;
+
         std::vector<Skin*> skins;
 
+        // Morph targets of all primitives and the deltas of the vertices they move
+        std::vector<MorphTarget> morphTargets;
+        std::vector<MorphDelta> morphDeltas;
+
         std::vector<Texture> textures;
         std::vector<TextureSampler> textureSamplers;
         std::vector<Material> materials;
         std::vector<Animation> animations;
+        // Sampled by updateAnimation, kept to reuse its storage
+        AnimationTracks::Pose animationPose;
 
         std::vector<std::string> extensions;
         std::vector<std::string> extensionsRequired;
@@ -299,15 +552,117 @@ namespace vkglTF
             glm::vec3 max = glm::vec3(-FLT_MAX);
         } dimensions;
 
+        /*
+            Write cursors into the mapped vertex and index staging buffers while loading the nodes
+        */
+        struct LoaderInfo {
+            uint8_t *indexBuffer;
+            uint8_t *vertexBuffer;
+            // Indices written to the 32-bit and to the 16-bit region
+            size_t indexPos = 0;
+            size_t narrowIndexPos = 0;
+            size_t vertexPos = 0;
+            // Vertices written per vertex layout and the layout chosen for each primitive of each mesh
+            std::vector<uint32_t> layoutVertexPos;
+            std::vector<std::vector<uint32_t>> primitiveLayouts;
+            // Only place the primitives in the buffers, their data is streamed in later with their glTF mesh
+            bool deferGeometry = false;
+            std::vector<std::pair<Mesh*, int>> deferredMeshes;
+            // First morph target of each primitive of each glTF mesh, nodes sharing a mesh share its targets
+            std::vector<std::vector<uint32_t>> primitiveMorphTargets;
+            // Mesh which placed the geometry of each glTF mesh and whether getNodeProps counted it already
+            std::vector<Mesh*> sharedMeshes;
+            std::vector<bool> sharedMeshCounted;
+            size_t sharedMeshCount = 0;
+            // Index of the next node created for an instance of EXT_mesh_gpu_instancing, behind the glTF nodes
+            uint32_t nextNodeIndex = 0;
+        };
+
+        /*
+            BIN chunk of a memory mapped .glb, only valid during loadFromFile
+        */
+        const unsigned char *binaryChunk = nullptr;
+        size_t binaryChunkSize = 0;
+
         void destroy(VkDevice device);
 
+        /*
+            Start of the data of a buffer view, either from the tinygltf buffer or the mapped BIN chunk
+        */
+        const unsigned char *bufferViewData(const tinygltf::Model &model, const tinygltf::BufferView &bufferView);
+
+        /*
+            Whether bufferView is a valid index and byteSize bytes from byteOffset lie inside the view and its buffer
+        */
+        bool bufferViewContains(const tinygltf::Model &model, int bufferView, size_t byteOffset, size_t byteSize) const;
+
+        /*
+            Decode all KHR_draco_mesh_compression primitives in parallel and point their accessors at the results
+        */
+        void decodeDracoPrimitives(tinygltf::Model &gltfModel);
+
+        /*
+            Count the vertices and the 32-bit and 16-bit indices below a node and choose the vertex layouts of its primitives
+        */
+        void getNodeProps(const tinygltf::Node &node, const tinygltf::Model &model, LoaderInfo &loaderInfo,
+            size_t &vertexCount, size_t &indexCount, size_t &narrowIndexCount);
+
+        /*
+            Whether the indices of a primitive with this many vertices are stored as 16 bit
+        */
+        bool narrowIndexType(size_t vertexCount) const;
+
+        /*
+            Choose the most compact vertex layout for a primitive and return its index in vertexLayouts
+        */
+        uint32_t choosePrimitiveLayout(const tinygltf::Model &model, const tinygltf::Primitive &primitive);
+
+        /*
+            Bind the vertex streams of a layout to their bindings
+        */
+        void bindVertexBuffers(VkCommandBuffer commandBuffer, uint32_t layout);
+
         void loadNode(vkglTF::Node *parent, const tinygltf::Node &node, uint32_t nodeIndex,
-            const tinygltf::Model &model, std::vector<uint32_t>& indexBuffer,
-            std::vector<Vertex>& vertexBuffer, float globalscale);
+            const tinygltf::Model &model, LoaderInfo &loaderInfo, float globalscale);
+
+        /*
+            Create the mesh of a node, nodes without a skin drawing a mesh without morph targets share the geometry
+            placed by the first of them
+        */
+        Mesh *loadMesh(const tinygltf::Model &model, const tinygltf::Node &node, const glm::mat4 &matrix, LoaderInfo &loaderInfo);
+
+        /*
+            Convert the vertices and indices of a placed primitive into its vertex streams and index range
+        */
+        bool loadPrimitiveData(const tinygltf::Model &model, const tinygltf::Primitive &primitive, const Primitive &target,
+            uint8_t *mainStream, uint8_t *skinStream, uint8_t *indexDst);
+
+        /*
+            Load the morph targets of a primitive as sparse deltas and widen its bounds by them
+            Dense and sparse accessors are both read, only vertices a target moves are kept
+        */
+        void loadMorphTargets(const tinygltf::Model &model, const tinygltf::Primitive &primitive, Primitive &target,
+            uint32_t &firstMorphTarget);
+
+        /*
+            Byte offset of the first index of a primitive inside the index buffer
+        */
+        VkDeviceSize indexOffset(const Primitive &primitive) const;
+
+        /*
+            Bind the region of the index buffer holding indices of the given type
+        */
+        void bindIndexBuffer(VkCommandBuffer commandBuffer, VkIndexType indexType);
 
         void loadSkins(tinygltf::Model &gltfModel);
 
-        void loadTextures(tinygltf::Model &gltfModel, xy::VulkanDevice *device, VkQueue transferQueue);
+        /*
+            Decode the images on the worker pool and upload the listed textures with a few batched
+            command buffers, in groups of images the staging ring holds, one submission and fence per group
+            Textures sharing a source image have to be loaded together, the encoded image is released once decoded
+        */
+        void loadTextures(tinygltf::Model &gltfModel, xy::VulkanDevice *device, VkQueue transferQueue,
+            const std::vector<uint32_t> &textureIndices);
 
         VkSamplerAddressMode getVkWrapMode(int32_t wrapMode);
 
@@ -321,11 +676,55 @@ namespace vkglTF
 
         void loadFromFile(std::string filename, xy::VulkanDevice *device, VkQueue transferQueue, float scale = 1.0f);
 
-        void drawNode(Node *node, VkCommandBuffer commandBuffer);
+        /*
+            Body of the streaming job, uploads the deferred meshes batch by batch followed by their textures
+        */
+        void streamResources(std::shared_ptr<StreamingSource> source);
+
+        /*
+            Convert the meshes of one streaming batch into a staging buffer and copy them to their final place
+        */
+        void uploadMeshes(const tinygltf::Model &gltfModel, const std::vector<std::pair<Mesh*, int>> &batch,
+            VkQueue transferQueue);
+
+        /*
+            Cancel the streaming job and wait for it, the batch being uploaded is finished first
+        */
+        void stopStreaming();
+
+        /*
+            Position the streaming job prioritizes meshes for, in model space
+        */
+        void setStreamingViewpoint(const glm::vec3 &position);
+
+        /*
+            Mark the meshes and textures streamed in since the last call as resident, called by the render thread
+            Returns true when anything became resident, command buffers have to be recorded again then
+        */
+        bool updateResidency();
+
+        void drawNode(Node *node, VkCommandBuffer commandBuffer, uint32_t &boundLayout, VkIndexType &boundIndexType);
 
         void draw(VkCommandBuffer commandBuffer);
 
-        void calculateBoundingBox(Node *node, Node *parent);
+        /*
+            Flatten the node tree into the transform hierarchy, depth first from the scene roots, and apply the
+            loaded pose, skins have to be assigned before
+        */
+        void buildTransformHierarchy();
+
+        /*
+            Propagate the local transforms changed since the last call, update the matrices of the meshes below
+            moved nodes and the bounds
+            Returns true when any node moved
+        */
+        bool updateTransforms();
+
+        /*
+            Bounds of the node meshes and bounding volumes of the subtrees from the world matrices
+            Skinned meshes and meshes without bounds may be anywhere, the volumes containing them are unbounded
+        */
+        void updateBounds();
 
         void getSceneDimensions();
 
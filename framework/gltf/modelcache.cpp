@@ -0,0 +1,860 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Binary on-disk cache of fully processed glTF models
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include "modelcache.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+#include <unordered_map>
+
+#include "vulkan/macros.h"
+#include "logger.h"
+#include "mappedfile.h"
+
+namespace vkglTF
+{
+
+    /*
+        File layout: header, metadata stream, bulk data
+        The bulk data (vertices, indices and mip chains) starts 16 byte aligned so it can be copied
+        straight from the mapped file into the staging buffer
+    */
+    struct CacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint64_t metadataSize;
+        uint64_t blobOffset;
+        uint64_t blobSize;
+        double   coldLoadTime;
+    };
+
+    static const uint32_t cacheMagic = 0x43544c47;     // "GLTC"
+
+    /*
+        Range inside the bulk data
+    */
+    struct CacheBlob {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    class CacheWriter
+    {
+    public:
+        std::vector<uint8_t> bytes;
+
+        template <typename T>
+        void pod(const T &value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be written");
+            const uint8_t *src = reinterpret_cast<const uint8_t*>(&value);
+            bytes.insert(bytes.end(), src, src + sizeof(T));
+        }
+
+        template <typename T>
+        void array(const std::vector<T> &values)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be written");
+            pod(static_cast<uint32_t>(values.size()));
+            const uint8_t *src = reinterpret_cast<const uint8_t*>(values.data());
+            bytes.insert(bytes.end(), src, src + values.size() * sizeof(T));
+        }
+
+        void string(const std::string &value)
+        {
+            pod(static_cast<uint32_t>(value.size()));
+            bytes.insert(bytes.end(), value.begin(), value.end());
+        }
+
+        void boundingBox(const BoundingBox &bb)
+        {
+            pod(bb.min);
+            pod(bb.max);
+            pod(static_cast<uint8_t>(bb.valid));
+        }
+    };
+
+    /*
+        Bounds checked reader, any read past the end clears ok and returns zeroes
+    */
+    class CacheReader
+    {
+    private:
+        const uint8_t *cursor;
+        const uint8_t *end;
+
+    public:
+        bool ok = true;
+
+        CacheReader(const uint8_t *data, size_t size) : cursor(data), end(data + size) {}
+
+        template <typename T>
+        T pod()
+        {
+            T value{};
+            if (static_cast<size_t>(end - cursor) < sizeof(T)) {
+                ok = false;
+                return value;
+            }
+            memcpy(&value, cursor, sizeof(T));
+            cursor += sizeof(T);
+            return value;
+        }
+
+        template <typename T>
+        std::vector<T> array()
+        {
+            const uint32_t count = pod<uint32_t>();
+            if (static_cast<size_t>(end - cursor) / sizeof(T) < count) {
+                ok = false;
+                return {};
+            }
+            std::vector<T> values(count);
+            memcpy(values.data(), cursor, count * sizeof(T));
+            cursor += count * sizeof(T);
+            return values;
+        }
+
+        std::string string()
+        {
+            const uint32_t size = pod<uint32_t>();
+            if (static_cast<size_t>(end - cursor) < size) {
+                ok = false;
+                return {};
+            }
+            std::string value(reinterpret_cast<const char*>(cursor), size);
+            cursor += size;
+            return value;
+        }
+
+        BoundingBox boundingBox()
+        {
+            BoundingBox bb;
+            bb.min = pod<glm::vec3>();
+            bb.max = pod<glm::vec3>();
+            bb.valid = pod<uint8_t>() != 0;
+            return bb;
+        }
+    };
+
+    static inline uint64_t rotl64(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static inline uint64_t read64(const uint8_t *p)
+    {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    uint64_t ModelCache::hash(const uint8_t *data, size_t size, uint64_t seed)
+    {
+        const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+        const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+        const uint64_t prime3 = 0x165667B19E3779F9ull;
+
+        // Four independent lanes over 32 byte stripes keep the multipliers busy, hashing runs at memory speed
+        uint64_t lanes[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            for (int l = 0; l < 4; l++) {
+                lanes[l] = rotl64(lanes[l] + read64(data + i + l * 8) * prime2, 31) * prime1;
+            }
+        }
+        uint64_t h = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) + rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+        h += static_cast<uint64_t>(size);
+        for (; i + 8 <= size; i += 8) {
+            h ^= rotl64(read64(data + i) * prime2, 31) * prime1;
+            h = rotl64(h, 27) * prime1 + prime3;
+        }
+        for (; i < size; i++) {
+            h ^= data[i] * prime3;
+            h = rotl64(h, 11) * prime1;
+        }
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    uint64_t ModelCache::key(const uint8_t *data, size_t size, const VertexLayoutOptions &options)
+    {
+        const uint8_t flags[] = {
+            options.compactNormals, options.octahedralNormals, options.compactTexCoords,
+            options.compactSkin, options.separateSkinStream, options.narrowIndices
+        };
+        return hash(flags, sizeof(flags), hash(data, size, version));
+    }
+
+    std::string ModelCache::path(const std::string &directory, uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.gltfcache", static_cast<unsigned long long>(key));
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    static bool hashFile(const std::string &filename, uint64_t &fileHash)
+    {
+        xy::MappedFile file;
+        if (!file.open(filename)) {
+            return false;
+        }
+        fileHash = ModelCache::hash(file.data(), file.size());
+        return true;
+    }
+
+    static int32_t textureIndex(const Model &model, const Texture *texture)
+    {
+        return texture ? static_cast<int32_t>(texture - model.textures.data()) : -1;
+    }
+
+    bool ModelCache::store(const Model &model, const std::string &cacheFile, uint64_t key,
+        const std::vector<std::string> &dependencies, double coldLoadTime, VkQueue transferQueue)
+    {
+        auto tStart = std::chrono::high_resolution_clock::now();
+        xy::VulkanDevice *device = model.device;
+        const std::filesystem::path modelDir = std::filesystem::path(model.name).parent_path();
+
+        CacheWriter meta;
+
+        // External buffers and images, stored relative to the model so the cache survives moving both together
+        meta.pod(static_cast<uint32_t>(dependencies.size()));
+        for (const std::string &uri : dependencies) {
+            uint64_t fileHash;
+            if (!hashFile((modelDir / uri).string(), fileHash)) {
+                LOGW("Model cache not written, dependency {} could not be read", uri);
+                return false;
+            }
+            meta.string(uri);
+            meta.pod(fileHash);
+        }
+
+        meta.string(model.asset.copyright);
+        meta.string(model.asset.generator);
+        meta.string(model.asset.version);
+        meta.string(model.asset.minVersion);
+        meta.pod(static_cast<uint32_t>(model.extensions.size()));
+        for (const std::string &extension : model.extensions) {
+            meta.string(extension);
+        }
+        meta.pod(static_cast<uint32_t>(model.extensionsRequired.size()));
+        for (const std::string &extension : model.extensionsRequired) {
+            meta.string(extension);
+        }
+
+        // Bulk data
+        uint64_t blobSize = 0;
+        auto allocate = [&blobSize](uint64_t size) {
+            CacheBlob blob = { blobSize, size };
+            blobSize = (blobSize + size + 15) & ~static_cast<uint64_t>(15);
+            return blob;
+        };
+        const CacheBlob vertexBlob = allocate(model.vertices.size);
+        const CacheBlob indexBlob = allocate(model.indices.size());
+        std::vector<CacheBlob> textureBlobs;
+        for (const Texture &texture : model.textures) {
+            textureBlobs.push_back(allocate(texture.mipChainSize()));
+        }
+
+        meta.array(model.vertexLayouts);
+        meta.pod(vertexBlob);
+        meta.pod(indexBlob);
+        meta.pod(static_cast<int32_t>(model.indices.count));
+        meta.pod(static_cast<int32_t>(model.indices.narrowCount));
+
+        meta.array(model.textureSamplers);
+        meta.pod(static_cast<uint32_t>(model.textures.size()));
+        for (size_t t = 0; t < model.textures.size(); t++) {
+            const Texture &texture = model.textures[t];
+            meta.pod(texture.width);
+            meta.pod(texture.height);
+            meta.pod(texture.mipLevels);
+            meta.pod(texture.textureSampler);
+            meta.pod(textureBlobs[t]);
+        }
+
+        meta.pod(static_cast<uint32_t>(model.materials.size()));
+        for (const Material &material : model.materials) {
+            meta.pod(static_cast<int32_t>(material.alphaMode));
+            meta.pod(material.alphaCutoff);
+            meta.pod(material.metallicFactor);
+            meta.pod(material.roughnessFactor);
+            meta.pod(material.baseColorFactor);
+            meta.pod(material.emissiveFactor);
+            meta.pod(textureIndex(model, material.baseColorTexture));
+            meta.pod(textureIndex(model, material.metallicRoughnessTexture));
+            meta.pod(textureIndex(model, material.normalTexture));
+            meta.pod(textureIndex(model, material.occlusionTexture));
+            meta.pod(textureIndex(model, material.emissiveTexture));
+            meta.pod(textureIndex(model, material.extension.specularGlossinessTexture));
+            meta.pod(textureIndex(model, material.extension.diffuseTexture));
+            meta.pod(material.texCoordSets);
+            meta.pod(material.extension.diffuseFactor);
+            meta.pod(material.extension.specularFactor);
+            meta.pod(static_cast<uint8_t>(material.pbrWorkflows.metallicRoughness));
+            meta.pod(static_cast<uint8_t>(material.pbrWorkflows.specularGlossiness));
+        }
+
+        meta.array(model.morphTargets);
+        meta.array(model.morphDeltas);
+
+        // Nodes in linear order, children always come before their parent
+        std::unordered_map<const Node*, int32_t> linearIndices;
+        for (size_t i = 0; i < model.linearNodes.size(); i++) {
+            linearIndices[model.linearNodes[i]] = static_cast<int32_t>(i);
+        }
+        meta.pod(static_cast<uint32_t>(model.linearNodes.size()));
+        for (const Node *node : model.linearNodes) {
+            const int32_t parent = node->parent ? linearIndices[node->parent] : -1;
+            meta.pod(node->index);
+            meta.pod(parent);
+            meta.string(node->name);
+            meta.pod(node->skinIndex);
+            meta.pod(node->matrix);
+            meta.pod(node->translation);
+            meta.pod(node->scale);
+            meta.pod(node->rotation);
+            meta.pod(static_cast<uint8_t>(node->mesh != nullptr));
+            if (node->mesh) {
+                meta.boundingBox(node->mesh->bb);
+                meta.array(node->mesh->morphWeights);
+                meta.pod(static_cast<uint32_t>(node->mesh->primitives.size()));
+                for (const Primitive *primitive : node->mesh->primitives) {
+                    meta.pod(primitive->firstIndex);
+                    meta.pod(primitive->indexCount);
+                    meta.pod(primitive->vertexCount);
+                    meta.pod(static_cast<uint32_t>(&primitive->material - model.materials.data()));
+                    meta.pod(primitive->layout);
+                    meta.pod(primitive->firstVertex);
+                    meta.pod(static_cast<uint8_t>(primitive->indexType == VK_INDEX_TYPE_UINT16));
+                    meta.boundingBox(primitive->bb);
+                    meta.pod(primitive->firstMorphTarget);
+                    meta.pod(primitive->morphTargetCount);
+                }
+            }
+        }
+
+        meta.pod(static_cast<uint32_t>(model.skins.size()));
+        for (const Skin *skin : model.skins) {
+            meta.string(skin->name);
+            meta.pod(skin->skeletonRoot ? static_cast<int32_t>(skin->skeletonRoot->index) : -1);
+            meta.array(skin->inverseBindMatrices);
+            std::vector<uint32_t> joints;
+            for (const Node *joint : skin->joints) {
+                joints.push_back(joint->index);
+            }
+            meta.array(joints);
+        }
+
+        meta.pod(static_cast<uint32_t>(model.animations.size()));
+        for (const Animation &animation : model.animations) {
+            meta.string(animation.name);
+            meta.pod(animation.start);
+            meta.pod(animation.end);
+            meta.pod(static_cast<uint32_t>(animation.samplers.size()));
+            for (const AnimationSampler &sampler : animation.samplers) {
+                meta.pod(static_cast<int32_t>(sampler.interpolation));
+                meta.array(sampler.inputs);
+                meta.array(sampler.outputsVec4);
+                meta.array(sampler.outputs);
+                meta.pod(sampler.timeline);
+            }
+            meta.pod(static_cast<uint32_t>(animation.channels.size()));
+            for (const AnimationChannel &channel : animation.channels) {
+                meta.pod(static_cast<int32_t>(channel.path));
+                meta.pod(channel.node->index);
+                meta.pod(channel.samplerIndex);
+            }
+        }
+
+        // Read back what was uploaded, including the mip chains generated on the device
+        VkBuffer readbackBuffer;
+        xy::Allocation readbackMemory;
+        VK_CHECK_RESULT(device->createBuffer(
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            std::max<uint64_t>(blobSize, 16),
+            &readbackBuffer,
+            &readbackMemory));
+
+        VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        VkBufferCopy copyRegion = {};
+        copyRegion.dstOffset = vertexBlob.offset;
+        copyRegion.size = vertexBlob.size;
+        vkCmdCopyBuffer(copyCmd, model.vertices.buffer, readbackBuffer, 1, &copyRegion);
+        if (indexBlob.size > 0) {
+            copyRegion.dstOffset = indexBlob.offset;
+            copyRegion.size = indexBlob.size;
+            vkCmdCopyBuffer(copyCmd, model.indices.buffer, readbackBuffer, 1, &copyRegion);
+        }
+        for (size_t t = 0; t < model.textures.size(); t++) {
+            model.textures[t].recordReadback(copyCmd, readbackBuffer, textureBlobs[t].offset);
+        }
+        device->flushCommandBuffer(copyCmd, transferQueue, true);
+
+        const uint8_t *blobData = static_cast<const uint8_t *>(readbackMemory.mapped);
+
+        CacheHeader header{};
+        header.magic = cacheMagic;
+        header.version = version;
+        header.key = key;
+        header.metadataSize = meta.bytes.size();
+        header.blobOffset = (sizeof(CacheHeader) + meta.bytes.size() + 15) & ~static_cast<uint64_t>(15);
+        header.blobSize = blobSize;
+        header.coldLoadTime = coldLoadTime;
+
+        // Written under a temporary name and renamed, a reader never sees a partially written cache file
+        bool written = false;
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(cacheFile).parent_path(), ec);
+        const std::string tempFile = cacheFile + ".tmp";
+        {
+            std::ofstream os(tempFile, std::ios::binary | std::ios::trunc);
+            if (os) {
+                const char padding[16] = {};
+                os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                os.write(reinterpret_cast<const char*>(meta.bytes.data()), meta.bytes.size());
+                os.write(padding, header.blobOffset - sizeof(header) - meta.bytes.size());
+                os.write(reinterpret_cast<const char*>(blobData), blobSize);
+                written = os.good();
+            }
+        }
+        if (written) {
+            std::filesystem::rename(tempFile, cacheFile, ec);
+            written = !ec;
+        }
+        if (!written) {
+            std::filesystem::remove(tempFile, ec);
+            LOGW("Model cache {} could not be written", cacheFile);
+        }
+
+        device->destroyBuffer(readbackBuffer, readbackMemory);
+
+        if (written) {
+            auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+            LOGI("Model cache {} written, {} bytes in {:.2f} ms", cacheFile, header.blobOffset + blobSize, tDiff);
+        }
+        return written;
+    }
+
+    bool ModelCache::load(Model &model, const std::string &cacheFile, uint64_t key, xy::VulkanDevice *device,
+        VkQueue transferQueue)
+    {
+        auto tStart = std::chrono::high_resolution_clock::now();
+
+        xy::MappedFile file;
+        if (!file.open(cacheFile)) {
+            return false;
+        }
+        CacheHeader header{};
+        if (file.size() >= sizeof(header)) {
+            memcpy(&header, file.data(), sizeof(header));
+        }
+        if (header.magic != cacheMagic || header.version != version || header.key != key ||
+            header.blobOffset < sizeof(header) + header.metadataSize || header.blobOffset + header.blobSize != file.size()) {
+            LOGW("Model cache {} is not usable, loading from source", cacheFile);
+            return false;
+        }
+        const uint8_t *blobData = file.data() + header.blobOffset;
+        auto blobValid = [&header](const CacheBlob &blob) {
+            return blob.offset <= header.blobSize && blob.size <= header.blobSize - blob.offset;
+        };
+
+        CacheReader meta(file.data() + sizeof(header), header.metadataSize);
+        const std::filesystem::path modelDir = std::filesystem::path(model.name).parent_path();
+
+        const uint32_t dependencyCount = meta.pod<uint32_t>();
+        for (uint32_t i = 0; i < dependencyCount && meta.ok; i++) {
+            const std::string uri = meta.string();
+            const uint64_t storedHash = meta.pod<uint64_t>();
+            uint64_t fileHash = 0;
+            if (!hashFile((modelDir / uri).string(), fileHash) || fileHash != storedHash) {
+                LOGI("Model cache {} is stale, {} changed", cacheFile, uri);
+                return false;
+            }
+        }
+
+        model.asset.copyright = meta.string();
+        model.asset.generator = meta.string();
+        model.asset.version = meta.string();
+        model.asset.minVersion = meta.string();
+        model.extensions.resize(meta.pod<uint32_t>());
+        for (size_t i = 0; i < model.extensions.size() && meta.ok; i++) {
+            model.extensions[i] = meta.string();
+        }
+        model.extensionsRequired.resize(meta.pod<uint32_t>());
+        for (size_t i = 0; i < model.extensionsRequired.size() && meta.ok; i++) {
+            model.extensionsRequired[i] = meta.string();
+        }
+
+        model.vertexLayouts = meta.array<VertexLayout>();
+        const CacheBlob vertexBlob = meta.pod<CacheBlob>();
+        const CacheBlob indexBlob = meta.pod<CacheBlob>();
+        const int32_t indexCount = meta.pod<int32_t>();
+        const int32_t narrowIndexCount = meta.pod<int32_t>();
+        if (!meta.ok || !blobValid(vertexBlob) || !blobValid(indexBlob) || indexCount < 0 || narrowIndexCount < 0 ||
+            indexBlob.size != static_cast<uint64_t>(indexCount) * sizeof(uint32_t) + static_cast<uint64_t>(narrowIndexCount) * sizeof(uint16_t)) {
+            LOGW("Model cache {} is corrupt, loading from source", cacheFile);
+            return false;
+        }
+        // The layouts were chosen for the device which wrote the cache
+        for (const VertexLayout &layout : model.vertexLayouts) {
+            for (uint32_t a = 0; a < VertexLayout::ATTRIBUTE_COUNT; a++) {
+                VkFormatProperties properties;
+                vkGetPhysicalDeviceFormatProperties(device->physicalDevice, layout.format(static_cast<VertexLayout::Attribute>(a)), &properties);
+                if (!(properties.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT)) {
+                    LOGI("Model cache {} uses vertex formats this device can not fetch, loading from source", cacheFile);
+                    model.vertexLayouts.clear();
+                    return false;
+                }
+            }
+        }
+
+        model.textureSamplers = meta.array<TextureSampler>();
+        struct TextureRecord {
+            uint32_t width, height, mipLevels;
+            TextureSampler sampler;
+            CacheBlob blob;
+        };
+        std::vector<TextureRecord> textureRecords(meta.pod<uint32_t>());
+        for (TextureRecord &record : textureRecords) {
+            record.width = meta.pod<uint32_t>();
+            record.height = meta.pod<uint32_t>();
+            record.mipLevels = meta.pod<uint32_t>();
+            record.sampler = meta.pod<TextureSampler>();
+            record.blob = meta.pod<CacheBlob>();
+            if (!meta.ok || !blobValid(record.blob) || record.width == 0 || record.height == 0) {
+                meta.ok = false;
+                break;
+            }
+        }
+
+        // Texture pointers are resolved once the textures exist
+        std::vector<std::array<int32_t, 7>> materialTextures(meta.ok ? meta.pod<uint32_t>() : 0);
+        model.materials.resize(materialTextures.size());
+        for (size_t m = 0; m < model.materials.size() && meta.ok; m++) {
+            Material &material = model.materials[m];
+            material.alphaMode = static_cast<Material::AlphaMode>(meta.pod<int32_t>());
+            material.alphaCutoff = meta.pod<float>();
+            material.metallicFactor = meta.pod<float>();
+            material.roughnessFactor = meta.pod<float>();
+            material.baseColorFactor = meta.pod<glm::vec4>();
+            material.emissiveFactor = meta.pod<glm::vec4>();
+            for (int32_t &index : materialTextures[m]) {
+                index = meta.pod<int32_t>();
+                if (index < -1 || index >= static_cast<int32_t>(textureRecords.size())) {
+                    meta.ok = false;
+                }
+            }
+            material.texCoordSets = meta.pod<Material::TexCoordSets>();
+            material.extension.diffuseFactor = meta.pod<glm::vec4>();
+            material.extension.specularFactor = meta.pod<glm::vec3>();
+            material.pbrWorkflows.metallicRoughness = meta.pod<uint8_t>() != 0;
+            material.pbrWorkflows.specularGlossiness = meta.pod<uint8_t>() != 0;
+        }
+        if (!meta.ok || model.materials.empty()) {
+            LOGW("Model cache {} is corrupt, loading from source", cacheFile);
+            model.destroy(device->logicalDevice);
+            return false;
+        }
+
+        model.morphTargets = meta.array<MorphTarget>();
+        model.morphDeltas = meta.array<MorphDelta>();
+        for (const MorphTarget &target : model.morphTargets) {
+            if (static_cast<uint64_t>(target.firstDelta) + target.deltaCount > model.morphDeltas.size()) {
+                meta.ok = false;
+            }
+        }
+
+        // Nodes are linked once all of them exist, parents are stored after their children which also rules out cycles
+        std::vector<int32_t> parents(meta.pod<uint32_t>());
+        std::vector<Node*> linearNodes;
+        for (size_t i = 0; i < parents.size() && meta.ok; i++) {
+            Node *node = new Node{};
+            linearNodes.push_back(node);
+            node->index = meta.pod<uint32_t>();
+            parents[i] = meta.pod<int32_t>();
+            node->name = meta.string();
+            node->skinIndex = meta.pod<int32_t>();
+            node->matrix = meta.pod<glm::mat4>();
+            node->translation = meta.pod<glm::vec3>();
+            node->scale = meta.pod<glm::vec3>();
+            node->rotation = meta.pod<glm::quat>();
+            if (parents[i] < -1 || parents[i] >= static_cast<int32_t>(parents.size()) ||
+                (parents[i] > -1 && parents[i] <= static_cast<int32_t>(i))) {
+                meta.ok = false;
+            }
+            if (meta.pod<uint8_t>() && meta.ok) {
+                Mesh *mesh = new Mesh(node->matrix);
+                node->mesh = mesh;
+                mesh->bb = meta.boundingBox();
+                mesh->morphWeights = meta.array<float>();
+                const uint32_t primitiveCount = meta.pod<uint32_t>();
+                for (uint32_t p = 0; p < primitiveCount && meta.ok; p++) {
+                    const uint32_t firstIndex = meta.pod<uint32_t>();
+                    const uint32_t primitiveIndexCount = meta.pod<uint32_t>();
+                    const uint32_t vertexCount = meta.pod<uint32_t>();
+                    const uint32_t material = meta.pod<uint32_t>();
+                    const uint32_t layout = meta.pod<uint32_t>();
+                    const uint32_t firstVertex = meta.pod<uint32_t>();
+                    const bool narrowIndices = meta.pod<uint8_t>() != 0;
+                    const BoundingBox bb = meta.boundingBox();
+                    const uint32_t firstMorphTarget = meta.pod<uint32_t>();
+                    const uint32_t morphTargetCount = meta.pod<uint32_t>();
+                    if (!meta.ok || material >= model.materials.size() || layout >= model.vertexLayouts.size() ||
+                        static_cast<uint64_t>(firstMorphTarget) + morphTargetCount > model.morphTargets.size()) {
+                        meta.ok = false;
+                        break;
+                    }
+                    // Draws and indirect commands must stay inside the vertex and index data of the cache
+                    const VertexLayout &vertexLayout = model.vertexLayouts[layout];
+                    const uint64_t vertexEnd = static_cast<uint64_t>(firstVertex) + vertexCount;
+                    for (uint32_t b = 0; b < VertexLayout::BINDING_DEFAULTS; b++) {
+                        if (vertexLayout.strides[b] > 0 && (vertexLayout.bufferOffsets[b] > vertexBlob.size ||
+                                vertexEnd * vertexLayout.strides[b] > vertexBlob.size - vertexLayout.bufferOffsets[b])) {
+                            meta.ok = false;
+                        }
+                    }
+                    const uint64_t primitiveIndices = narrowIndices ? narrowIndexCount : indexCount;
+                    if (primitiveIndexCount > 0 && static_cast<uint64_t>(firstIndex) + primitiveIndexCount > primitiveIndices) {
+                        meta.ok = false;
+                    }
+                    if (!meta.ok) {
+                        break;
+                    }
+                    Primitive *primitive = new Primitive(firstIndex, primitiveIndexCount, vertexCount, model.materials[material]);
+                    primitive->layout = layout;
+                    primitive->firstVertex = firstVertex;
+                    primitive->indexType = narrowIndices ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+                    primitive->bb = bb;
+                    primitive->firstMorphTarget = firstMorphTarget;
+                    primitive->morphTargetCount = morphTargetCount;
+                    mesh->primitives.push_back(primitive);
+                }
+            }
+        }
+        if (!meta.ok) {
+            for (Node *node : linearNodes) {
+                delete node;
+            }
+            LOGW("Model cache {} is corrupt, loading from source", cacheFile);
+            model.destroy(device->logicalDevice);
+            return false;
+        }
+        for (size_t i = 0; i < linearNodes.size(); i++) {
+            Node *node = linearNodes[i];
+            if (parents[i] > -1) {
+                node->parent = linearNodes[parents[i]];
+                node->parent->children.push_back(node);
+            } else {
+                model.nodes.push_back(node);
+            }
+        }
+        model.linearNodes = linearNodes;
+
+        const uint32_t skinCount = meta.pod<uint32_t>();
+        for (uint32_t i = 0; i < skinCount && meta.ok; i++) {
+            Skin *skin = new Skin{};
+            model.skins.push_back(skin);
+            skin->name = meta.string();
+            const int32_t skeletonRoot = meta.pod<int32_t>();
+            if (skeletonRoot > -1) {
+                skin->skeletonRoot = model.nodeFromIndex(skeletonRoot);
+            }
+            skin->inverseBindMatrices = meta.array<glm::mat4>();
+            for (uint32_t joint : meta.array<uint32_t>()) {
+                Node *node = model.nodeFromIndex(joint);
+                if (node) {
+                    skin->joints.push_back(node);
+                }
+            }
+        }
+
+        model.animations.resize(meta.pod<uint32_t>());
+        for (size_t i = 0; i < model.animations.size() && meta.ok; i++) {
+            Animation &animation = model.animations[i];
+            animation.name = meta.string();
+            animation.start = meta.pod<float>();
+            animation.end = meta.pod<float>();
+            animation.samplers.resize(meta.pod<uint32_t>());
+            for (size_t s = 0; s < animation.samplers.size() && meta.ok; s++) {
+                AnimationSampler &sampler = animation.samplers[s];
+                const int32_t interpolation = meta.pod<int32_t>();
+                sampler.interpolation = static_cast<AnimationSampler::InterpolationType>(interpolation);
+                sampler.inputs = meta.array<float>();
+                sampler.outputsVec4 = meta.array<glm::vec4>();
+                sampler.outputs = meta.array<float>();
+                sampler.timeline = meta.pod<uint32_t>();
+                if (sampler.timeline > s || interpolation < AnimationSampler::LINEAR ||
+                    interpolation > AnimationSampler::CUBICSPLINE) {
+                    meta.ok = false;
+                    break;
+                }
+                // Every key needs an output, cubic splines also an in and out tangent
+                const size_t keyOutputs = sampler.inputs.size() *
+                    (sampler.interpolation == AnimationSampler::CUBICSPLINE ? 3 : 1);
+                if ((!sampler.outputsVec4.empty() && sampler.outputsVec4.size() < keyOutputs) ||
+                    (!sampler.outputs.empty() && sampler.outputs.size() < keyOutputs)) {
+                    meta.ok = false;
+                }
+            }
+            const uint32_t channelCount = meta.pod<uint32_t>();
+            for (uint32_t c = 0; c < channelCount && meta.ok; c++) {
+                AnimationChannel channel{};
+                const int32_t path = meta.pod<int32_t>();
+                channel.path = static_cast<AnimationChannel::PathType>(path);
+                channel.node = model.nodeFromIndex(meta.pod<uint32_t>());
+                channel.samplerIndex = meta.pod<uint32_t>();
+                if (!channel.node || channel.samplerIndex >= animation.samplers.size() ||
+                    path < AnimationChannel::PathType::TRANSLATION || path > AnimationChannel::PathType::WEIGHTS ||
+                    (channel.path == AnimationChannel::PathType::WEIGHTS && !channel.node->mesh)) {
+                    meta.ok = false;
+                    break;
+                }
+                // Weights read the scalar outputs of the sampler, translation, rotation and scale the vec4 ones
+                const AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
+                const size_t outputCount = channel.path == AnimationChannel::PathType::WEIGHTS ?
+                    sampler.outputs.size() : sampler.outputsVec4.size();
+                if (outputCount < sampler.inputs.size()) {
+                    meta.ok = false;
+                    break;
+                }
+                animation.channels.push_back(channel);
+            }
+            if (meta.ok) {
+                animation.tracks.build(animation);
+            }
+        }
+        for (Node *node : model.linearNodes) {
+            if (node->skinIndex >= static_cast<int32_t>(model.skins.size())) {
+                meta.ok = false;
+            }
+        }
+        if (!meta.ok) {
+            LOGW("Model cache {} is corrupt, loading from source", cacheFile);
+            model.destroy(device->logicalDevice);
+            return false;
+        }
+
+        // Everything the device needs goes through one staging buffer and one command buffer
+        const VkDeviceSize vertexOffset = 0;
+        const VkDeviceSize indexOffset = vertexBlob.size;
+        const VkDeviceSize textureOffset = (indexOffset + indexBlob.size + 15) & ~static_cast<VkDeviceSize>(15);
+        VkDeviceSize stagingSize = textureOffset;
+        std::vector<VkDeviceSize> textureOffsets(textureRecords.size());
+        model.textures.resize(textureRecords.size());
+        for (size_t t = 0; t < textureRecords.size(); t++) {
+            const TextureRecord &record = textureRecords[t];
+            Texture &texture = model.textures[t];
+            texture.createImage(record.width, record.height, device);
+            textureOffsets[t] = stagingSize;
+            stagingSize += (texture.mipChainSize() + 15) & ~static_cast<VkDeviceSize>(15);
+            if (texture.mipLevels != record.mipLevels || texture.mipChainSize() != record.blob.size) {
+                meta.ok = false;
+            }
+        }
+        if (!meta.ok) {
+            // createImage leaves the view and sampler empty, destroying null handles is fine
+            for (Texture &texture : model.textures) {
+                texture.view = VK_NULL_HANDLE;
+                texture.sampler = VK_NULL_HANDLE;
+            }
+            LOGW("Model cache {} is corrupt, loading from source", cacheFile);
+            model.destroy(device->logicalDevice);
+            return false;
+        }
+
+        xy::StagingRing::Batch batch(device, transferQueue);
+        xy::StagingRing::Region staging = batch.allocate(stagingSize);
+        uint8_t *stagingData = staging.data;
+        memcpy(stagingData + vertexOffset, blobData + vertexBlob.offset, vertexBlob.size);
+        memcpy(stagingData + indexOffset, blobData + indexBlob.offset, indexBlob.size);
+        for (size_t t = 0; t < textureRecords.size(); t++) {
+            memcpy(stagingData + textureOffsets[t], blobData + textureRecords[t].blob.offset, textureRecords[t].blob.size);
+        }
+
+        model.vertices.size = vertexBlob.size;
+        VK_CHECK_RESULT(device->createBuffer(
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            vertexBlob.size,
+            &model.vertices.buffer,
+            &model.vertices.memory));
+        model.indices.count = indexCount;
+        model.indices.narrowCount = narrowIndexCount;
+        model.indices.narrowOffset = static_cast<VkDeviceSize>(indexCount) * sizeof(uint32_t);
+        if (indexBlob.size > 0) {
+            VK_CHECK_RESULT(device->createBuffer(
+                VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                indexBlob.size,
+                &model.indices.buffer,
+                &model.indices.memory));
+        }
+
+        VkCommandBuffer copyCmd = batch.commandBuffer();
+        VkBufferCopy copyRegion = {};
+        copyRegion.srcOffset = staging.offset + vertexOffset;
+        copyRegion.size = vertexBlob.size;
+        vkCmdCopyBuffer(copyCmd, staging.buffer, model.vertices.buffer, 1, &copyRegion);
+        if (indexBlob.size > 0) {
+            copyRegion.srcOffset = staging.offset + indexOffset;
+            copyRegion.size = indexBlob.size;
+            vkCmdCopyBuffer(copyCmd, staging.buffer, model.indices.buffer, 1, &copyRegion);
+        }
+        for (size_t t = 0; t < model.textures.size(); t++) {
+            model.textures[t].recordUploadMipChain(copyCmd, batch.graphicsCommandBuffer(), staging.buffer, staging.offset + textureOffsets[t]);
+        }
+        batch.flush();
+
+        for (size_t t = 0; t < model.textures.size(); t++) {
+            model.textures[t].createSamplerAndView(textureRecords[t].sampler);
+        }
+        Texture *textures = model.textures.data();
+        auto texture = [textures](int32_t index) { return index > -1 ? &textures[index] : nullptr; };
+        for (size_t m = 0; m < model.materials.size(); m++) {
+            Material &material = model.materials[m];
+            material.baseColorTexture = texture(materialTextures[m][0]);
+            material.metallicRoughnessTexture = texture(materialTextures[m][1]);
+            material.normalTexture = texture(materialTextures[m][2]);
+            material.occlusionTexture = texture(materialTextures[m][3]);
+            material.emissiveTexture = texture(materialTextures[m][4]);
+            material.extension.specularGlossinessTexture = texture(materialTextures[m][5]);
+            material.extension.diffuseTexture = texture(materialTextures[m][6]);
+        }
+
+        // Assign skins
+        for (Node *node : model.linearNodes) {
+            if (node->skinIndex > -1) {
+                node->skin = model.skins[node->skinIndex];
+            }
+        }
+        // Initial pose
+        model.buildTransformHierarchy();
+        model.getSceneDimensions();
+
+        auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        LOGI("Loaded {} from cache in {:.2f} ms, loading from source took {:.2f} ms ({:.1f}x)", model.name, tDiff,
+            header.coldLoadTime, header.coldLoadTime / std::max(tDiff, 0.001));
+        return true;
+    }
+
+}
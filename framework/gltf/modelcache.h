@@ -0,0 +1,57 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Binary on-disk cache of fully processed glTF models
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "model.h"
+
+namespace vkglTF
+{
+
+    /*
+        A cache file holds everything loadFromFile produces: the final vertex and index blobs, vertex layouts,
+        node hierarchy, materials, morph targets, skins, animations and the complete mip chain of every texture
+        Files are named after a hash of the model content, so renamed or copied models still hit the cache
+        and edited models miss it, external buffers and images are checked against the hashes stored inside
+    */
+    class ModelCache
+    {
+    public:
+        // Bump whenever the file layout or the processing done by the loader changes
+        static const uint32_t version = 5;
+
+        static uint64_t hash(const uint8_t *data, size_t size, uint64_t seed = 0);
+
+        /*
+            Cache key of a model: hash of the file content, the cache version and the loader options
+        */
+        static uint64_t key(const uint8_t *data, size_t size, const VertexLayoutOptions &options);
+
+        static std::string path(const std::string &directory, uint64_t key);
+
+        /*
+            Fill an empty model from a cache file
+            Returns false when the file is missing, stale or can not be used on this device, the model is left empty then
+        */
+        static bool load(Model &model, const std::string &cacheFile, uint64_t key, xy::VulkanDevice *device,
+            VkQueue transferQueue);
+
+        /*
+            Write a loaded model, the buffers and textures are read back from the device so the file holds
+            exactly what was uploaded, dependencies are the external files the model was built from
+        */
+        static bool store(const Model &model, const std::string &cacheFile, uint64_t key,
+            const std::vector<std::string> &dependencies, double coldLoadTime, VkQueue transferQueue);
+    };
+
+}
@@ -10,6 +10,10 @@
 
 #include "gltf/render.h"
 
+#include <algorithm>
+#include <chrono>
+#include <tuple>
+
 #include "logger.h"
 #include "gltf/model.h"
 #include "vulkan/utils.h"
@@ -18,6 +22,23 @@
 namespace xy
 {
 
+    // Textures still being streamed in are drawn as if the material had none
+    static const vkglTF::Texture *residentTexture(const vkglTF::Texture *texture)
+    {
+        return (texture && texture->resident) ? texture : nullptr;
+    }
+
+    static bool materialResident(const vkglTF::Material &material)
+    {
+        for (const vkglTF::Texture *texture : { material.baseColorTexture, material.metallicRoughnessTexture, material.normalTexture,
+            material.occlusionTexture, material.emissiveTexture, material.extension.specularGlossinessTexture, material.extension.diffuseTexture }) {
+            if (texture && !texture->resident) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     GLTFRender::GLTFRender(VulkanDevice *vulkanDevice, uint32_t frameBufferCount, VkRenderPass renderPass,
         VkQueue queue, VkPipelineCache pipelineCache, VkSampleCountFlagBits multiSampleCount, Textures *textures,
         Camera *camera, std::vector<Buffer> *uniformBufferParams)
@@ -33,6 +54,11 @@ namespace xy
         this->camera                = camera;
         this->uniformBufferParams   = uniformBufferParams;
 
+        // Processed models are kept next to the other assets, reopening a model skips the glTF parsing
+        scene.cacheDirectory = "./../data/cache";
+        // Large scenes show up while their geometry and textures are still streaming in
+        scene.progressiveLoading = true;
+
         uniformBuffers.resize(frameBufferCount);
         descriptorSets.resize(frameBufferCount);
 
@@ -41,13 +67,14 @@ namespace xy
 
     GLTFRender::~GLTFRender()
     {
-        vkDestroyPipeline(device, pipelines.pbr, nullptr);
-        vkDestroyPipeline(device, pipelines.pbrAlphaBlend, nullptr);
+        destroyPipelines();
 
         vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
         vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.scene, nullptr);
         vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.material, nullptr);
         vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.node, nullptr);
+        vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.cull, nullptr);
 
         scene.destroy(device);
 
@@ -56,7 +83,21 @@ namespace xy
 
         for (auto buffer : uniformBuffers) {
             buffer.scene.destroy();
+            buffer.materials.destroy();
+            buffer.nodes.destroy();
         }
+        for (auto &frame : indirectFrames) {
+            frame.transforms.destroy();
+            frame.commands.destroy();
+            frame.instances.destroy();
+            frame.cull.destroy();
+            frame.stats.destroy();
+        }
+        drawData.destroy();
+        drawBounds.destroy();
+        drawVisibility.destroy();
+        depthPyramid.destroy();
+        skinning.destroy();
 
         uniformBuffers.resize(0);
         descriptorSets.resize(0);
@@ -81,8 +122,9 @@ namespace xy
         // Calculating the scale
         scale = glm::vec3(1.0f, 1.0f, 1.0f);
 
-        loaded = true;
-        return true;
+        // A failed load leaves the model without buffers
+        loaded = scene.vertices.buffer != VK_NULL_HANDLE;
+        return loaded;
     }
 
     /* 
@@ -96,25 +138,41 @@ namespace xy
         }
     }
 
-    void GLTFRender::updateUniformBuffers(uint32_t cbIndex)
+    /*
+        Calculating the location, rotation and scale
+    */
+    glm::mat4 GLTFRender::modelMatrix() const
     {
-        // Scene
-        shaderValuesScene.projection = camera->matrices.perspective;
-        shaderValuesScene.view = camera->matrices.view;
-        
-        // Calculating the location, rotation and scale
-        shaderValuesScene.model = glm::mat4(1.0f);
-        shaderValuesScene.model = glm::translate(shaderValuesScene.model, location);
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, location);
         if(rotation.x != 0.0f) {
-            shaderValuesScene.model = glm::rotate(shaderValuesScene.model, rotation.x, glm::vec3(1, 0, 0));
+            model = glm::rotate(model, rotation.x, glm::vec3(1, 0, 0));
         }
         if(rotation.y != 0.0f) {
-            shaderValuesScene.model = glm::rotate(shaderValuesScene.model, rotation.y, glm::vec3(0, 1, 0));
+            model = glm::rotate(model, rotation.y, glm::vec3(0, 1, 0));
         }
         if(rotation.z != 0.0f) {
-            shaderValuesScene.model = glm::rotate(shaderValuesScene.model, rotation.z, glm::vec3(0, 0, 1));
+            model = glm::rotate(model, rotation.z, glm::vec3(0, 0, 1));
         }
-        shaderValuesScene.model = glm::scale(shaderValuesScene.model, scale);
+        return glm::scale(model, scale);
+    }
+
+    /*
+        Transform from the space of the model to clip space, pbr.vert flips y after the model matrix
+    */
+    glm::mat4 GLTFRender::cullMatrix() const
+    {
+        const glm::mat4 flipY = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f));
+        return camera->matrices.perspective * camera->matrices.view * flipY * modelMatrix();
+    }
+
+    void GLTFRender::updateUniformBuffers(uint32_t cbIndex)
+    {
+        // Scene
+        shaderValuesScene.projection = camera->matrices.perspective;
+        shaderValuesScene.view = camera->matrices.view;
+        
+        shaderValuesScene.model = modelMatrix();
 
         shaderValuesScene.camPos = glm::vec3(
             -camera->position.z * sin(glm::radians(camera->rotation.y)) * cos(glm::radians(camera->rotation.x)),
@@ -123,6 +181,42 @@ namespace xy
         );
 
         memcpy(uniformBuffers[cbIndex].scene.mapped, &shaderValuesScene, sizeof(shaderValuesScene));
+
+        // The node and joint matrices of every mesh go into one buffer per frame, in the order of the slots
+        const glm::mat4 identity(1.0f);
+        if (indirect) {
+            glm::mat4 *transforms = static_cast<glm::mat4 *>(indirectFrames[cbIndex].transforms.mapped);
+            for (const TransformSlot &slot : transformSlots) {
+                const vkglTF::Mesh::UniformBlock &block = slot.node->mesh->uniformBlock;
+                transforms[slot.transform] = slot.skinned ? identity : block.matrix;
+                memcpy(&transforms[slot.transform + 1], block.jointMatrix, slot.jointCount * sizeof(glm::mat4));
+            }
+        } else {
+            uint8_t *arena = static_cast<uint8_t *>(uniformBuffers[cbIndex].nodes.mapped);
+            for (const TransformSlot &slot : transformSlots) {
+                const vkglTF::Mesh::UniformBlock &block = slot.node->mesh->uniformBlock;
+                NodeBlockHeader *header = reinterpret_cast<NodeBlockHeader *>(arena + slot.transform);
+                header->matrix = slot.skinned ? identity : block.matrix;
+                header->jointCount = static_cast<float>(slot.jointCount);
+                memcpy(header + 1, block.jointMatrix, slot.jointCount * sizeof(glm::mat4));
+            }
+        }
+        if (skinningActive) {
+            skinning.update(cbIndex);
+        }
+        if (gpuCulling) {
+            const vkglTF::Frustum frustum(cullMatrix());
+            UBOCull *cull = static_cast<UBOCull *>(indirectFrames[cbIndex].cull.mapped);
+            memcpy(cull->planes, frustum.planes, sizeof(frustum.planes));
+            cull->viewProjection = cullMatrix();
+            cull->drawCount = static_cast<uint32_t>(indirectPrimitives.size());
+            cull->occlusion = occlusion ? 1 : 0;
+        }
+
+        // Streaming prioritizes meshes by their size seen from the camera, in the space of the model
+        if (scene.progressiveLoading) {
+            scene.setStreamingViewpoint(glm::vec3(glm::inverse(shaderValuesScene.model) * glm::vec4(shaderValuesScene.camPos, 1.0f)));
+        }
     }
 
     void GLTFRender::setupDescriptors()
@@ -131,34 +225,84 @@ namespace xy
             vkDestroyDescriptorPool(device, descriptorPool, nullptr);
         }
 
+        bindless = bindlessMaterials && bindlessSupported();
+        bindlessTextureCount = static_cast<uint32_t>(scene.textures.size()) + 1;
+        bindlessStale.assign(frameBufferCount, false);
+        indirect = bindless && indirectDraws && indirectSupported();
+        gpuCulling = indirect && frustumCulling && gpuCullingSupported();
+        occlusion = gpuCulling && occlusionCulling && viewExtent.width > 0 && viewExtent.height > 0 &&
+            occlusionCullingSupported();
+
+        // The depth pyramid is only kept while the occlusion culling uses it
+        if (occlusion) {
+            if (!depthPyramid.renderPass) {
+                depthPyramid.init(vulkanDevice, pipelineCache);
+            }
+            if (!depthPyramid.valid() || depthPyramid.width != viewExtent.width || depthPyramid.height != viewExtent.height) {
+                depthPyramid.resize(viewExtent.width, viewExtent.height);
+            }
+        } else {
+            depthPyramid.destroy();
+        }
+
+        // The skinned and morphed nodes decide the transform slots and draw groups built below
+        // Only the compute pass blends morph targets, a model with them keeps it on
+        skinningActive = false;
+        if ((computeSkinning || computeSkinningRequired()) && computeSkinningSupported()) {
+            if (!skinning.initialized()) {
+                skinning.init(vulkanDevice, pipelineCache);
+            }
+            skinningActive = skinning.build(scene, frameBufferCount);
+        } else {
+            skinning.destroy();
+        }
+        if (computeSkinningRequired() && !skinningActive) {
+            LOGW("No compute skinning pass, {} morph targets are not blended and their meshes are drawn at rest",
+                scene.morphTargets.size());
+        }
+
         /*
             Descriptor Pool
         */
         uint32_t imageSamplerCount = 0;
         uint32_t materialCount = 0;
-        uint32_t meshCount = 0;
 
         // Environment samplers (radiance, irradiance, brdf lut)
 
-        for (auto &material : scene.materials) {
-            imageSamplerCount += 5;
-            materialCount++;
-        }
-        for (auto node : scene.linearNodes) {
-            if (node->mesh) {
-                meshCount++;
+        // Materials waiting for streamed textures get a second descriptor set later on
+        materialPlaceholders.clear();
+        if (bindless) {
+            // One texture array and material buffer per frame
+            imageSamplerCount = 3 + bindlessTextureCount;
+            materialCount = 1;
+        } else {
+            for (auto &material : scene.materials) {
+                const bool placeholder = !materialResident(material);
+                imageSamplerCount += placeholder ? 10 : 5;
+                materialCount += placeholder ? 2 : 1;
+                materialPlaceholders.push_back(placeholder);
             }
         }
 
+        // The culling pass reads the transforms, draw data, bounds and depth pyramid and writes the commands,
+        // the stats, the visibility and the instances
+        const uint32_t cullSetCount = gpuCulling ? 1 : 0;
+
+        // The node matrices are one set per frame, the transforms, draw data and instances with indirect draws,
+        // the node arena otherwise
         std::vector<VkDescriptorPoolSize> poolSizes = {
-            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, (4 + meshCount) * frameBufferCount },
-            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageSamplerCount * frameBufferCount }
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, (4 + cullSetCount) * frameBufferCount },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (imageSamplerCount + cullSetCount) * frameBufferCount },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, ((indirect ? 4 : 1) + 7 * cullSetCount) * frameBufferCount }
         };
+        if (!indirect) {
+            poolSizes.push_back({ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, frameBufferCount });
+        }
         VkDescriptorPoolCreateInfo descriptorPoolCI{};
         descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        descriptorPoolCI.poolSizeCount = 2;
+        descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
         descriptorPoolCI.pPoolSizes = poolSizes.data();
-        descriptorPoolCI.maxSets = (2 + materialCount + meshCount) * frameBufferCount;
+        descriptorPoolCI.maxSets = (3 + materialCount + cullSetCount) * frameBufferCount;
         VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &descriptorPool));
         LOGI("Create DescriptorPool : [{}, {}]", poolSizes.at(0).descriptorCount, poolSizes.at(1).descriptorCount);
 
@@ -249,60 +393,39 @@ namespace xy
                 { 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
                 { 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
             };
+            if (bindless) {
+                setLayoutBindings = {
+                    { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bindlessTextureCount, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                    { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+                };
+            }
             VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
             descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
             descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
             descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
             VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.material));
 
-            // Per-Material descriptor sets
-            for (auto &material : scene.materials) {
-                VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-                descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-                descriptorSetAllocInfo.descriptorPool = descriptorPool;
-                descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.material;
-                descriptorSetAllocInfo.descriptorSetCount = 1;
-                VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &material.descriptorSet));
-
-                std::vector<VkDescriptorImageInfo> imageDescriptors = {
-                    textures->empty.descriptor,
-                    textures->empty.descriptor,
-                    material.normalTexture ? material.normalTexture->descriptor : textures->empty.descriptor,
-                    material.occlusionTexture ? material.occlusionTexture->descriptor : textures->empty.descriptor,
-                    material.emissiveTexture ? material.emissiveTexture->descriptor : textures->empty.descriptor
-                };
-
-                // TODO: glTF specs states that metallic roughness should be preferred, even if specular glosiness is present
-
-                if (material.pbrWorkflows.metallicRoughness) {
-                    if (material.baseColorTexture) {
-                        imageDescriptors[0] = material.baseColorTexture->descriptor;
-                    }
-                    if (material.metallicRoughnessTexture) {
-                        imageDescriptors[1] = material.metallicRoughnessTexture->descriptor;
-                    }
+            if (bindless) {
+                // Texture array and material buffer per frame, a frame only rewrites its own before it is recorded
+                for (uint32_t i = 0; i < descriptorSets.size(); i++) {
+                    VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+                    descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+                    descriptorSetAllocInfo.descriptorPool = descriptorPool;
+                    descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.material;
+                    descriptorSetAllocInfo.descriptorSetCount = 1;
+                    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets[i].materials));
+
+                    uniformBuffers[i].materials.destroy();
+                    uniformBuffers[i].materials.create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        std::max<size_t>(1, scene.materials.size()) * sizeof(MaterialData));
+                    writeBindlessDescriptorSet(i);
                 }
-
-                if (material.pbrWorkflows.specularGlossiness) {
-                    if (material.extension.diffuseTexture) {
-                        imageDescriptors[0] = material.extension.diffuseTexture->descriptor;
-                    }
-                    if (material.extension.specularGlossinessTexture) {
-                        imageDescriptors[1] = material.extension.specularGlossinessTexture->descriptor;
-                    }
-                }
-
-                std::array<VkWriteDescriptorSet, 5> writeDescriptorSets{};
-                for (size_t i = 0; i < imageDescriptors.size(); i++) {
-                    writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                    writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-                    writeDescriptorSets[i].descriptorCount = 1;
-                    writeDescriptorSets[i].dstSet = material.descriptorSet;
-                    writeDescriptorSets[i].dstBinding = static_cast<uint32_t>(i);
-                    writeDescriptorSets[i].pImageInfo = &imageDescriptors[i];
+            } else {
+                // Per-Material descriptor sets
+                for (auto &material : scene.materials) {
+                    writeMaterialDescriptorSet(material);
                 }
-
-                vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
             }
 
             // Model node (matrices)
@@ -311,56 +434,691 @@ namespace xy
                     vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.node, nullptr);
                 }
                 std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-                    { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+                    { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
                 };
+                if (indirect) {
+                    setLayoutBindings = {
+                        { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+                        { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+                        { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+                    };
+                }
                 VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
                 descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
                 descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
                 descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
                 VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.node));
 
-                // Per-Node descriptor set
-                for (auto &node : scene.nodes) {
-                    setupNodeDescriptorSet(node);
+                if (indirect) {
+                    for (auto &buffer : uniformBuffers) {
+                        buffer.nodes.destroy();
+                    }
+                    buildIndirectDraws();
+                    for (auto &frame : indirectFrames) {
+                        VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+                        descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+                        descriptorSetAllocInfo.descriptorPool = descriptorPool;
+                        descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.node;
+                        descriptorSetAllocInfo.descriptorSetCount = 1;
+                        VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &frame.descriptorSet));
+
+                        std::array<VkWriteDescriptorSet, 3> writeDescriptorSets{};
+                        writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                        writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                        writeDescriptorSets[0].descriptorCount = 1;
+                        writeDescriptorSets[0].dstSet = frame.descriptorSet;
+                        writeDescriptorSets[0].dstBinding = 0;
+                        writeDescriptorSets[0].pBufferInfo = &frame.transforms.descriptor;
+
+                        writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                        writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                        writeDescriptorSets[1].descriptorCount = 1;
+                        writeDescriptorSets[1].dstSet = frame.descriptorSet;
+                        writeDescriptorSets[1].dstBinding = 1;
+                        writeDescriptorSets[1].pBufferInfo = &drawData.descriptor;
+
+                        writeDescriptorSets[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                        writeDescriptorSets[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                        writeDescriptorSets[2].descriptorCount = 1;
+                        writeDescriptorSets[2].dstSet = frame.descriptorSet;
+                        writeDescriptorSets[2].dstBinding = 2;
+                        writeDescriptorSets[2].pBufferInfo = &frame.instances.descriptor;
+
+                        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+                    }
+                } else {
+                    for (auto &frame : indirectFrames) {
+                        frame.transforms.destroy();
+                        frame.commands.destroy();
+                        frame.instances.destroy();
+                        frame.cull.destroy();
+                        frame.stats.destroy();
+                    }
+                    indirectFrames.clear();
+
+                    // Node arena per frame, each mesh binds it at its own offset
+                    buildNodeArena();
+                    buildDrawList();
+                    for (uint32_t i = 0; i < descriptorSets.size(); i++) {
+                        VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+                        descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+                        descriptorSetAllocInfo.descriptorPool = descriptorPool;
+                        descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.node;
+                        descriptorSetAllocInfo.descriptorSetCount = 1;
+                        VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets[i].nodes));
+
+                        const VkDescriptorBufferInfo bufferInfo = {
+                            uniformBuffers[i].nodes.buffer, 0, sizeof(NodeBlockHeader) + MAX_NUM_JOINTS * sizeof(glm::mat4)
+                        };
+                        VkWriteDescriptorSet writeDescriptorSet{};
+                        writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                        writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+                        writeDescriptorSet.descriptorCount = 1;
+                        writeDescriptorSet.dstSet = descriptorSets[i].nodes;
+                        writeDescriptorSet.dstBinding = 0;
+                        writeDescriptorSet.pBufferInfo = &bufferInfo;
+                        vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+                    }
                 }
             }
 
         }
+
+        // Culling pass (transforms, draw data, bounds, commands, stats, frustum, visibility, depth pyramid and instances)
+        if (gpuCulling) {
+            if(descriptorSetLayouts.cull) {
+                vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.cull, nullptr);
+            }
+            std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+                { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+                { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+                { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+                { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+                { 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+                { 5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+                { 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+                { 7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+                { 8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+            };
+            VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+            descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
+            descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+            VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayouts.cull));
+
+            for (auto &frame : indirectFrames) {
+                VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+                descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+                descriptorSetAllocInfo.descriptorPool = descriptorPool;
+                descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.cull;
+                descriptorSetAllocInfo.descriptorSetCount = 1;
+                VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &frame.cullDescriptorSet));
+                writeCullDescriptorSet(frame);
+            }
+        }
     }
 
-    void GLTFRender::setupNodeDescriptorSet(vkglTF::Node *node) {
-        LOGI("Setup Node DescriptorSet : {}", node->name);
-        if (node->mesh) {
-            VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-            descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-            descriptorSetAllocInfo.descriptorPool = descriptorPool;
-            descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.node;
-            descriptorSetAllocInfo.descriptorSetCount = 1;
-            VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &node->mesh->uniformBuffer.descriptorSet));
+    void GLTFRender::writeCullDescriptorSet(const IndirectFrame &frame)
+    {
+        const std::array<const VkDescriptorBufferInfo *, 7> bufferInfos = {
+            &frame.transforms.descriptor, &drawData.descriptor, &drawBounds.descriptor,
+            &frame.commands.descriptor, &frame.stats.descriptor, &frame.cull.descriptor, &drawVisibility.descriptor
+        };
+        std::array<VkWriteDescriptorSet, 9> writeDescriptorSets{};
+        for (uint32_t b = 0; b < writeDescriptorSets.size(); b++) {
+            writeDescriptorSets[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSets[b].descriptorType = b == 5 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writeDescriptorSets[b].descriptorCount = 1;
+            writeDescriptorSets[b].dstSet = frame.cullDescriptorSet;
+            writeDescriptorSets[b].dstBinding = b;
+            if (b < bufferInfos.size()) {
+                writeDescriptorSets[b].pBufferInfo = bufferInfos[b];
+            }
+        }
+        // The pyramid is only read with occlusion culling, the set needs a valid image either way
+        writeDescriptorSets[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writeDescriptorSets[7].pImageInfo = occlusion ? &depthPyramid.descriptor : &textures->empty.descriptor;
+        writeDescriptorSets[8].pBufferInfo = &frame.instances.descriptor;
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+    }
 
-            VkWriteDescriptorSet writeDescriptorSet{};
-            writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            writeDescriptorSet.descriptorCount = 1;
-            writeDescriptorSet.dstSet = node->mesh->uniformBuffer.descriptorSet;
-            writeDescriptorSet.dstBinding = 0;
-            writeDescriptorSet.pBufferInfo = &node->mesh->uniformBuffer.descriptor;
+    void GLTFRender::writeMaterialDescriptorSet(vkglTF::Material &material)
+    {
+        VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+        descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        descriptorSetAllocInfo.descriptorPool = descriptorPool;
+        descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayouts.material;
+        descriptorSetAllocInfo.descriptorSetCount = 1;
+        VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &material.descriptorSet));
+
+        const vkglTF::Texture *normalTexture = residentTexture(material.normalTexture);
+        const vkglTF::Texture *occlusionTexture = residentTexture(material.occlusionTexture);
+        const vkglTF::Texture *emissiveTexture = residentTexture(material.emissiveTexture);
+        std::vector<VkDescriptorImageInfo> imageDescriptors = {
+            textures->empty.descriptor,
+            textures->empty.descriptor,
+            normalTexture ? normalTexture->descriptor : textures->empty.descriptor,
+            occlusionTexture ? occlusionTexture->descriptor : textures->empty.descriptor,
+            emissiveTexture ? emissiveTexture->descriptor : textures->empty.descriptor
+        };
+
+        // TODO: glTF specs states that metallic roughness should be preferred, even if specular glosiness is present
+
+        if (material.pbrWorkflows.metallicRoughness) {
+            if (residentTexture(material.baseColorTexture)) {
+                imageDescriptors[0] = material.baseColorTexture->descriptor;
+            }
+            if (residentTexture(material.metallicRoughnessTexture)) {
+                imageDescriptors[1] = material.metallicRoughnessTexture->descriptor;
+            }
+        }
+
+        if (material.pbrWorkflows.specularGlossiness) {
+            if (residentTexture(material.extension.diffuseTexture)) {
+                imageDescriptors[0] = material.extension.diffuseTexture->descriptor;
+            }
+            if (residentTexture(material.extension.specularGlossinessTexture)) {
+                imageDescriptors[1] = material.extension.specularGlossinessTexture->descriptor;
+            }
+        }
 
-            vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+        std::array<VkWriteDescriptorSet, 5> writeDescriptorSets{};
+        for (size_t i = 0; i < imageDescriptors.size(); i++) {
+            writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writeDescriptorSets[i].descriptorCount = 1;
+            writeDescriptorSets[i].dstSet = material.descriptorSet;
+            writeDescriptorSets[i].dstBinding = static_cast<uint32_t>(i);
+            writeDescriptorSets[i].pImageInfo = &imageDescriptors[i];
         }
-        for (auto& child : node->children) {
-            setupNodeDescriptorSet(child);
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+    }
+
+    bool GLTFRender::bindlessSupported() const
+    {
+        if (!vulkanDevice->enabledFeatures.shaderSampledImageArrayDynamicIndexing) {
+            LOGW("Sampler arrays can not be indexed dynamically, using a descriptor set per material");
+            return false;
+        }
+        // The environment maps of the scene set count against the same limits
+        const VkPhysicalDeviceLimits &limits = vulkanDevice->properties.limits;
+        const uint32_t samplerCount = static_cast<uint32_t>(scene.textures.size()) + 1 + 3;
+        if (samplerCount > std::min(limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages) ||
+            samplerCount > std::min(limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages)) {
+            LOGW("{} textures exceed the sampler limits, using a descriptor set per material", scene.textures.size());
+            return false;
         }
+        if (!shaderAvailable("pbr_khr_bindless.frag.spv")) {
+            LOGW("pbr_khr_bindless.frag.spv is missing, using a descriptor set per material");
+            return false;
+        }
+        return true;
     }
 
-    void GLTFRender::preparePipelines()
+    void GLTFRender::writeBindlessDescriptorSet(uint32_t frameIndex)
+    {
+        // Textures still being streamed in keep the empty texture in their slot
+        std::vector<VkDescriptorImageInfo> imageDescriptors(bindlessTextureCount, textures->empty.descriptor);
+        for (size_t t = 0; t < scene.textures.size(); t++) {
+            if (scene.textures[t].resident) {
+                imageDescriptors[t + 1] = scene.textures[t].descriptor;
+            }
+        }
+
+        const vkglTF::Texture *modelTextures = scene.textures.data();
+        auto slot = [modelTextures](const vkglTF::Texture *texture) {
+            return residentTexture(texture) ? static_cast<int32_t>(texture - modelTextures) + 1 : 0;
+        };
+        MaterialData *materialData = static_cast<MaterialData *>(uniformBuffers[frameIndex].materials.mapped);
+        for (size_t m = 0; m < scene.materials.size(); m++) {
+            const vkglTF::Material &material = scene.materials[m];
+            MaterialData &data = materialData[m];
+            data = {};
+            data.parameters = materialParameters(material);
+            data.normalTexture = slot(material.normalTexture);
+            data.occlusionTexture = slot(material.occlusionTexture);
+            data.emissiveTexture = slot(material.emissiveTexture);
+            if (material.pbrWorkflows.metallicRoughness) {
+                data.colorTexture = slot(material.baseColorTexture);
+                data.physicalDescriptorTexture = slot(material.metallicRoughnessTexture);
+            }
+            if (material.pbrWorkflows.specularGlossiness) {
+                data.colorTexture = slot(material.extension.diffuseTexture);
+                data.physicalDescriptorTexture = slot(material.extension.specularGlossinessTexture);
+            }
+        }
+
+        std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+        writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writeDescriptorSets[0].descriptorCount = bindlessTextureCount;
+        writeDescriptorSets[0].dstSet = descriptorSets[frameIndex].materials;
+        writeDescriptorSets[0].dstBinding = 0;
+        writeDescriptorSets[0].pImageInfo = imageDescriptors.data();
+
+        writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writeDescriptorSets[1].descriptorCount = 1;
+        writeDescriptorSets[1].dstSet = descriptorSets[frameIndex].materials;
+        writeDescriptorSets[1].dstBinding = 1;
+        writeDescriptorSets[1].pBufferInfo = &uniformBuffers[frameIndex].materials.descriptor;
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+        bindlessStale[frameIndex] = false;
+    }
+
+    GLTFRender::PushConstBlockMaterial GLTFRender::materialParameters(const vkglTF::Material &material) const
     {
-        if(pipelines.pbr) {
-            vkDestroyPipeline(device, pipelines.pbr, nullptr);
+        PushConstBlockMaterial parameters{};
+        parameters.emissiveFactor = material.emissiveFactor;
+        // To save push constant space, availabilty and texture coordiante set are combined
+        // -1 = texture not used for this material, >= 0 texture used and index of texture coordinate set
+        parameters.colorTextureSet = residentTexture(material.baseColorTexture) != nullptr ? material.texCoordSets.baseColor : -1;
+        parameters.normalTextureSet = residentTexture(material.normalTexture) != nullptr ? material.texCoordSets.normal : -1;
+        parameters.occlusionTextureSet = residentTexture(material.occlusionTexture) != nullptr ? material.texCoordSets.occlusion : -1;
+        parameters.emissiveTextureSet = residentTexture(material.emissiveTexture) != nullptr ? material.texCoordSets.emissive : -1;
+        parameters.alphaMask = static_cast<float>(material.alphaMode == vkglTF::Material::ALPHAMODE_MASK);
+        parameters.alphaMaskCutoff = material.alphaCutoff;
+
+        // TODO: glTF specs states that metallic roughness should be preferred, even if specular glosiness is present
+
+        if (material.pbrWorkflows.metallicRoughness) {
+            // Metallic roughness workflow
+            parameters.workflow = static_cast<float>(PBR_WORKFLOW_METALLIC_ROUGHNESS);
+            parameters.baseColorFactor = material.baseColorFactor;
+            parameters.metallicFactor = material.metallicFactor;
+            parameters.roughnessFactor = material.roughnessFactor;
+            parameters.PhysicalDescriptorTextureSet = residentTexture(material.metallicRoughnessTexture) != nullptr ?
+                material.texCoordSets.metallicRoughness : -1;
+            parameters.colorTextureSet = residentTexture(material.baseColorTexture) != nullptr ? material.texCoordSets.baseColor : -1;
+        }
+
+        if (material.pbrWorkflows.specularGlossiness) {
+            // Specular glossiness workflow
+            parameters.workflow = static_cast<float>(PBR_WORKFLOW_SPECULAR_GLOSINESS);
+            parameters.PhysicalDescriptorTextureSet = residentTexture(material.extension.specularGlossinessTexture) != nullptr ?
+                material.texCoordSets.specularGlossiness : -1;
+            parameters.colorTextureSet = residentTexture(material.extension.diffuseTexture) != nullptr ? material.texCoordSets.baseColor : -1;
+            parameters.diffuseFactor = material.extension.diffuseFactor;
+            parameters.specularFactor = glm::vec4(material.extension.specularFactor, 1.0f);
         }
-        if(pipelines.pbrAlphaBlend) {
-            vkDestroyPipeline(device, pipelines.pbrAlphaBlend, nullptr);
+        return parameters;
+    }
+
+    bool GLTFRender::indirectSupported() const
+    {
+        // The first instance of a command selects its draw data
+        if (!vulkanDevice->enabledFeatures.drawIndirectFirstInstance) {
+            LOGW("Indirect draws need drawIndirectFirstInstance, recording a draw per primitive");
+            return false;
+        }
+        for (const char *shader : { "pbr_indirect.vert.spv", "pbr_khr_indirect.frag.spv" }) {
+            if (!shaderAvailable(shader)) {
+                LOGW("{} is missing, recording a draw per primitive", shader);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool GLTFRender::gpuCullingSupported() const
+    {
+        // The culling pass is recorded into the command buffers of the graphics queue
+        const uint32_t graphics = vulkanDevice->queueFamilyIndices.graphics;
+        if (!(vulkanDevice->queueFamilyProperties[graphics].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+            LOGW("Graphics queue can not run compute shaders, indirect draws are not culled");
+            return false;
         }
+        if (!shaderAvailable("cull.comp.spv")) {
+            LOGW("cull.comp.spv is missing, indirect draws are not culled");
+            return false;
+        }
+        return true;
+    }
+
+    bool GLTFRender::occlusionCullingSupported() const
+    {
+        if (!shaderAvailable("depthpyramid.comp.spv")) {
+            LOGW("depthpyramid.comp.spv is missing, indirect draws are not occlusion culled");
+            return false;
+        }
+        return true;
+    }
+
+    bool GLTFRender::computeSkinningSupported() const
+    {
+        if (!shaderAvailable("skinning.comp.spv")) {
+            LOGW("skinning.comp.spv is missing, skinning in the vertex shader");
+            return false;
+        }
+        const uint32_t graphics = vulkanDevice->queueFamilyIndices.graphics;
+        if (!(vulkanDevice->queueFamilyProperties[graphics].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+            LOGW("Graphics queue can not run compute shaders, skinning in the vertex shader");
+            return false;
+        }
+        // The skinning pass reads the whole vertex buffer through one storage buffer descriptor
+        if (scene.vertices.size > vulkanDevice->properties.limits.maxStorageBufferRange) {
+            LOGW("{:.1f} MB of vertices exceed the storage buffer range, skinning in the vertex shader",
+                scene.vertices.size / 1048576.0);
+            return false;
+        }
+        return true;
+    }
+
+    uint32_t GLTFRender::pipelineIndex(uint32_t layout, bool deformed) const
+    {
+        return layout + (deformed ? static_cast<uint32_t>(scene.vertexLayouts.size()) : 0);
+    }
+
+    void GLTFRender::buildIndirectDraws()
+    {
+        struct Draw {
+            vkglTF::Node *node;
+            vkglTF::Primitive *primitive;
+            uint32_t transform;
+            uint32_t jointCount;
+            bool deformed;
+        };
+        std::vector<Draw> draws;
+        transformSlots.clear();
+        transformCount = 0;
+        for (auto node : scene.linearNodes) {
+            if (!node->mesh) {
+                continue;
+            }
+            const bool skinned = skinningActive && skinning.skinned(node);
+            const bool deformed = skinningActive && skinning.deformed(node);
+            const uint32_t jointCount = (node->skin && !skinned) ?
+                std::min(static_cast<uint32_t>(node->skin->joints.size()), MAX_NUM_JOINTS) : 0;
+            transformSlots.push_back({ node, transformCount, jointCount, skinned });
+            for (vkglTF::Primitive *primitive : node->mesh->primitives) {
+                // Primitives without vertices, from a failed Draco decode, get no draw command
+                if (primitive->vertexCount > 0) {
+                    draws.push_back({ node, primitive, transformCount, jointCount, deformed });
+                }
+            }
+            transformCount += 1 + jointCount;
+        }
+
+        // Opaque, masked and blended primitives in that order, grouped by the state an indirect call can not change
+        auto groupKey = [](const Draw &draw) {
+            const vkglTF::Primitive *primitive = draw.primitive;
+            return std::make_tuple(primitive->material.alphaMode, primitive->layout, draw.deformed, !primitive->hasIndices,
+                primitive->hasIndices ? primitive->indexType : VK_INDEX_TYPE_UINT32);
+        };
+        /*
+            Inside a group the draws of the same geometry and material follow each other, nodes sharing a mesh
+            become the instances of one command
+            Deformed vertices differ per node and are never batched
+        */
+        auto batchKey = [](const Draw &draw) {
+            const vkglTF::Primitive *primitive = draw.primitive;
+            return std::make_tuple(&primitive->material, primitive->firstIndex, primitive->indexCount,
+                primitive->firstVertex, primitive->vertexCount);
+        };
+        std::stable_sort(draws.begin(), draws.end(), [&groupKey, &batchKey](const Draw &a, const Draw &b) {
+            const auto keyA = groupKey(a);
+            const auto keyB = groupKey(b);
+            return keyA != keyB ? keyA < keyB : batchKey(a) < batchKey(b);
+        });
+
+        indirectPrimitives.clear();
+        drawBatches.clear();
+        drawGroups.clear();
+        std::vector<DrawData> drawDataEntries;
+        std::vector<DrawBounds> drawBoundsEntries;
+        VkDeviceSize commandsSize = 0;
+        for (uint32_t d = 0; d < draws.size(); d++) {
+            const Draw &draw = draws[d];
+            const bool newGroup = drawGroups.empty() || groupKey(draws[d - 1]) != groupKey(draw);
+            if (newGroup) {
+                DrawGroup group{};
+                group.alphaMode = draw.primitive->material.alphaMode;
+                group.layout = draw.primitive->layout;
+                group.deformed = draw.deformed;
+                group.indexed = draw.primitive->hasIndices;
+                group.indexType = draw.primitive->indexType;
+                group.firstBatch = static_cast<uint32_t>(drawBatches.size());
+                group.offset = commandsSize;
+                drawGroups.push_back(group);
+            }
+            if (newGroup || draw.deformed || batchKey(draws[d - 1]) != batchKey(draw)) {
+                drawBatches.push_back({ d, 0 });
+                drawGroups.back().batchCount++;
+                commandsSize += drawGroups.back().indexed ? sizeof(VkDrawIndexedIndirectCommand) : sizeof(VkDrawIndirectCommand);
+            }
+            DrawBatch &batch = drawBatches.back();
+            batch.count++;
+
+            indirectPrimitives.push_back({ draw.node, draw.primitive });
+            DrawData data{};
+            data.transform = draw.transform;
+            data.jointCount = draw.jointCount;
+            data.material = static_cast<uint32_t>(&draw.primitive->material - scene.materials.data());
+            // Both command types have the instance count in their second word
+            const VkDeviceSize stride = drawGroups.back().indexed ? sizeof(VkDrawIndexedIndirectCommand) : sizeof(VkDrawIndirectCommand);
+            data.command = static_cast<uint32_t>((commandsSize - stride) / sizeof(uint32_t)) + 1;
+            data.firstInstance = batch.first;
+            drawDataEntries.push_back(data);
+
+            DrawBounds bounds{};
+            bounds.extent.w = -1.0f;
+            if (draw.primitive->bb.valid && !draw.node->skin) {
+                bounds.center = glm::vec4((draw.primitive->bb.min + draw.primitive->bb.max) * 0.5f, 1.0f);
+                bounds.extent = glm::vec4((draw.primitive->bb.max - draw.primitive->bb.min) * 0.5f, 0.0f);
+            }
+            drawBoundsEntries.push_back(bounds);
+        }
+
+        drawData.destroy();
+        drawData.create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            std::max<size_t>(1, drawDataEntries.size()) * sizeof(DrawData));
+        if (!drawDataEntries.empty()) {
+            memcpy(drawData.mapped, drawDataEntries.data(), drawDataEntries.size() * sizeof(DrawData));
+        }
+        drawBounds.destroy();
+        drawBounds.create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            std::max<size_t>(1, drawBoundsEntries.size()) * sizeof(DrawBounds));
+        if (!drawBoundsEntries.empty()) {
+            memcpy(drawBounds.mapped, drawBoundsEntries.data(), drawBoundsEntries.size() * sizeof(DrawBounds));
+        }
+        // No draw is an occluder of the first frame
+        drawVisibility.destroy();
+        drawVisibility.create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            std::max<size_t>(1, draws.size()) * sizeof(uint32_t));
+        memset(drawVisibility.mapped, 0, std::max<size_t>(1, draws.size()) * sizeof(uint32_t));
+
+        for (auto &frame : indirectFrames) {
+            frame.transforms.destroy();
+            frame.commands.destroy();
+            frame.instances.destroy();
+            frame.cull.destroy();
+            frame.stats.destroy();
+        }
+        indirectFrames.resize(frameBufferCount);
+        for (auto &frame : indirectFrames) {
+            frame.transforms.create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                std::max<size_t>(1, transformCount) * sizeof(glm::mat4));
+            // Every instance draws its own DrawData until the culling pass compacts the visible ones
+            frame.instances.create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                std::max<size_t>(1, draws.size()) * sizeof(uint32_t));
+            uint32_t *instances = static_cast<uint32_t *>(frame.instances.mapped);
+            for (uint32_t d = 0; d < draws.size(); d++) {
+                instances[d] = d;
+            }
+            frame.commands.create(vulkanDevice, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                std::max<VkDeviceSize>(sizeof(VkDrawIndexedIndirectCommand), commandsSize));
+            frame.cull.create(vulkanDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(UBOCull));
+            frame.stats.create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(CullCounters));
+            memset(frame.stats.mapped, 0, sizeof(CullCounters));
+            frame.stale = true;
+        }
+        LOGI("Indirect draws: {} primitives in {} instanced commands and {} groups", draws.size(), drawBatches.size(), drawGroups.size());
+    }
+
+    void GLTFRender::writeDrawCommands(uint32_t frameIndex)
+    {
+        IndirectFrame &frame = indirectFrames[frameIndex];
+        uint8_t *commands = static_cast<uint8_t *>(frame.commands.mapped);
+        frame.residentDraws = 0;
+        for (const DrawGroup &group : drawGroups) {
+            for (uint32_t i = 0; i < group.batchCount; i++) {
+                const DrawBatch &batch = drawBatches[group.firstBatch + i];
+                const vkglTF::Node *node = indirectPrimitives[batch.first].first;
+                const vkglTF::Primitive *primitive = indirectPrimitives[batch.first].second;
+                // Meshes still streaming in draw nothing until they are resident, instances share the residency
+                const bool resident = node->mesh->resident;
+                if (group.indexed) {
+                    VkDrawIndexedIndirectCommand &command = reinterpret_cast<VkDrawIndexedIndirectCommand *>(commands + group.offset)[i];
+                    command.indexCount = resident ? primitive->indexCount : 0;
+                    command.instanceCount = batch.count;
+                    command.firstIndex = primitive->firstIndex;
+                    command.vertexOffset = static_cast<int32_t>(primitive->firstVertex);
+                    command.firstInstance = batch.first;
+                } else {
+                    VkDrawIndirectCommand &command = reinterpret_cast<VkDrawIndirectCommand *>(commands + group.offset)[i];
+                    command.vertexCount = resident ? primitive->vertexCount : 0;
+                    command.instanceCount = batch.count;
+                    command.firstVertex = primitive->firstVertex;
+                    command.firstInstance = batch.first;
+                }
+                frame.residentDraws += resident ? batch.count : 0;
+            }
+        }
+        frame.stale = false;
+    }
+
+    /*
+        The range bound for a mesh always covers MAX_NUM_JOINTS joint matrices, the shader only reads the ones
+        of its skin, so meshes are packed by the joints they have and only the last one needs padding behind it
+    */
+    void GLTFRender::buildNodeArena()
+    {
+        const VkDeviceSize alignment = std::max<VkDeviceSize>(1, vulkanDevice->properties.limits.minUniformBufferOffsetAlignment);
+        transformSlots.clear();
+        VkDeviceSize size = 0;
+        for (auto node : scene.linearNodes) {
+            if (!node->mesh) {
+                continue;
+            }
+            const bool skinned = skinningActive && skinning.skinned(node);
+            const uint32_t jointCount = (node->skin && !skinned) ?
+                std::min(static_cast<uint32_t>(node->skin->joints.size()), MAX_NUM_JOINTS) : 0;
+            node->mesh->uniformOffset = static_cast<uint32_t>(size);
+            transformSlots.push_back({ node, static_cast<uint32_t>(size), jointCount, skinned });
+            size += sizeof(NodeBlockHeader) + jointCount * sizeof(glm::mat4);
+            size = (size + alignment - 1) / alignment * alignment;
+        }
+        size += sizeof(NodeBlockHeader) + MAX_NUM_JOINTS * sizeof(glm::mat4);
+
+        for (auto &buffer : uniformBuffers) {
+            buffer.nodes.destroy();
+            buffer.nodes.create(vulkanDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size);
+        }
+        LOGI("Node arena: {} meshes in {} bytes per frame", transformSlots.size(), size);
+    }
+
+    /*
+        Sorting by pipeline first keeps the pipeline and vertex binds as rare as the grouping by alpha mode allowed,
+        the material next makes most material binds and pushes redundant, the mesh last keeps a mesh together
+        With bindless materials a material is only a push and the mesh a set bind, so the mesh goes before the material
+        Blended primitives stay in tree order, the order they are blended in
+    */
+    void GLTFRender::buildDrawList()
+    {
+        drawList.clear();
+        uint32_t nodeCount = 0;
+        for (auto node : scene.linearNodes) {
+            nodeCount = std::max(nodeCount, node->index + 1);
+        }
+        nodeVisibility.assign(nodeCount, 0);
+
+        // Meshes in the order the tree is walked, a node before its children
+        std::vector<vkglTF::Node *> stack(scene.nodes.rbegin(), scene.nodes.rend());
+        uint64_t sequence = 0;
+        uint64_t meshIndex = 0;
+        while (!stack.empty()) {
+            vkglTF::Node *node = stack.back();
+            stack.pop_back();
+            stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
+            if (!node->mesh) {
+                continue;
+            }
+            const bool deformed = skinningActive && skinning.deformed(node);
+            for (vkglTF::Primitive *primitive : node->mesh->primitives) {
+                if (primitive->vertexCount == 0) {
+                    continue;
+                }
+                const uint64_t alphaMode = primitive->material.alphaMode;
+                const uint32_t variant = pipelineIndex(primitive->layout, deformed);
+                const uint64_t material = static_cast<uint64_t>(&primitive->material - scene.materials.data());
+                uint64_t key = alphaMode << 62;
+                if (primitive->material.alphaMode == vkglTF::Material::ALPHAMODE_BLEND) {
+                    key |= sequence++;
+                } else {
+                    key |= (static_cast<uint64_t>(variant) & 0x1fff) << 49;
+                    key |= static_cast<uint64_t>(primitive->indexType == VK_INDEX_TYPE_UINT16 ? 1 : 0) << 48;
+                    key |= ((bindless ? meshIndex : material) & 0xffffff) << 24;
+                    key |= (bindless ? material : meshIndex) & 0xffffff;
+                }
+                drawList.push_back({ key, node, primitive, variant, deformed });
+            }
+            meshIndex++;
+        }
+        std::stable_sort(drawList.begin(), drawList.end(), [](const ListDraw &a, const ListDraw &b) {
+            return a.key < b.key;
+        });
+
+        // Calls of a recording with everything visible, the recording per primitive issued one of each per draw
+        uint32_t binds = 0;
+        uint32_t pushes = 0;
+        const vkglTF::Material *material = nullptr;
+        const vkglTF::Mesh *mesh = nullptr;
+        for (const ListDraw &draw : drawList) {
+            const bool materialChanged = &draw.primitive->material != material;
+            const bool meshChanged = draw.node->mesh != mesh;
+            binds += (meshChanged || (materialChanged && !bindless)) ? 1 : 0;
+            pushes += materialChanged ? 1 : 0;
+            material = &draw.primitive->material;
+            mesh = draw.node->mesh;
+        }
+        LOGI("Draw list: {} primitives of {} meshes, {} descriptor set binds and {} push constants", drawList.size(),
+            meshIndex, binds, pushes);
+    }
+
+    void GLTFRender::destroyPipelines()
+    {
+        for (VkPipeline pipeline : pipelines.pbr) {
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+        for (VkPipeline pipeline : pipelines.pbrAlphaBlend) {
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+        for (VkPipeline pipeline : pipelines.depth) {
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+        pipelines.pbr.clear();
+        pipelines.pbrAlphaBlend.clear();
+        pipelines.depth.clear();
+        if (cullPipeline) {
+            vkDestroyPipeline(device, cullPipeline, nullptr);
+            cullPipeline = VK_NULL_HANDLE;
+        }
+    }
+
+    void GLTFRender::preparePipelines()
+    {
+        destroyPipelines();
         if(pipelineLayout) {
             vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
         }
@@ -422,28 +1180,16 @@ namespace xy
         pipelineLayoutCI.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
         pipelineLayoutCI.pSetLayouts = setLayouts.data();
         VkPushConstantRange pushConstantRange{};
-        pushConstantRange.size = sizeof(PushConstBlockMaterial);
+        // The bindless mode only pushes the material index
+        pushConstantRange.size = bindless ? sizeof(int32_t) : sizeof(PushConstBlockMaterial);
         pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
         pipelineLayoutCI.pushConstantRangeCount = 1;
         pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
         VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
 
-        // Vertex bindings an attributes
-        VkVertexInputBindingDescription vertexInputBinding = { 0, sizeof(vkglTF::Model::Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
-        std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-            { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
-            { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3 },
-            { 2, 0, VK_FORMAT_R32G32_SFLOAT, sizeof(float) * 6 },
-            { 3, 0, VK_FORMAT_R32G32_SFLOAT, sizeof(float) * 8 },
-            { 4, 0, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 10 },
-            { 5, 0, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 14 }
-        };
+        // Vertex bindings an attributes are set per vertex layout below
         VkPipelineVertexInputStateCreateInfo vertexInputStateCI{};
         vertexInputStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputStateCI.vertexBindingDescriptionCount = 1;
-        vertexInputStateCI.pVertexBindingDescriptions = &vertexInputBinding;
-        vertexInputStateCI.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
-        vertexInputStateCI.pVertexAttributeDescriptions = vertexInputAttributes.data();
 
         // Pipelines
         std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
@@ -467,123 +1213,496 @@ namespace xy
             multisampleStateCI.rasterizationSamples = multiSampleCount;
         }
 
-        // PBR pipeline
         shaderStages = {
-            loadShader(device, "pbr.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-            loadShader(device, "pbr_khr.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+            loadShader(device, indirect ? "pbr_indirect.vert.spv" : "pbr.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+            loadShader(device, indirect ? "pbr_khr_indirect.frag.spv" : bindless ? "pbr_khr_bindless.frag.spv" : "pbr_khr.frag.spv",
+                VK_SHADER_STAGE_FRAGMENT_BIT)
         };
-        depthStencilStateCI.depthWriteEnable = VK_TRUE;
-        depthStencilStateCI.depthTestEnable = VK_TRUE;
-        VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.pbr));
 
-        rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
-        blendAttachmentState.blendEnable = VK_TRUE;
-        blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-        blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-        blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
-        blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-        blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-        blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
-        VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.pbrAlphaBlend));
+        // Vertex shader specialization: constant 0 selects the octahedral normal decode
+        VkBool32 octahedralNormals = VK_FALSE;
+        VkSpecializationMapEntry specializationEntry = { 0, 0, sizeof(VkBool32) };
+        VkSpecializationInfo specializationInfo = { 1, &specializationEntry, sizeof(VkBool32), &octahedralNormals };
+        shaderStages[0].pSpecializationInfo = &specializationInfo;
+
+        // Bindless fragment shader specialization: constant 0 is the size of the texture array
+        int32_t textureCount = static_cast<int32_t>(bindlessTextureCount);
+        VkSpecializationMapEntry textureCountEntry = { 0, 0, sizeof(int32_t) };
+        VkSpecializationInfo textureCountInfo = { 1, &textureCountEntry, sizeof(int32_t), &textureCount };
+        if (bindless) {
+            shaderStages[1].pSpecializationInfo = &textureCountInfo;
+        }
+
+        /*
+            The formats follow the storage chosen by the loader, quantized attributes are expanded by the vertex fetch
+            Every vertex layout of the model gets its own pair of pipelines, with compute skinning a second pair
+            reads the skinned or morphed float positions and normals instead of the ones of the layout
+        */
+        const size_t layoutCount = scene.vertexLayouts.size();
+        const size_t pipelineCount = skinningActive ? 2 * layoutCount : layoutCount;
+        pipelines.pbr.resize(pipelineCount, VK_NULL_HANDLE);
+        pipelines.pbrAlphaBlend.resize(pipelineCount, VK_NULL_HANDLE);
+        pipelines.depth.resize(occlusion ? pipelineCount : 0, VK_NULL_HANDLE);
+
+        // The occluders only write depth into the depth pyramid pass, without a fragment stage
+        VkPipelineColorBlendStateCreateInfo depthColorBlendStateCI{};
+        depthColorBlendStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        VkPipelineMultisampleStateCreateInfo depthMultisampleStateCI{};
+        depthMultisampleStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        depthMultisampleStateCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        VkGraphicsPipelineCreateInfo depthPipelineCI = pipelineCI;
+        depthPipelineCI.renderPass = depthPyramid.renderPass;
+        depthPipelineCI.pColorBlendState = &depthColorBlendStateCI;
+        depthPipelineCI.pMultisampleState = &depthMultisampleStateCI;
+        depthPipelineCI.stageCount = 1;
+
+        for (size_t i = 0; i < pipelineCount; i++) {
+            const vkglTF::VertexLayout &layout = scene.vertexLayouts[i % layoutCount];
+            const bool deformed = i >= layoutCount;
+            std::vector<VkVertexInputBindingDescription> vertexInputBindings = layout.inputBindings();
+            std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = layout.inputAttributes();
+            if (deformed) {
+                vertexInputBindings.push_back({ ComputeSkinning::binding, ComputeSkinning::stride, VK_VERTEX_INPUT_RATE_VERTEX });
+                vertexInputAttributes[vkglTF::VertexLayout::POSITION] = {
+                    vkglTF::VertexLayout::POSITION, ComputeSkinning::binding, VK_FORMAT_R32G32B32_SFLOAT, 0
+                };
+                vertexInputAttributes[vkglTF::VertexLayout::NORMAL] = {
+                    vkglTF::VertexLayout::NORMAL, ComputeSkinning::binding, VK_FORMAT_R32G32B32_SFLOAT, 3 * sizeof(float)
+                };
+            }
+            vertexInputStateCI.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInputBindings.size());
+            vertexInputStateCI.pVertexBindingDescriptions = vertexInputBindings.data();
+            vertexInputStateCI.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
+            vertexInputStateCI.pVertexAttributeDescriptions = vertexInputAttributes.data();
+            octahedralNormals = !deformed &&
+                layout.attributes[vkglTF::VertexLayout::NORMAL].encoding == vkglTF::streams::Encoding::OCTAHEDRAL16;
+
+            // PBR pipeline
+            rasterizationStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
+            blendAttachmentState.blendEnable = VK_FALSE;
+            depthStencilStateCI.depthWriteEnable = VK_TRUE;
+            depthStencilStateCI.depthTestEnable = VK_TRUE;
+            VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.pbr[i]));
+            if (occlusion) {
+                VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &depthPipelineCI, nullptr, &pipelines.depth[i]));
+            }
+
+            rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
+            blendAttachmentState.blendEnable = VK_TRUE;
+            blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+            blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+            blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+            blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+            blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+            blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+            blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+            VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.pbrAlphaBlend[i]));
+        }
 
         for (auto shaderStage : shaderStages) {
             vkDestroyShaderModule(device, shaderStage.module, nullptr);
         }
+
+        // Culling pass
+        if(cullPipelineLayout) {
+            vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+            cullPipelineLayout = VK_NULL_HANDLE;
+        }
+        if (gpuCulling) {
+            VkPipelineLayoutCreateInfo cullPipelineLayoutCI{};
+            cullPipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            cullPipelineLayoutCI.setLayoutCount = 1;
+            cullPipelineLayoutCI.pSetLayouts = &descriptorSetLayouts.cull;
+            // Phase of the culling pass
+            VkPushConstantRange cullPushConstantRange{};
+            cullPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            cullPushConstantRange.size = sizeof(CullPushConstants);
+            cullPipelineLayoutCI.pushConstantRangeCount = 1;
+            cullPipelineLayoutCI.pPushConstantRanges = &cullPushConstantRange;
+            VK_CHECK_RESULT(vkCreatePipelineLayout(device, &cullPipelineLayoutCI, nullptr, &cullPipelineLayout));
+
+            VkComputePipelineCreateInfo computePipelineCI{};
+            computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            computePipelineCI.layout = cullPipelineLayout;
+            computePipelineCI.stage = loadShader(device, "cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+            VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, &cullPipeline));
+            vkDestroyShaderModule(device, computePipelineCI.stage.module, nullptr);
+        }
     }
 
     void GLTFRender::recordCommandBuffers(VkCommandBuffer currentCB, uint32_t frameIndex)
     {
+        auto tStart = std::chrono::high_resolution_clock::now();
+
         vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[frameIndex].scene, 0, nullptr);
-        vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.pbr);
+        if (bindless) {
+            // The command buffer of this frame is not pending while it is recorded, so neither is its set
+            if (bindlessStale[frameIndex]) {
+                writeBindlessDescriptorSet(frameIndex);
+            }
+            vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &descriptorSets[frameIndex].materials, 0, nullptr);
+        }
+        if (indirect) {
+            recordIndirectDraws(currentCB, frameIndex);
+            recordStats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+            return;
+        }
+
+        // Culling on the CPU holds until the camera, the model transform or the animated nodes move
+        recordedCullMatrix = cullMatrix();
+        boundsMoved = false;
+        const vkglTF::Frustum frustum(recordedCullMatrix);
+        std::fill(nodeVisibility.begin(), nodeVisibility.end(), 0);
+        for (auto node : scene.nodes) {
+            cullNode(node, frustumCulling ? &frustum : nullptr);
+        }
+
+        /*
+            The list is sorted by the state it binds, a draw only binds what differs from the previous one
+            The pipeline layout is the same for all pipelines, so neither a pipeline nor a set bind disturbs the
+            other sets or the push constants
+        */
+        VkPipeline boundPipeline = VK_NULL_HANDLE;
+        uint32_t boundLayout = UINT32_MAX;
+        VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+        const vkglTF::Material *boundMaterial = nullptr;
+        uint32_t boundOffset = UINT32_MAX;
+        uint32_t drawCount = 0;
+        // Calls the recording per primitive in tree order issued, one material push per primitive and one set bind
+        // per primitive, or per node and alpha mode with bindless materials
+        uint32_t treeBinds = 0;
+        recordStats.descriptorBinds = 0;
+        recordStats.pushConstants = 0;
+        for (const ListDraw &draw : drawList) {
+            const vkglTF::Node *node = draw.node;
+            const vkglTF::Primitive *primitive = draw.primitive;
+            uint8_t &visibility = nodeVisibility[node->index];
+            if (!node->mesh->resident || !(visibility & 1)) {
+                continue;
+            }
+            const vkglTF::Material::AlphaMode alphaMode = primitive->material.alphaMode;
+            const uint8_t passBit = static_cast<uint8_t>(2 << alphaMode);
+            treeBinds += (!bindless || !(visibility & passBit)) ? 1 : 0;
+            visibility |= passBit;
+
+            // TODO: Correct depth sorting of the transparent primitives
+            const VkPipeline pipeline = (alphaMode == vkglTF::Material::ALPHAMODE_BLEND ? pipelines.pbrAlphaBlend : pipelines.pbr)[draw.variant];
+            if (pipeline != boundPipeline) {
+                vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                boundPipeline = pipeline;
+            }
+            if (draw.variant != boundLayout) {
+                scene.bindVertexBuffers(currentCB, primitive->layout);
+                if (draw.deformed) {
+                    skinning.bindVertices(currentCB, frameIndex, primitive->layout);
+                }
+                boundLayout = draw.variant;
+            }
+            if (primitive->hasIndices && primitive->indexType != boundIndexType) {
+                scene.bindIndexBuffer(currentCB, primitive->indexType);
+                boundIndexType = primitive->indexType;
+            }
+
+            const bool materialChanged = &primitive->material != boundMaterial;
+            const bool meshChanged = node->mesh->uniformOffset != boundOffset;
+            if (bindless) {
+                // Scene and materials are bound once, the node matrices per mesh
+                if (meshChanged) {
+                    vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1,
+                        &descriptorSets[frameIndex].nodes, 1, &node->mesh->uniformOffset);
+                    recordStats.descriptorBinds++;
+                }
+                if (materialChanged) {
+                    const int32_t materialIndex = static_cast<int32_t>(&primitive->material - scene.materials.data());
+                    vkCmdPushConstants(currentCB, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(int32_t), &materialIndex);
+                    recordStats.pushConstants++;
+                }
+            } else {
+                // The scene set stays bound from the start of the command buffer, a material bind brings the nodes along
+                if (materialChanged) {
+                    const std::array<VkDescriptorSet, 2> descriptorsets = {
+                        primitive->material.descriptorSet,
+                        descriptorSets[frameIndex].nodes,
+                    };
+                    vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1,
+                        static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), 1, &node->mesh->uniformOffset);
+                    recordStats.descriptorBinds++;
 
-        vkglTF::Model &model = scene;
-        VkDeviceSize offsets[1] = { 0 };
-        vkCmdBindVertexBuffers(currentCB, 0, 1, &model.vertices.buffer, offsets);
-        if (model.indices.buffer != VK_NULL_HANDLE) {
-            vkCmdBindIndexBuffer(currentCB, model.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+                    // Pass material parameters as push constants
+                    const PushConstBlockMaterial pushConstBlockMaterial = materialParameters(primitive->material);
+                    vkCmdPushConstants(currentCB, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlockMaterial), &pushConstBlockMaterial);
+                    recordStats.pushConstants++;
+                } else if (meshChanged) {
+                    vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1,
+                        &descriptorSets[frameIndex].nodes, 1, &node->mesh->uniformOffset);
+                    recordStats.descriptorBinds++;
+                }
+            }
+            boundMaterial = &primitive->material;
+            boundOffset = node->mesh->uniformOffset;
+
+            if (primitive->hasIndices) {
+                vkCmdDrawIndexed(currentCB, primitive->indexCount, 1, primitive->firstIndex, primitive->firstVertex, 0);
+            } else {
+                vkCmdDraw(currentCB, primitive->vertexCount, 1, primitive->firstVertex, 0);
+            }
+            drawCount++;
         }
 
-        // Opaque primitives first
-        for (auto node : model.nodes) {
-            renderNode(currentCB, node, frameIndex, vkglTF::Material::ALPHAMODE_OPAQUE);
+        recordStats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        recordStats.draws = drawCount;
+        recordStats.drawCalls = drawCount;
+        recordStats.treeDescriptorBinds = treeBinds;
+        recordStats.treePushConstants = drawCount;
+
+        cullStats.visible = drawCount;
+        cullStats.total = 0;
+        for (auto node : scene.linearNodes) {
+            if (node->mesh && node->mesh->resident) {
+                cullStats.total += static_cast<uint32_t>(node->mesh->primitives.size());
+            }
         }
-        // Alpha masked primitives
-        for (auto node : model.nodes) {
-            renderNode(currentCB, node, frameIndex, vkglTF::Material::ALPHAMODE_MASK);
+        cullStats.frustumCulled = cullStats.total - cullStats.visible;
+        cullStats.occlusionCulled = 0;
+    }
+
+    void GLTFRender::setViewExtent(uint32_t width, uint32_t height)
+    {
+        if (width == viewExtent.width && height == viewExtent.height) {
+            return;
+        }
+        viewExtent = { width, height };
+        if (!occlusion) {
+            return;
         }
-        // Transparent primitives
-        // TODO: Correct depth sorting
-        vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.pbrAlphaBlend);
-        for (auto node : model.nodes) {
-            renderNode(currentCB, node, frameIndex, vkglTF::Material::ALPHAMODE_BLEND);
+        depthPyramid.resize(width, height);
+        for (const IndirectFrame &frame : indirectFrames) {
+            writeCullDescriptorSet(frame);
         }
     }
 
-    void GLTFRender::renderNode(VkCommandBuffer currentCB, vkglTF::Node *node, uint32_t cbIndex, vkglTF::Material::AlphaMode alphaMode)
+    /*
+        Without occlusion culling one culling pass sets the instance counts of the draws in the render pass
+        With occlusion culling:
+            - phase 0 enables the draws which were visible in the last frame and are inside the frustum
+            - their opaque primitives are drawn into the depth target, which is reduced to the depth pyramid
+            - phase 1 tests every draw against the frustum and the pyramid, the draws of the render pass
+              and the occluders of the next frame are the ones passing both
+        Primitives first seen in a frame are only tested against the depth of the occluders of that frame,
+        they show up in the same frame they get visible
+    */
+    void GLTFRender::recordCompute(VkCommandBuffer currentCB, uint32_t frameIndex)
     {
-        if (node->mesh) {
-            // Render mesh primitives
-            for (vkglTF::Primitive * primitive : node->mesh->primitives) {
-                if (primitive->material.alphaMode == alphaMode) {
+        // The occluders of the depth pyramid already draw the deformed vertices
+        if (skinningActive) {
+            skinning.record(currentCB, frameIndex);
+        }
+        if (!gpuCulling || indirectPrimitives.empty()) {
+            return;
+        }
+        IndirectFrame &frame = indirectFrames[frameIndex];
+        if (frame.stale) {
+            writeDrawCommands(frameIndex);
+        }
+        const uint32_t groupCount = (static_cast<uint32_t>(indirectPrimitives.size()) + 63) / 64;
+
+        // The culling of the previous frame wrote the visibility
+        vkCmdFillBuffer(currentCB, frame.stats.buffer, 0, sizeof(CullCounters), 0);
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(currentCB, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &frame.cullDescriptorSet, 0, nullptr);
+
+        // The instance counts start at zero, every visible instance of a command takes the next slot of its list
+        auto cull = [&](uint32_t phase) {
+            CullPushConstants pushConstants{ phase, 1 };
+            vkCmdPushConstants(currentCB, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+            vkCmdDispatch(currentCB, groupCount, 1, 1);
+
+            VkMemoryBarrier resetBarrier{};
+            resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            resetBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(currentCB, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                1, &resetBarrier, 0, nullptr, 0, nullptr);
+
+            pushConstants.reset = 0;
+            vkCmdPushConstants(currentCB, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+            vkCmdDispatch(currentCB, groupCount, 1, 1);
+        };
 
-                    const std::vector<VkDescriptorSet> descriptorsets = {
-                        descriptorSets[cbIndex].scene,
-                        primitive->material.descriptorSet,
-                        node->mesh->uniformBuffer.descriptorSet,
-                    };
-                    vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0,
-                        static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), 0, NULL);
+        if (occlusion) {
+            cull(0);
 
-                    // Pass material parameters as push constants
-                    PushConstBlockMaterial pushConstBlockMaterial{};					
-                    pushConstBlockMaterial.emissiveFactor = primitive->material.emissiveFactor;
-                    // To save push constant space, availabilty and texture coordiante set are combined
-                    // -1 = texture not used for this material, >= 0 texture used and index of texture coordinate set
-                    pushConstBlockMaterial.colorTextureSet = primitive->material.baseColorTexture != nullptr ? primitive->material.texCoordSets.baseColor : -1;
-                    pushConstBlockMaterial.normalTextureSet = primitive->material.normalTexture != nullptr ? primitive->material.texCoordSets.normal : -1;
-                    pushConstBlockMaterial.occlusionTextureSet = primitive->material.occlusionTexture != nullptr ? primitive->material.texCoordSets.occlusion : -1;
-                    pushConstBlockMaterial.emissiveTextureSet = primitive->material.emissiveTexture != nullptr ? primitive->material.texCoordSets.emissive : -1;
-                    pushConstBlockMaterial.alphaMask = static_cast<float>(primitive->material.alphaMode == vkglTF::Material::ALPHAMODE_MASK);
-                    pushConstBlockMaterial.alphaMaskCutoff = primitive->material.alphaCutoff;
-
-                    // TODO: glTF specs states that metallic roughness should be preferred, even if specular glosiness is present
-
-                    if (primitive->material.pbrWorkflows.metallicRoughness) {
-                        // Metallic roughness workflow
-                        pushConstBlockMaterial.workflow = static_cast<float>(PBR_WORKFLOW_METALLIC_ROUGHNESS);
-                        pushConstBlockMaterial.baseColorFactor = primitive->material.baseColorFactor;
-                        pushConstBlockMaterial.metallicFactor = primitive->material.metallicFactor;
-                        pushConstBlockMaterial.roughnessFactor = primitive->material.roughnessFactor;
-                        pushConstBlockMaterial.PhysicalDescriptorTextureSet = primitive->material.metallicRoughnessTexture != nullptr ?
-                            primitive->material.texCoordSets.metallicRoughness : -1;
-                        pushConstBlockMaterial.colorTextureSet = primitive->material.baseColorTexture != nullptr ? primitive->material.texCoordSets.baseColor : -1;
-                    }
+            // The vertex shader reads the instance lists
+            memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(currentCB, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+                1, &memoryBarrier, 0, nullptr, 0, nullptr);
 
-                    if (primitive->material.pbrWorkflows.specularGlossiness) {
-                        // Specular glossiness workflow
-                        pushConstBlockMaterial.workflow = static_cast<float>(PBR_WORKFLOW_SPECULAR_GLOSINESS);
-                        pushConstBlockMaterial.PhysicalDescriptorTextureSet = primitive->material.extension.specularGlossinessTexture != nullptr ?
-                            primitive->material.texCoordSets.specularGlossiness : -1;
-                        pushConstBlockMaterial.colorTextureSet = primitive->material.extension.diffuseTexture != nullptr ? primitive->material.texCoordSets.baseColor : -1;
-                        pushConstBlockMaterial.diffuseFactor = primitive->material.extension.diffuseFactor;
-                        pushConstBlockMaterial.specularFactor = glm::vec4(primitive->material.extension.specularFactor, 1.0f);
-                    }
+            depthPyramid.beginDepthPass(currentCB);
+            vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[frameIndex].scene, 0, nullptr);
+            vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &frame.descriptorSet, 0, nullptr);
+            recordDrawGroups(currentCB, frameIndex, true);
+            vkCmdEndRenderPass(currentCB);
 
-                    vkCmdPushConstants(currentCB, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlockMaterial), &pushConstBlockMaterial);
+            depthPyramid.build(currentCB);
 
-                    if (primitive->hasIndices) {
-                        vkCmdDrawIndexed(currentCB, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
-                    } else {
-                        vkCmdDraw(currentCB, primitive->vertexCount, 1, 0, 0);
-                    }
+            // Phase 1 rewrites the commands and instances the occluders were drawn with
+            memoryBarrier.srcAccessMask = 0;
+            memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(currentCB, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+            vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+            vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &frame.cullDescriptorSet, 0, nullptr);
+        }
+        cull(1);
+
+        // The draws read the instance counts and lists, the host reads the stats once the frame has finished
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(currentCB, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+            1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    void GLTFRender::collectCullStats(uint32_t frameIndex)
+    {
+        if (!gpuCulling) {
+            return;
+        }
+        const CullCounters *counters = static_cast<const CullCounters *>(indirectFrames[frameIndex].stats.mapped);
+        cullStats.visible = counters->visible;
+        cullStats.frustumCulled = counters->frustumCulled;
+        cullStats.occlusionCulled = counters->occlusionCulled;
+        cullStats.total = static_cast<uint32_t>(indirectPrimitives.size());
+    }
+
+    bool GLTFRender::updateVisibility()
+    {
+        // Indirect draws are culled on the GPU every frame
+        if (!frustumCulling || indirect) {
+            return false;
+        }
+        return boundsMoved || cullMatrix() != recordedCullMatrix;
+    }
+
+    void GLTFRender::recordIndirectDraws(VkCommandBuffer currentCB, uint32_t frameIndex)
+    {
+        IndirectFrame &frame = indirectFrames[frameIndex];
+        if (frame.stale) {
+            writeDrawCommands(frameIndex);
+        }
+        vkCmdBindDescriptorSets(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &frame.descriptorSet, 0, nullptr);
+
+        recordStats.draws = frame.residentDraws;
+        recordStats.drawCalls = 0;
+        recordDrawGroups(currentCB, frameIndex, false);
+    }
+
+    /*
+        The depth only pass draws the opaque groups, alpha masked primitives need their fragment shader
+    */
+    void GLTFRender::recordDrawGroups(VkCommandBuffer currentCB, uint32_t frameIndex, bool depthOnly)
+    {
+        const IndirectFrame &frame = indirectFrames[frameIndex];
+        // Without multiDrawIndirect every command needs a call of its own
+        const uint32_t maxDrawCount = vulkanDevice->enabledFeatures.multiDrawIndirect ?
+            vulkanDevice->properties.limits.maxDrawIndirectCount : 1;
+
+        VkPipeline boundPipeline = VK_NULL_HANDLE;
+        uint32_t boundLayout = UINT32_MAX;
+        VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+        for (const DrawGroup &group : drawGroups) {
+            const uint32_t count = group.batchCount;
+            if (depthOnly && group.alphaMode != vkglTF::Material::ALPHAMODE_OPAQUE) {
+                continue;
+            }
+
+            // TODO: Correct depth sorting of the transparent primitives
+            const uint32_t variant = pipelineIndex(group.layout, group.deformed);
+            const VkPipeline pipeline = (depthOnly ? pipelines.depth :
+                group.alphaMode == vkglTF::Material::ALPHAMODE_BLEND ? pipelines.pbrAlphaBlend : pipelines.pbr)[variant];
+            if (pipeline != boundPipeline) {
+                vkCmdBindPipeline(currentCB, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                boundPipeline = pipeline;
+            }
+            if (variant != boundLayout) {
+                scene.bindVertexBuffers(currentCB, group.layout);
+                if (group.deformed) {
+                    skinning.bindVertices(currentCB, frameIndex, group.layout);
                 }
+                boundLayout = variant;
+            }
+            if (group.indexed && group.indexType != boundIndexType) {
+                scene.bindIndexBuffer(currentCB, group.indexType);
+                boundIndexType = group.indexType;
             }
 
-        };
+            const uint32_t stride = group.indexed ? sizeof(VkDrawIndexedIndirectCommand) : sizeof(VkDrawIndirectCommand);
+            for (uint32_t first = 0; first < count; first += maxDrawCount) {
+                const uint32_t drawCount = std::min(maxDrawCount, count - first);
+                const VkDeviceSize offset = group.offset + static_cast<VkDeviceSize>(first) * stride;
+                if (group.indexed) {
+                    vkCmdDrawIndexedIndirect(currentCB, frame.commands.buffer, offset, drawCount, stride);
+                } else {
+                    vkCmdDrawIndirect(currentCB, frame.commands.buffer, offset, drawCount, stride);
+                }
+                recordStats.drawCalls += depthOnly ? 0 : 1;
+            }
+        }
+    }
+
+    /*
+        The frustum is tested against the bounding volume of each subtree, a subtree entirely inside is not tested any further
+    */
+    void GLTFRender::cullNode(const vkglTF::Node *node, const vkglTF::Frustum *frustum)
+    {
+        if (frustum) {
+            // A subtree without a volume has no meshes
+            const vkglTF::Frustum::Result result = node->bvh.valid ? frustum->test(node->bvh) : vkglTF::Frustum::OUTSIDE;
+            if (result == vkglTF::Frustum::OUTSIDE) {
+                return;
+            }
+            if (result == vkglTF::Frustum::INSIDE) {
+                frustum = nullptr;
+            }
+        }
+        if (node->mesh) {
+            const bool meshVisible = !frustum || !node->aabb.valid || node->skin || frustum->test(node->aabb) != vkglTF::Frustum::OUTSIDE;
+            nodeVisibility[node->index] = meshVisible ? 1 : 0;
+        }
         for (auto child : node->children) {
-            renderNode(currentCB, child, cbIndex, alphaMode);
+            cullNode(child, frustum);
+        }
+    }
+
+    bool GLTFRender::updateStreaming()
+    {
+        if (!scene.updateResidency()) {
+            return false;
         }
+        // Bindless sets pick up the textures when their frame is recorded again
+        if (bindless) {
+            std::fill(bindlessStale.begin(), bindlessStale.end(), true);
+        }
+        for (auto &frame : indirectFrames) {
+            frame.stale = true;
+        }
+        for (size_t i = 0; i < materialPlaceholders.size(); i++) {
+            if (materialPlaceholders[i] && materialResident(scene.materials[i])) {
+                writeMaterialDescriptorSet(scene.materials[i]);
+                materialPlaceholders[i] = false;
+            }
+        }
+        return true;
     }
 
     vkglTF::Model* GLTFRender::getModel()
@@ -606,6 +1725,7 @@ namespace xy
                     animationTimer -= scene.animations[i].end;
                 }
                 scene.updateAnimation(i, animationTimer);
+                boundsMoved = true;
             }
         }
     }
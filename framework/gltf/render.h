@@ -15,7 +15,9 @@
 #include "camera.hpp"
 #include "vulkan/buffer.h"
 #include "vulkan/device.h"
+#include "depthpyramid.h"
 #include "model.h"
+#include "skinning.h"
 #include "textures.h"
 
 namespace xy
@@ -28,6 +30,10 @@ namespace xy
 
         struct UniformBufferSet {
             Buffer scene;
+            // Material parameters of the bindless mode
+            Buffer materials;
+            // Node arena, the matrices of every mesh without indirect draws addressed with a dynamic offset
+            Buffer nodes;
         };
 
         struct UBOMatrices {
@@ -54,23 +60,216 @@ namespace xy
             float alphaMaskCutoff;
         } pushConstBlockMaterial;
 
+        /*
+            Material in the storage buffer of the bindless mode, the std430 layout of MaterialData in pbr_khr.frag
+            The textures are indices into the texture array, 0 is the empty texture
+        */
+        struct MaterialData {
+            PushConstBlockMaterial parameters;
+            int32_t colorTexture;
+            int32_t physicalDescriptorTexture;
+            int32_t normalTexture;
+            int32_t occlusionTexture;
+            int32_t emissiveTexture;
+            int32_t padding;
+        };
+
+        /*
+            Start of the matrices of a mesh in the node arena, the std140 layout of UBONode in pbr.vert
+            The joint matrices of the skin follow, the next mesh starts behind them
+        */
+        struct NodeBlockHeader {
+            glm::mat4 matrix;
+            float jointCount;
+            float padding[3];
+        };
+        static_assert(sizeof(NodeBlockHeader) == 80, "jointMatrix of UBONode in pbr.vert starts at byte 80");
+
+        /*
+            Per draw data of the indirect path, the std430 layout of DrawData in pbr.vert and cull.comp
+            Draws of the same geometry and material are instances of one draw command, the instance buffer of a frame
+            maps the instances of a command to their DrawData
+        */
+        struct DrawData {
+            // Index of the node matrix in the transform buffer, the joint matrices follow it
+            uint32_t transform;
+            uint32_t jointCount;
+            uint32_t material;
+            // Index of the instance count of the draw command in 32 bit words, written by the culling pass
+            uint32_t command;
+            // First instance of the draw command, its instances are listed from there in the instance buffer
+            uint32_t firstInstance;
+        };
+        static_assert(sizeof(DrawData) == 20, "DrawData in pbr.vert and cull.comp is five uints");
+
+        /*
+            Bounds of a primitive in the space of its node for the culling pass, the std430 layout of DrawBounds in cull.comp
+            A negative extent.w marks skinned primitives and primitives without bounds, they are never culled
+        */
+        struct DrawBounds {
+            glm::vec4 center;
+            glm::vec4 extent;
+        };
+
+        /*
+            Frustum planes and the transform to clip space from the space of the model, the layout of UBOCull in cull.comp
+            occlusion enables the test against the depth pyramid
+        */
+        struct UBOCull {
+            glm::vec4 planes[6];
+            glm::mat4 viewProjection;
+            uint32_t drawCount;
+            uint32_t occlusion;
+        };
+
+        // The layout of PushConsts in cull.comp, a reset dispatch clears the instance counts before each phase
+        struct CullPushConstants {
+            uint32_t phase;
+            uint32_t reset;
+        };
+
+        // Draws and counters written by the culling pass, the layout of Stats in cull.comp
+        struct CullCounters {
+            uint32_t visible;
+            uint32_t frustumCulled;
+            uint32_t occlusionCulled;
+        };
+
+        // Draws sharing the geometry and material of a primitive, drawn by one instanced command
+        struct DrawBatch {
+            uint32_t first;
+            uint32_t count;
+        };
+
+        /*
+            Primitives of one alpha mode, vertex layout, deformation and index type, recorded as one indirect call
+            Their commands, one per batch, start at offset in the command buffer of a frame
+        */
+        struct DrawGroup {
+            vkglTF::Material::AlphaMode alphaMode;
+            uint32_t layout;
+            // Reads the vertices of the compute skinning and morph targets
+            bool deformed;
+            bool indexed;
+            VkIndexType indexType;
+            uint32_t firstBatch;
+            uint32_t batchCount;
+            VkDeviceSize offset;
+        };
+
+        /*
+            Node matrices and draw commands of one frame of the indirect path, every batch has a fixed command slot
+            Meshes which are not resident yet get empty commands, they are written again before the frame is
+            recorded once more meshes got resident
+            With GPU culling the culling pass sets the instance counts, lists the visible instances of every command
+            in instances and counts the visible and culled draws in stats
+        */
+        struct IndirectFrame {
+            Buffer transforms;
+            Buffer commands;
+            Buffer instances;
+            Buffer cull;
+            Buffer stats;
+            VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+            VkDescriptorSet cullDescriptorSet{VK_NULL_HANDLE};
+            uint32_t residentDraws = 0;
+            bool stale = true;
+        };
+
+        /*
+            One pipeline per vertex layout of the model, with compute skinning followed by one per vertex layout
+            reading the skinned or morphed positions and normals, see pipelineIndex
+        */
         struct Pipelines {
-            VkPipeline pbr{VK_NULL_HANDLE};
-            VkPipeline pbrAlphaBlend{VK_NULL_HANDLE};
+            std::vector<VkPipeline> pbr;
+            std::vector<VkPipeline> pbrAlphaBlend;
+            // Depth only pipelines of the occluder pass
+            std::vector<VkPipeline> depth;
         } pipelines;
 
         struct DescriptorSetLayouts {
             VkDescriptorSetLayout scene{VK_NULL_HANDLE};
             VkDescriptorSetLayout material{VK_NULL_HANDLE};
             VkDescriptorSetLayout node{VK_NULL_HANDLE};
+            VkDescriptorSetLayout cull{VK_NULL_HANDLE};
         } descriptorSetLayouts;
 
         struct DescriptorSets {
             VkDescriptorSet scene;
+            // Texture array and material buffer of the bindless mode
+            VkDescriptorSet materials{VK_NULL_HANDLE};
+            // Node arena of the frame without indirect draws
+            VkDescriptorSet nodes{VK_NULL_HANDLE};
         };
         std::vector<DescriptorSets>     descriptorSets;
         std::vector<UniformBufferSet>   uniformBuffers;
         std::vector<Buffer> *uniformBufferParams;
+        // Materials whose descriptor set still points at the empty texture for textures being streamed in
+        std::vector<bool>   materialPlaceholders;
+        // Bindless sets which miss textures streamed in since they were written, rewritten before their command buffer is recorded
+        std::vector<bool>   bindlessStale;
+
+        // Mode the descriptors and pipelines were set up for and the size of its texture array
+        bool        bindless = false;
+        uint32_t    bindlessTextureCount = 0;
+        bool        indirect = false;
+        // Frustum culling of the indirect draws by a compute pass
+        bool        gpuCulling = false;
+        // Occlusion culling of the indirect draws against the depth pyramid, needs the size of the view
+        bool        occlusion = false;
+        VkExtent2D  viewExtent{0, 0};
+
+        // Primitives of the indirect path sorted into their groups and batches, the DrawData of a draw has the same index
+        std::vector<std::pair<vkglTF::Node *, vkglTF::Primitive *>> indirectPrimitives;
+        std::vector<DrawBatch>      drawBatches;
+        std::vector<DrawGroup>      drawGroups;
+        std::vector<IndirectFrame>  indirectFrames;
+        Buffer                      drawData;
+        Buffer                      drawBounds;
+        // Draws which passed the culling of the last frame, they are the occluders of the next one
+        Buffer                      drawVisibility;
+        DepthPyramid                depthPyramid;
+        // Skinning and morph targets by a compute pass, skinned nodes draw its output without joints
+        ComputeSkinning             skinning;
+        bool                        skinningActive = false;
+        VkPipeline                  cullPipeline{VK_NULL_HANDLE};
+        VkPipelineLayout            cullPipelineLayout{VK_NULL_HANDLE};
+        // Culling the command buffers were recorded with, animations move the bounds
+        glm::mat4   recordedCullMatrix{0.0f};
+        bool        boundsMoved = false;
+        /*
+            Mesh nodes and where their node and joint matrices go, an index into the transform buffer with
+            indirect draws, a byte offset into the node arena otherwise
+        */
+        struct TransformSlot {
+            vkglTF::Node *node;
+            uint32_t transform;
+            uint32_t jointCount;
+            // Skinned by the compute pass, the vertices are in the space of the model already
+            bool skinned;
+        };
+        std::vector<TransformSlot>  transformSlots;
+        uint32_t    transformCount = 0;
+
+        /*
+            Primitive of the draw list without indirect draws, the list is sorted by key
+            From the top bits: alpha mode (2), pipeline variant (13), index type (1), material (24) and mesh (24),
+            mesh before material with bindless materials
+            Blended primitives keep the order of the tree below the alpha mode
+        */
+        struct ListDraw {
+            uint64_t key;
+            vkglTF::Node *node;
+            vkglTF::Primitive *primitive;
+            uint32_t variant;
+            bool deformed;
+        };
+        std::vector<ListDraw>   drawList;
+        /*
+            By node index, bit 0 is set when the mesh passed the frustum culling of the recording, the bit of an
+            alpha mode above it once primitives of that mode were drawn, see RecordStats
+        */
+        std::vector<uint8_t>    nodeVisibility;
 
         vkglTF::Model       scene;
         Camera             *camera;
@@ -90,8 +289,26 @@ namespace xy
         bool        animate          = true;
 
         void prepareUniformBuffers();
-        void setupNodeDescriptorSet(vkglTF::Node *node);
-        void renderNode(VkCommandBuffer currentCB, vkglTF::Node *node, uint32_t cbIndex, vkglTF::Material::AlphaMode alphaMode);
+        void buildNodeArena();
+        void writeMaterialDescriptorSet(vkglTF::Material &material);
+        bool bindlessSupported() const;
+        void writeBindlessDescriptorSet(uint32_t frameIndex);
+        PushConstBlockMaterial materialParameters(const vkglTF::Material &material) const;
+        bool indirectSupported() const;
+        void buildIndirectDraws();
+        void writeDrawCommands(uint32_t frameIndex);
+        void recordIndirectDraws(VkCommandBuffer currentCB, uint32_t frameIndex);
+        void recordDrawGroups(VkCommandBuffer currentCB, uint32_t frameIndex, bool depthOnly);
+        void writeCullDescriptorSet(const IndirectFrame &frame);
+        bool gpuCullingSupported() const;
+        bool occlusionCullingSupported() const;
+        bool computeSkinningSupported() const;
+        uint32_t pipelineIndex(uint32_t layout, bool deformed) const;
+        glm::mat4 modelMatrix() const;
+        glm::mat4 cullMatrix() const;
+        void destroyPipelines();
+        void buildDrawList();
+        void cullNode(const vkglTF::Node *node, const vkglTF::Frustum *frustum);
 
     public:
 
@@ -103,6 +320,79 @@ namespace xy
         glm::vec3 rotation = glm::vec3(0.0f, 0.0f, 0.0f);
         glm::vec3 scale    = glm::vec3(0.3f, 0.3f, 0.3f);
 
+        /*
+            Draw with one array of all model textures and the materials in a storage buffer, each draw only pushes
+            the index of its material, takes effect with the next setupDescriptors and preparePipelines
+            Falls back to a descriptor set per material when the device can not index sampler arrays, the
+            textures exceed the sampler limits or pbr_khr_bindless.frag.spv was not built
+        */
+        bool bindlessMaterials = true;
+
+        /*
+            Draw each group of primitives sharing an alpha mode, vertex layout and index type with one indirect
+            call, recording no longer depends on the number of primitives, needs the bindless materials
+            Falls back to a draw per primitive without drawIndirectFirstInstance or when pbr_indirect.vert.spv or
+            pbr_khr_indirect.frag.spv was not built
+            Takes effect with the next setupDescriptors and preparePipelines
+        */
+        bool indirectDraws = true;
+
+        /*
+            Skip primitives outside the view frustum, tested against the node bounding volume hierarchy while
+            recording, or per draw by a compute pass in front of the render pass with indirect draws
+            The compute pass needs cull.comp.spv, indirect draws are not culled when it was not built
+            Takes effect with the next setupDescriptors and preparePipelines
+        */
+        bool frustumCulling = true;
+
+        /*
+            Skip primitives hidden behind the primitives which were visible in the previous frame, their depth is
+            drawn in front of the render pass and reduced to a depth pyramid the bounds are tested against
+            Needs the GPU culling, setViewExtent and depthpyramid.comp.spv, takes effect with the next setupDescriptors
+            and preparePipelines
+        */
+        bool occlusionCulling = true;
+
+        /*
+            Skin the vertices of the skinned meshes in a compute pass in front of the render pass, with all joints
+            of a skin in one palette, instead of blending up to MAX_NUM_JOINTS joint matrices in the vertex shader
+            The same pass blends the morph targets, a model with morph targets runs it whatever this says
+            Needs skinning.comp.spv, skins in the vertex shader and draws morphed meshes at rest when it was not built
+            Takes effect with the next setupDescriptors and preparePipelines
+        */
+        bool computeSkinning = true;
+
+        // Primitives which passed the culling and primitives tested, of the last recording or last finished culling pass
+        struct CullStats {
+            uint32_t visible = 0;
+            uint32_t total = 0;
+            uint32_t frustumCulled = 0;
+            uint32_t occlusionCulled = 0;
+        } cullStats;
+
+        /*
+            CPU time, draws and draw calls of the last recording of the model, an indirect call executes many draws
+            Without indirect draws also the descriptor set binds and push constants issued from the draw list, next to
+            the ones a recording of the same draws per primitive in tree order issues
+        */
+        struct RecordStats {
+            double milliseconds = 0.0;
+            uint32_t draws = 0;
+            uint32_t drawCalls = 0;
+            uint32_t descriptorBinds = 0;
+            uint32_t pushConstants = 0;
+            uint32_t treeDescriptorBinds = 0;
+            uint32_t treePushConstants = 0;
+        } recordStats;
+
+        bool bindlessActive() const { return bindless; }
+        bool indirectActive() const { return indirect; }
+        bool gpuCullingActive() const { return gpuCulling; }
+        bool occlusionCullingActive() const { return occlusion; }
+        bool computeSkinningActive() const { return skinningActive; }
+        // The model has morph targets, which only the compute skinning pass blends
+        bool computeSkinningRequired() const { return !scene.morphTargets.empty(); }
+
         GLTFRender(VulkanDevice *vulkanDevice, uint32_t frameBufferCount, VkRenderPass renderPass,
             VkQueue queue, VkPipelineCache pipelineCache, VkSampleCountFlagBits multiSampleCount, Textures *textures,
             Camera *camera, std::vector<Buffer> *uniformBufferParams);
@@ -113,7 +403,37 @@ namespace xy
         void setupDescriptors();
         void preparePipelines();
         void recordCommandBuffers(VkCommandBuffer currentCB, uint32_t frameIndex);
+
+        /*
+            Size of the view the model is drawn into, the depth pyramid of the occlusion culling follows it
+            Call it before setupDescriptors and whenever the window is resized, the device must be idle
+        */
+        void setViewExtent(uint32_t width, uint32_t height);
+
+        /*
+            Record the work in front of the render pass, the compute skinning, the culling pass of the indirect draws
+            and with occlusion culling the depth of the occluders and the depth pyramid
+        */
+        void recordCompute(VkCommandBuffer currentCB, uint32_t frameIndex);
+
+        /*
+            Read the result of the last culling pass of the frame, its command buffer must have finished
+        */
+        void collectCullStats(uint32_t frameIndex);
+
+        /*
+            Returns true when the command buffers have to be recorded again because they cull on the CPU and the
+            camera, the model transform or animated nodes moved since
+        */
+        bool updateVisibility();
         void render(float time);
+
+        /*
+            Take over the meshes and textures streamed in since the last frame, materials which got all their
+            textures get a new descriptor set, the old one may still be used by frames in flight
+            Returns true when the command buffers have to be recorded again
+        */
+        bool updateStreaming();
     };
 
 } //namespace xy
\ No newline at end of file
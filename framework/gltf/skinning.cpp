@@ -0,0 +1,326 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Compute skinning and morph targets of the GLTF Model
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include "gltf/skinning.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <unordered_map>
+
+#include "logger.h"
+#include "vulkan/utils.h"
+#include "vulkan/macros.h"
+
+namespace xy
+{
+
+    void ComputeSkinning::init(VulkanDevice *vulkanDevice, VkPipelineCache pipelineCache)
+    {
+        this->vulkanDevice = vulkanDevice;
+        this->device = vulkanDevice->logicalDevice;
+
+        // Vertex streams of the model, joint palette, deformed vertices, morph weights and morph deltas
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+            { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+            { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+            { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+            { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+            { 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+        descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        descriptorSetLayoutCI.pBindings = setLayoutBindings.data();
+        descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+        VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(PushConstBlockSkin);
+        VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+        pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCI.setLayoutCount = 1;
+        pipelineLayoutCI.pSetLayouts = &descriptorSetLayout;
+        pipelineLayoutCI.pushConstantRangeCount = 1;
+        pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+        VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
+
+        VkComputePipelineCreateInfo computePipelineCI{};
+        computePipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        computePipelineCI.layout = pipelineLayout;
+        computePipelineCI.stage = loadShader(device, "skinning.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+        VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, &pipeline));
+        vkDestroyShaderModule(device, computePipelineCI.stage.module, nullptr);
+    }
+
+    bool ComputeSkinning::build(vkglTF::Model &model, uint32_t frameCount)
+    {
+        destroyFrames();
+        jobs.clear();
+        nodes.clear();
+        skinnedNodes.clear();
+        skins.clear();
+        paletteSize = 0;
+        morphTargets = model.morphTargets;
+        morphWeightCount = 0;
+
+        // The output is indexed by the vertices of a mesh, a mesh skinned by several nodes would need one per node
+        std::unordered_map<const vkglTF::Mesh *, uint32_t> meshSkins;
+        for (auto node : model.linearNodes) {
+            if (node->mesh && node->skin) {
+                meshSkins[node->mesh]++;
+            }
+        }
+
+        const vkglTF::VertexLayout::Attribute skinAttributes[4] = {
+            vkglTF::VertexLayout::POSITION, vkglTF::VertexLayout::NORMAL, vkglTF::VertexLayout::JOINT0, vkglTF::VertexLayout::WEIGHT0
+        };
+        std::vector<uint32_t> jobLayouts;
+        std::vector<bool> layoutDeformed(model.vertexLayouts.size(), false);
+        for (auto node : model.linearNodes) {
+            if (!node->mesh) {
+                continue;
+            }
+            const bool skinned = node->skin && !node->skin->joints.empty() && meshSkins[node->mesh] == 1;
+            const bool morphed = !node->mesh->morphWeights.empty() && std::any_of(node->mesh->primitives.begin(),
+                node->mesh->primitives.end(), [](const vkglTF::Primitive *primitive) { return primitive->morphTargetCount > 0; });
+            if (!skinned && !morphed) {
+                continue;
+            }
+            uint32_t palette = 0;
+            if (skinned) {
+                auto skin = std::find_if(skins.begin(), skins.end(), [node](const std::pair<const vkglTF::Skin *, uint32_t> &entry) {
+                    return entry.first == node->skin;
+                });
+                if (skin == skins.end()) {
+                    skins.push_back({ node->skin, paletteSize });
+                    paletteSize += static_cast<uint32_t>(node->skin->joints.size());
+                    skin = skins.end() - 1;
+                }
+                palette = skin->second;
+                skinnedNodes.push_back(node);
+            }
+            nodes.push_back(node);
+
+            for (const vkglTF::Primitive *primitive : node->mesh->primitives) {
+                const vkglTF::VertexLayout &layout = model.vertexLayouts[primitive->layout];
+                Job job{};
+                job.mesh = node->mesh;
+                job.firstMorphTarget = primitive->firstMorphTarget;
+                job.morphTargetCount = primitive->morphTargetCount;
+                PushConstBlockSkin &block = job.pushConstBlock;
+                for (uint32_t i = 0; i < 4; i++) {
+                    const vkglTF::VertexLayout::AttributeFormat &format = layout.attributes[skinAttributes[i]];
+                    if (format.present) {
+                        block.attributes[i] = glm::uvec4(static_cast<uint32_t>(layout.bufferOffsets[format.binding]) + format.offset,
+                            layout.strides[format.binding], static_cast<uint32_t>(format.encoding), 0);
+                    } else {
+                        block.attributes[i] = glm::uvec4(format.offset, 0, static_cast<uint32_t>(vkglTF::streams::Encoding::FLOAT32), 0);
+                    }
+                }
+                block.firstVertex = primitive->firstVertex;
+                block.vertexCount = primitive->vertexCount;
+                block.palette = palette;
+                block.jointCount = skinned ? static_cast<uint32_t>(node->skin->joints.size()) : 0;
+                // The count of the active targets followed by room for all of them
+                block.morphs = morphWeightCount;
+                morphWeightCount += 1 + job.morphTargetCount;
+                jobs.push_back(job);
+                jobLayouts.push_back(primitive->layout);
+                layoutDeformed[primitive->layout] = true;
+            }
+        }
+        std::sort(nodes.begin(), nodes.end());
+        std::sort(skinnedNodes.begin(), skinnedNodes.end());
+        if (jobs.empty()) {
+            return false;
+        }
+
+        // Only the layouts with skinned primitives get a region
+        uint32_t outputSize = 0;
+        layoutOffsets.assign(model.vertexLayouts.size(), 0);
+        for (size_t l = 0; l < model.vertexLayouts.size(); l++) {
+            layoutOffsets[l] = outputSize;
+            outputSize += layoutDeformed[l] ? model.vertexLayouts[l].vertexCount : 0;
+        }
+        for (size_t j = 0; j < jobs.size(); j++) {
+            jobs[j].pushConstBlock.firstOutput = layoutOffsets[jobLayouts[j]];
+        }
+
+        // Storage buffers can not be empty, models without skins or morph targets get a dummy element
+        morphDeltas.create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            std::max<size_t>(1, model.morphDeltas.size()) * sizeof(vkglTF::MorphDelta));
+        if (!model.morphDeltas.empty()) {
+            memcpy(morphDeltas.mapped, model.morphDeltas.data(), model.morphDeltas.size() * sizeof(vkglTF::MorphDelta));
+        }
+
+        /*
+            Palette, morph weights, deformed vertices and descriptor set per frame
+        */
+        VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 * frameCount };
+        VkDescriptorPoolCreateInfo descriptorPoolCI{};
+        descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        descriptorPoolCI.poolSizeCount = 1;
+        descriptorPoolCI.pPoolSizes = &poolSize;
+        descriptorPoolCI.maxSets = frameCount;
+        VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &descriptorPool));
+
+        const VkDescriptorBufferInfo source = { model.vertices.buffer, 0, VK_WHOLE_SIZE };
+        frames.resize(frameCount);
+        for (Frame &frame : frames) {
+            frame.palette.create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                std::max<uint32_t>(1, paletteSize) * sizeof(glm::mat4));
+            // Every list starts empty, update only rewrites the lists of morphed primitives
+            frame.morphWeights.create(vulkanDevice, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, morphWeightCount * sizeof(MorphWeight));
+            memset(frame.morphWeights.mapped, 0, morphWeightCount * sizeof(MorphWeight));
+            frame.vertices.create(vulkanDevice, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, static_cast<VkDeviceSize>(outputSize) * stride, false);
+
+            VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
+            descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            descriptorSetAllocInfo.descriptorPool = descriptorPool;
+            descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
+            descriptorSetAllocInfo.descriptorSetCount = 1;
+            VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &frame.descriptorSet));
+
+            const std::array<const VkDescriptorBufferInfo *, 5> bufferInfos = {
+                &source, &frame.palette.descriptor, &frame.vertices.descriptor, &frame.morphWeights.descriptor,
+                &morphDeltas.descriptor
+            };
+            std::array<VkWriteDescriptorSet, 5> writeDescriptorSets{};
+            for (uint32_t b = 0; b < writeDescriptorSets.size(); b++) {
+                writeDescriptorSets[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writeDescriptorSets[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writeDescriptorSets[b].descriptorCount = 1;
+                writeDescriptorSets[b].dstSet = frame.descriptorSet;
+                writeDescriptorSets[b].dstBinding = b;
+                writeDescriptorSets[b].pBufferInfo = bufferInfos[b];
+            }
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+        }
+        LOGI("Compute skinning: {} primitives of {} nodes, {} joints in {} skins, {} morph targets, {:.2f} KB deformed vertices per frame",
+            jobs.size(), nodes.size(), paletteSize, skins.size(), morphTargets.size(), outputSize * stride / 1024.0);
+        return true;
+    }
+
+    void ComputeSkinning::destroyFrames()
+    {
+        if (!device) {
+            return;
+        }
+        for (Frame &frame : frames) {
+            frame.palette.destroy();
+            frame.morphWeights.destroy();
+            frame.vertices.destroy();
+        }
+        frames.clear();
+        morphDeltas.destroy();
+        if (descriptorPool) {
+            vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+            descriptorPool = VK_NULL_HANDLE;
+        }
+    }
+
+    void ComputeSkinning::destroy()
+    {
+        if (!device) {
+            return;
+        }
+        destroyFrames();
+        jobs.clear();
+        nodes.clear();
+        skinnedNodes.clear();
+        skins.clear();
+        morphTargets.clear();
+        vkDestroyPipeline(device, pipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+        pipeline = VK_NULL_HANDLE;
+        pipelineLayout = VK_NULL_HANDLE;
+        descriptorSetLayout = VK_NULL_HANDLE;
+        device = VK_NULL_HANDLE;
+    }
+
+    bool ComputeSkinning::deformed(const vkglTF::Node *node) const
+    {
+        return std::binary_search(nodes.begin(), nodes.end(), node);
+    }
+
+    bool ComputeSkinning::skinned(const vkglTF::Node *node) const
+    {
+        return std::binary_search(skinnedNodes.begin(), skinnedNodes.end(), node);
+    }
+
+    void ComputeSkinning::update(uint32_t frameIndex)
+    {
+        glm::mat4 *palette = static_cast<glm::mat4 *>(frames[frameIndex].palette.mapped);
+        for (const auto &skin : skins) {
+            const std::vector<glm::mat4> &jointMatrices = skin.first->jointMatrices;
+            const size_t count = std::min(jointMatrices.size(), skin.first->joints.size());
+            memcpy(palette + skin.second, jointMatrices.data(), count * sizeof(glm::mat4));
+        }
+
+        // Only targets with a weight are listed, the shader searches the deltas of each of them per vertex
+        MorphWeight *morphWeights = static_cast<MorphWeight *>(frames[frameIndex].morphWeights.mapped);
+        for (const Job &job : jobs) {
+            if (job.morphTargetCount == 0) {
+                continue;
+            }
+            MorphWeight *list = morphWeights + job.pushConstBlock.morphs;
+            const std::vector<float> &weights = job.mesh->morphWeights;
+            uint32_t count = 0;
+            for (uint32_t t = 0; t < job.morphTargetCount && t < weights.size(); t++) {
+                const vkglTF::MorphTarget &target = morphTargets[job.firstMorphTarget + t];
+                if (weights[t] != 0.0f && target.deltaCount > 0) {
+                    list[1 + count++] = { target.firstDelta, target.deltaCount, weights[t], 0 };
+                }
+            }
+            list[0] = { count, 0, 0.0f, 0 };
+        }
+    }
+
+    void ComputeSkinning::record(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+    {
+        const Frame &frame = frames[frameIndex];
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+        bool dispatched = false;
+        for (const Job &job : jobs) {
+            // Meshes still streaming in are not drawn either
+            if (!job.mesh->resident || job.pushConstBlock.vertexCount == 0) {
+                continue;
+            }
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstBlockSkin), &job.pushConstBlock);
+            vkCmdDispatch(commandBuffer, (job.pushConstBlock.vertexCount + 63) / 64, 1, 1);
+            dispatched = true;
+        }
+        if (!dispatched) {
+            return;
+        }
+
+        // The draws of this frame and the occluders of the depth pyramid read the deformed vertices
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+            1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    void ComputeSkinning::bindVertices(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t layout)
+    {
+        const VkDeviceSize offset = static_cast<VkDeviceSize>(layoutOffsets[layout]) * stride;
+        vkCmdBindVertexBuffers(commandBuffer, binding, 1, &frames[frameIndex].vertices.buffer, &offset);
+    }
+
+}
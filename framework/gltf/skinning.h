@@ -0,0 +1,158 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Compute skinning and morph targets of the GLTF Model
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include "vulkan/buffer.h"
+#include "vulkan/device.h"
+#include "model.h"
+
+namespace xy
+{
+
+    /*
+        Skins the vertices of the skinned meshes and blends the morph targets of the morphed meshes in a compute pass
+        in front of the draws
+        The joint matrices of every skin go into one palette buffer per frame, all meshes of a skin read the same range
+        Morph targets are sparse deltas in one static buffer, each frame lists the targets with a non-zero weight
+        per primitive so targets at rest cost nothing
+        The skinned positions and normals are in the space of the model, drawn with an identity node matrix and
+        without joints, morphed meshes without a skin stay in the space of their node
+        Both are read through an extra vertex binding which replaces the position and normal streams
+        The output has a region per vertex layout indexed like the vertex streams, draws keep their first vertex
+        A mesh used by several skinned nodes keeps the skinning in the vertex shader
+    */
+    class ComputeSkinning
+    {
+    public:
+        // Vertex binding of the skinned positions and normals, behind the bindings of the vertex layouts
+        static const uint32_t binding = vkglTF::VertexLayout::BINDING_COUNT;
+        // Float position and normal
+        static const uint32_t stride = 6 * sizeof(float);
+
+        /*
+            Create the skinning pipeline, it does not depend on the model
+        */
+        void init(VulkanDevice *vulkanDevice, VkPipelineCache pipelineCache);
+
+        /*
+            Collect the skinned and morphed primitives of the model and create the palette, morph weight and
+            output buffers of every frame
+            Returns false when no primitive is deformed by the compute pass, the device must be idle
+        */
+        bool build(vkglTF::Model &model, uint32_t frameCount);
+
+        void destroy();
+
+        bool initialized() const { return pipeline != VK_NULL_HANDLE; }
+
+        // Draws the vertices of the compute pass
+        bool deformed(const vkglTF::Node *node) const;
+
+        // Skinned by the compute pass, drawn without its node matrix
+        bool skinned(const vkglTF::Node *node) const;
+
+        size_t size() const { return jobs.size(); }
+
+        /*
+            Copy the joint matrices of the skins into the palette of a frame which is no longer in flight and
+            list the morph targets with a weight
+        */
+        void update(uint32_t frameIndex);
+
+        /*
+            Deform the resident meshes, the vertices are ready for the vertex input after
+        */
+        void record(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+        /*
+            Bind the deformed vertices of a vertex layout to the skinning binding
+        */
+        void bindVertices(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t layout);
+
+    private:
+        /*
+            The layout of PushConsts in skinning.comp
+            Per attribute (position, normal, joints, weights) the byte offset of vertex 0 of its stream, its stride
+            and its encoding, absent attributes read the constant defaults with a zero stride
+        */
+        struct PushConstBlockSkin {
+            glm::uvec4 attributes[4];
+            uint32_t firstVertex;
+            uint32_t vertexCount;
+            // First skinned vertex of the layout in the output
+            uint32_t firstOutput;
+            // First joint matrix of the skin in the palette
+            uint32_t palette;
+            // Zero for morphed meshes without a skin
+            uint32_t jointCount;
+            // Active morph targets of the primitive in the morph weights of the frame
+            uint32_t morphs;
+            uint32_t padding[2];
+        };
+
+        /*
+            Active morph target of a primitive, the layout of the entries of Morphs in skinning.comp
+            The list of a primitive starts with an entry holding the count in firstDelta
+        */
+        struct MorphWeight {
+            uint32_t firstDelta;
+            uint32_t deltaCount;
+            float weight;
+            uint32_t padding;
+        };
+
+        // One dispatch per primitive of a skinned or morphed node
+        struct Job {
+            const vkglTF::Mesh *mesh;
+            uint32_t firstMorphTarget;
+            uint32_t morphTargetCount;
+            PushConstBlockSkin pushConstBlock;
+        };
+
+        struct Frame {
+            Buffer palette;
+            Buffer morphWeights;
+            Buffer vertices;
+            VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+        };
+
+        VulkanDevice   *vulkanDevice = nullptr;
+        VkDevice        device = VK_NULL_HANDLE;
+
+        std::vector<Job>                    jobs;
+        // Deformed and skinned nodes, sorted
+        std::vector<const vkglTF::Node *>   nodes;
+        std::vector<const vkglTF::Node *>   skinnedNodes;
+        // Skins with their first joint matrix in the palette
+        std::vector<std::pair<const vkglTF::Skin *, uint32_t>> skins;
+        uint32_t                            paletteSize = 0;
+        std::vector<vkglTF::MorphTarget>    morphTargets;
+        // Sparse deltas of all morph targets, shared by the frames
+        Buffer                              morphDeltas;
+        uint32_t                            morphWeightCount = 0;
+        // First skinned vertex of every vertex layout in the output
+        std::vector<uint32_t>               layoutOffsets;
+        std::vector<Frame>                  frames;
+
+        VkDescriptorSetLayout   descriptorSetLayout{VK_NULL_HANDLE};
+        VkDescriptorPool        descriptorPool{VK_NULL_HANDLE};
+        VkPipelineLayout        pipelineLayout{VK_NULL_HANDLE};
+        VkPipeline              pipeline{VK_NULL_HANDLE};
+
+        void destroyFrames();
+    };
+
+}
@@ -0,0 +1,116 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Flattened transform hierarchy of the glTF nodes
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include "gltf/transformhierarchy.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace vkglTF
+{
+
+    void TransformHierarchy::clear()
+    {
+        parents.clear();
+        translations.clear();
+        rotations.clear();
+        scales.clear();
+        matrices.clear();
+        worldMatrices.clear();
+        moved.clear();
+        dirty.clear();
+        anyDirty = false;
+    }
+
+    void TransformHierarchy::reserve(size_t count)
+    {
+        parents.reserve(count);
+        translations.reserve(count);
+        rotations.reserve(count);
+        scales.reserve(count);
+        matrices.reserve(count);
+        worldMatrices.reserve(count);
+        moved.reserve(count);
+        dirty.reserve(count);
+    }
+
+    uint32_t TransformHierarchy::add(int32_t parent, const glm::vec3 &translation, const glm::quat &rotation,
+        const glm::vec3 &scale, const glm::mat4 &matrix)
+    {
+        assert(parent < static_cast<int32_t>(parents.size()));
+        const uint32_t slot = size();
+        parents.push_back(parent);
+        translations.push_back(translation);
+        rotations.push_back(rotation);
+        scales.push_back(scale);
+        matrices.push_back(matrix);
+        worldMatrices.push_back(glm::mat4(1.0f));
+        moved.push_back(0);
+        dirty.push_back(1);
+        anyDirty = true;
+        return slot;
+    }
+
+    glm::mat4 TransformHierarchy::localMatrix(uint32_t slot) const
+    {
+        // Translation * rotation * scale without the full products
+        glm::mat4 trs = glm::mat4_cast(rotations[slot]);
+        trs[0] *= scales[slot].x;
+        trs[1] *= scales[slot].y;
+        trs[2] *= scales[slot].z;
+        trs[3] = glm::vec4(translations[slot], 1.0f);
+        return trs * matrices[slot];
+    }
+
+    void TransformHierarchy::setTranslation(uint32_t slot, const glm::vec3 &translation)
+    {
+        translations[slot] = translation;
+        dirty[slot] = 1;
+        anyDirty = true;
+    }
+
+    void TransformHierarchy::setRotation(uint32_t slot, const glm::quat &rotation)
+    {
+        rotations[slot] = rotation;
+        dirty[slot] = 1;
+        anyDirty = true;
+    }
+
+    void TransformHierarchy::setScale(uint32_t slot, const glm::vec3 &scale)
+    {
+        scales[slot] = scale;
+        dirty[slot] = 1;
+        anyDirty = true;
+    }
+
+    bool TransformHierarchy::update()
+    {
+        std::fill(moved.begin(), moved.end(), 0);
+        if (!anyDirty) {
+            return false;
+        }
+        // Parents come first, a slot sees whether its parent moved in this pass
+        const uint32_t count = size();
+        for (uint32_t slot = 0; slot < count; slot++) {
+            const int32_t parent = parents[slot];
+            const bool parentMoved = parent >= 0 && moved[parent];
+            if (!dirty[slot] && !parentMoved) {
+                continue;
+            }
+            const glm::mat4 local = localMatrix(slot);
+            worldMatrices[slot] = parent >= 0 ? worldMatrices[parent] * local : local;
+            moved[slot] = 1;
+            dirty[slot] = 0;
+        }
+        anyDirty = false;
+        return true;
+    }
+
+}
@@ -0,0 +1,70 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Flattened transform hierarchy of the glTF nodes
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace vkglTF
+{
+
+    /*
+        Node transforms as arrays indexed by slot, every parent is added before its children
+        The local transforms are the current pose, setting one marks the slot dirty and the next update
+        recomputes the world matrices of the dirty slots and their descendants in one pass in slot order
+    */
+    class TransformHierarchy
+    {
+    public:
+        // Parent slot, -1 for roots
+        std::vector<int32_t>    parents;
+        std::vector<glm::vec3>  translations;
+        std::vector<glm::quat>  rotations;
+        std::vector<glm::vec3>  scales;
+        // The matrix property of the glTF node, applied before translation, rotation and scale
+        std::vector<glm::mat4>  matrices;
+        std::vector<glm::mat4>  worldMatrices;
+        // Slots whose world matrix changed in the last update
+        std::vector<uint8_t>    moved;
+
+        void clear();
+
+        void reserve(size_t count);
+
+        /*
+            Append a slot, parent has to be a slot added before or -1
+        */
+        uint32_t add(int32_t parent, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale,
+            const glm::mat4 &matrix);
+
+        uint32_t size() const { return static_cast<uint32_t>(parents.size()); }
+
+        glm::mat4 localMatrix(uint32_t slot) const;
+
+        void setTranslation(uint32_t slot, const glm::vec3 &translation);
+        void setRotation(uint32_t slot, const glm::quat &rotation);
+        void setScale(uint32_t slot, const glm::vec3 &scale);
+
+        /*
+            Recompute the world matrices of the dirty slots and their descendants
+            Returns true when any world matrix changed, moved tells which ones
+        */
+        bool update();
+
+    private:
+        std::vector<uint8_t>    dirty;
+        bool                    anyDirty = false;
+    };
+
+}
@@ -0,0 +1,536 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Stream kernels converting glTF accessors into interleaved vertices
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include "vertexstreams.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "tiny_gltf.h"
+
+/*
+    The AVX2 kernels are always compiled on x86, with the target attribute when the rest of the
+    code is not built for AVX2 (USE_AVX2), and picked at runtime from the CPU features.
+    Define VERTEX_STREAMS_NO_AVX2 to leave them out.
+*/
+#if defined(VERTEX_STREAMS_NO_AVX2)
+#elif defined(__AVX2__)
+#define VERTEX_STREAMS_AVX2
+#define VERTEX_STREAMS_AVX2_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define VERTEX_STREAMS_AVX2
+#define VERTEX_STREAMS_AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define VERTEX_STREAMS_AVX2
+#define VERTEX_STREAMS_AVX2_TARGET
+#include <intrin.h>
+#endif
+
+#if defined(VERTEX_STREAMS_AVX2)
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VERTEX_STREAMS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace vkglTF
+{
+namespace streams
+{
+
+#if defined(VERTEX_STREAMS_AVX2)
+    static bool cpuSupportsAvx2()
+    {
+#if defined(__AVX2__)
+        return true;
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        // The OS has to save the YMM registers (OSXSAVE and AVX, then XCR0 bits 1 and 2)
+        __cpuid(info, 1);
+        const int osxsaveAvx = (1 << 27) | (1 << 28);
+        if ((info[2] & osxsaveAvx) != osxsaveAvx || (_xgetbv(0) & 6) != 6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }
+
+    static const bool hasAvx2 = cpuSupportsAvx2();
+#endif
+
+    const char *instructionSet()
+    {
+#if defined(VERTEX_STREAMS_AVX2)
+        if (hasAvx2) {
+            return "AVX2";
+        }
+#endif
+#if defined(VERTEX_STREAMS_SSE2)
+        return "SSE2";
+#else
+        return "scalar";
+#endif
+    }
+
+    Encoding encodingOf(int componentType, bool normalized)
+    {
+        switch (componentType) {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+            return normalized ? Encoding::SNORM8 : Encoding::SSCALED8;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return normalized ? Encoding::UNORM8 : Encoding::USCALED8;
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+            return normalized ? Encoding::SNORM16 : Encoding::SSCALED16;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return normalized ? Encoding::UNORM16 : Encoding::USCALED16;
+        default:
+            return Encoding::FLOAT32;
+        }
+    }
+
+    uint32_t componentSize(Encoding encoding)
+    {
+        switch (encoding) {
+        case Encoding::SNORM8:
+        case Encoding::UNORM8:
+        case Encoding::SSCALED8:
+        case Encoding::USCALED8:
+            return 1;
+        case Encoding::FLOAT16:
+        case Encoding::SNORM16:
+        case Encoding::UNORM16:
+        case Encoding::SSCALED16:
+        case Encoding::USCALED16:
+        case Encoding::OCTAHEDRAL16:
+            return 2;
+        default:
+            return 4;
+        }
+    }
+
+    /*
+        Round to nearest even float to half conversion, out of range values saturate to infinity
+    */
+    static uint16_t floatToHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        const uint32_t sign = (bits >> 16) & 0x8000u;
+        const uint32_t absBits = bits & 0x7FFFFFFFu;
+        if (absBits >= 0x7F800000u) {
+            // Inf or NaN
+            return static_cast<uint16_t>(sign | 0x7C00u | (absBits > 0x7F800000u ? 0x200u : 0u));
+        }
+        if (absBits >= 0x477FF000u) {
+            return static_cast<uint16_t>(sign | 0x7C00u);
+        }
+        if (absBits < 0x38800000u) {
+            // Subnormal half, let the float adder do the rounding
+            float magnitude;
+            memcpy(&magnitude, &absBits, sizeof(magnitude));
+            magnitude += 0.5f;
+            uint32_t rounded;
+            memcpy(&rounded, &magnitude, sizeof(rounded));
+            return static_cast<uint16_t>(sign | (rounded - 0x3F000000u));
+        }
+        const uint32_t mantissaOdd = (absBits >> 13) & 1u;
+        const uint32_t rebased = absBits + 0xC8000FFFu + mantissaOdd;
+        return static_cast<uint16_t>(sign | (rebased >> 13));
+    }
+
+    template <typename T>
+    static void encodeInteger(const float *const *columns, uint32_t components, size_t count, uint8_t *dst,
+        size_t dstStride, float scale, float minValue, float maxValue)
+    {
+        for (uint32_t c = 0; c < components; c++) {
+            const float *column = columns[c];
+            uint8_t *element = dst + c * sizeof(T);
+            for (size_t i = 0; i < count; i++) {
+                float v = std::min(std::max(column[i] * scale, minValue), maxValue);
+                T value = static_cast<T>(std::lround(v));
+                memcpy(element + i * dstStride, &value, sizeof(T));
+            }
+        }
+    }
+
+    /*
+        Octahedral mapping of unit vectors (Cigolle et al. 2014), decoded in the vertex shader
+    */
+    static void encodeOctahedral(const float *const *columns, size_t count, uint8_t *dst, size_t dstStride)
+    {
+        for (size_t i = 0; i < count; i++) {
+            float x = columns[0][i];
+            float y = columns[1][i];
+            float z = columns[2][i];
+            float l1 = std::abs(x) + std::abs(y) + std::abs(z);
+            float u = 0.0f;
+            float v = 0.0f;
+            if (l1 > 0.0f) {
+                u = x / l1;
+                v = y / l1;
+                if (z < 0.0f) {
+                    float wrappedU = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+                    float wrappedV = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+                    u = wrappedU;
+                    v = wrappedV;
+                }
+            }
+            int16_t packed[2] = {
+                static_cast<int16_t>(std::lround(std::min(std::max(u, -1.0f), 1.0f) * 32767.0f)),
+                static_cast<int16_t>(std::lround(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f))
+            };
+            memcpy(dst + i * dstStride, packed, sizeof(packed));
+        }
+    }
+
+    /*
+        Integer gather, the conversion loop is simple enough for the compiler to vectorize
+    */
+    template <typename T>
+    static void gatherInteger(const uint8_t *src, size_t byteStride, float scale, float minValue,
+        uint32_t components, size_t count, float *const *columns)
+    {
+        for (uint32_t c = 0; c < components; c++) {
+            float *column = columns[c];
+            const uint8_t *element = src + c * sizeof(T);
+            for (size_t i = 0; i < count; i++) {
+                T value;
+                memcpy(&value, element + i * byteStride, sizeof(T));
+                column[i] = std::max(static_cast<float>(value) * scale, minValue);
+            }
+        }
+    }
+
+#if defined(VERTEX_STREAMS_AVX2)
+    /*
+        AVX2 kernels, each returns the number of elements it processed (a multiple of 8),
+        the caller finishes the rest
+    */
+    VERTEX_STREAMS_AVX2_TARGET
+    static size_t gatherFloatAvx2(const uint8_t *element, size_t byteStride, size_t count, float *column)
+    {
+        // The hardware gather only touches the 4 bytes of each element, so reading the last
+        // vertices of a mapped file can not fault
+        const int stride = static_cast<int>(byteStride);
+        const __m256i offsets = _mm256_mullo_epi32(_mm256_set1_epi32(stride),
+            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const float *base = reinterpret_cast<const float*>(element + i * byteStride);
+            _mm256_storeu_ps(column + i, _mm256_i32gather_ps(base, offsets, 1));
+        }
+        return i;
+    }
+
+    VERTEX_STREAMS_AVX2_TARGET
+    static size_t normalize3Avx2(float *x, float *y, float *z, size_t count)
+    {
+        const __m256 one8 = _mm256_set1_ps(1.0f);
+        const __m256 zero8 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256 vx = _mm256_loadu_ps(x + i);
+            __m256 vy = _mm256_loadu_ps(y + i);
+            __m256 vz = _mm256_loadu_ps(z + i);
+            __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), _mm256_mul_ps(vz, vz));
+            __m256 valid = _mm256_cmp_ps(len2, zero8, _CMP_GT_OQ);
+            __m256 inv = _mm256_and_ps(valid, _mm256_div_ps(one8, _mm256_sqrt_ps(len2)));
+            _mm256_storeu_ps(x + i, _mm256_mul_ps(vx, inv));
+            _mm256_storeu_ps(y + i, _mm256_mul_ps(vy, inv));
+            _mm256_storeu_ps(z + i, _mm256_mul_ps(vz, inv));
+        }
+        return i;
+    }
+
+    VERTEX_STREAMS_AVX2_TARGET
+    static size_t fixWeightsAvx2(float *w0, const float *w1, const float *w2, const float *w3, size_t count)
+    {
+        const __m256 one8 = _mm256_set1_ps(1.0f);
+        const __m256 zero8 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256 v0 = _mm256_loadu_ps(w0 + i);
+            __m256 v1 = _mm256_loadu_ps(w1 + i);
+            __m256 v2 = _mm256_loadu_ps(w2 + i);
+            __m256 v3 = _mm256_loadu_ps(w3 + i);
+            __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v0, v0), _mm256_mul_ps(v1, v1)),
+                _mm256_add_ps(_mm256_mul_ps(v2, v2), _mm256_mul_ps(v3, v3)));
+            __m256 empty = _mm256_cmp_ps(len2, zero8, _CMP_EQ_OQ);
+            _mm256_storeu_ps(w0 + i, _mm256_blendv_ps(v0, one8, empty));
+        }
+        return i;
+    }
+#endif
+
+    static void gatherFloat(const uint8_t *src, size_t byteStride, uint32_t components, size_t count,
+        float *const *columns)
+    {
+        for (uint32_t c = 0; c < components; c++) {
+            float *column = columns[c];
+            const uint8_t *element = src + c * sizeof(float);
+            size_t i = 0;
+#if defined(VERTEX_STREAMS_AVX2)
+            if (hasAvx2) {
+                i = gatherFloatAvx2(element, byteStride, count, column);
+            }
+#endif
+            for (; i < count; i++) {
+                memcpy(&column[i], element + i * byteStride, sizeof(float));
+            }
+        }
+    }
+
+    bool gather(const uint8_t *src, size_t byteStride, int componentType, bool normalized,
+        uint32_t components, size_t count, float *const *columns)
+    {
+        const float lowest = -std::numeric_limits<float>::max();
+        switch (componentType) {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            gatherFloat(src, byteStride, components, count, columns);
+            return true;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            gatherInteger<uint8_t>(src, byteStride, normalized ? 1.0f / 255.0f : 1.0f, lowest, components, count, columns);
+            return true;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            gatherInteger<uint16_t>(src, byteStride, normalized ? 1.0f / 65535.0f : 1.0f, lowest, components, count, columns);
+            return true;
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+            gatherInteger<int8_t>(src, byteStride, normalized ? 1.0f / 127.0f : 1.0f, normalized ? -1.0f : lowest, components, count, columns);
+            return true;
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+            gatherInteger<int16_t>(src, byteStride, normalized ? 1.0f / 32767.0f : 1.0f, normalized ? -1.0f : lowest, components, count, columns);
+            return true;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            gatherInteger<uint32_t>(src, byteStride, 1.0f, lowest, components, count, columns);
+            return true;
+        default:
+            for (uint32_t c = 0; c < components; c++) {
+                fill(0.0f, count, columns[c]);
+            }
+            return false;
+        }
+    }
+
+    void fill(float value, size_t count, float *column)
+    {
+        std::fill(column, column + count, value);
+    }
+
+    void normalize3(float *x, float *y, float *z, size_t count)
+    {
+        size_t i = 0;
+#if defined(VERTEX_STREAMS_AVX2)
+        if (hasAvx2) {
+            i = normalize3Avx2(x, y, z, count);
+        }
+#endif
+#if defined(VERTEX_STREAMS_SSE2)
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4) {
+            __m128 vx = _mm_loadu_ps(x + i);
+            __m128 vy = _mm_loadu_ps(y + i);
+            __m128 vz = _mm_loadu_ps(z + i);
+            __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+            __m128 valid = _mm_cmpgt_ps(len2, zero);
+            __m128 inv = _mm_and_ps(valid, _mm_div_ps(one, _mm_sqrt_ps(len2)));
+            _mm_storeu_ps(x + i, _mm_mul_ps(vx, inv));
+            _mm_storeu_ps(y + i, _mm_mul_ps(vy, inv));
+            _mm_storeu_ps(z + i, _mm_mul_ps(vz, inv));
+        }
+#endif
+        for (; i < count; i++) {
+            float len2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+            float inv = len2 > 0.0f ? 1.0f / std::sqrt(len2) : 0.0f;
+            x[i] *= inv;
+            y[i] *= inv;
+            z[i] *= inv;
+        }
+    }
+
+    void fixWeights(float *w0, float *w1, float *w2, float *w3, size_t count)
+    {
+        size_t i = 0;
+#if defined(VERTEX_STREAMS_AVX2)
+        if (hasAvx2) {
+            i = fixWeightsAvx2(w0, w1, w2, w3, count);
+        }
+#endif
+#if defined(VERTEX_STREAMS_SSE2)
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4) {
+            __m128 v0 = _mm_loadu_ps(w0 + i);
+            __m128 v1 = _mm_loadu_ps(w1 + i);
+            __m128 v2 = _mm_loadu_ps(w2 + i);
+            __m128 v3 = _mm_loadu_ps(w3 + i);
+            __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v0, v0), _mm_mul_ps(v1, v1)),
+                _mm_add_ps(_mm_mul_ps(v2, v2), _mm_mul_ps(v3, v3)));
+            __m128 empty = _mm_cmpeq_ps(len2, zero);
+            _mm_storeu_ps(w0 + i, _mm_or_ps(_mm_andnot_ps(empty, v0), _mm_and_ps(empty, one)));
+        }
+#endif
+        for (; i < count; i++) {
+            if (w0[i] * w0[i] + w1[i] * w1[i] + w2[i] * w2[i] + w3[i] * w3[i] == 0.0f) {
+                w0[i] = 1.0f;
+            }
+        }
+    }
+
+    void interleave(const float *const *columns, uint32_t columnCount, size_t count, float *dst, size_t dstStride)
+    {
+        uint32_t c = 0;
+#if defined(VERTEX_STREAMS_SSE2)
+        // Transpose 4 columns x 4 rows at a time
+        for (; c + 4 <= columnCount; c += 4) {
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                __m128 r0 = _mm_loadu_ps(columns[c] + i);
+                __m128 r1 = _mm_loadu_ps(columns[c + 1] + i);
+                __m128 r2 = _mm_loadu_ps(columns[c + 2] + i);
+                __m128 r3 = _mm_loadu_ps(columns[c + 3] + i);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                float *row = dst + i * dstStride + c;
+                _mm_storeu_ps(row, r0);
+                _mm_storeu_ps(row + dstStride, r1);
+                _mm_storeu_ps(row + 2 * dstStride, r2);
+                _mm_storeu_ps(row + 3 * dstStride, r3);
+            }
+            for (; i < count; i++) {
+                for (uint32_t k = 0; k < 4; k++) {
+                    dst[i * dstStride + c + k] = columns[c + k][i];
+                }
+            }
+        }
+#endif
+        for (; c < columnCount; c++) {
+            const float *column = columns[c];
+            for (size_t i = 0; i < count; i++) {
+                dst[i * dstStride + c] = column[i];
+            }
+        }
+    }
+
+    void encode(const float *const *columns, uint32_t components, size_t count, uint8_t *dst, size_t dstStride,
+        Encoding encoding)
+    {
+        switch (encoding) {
+        case Encoding::FLOAT32:
+            interleave(columns, components, count, reinterpret_cast<float*>(dst), dstStride / sizeof(float));
+            break;
+        case Encoding::FLOAT16:
+            for (uint32_t c = 0; c < components; c++) {
+                for (size_t i = 0; i < count; i++) {
+                    uint16_t half = floatToHalf(columns[c][i]);
+                    memcpy(dst + i * dstStride + c * sizeof(half), &half, sizeof(half));
+                }
+            }
+            break;
+        case Encoding::SNORM8:
+            encodeInteger<int8_t>(columns, components, count, dst, dstStride, 127.0f, -127.0f, 127.0f);
+            break;
+        case Encoding::UNORM8:
+            encodeInteger<uint8_t>(columns, components, count, dst, dstStride, 255.0f, 0.0f, 255.0f);
+            break;
+        case Encoding::SNORM16:
+            encodeInteger<int16_t>(columns, components, count, dst, dstStride, 32767.0f, -32767.0f, 32767.0f);
+            break;
+        case Encoding::UNORM16:
+            encodeInteger<uint16_t>(columns, components, count, dst, dstStride, 65535.0f, 0.0f, 65535.0f);
+            break;
+        case Encoding::SSCALED8:
+            encodeInteger<int8_t>(columns, components, count, dst, dstStride, 1.0f, -128.0f, 127.0f);
+            break;
+        case Encoding::USCALED8:
+            encodeInteger<uint8_t>(columns, components, count, dst, dstStride, 1.0f, 0.0f, 255.0f);
+            break;
+        case Encoding::SSCALED16:
+            encodeInteger<int16_t>(columns, components, count, dst, dstStride, 1.0f, -32768.0f, 32767.0f);
+            break;
+        case Encoding::USCALED16:
+            encodeInteger<uint16_t>(columns, components, count, dst, dstStride, 1.0f, 0.0f, 65535.0f);
+            break;
+        case Encoding::OCTAHEDRAL16:
+            encodeOctahedral(columns, count, dst, dstStride);
+            break;
+        }
+    }
+
+    void copyElements(const uint8_t *src, size_t srcStride, uint8_t *dst, size_t dstStride,
+        size_t elementSize, size_t count)
+    {
+        // Fixed size copies for the common element sizes compile to plain loads and stores
+        switch (elementSize) {
+        case 4:
+            for (size_t i = 0; i < count; i++) {
+                memcpy(dst + i * dstStride, src + i * srcStride, 4);
+            }
+            break;
+        case 8:
+            for (size_t i = 0; i < count; i++) {
+                memcpy(dst + i * dstStride, src + i * srcStride, 8);
+            }
+            break;
+        default:
+            for (size_t i = 0; i < count; i++) {
+                memcpy(dst + i * dstStride, src + i * srcStride, elementSize);
+            }
+            break;
+        }
+    }
+
+    void streamCopy(void *dst, const void *src, size_t size)
+    {
+        uint8_t *d = static_cast<uint8_t*>(dst);
+        const uint8_t *s = static_cast<const uint8_t*>(src);
+#if defined(VERTEX_STREAMS_SSE2)
+        size_t head = std::min(size, (16 - (reinterpret_cast<uintptr_t>(d) & 15)) & 15);
+        memcpy(d, s, head);
+        d += head;
+        s += head;
+        size -= head;
+        for (; size >= 64; size -= 64, d += 64, s += 64) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+            __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(d), a);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(d + 16), b);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(d + 32), c);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(d + 48), e);
+        }
+        for (; size >= 16; size -= 16, d += 16, s += 16) {
+            _mm_stream_si128(reinterpret_cast<__m128i*>(d), _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+        }
+#endif
+        memcpy(d, s, size);
+    }
+
+    void streamFence()
+    {
+#if defined(VERTEX_STREAMS_SSE2)
+        _mm_sfence();
+#endif
+    }
+
+}
+}
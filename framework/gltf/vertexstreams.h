@@ -0,0 +1,95 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Stream kernels converting glTF accessors into interleaved vertices
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vkglTF
+{
+namespace streams
+{
+
+    /*
+        Storage encodings of vertex attribute components
+    */
+    enum class Encoding {
+        FLOAT32, FLOAT16,
+        SNORM8, UNORM8, SNORM16, UNORM16,
+        SSCALED8, USCALED8, SSCALED16, USCALED16,
+        OCTAHEDRAL16    // unit vec3 packed into two snorm16 with an octahedral mapping
+    };
+
+    /*
+        Encoding which stores a glTF component type without conversion
+    */
+    Encoding encodingOf(int componentType, bool normalized);
+
+    uint32_t componentSize(Encoding encoding);
+
+    /*
+        Number of vertices converted per block, the columns of one block stay resident in L1
+    */
+    constexpr size_t BlockSize = 256;
+
+    /*
+        Instruction set the kernels run with: "AVX2", "SSE2" or "scalar"
+        AVX2 is detected at runtime, it does not need the USE_AVX2 build option
+    */
+    const char *instructionSet();
+
+    /*
+        Gather `components` values per element from a strided accessor into separate float columns,
+        integer components are converted (and normalized when requested) on the way
+        Returns false for component types that can not be converted, the columns are zeroed then
+    */
+    bool gather(const uint8_t *src, size_t byteStride, int componentType, bool normalized,
+        uint32_t components, size_t count, float *const *columns);
+
+    void fill(float value, size_t count, float *column);
+
+    /*
+        Normalize vec3 columns in place, zero length vectors stay zero
+    */
+    void normalize3(float *x, float *y, float *z, size_t count);
+
+    /*
+        Replace all zero joint weights by (1, 0, 0, 0)
+    */
+    void fixWeights(float *w0, float *w1, float *w2, float *w3, size_t count);
+
+    /*
+        Interleave `columnCount` columns into rows which are `dstStride` floats apart
+    */
+    void interleave(const float *const *columns, uint32_t columnCount, size_t count, float *dst, size_t dstStride);
+
+    /*
+        Encode `components` float columns into rows which are `dstStride` bytes apart
+    */
+    void encode(const float *const *columns, uint32_t components, size_t count, uint8_t *dst, size_t dstStride,
+        Encoding encoding);
+
+    /*
+        Copy `elementSize` bytes per element between two strided streams without any conversion
+    */
+    void copyElements(const uint8_t *src, size_t srcStride, uint8_t *dst, size_t dstStride,
+        size_t elementSize, size_t count);
+
+    /*
+        Copy into write combined (mapped staging) memory with non temporal stores,
+        call streamFence() once all copies are issued
+    */
+    void streamCopy(void *dst, const void *src, size_t size);
+
+    void streamFence();
+
+}
+}
@@ -372,7 +372,7 @@ namespace xy
         }
     }
 
-    bool UIRender::updateBuffer(ImVec2 scale)
+    bool UIRender::updateBuffer(ImVec2 scale, const std::function<void(std::function<void()>)> &retire)
     {
         ImDrawData* imDrawData = ImGui::GetDrawData();
 
@@ -384,26 +384,41 @@ namespace xy
         // BugFix: The ImGui is not correct on MacOS retina display.
         imDrawData->FramebufferScale = scale;
 
-        VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
-        VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
-
+        // The buffers only grow, by half again each time, so a changing draw list rarely has to wait for the device
         bool updateBuffers = (vertexBuffer.buffer == VK_NULL_HANDLE) ||
-            (vertexBuffer.count != imDrawData->TotalVtxCount) ||
+            (vertexBuffer.count < imDrawData->TotalVtxCount) ||
             (indexBuffer.buffer == VK_NULL_HANDLE) ||
-            (indexBuffer.count != imDrawData->TotalIdxCount);
+            (indexBuffer.count < imDrawData->TotalIdxCount);
 
         if (updateBuffers) {
-            vkDeviceWaitIdle(device);
+            if (retire) {
+                Buffer oldVertexBuffer = vertexBuffer;
+                Buffer oldIndexBuffer = indexBuffer;
+                retire([oldVertexBuffer, oldIndexBuffer]() mutable {
+                    if (oldVertexBuffer.buffer) {
+                        oldVertexBuffer.destroy();
+                    }
+                    if (oldIndexBuffer.buffer) {
+                        oldIndexBuffer.destroy();
+                    }
+                });
+                vertexBuffer.buffer = VK_NULL_HANDLE;
+                indexBuffer.buffer = VK_NULL_HANDLE;
+            } else {
+                vulkanDevice->waitIdle();
+            }
             if (vertexBuffer.buffer) {
                 vertexBuffer.destroy();
             }
-            vertexBuffer.create(vulkanDevice, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertexBufferSize);
-            vertexBuffer.count = imDrawData->TotalVtxCount;
+            vertexBuffer.count = std::max(std::max(imDrawData->TotalVtxCount, vertexBuffer.count + vertexBuffer.count / 2), 1);
+            vertexBuffer.create(vulkanDevice, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                vertexBuffer.count * sizeof(ImDrawVert));
             if (indexBuffer.buffer) {
                 indexBuffer.destroy();
             }
-            indexBuffer.create(vulkanDevice, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, indexBufferSize);
-            indexBuffer.count = imDrawData->TotalIdxCount;
+            indexBuffer.count = std::max(std::max(imDrawData->TotalIdxCount, indexBuffer.count + indexBuffer.count / 2), 1);
+            indexBuffer.create(vulkanDevice, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                indexBuffer.count * sizeof(ImDrawIdx));
         }
 
         // Upload data
@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include <functional>
 #include <vector>
 #include <map>
 
@@ -59,7 +60,11 @@ namespace xy
 
         void draw(VkCommandBuffer cmdBuffer);
 
-        bool updateBuffer(ImVec2 scale);
+        /*
+            Copy the draw lists into the host visible buffers, buffers replaced by larger ones are handed to retire
+            which destroys them once the frames in flight are done with them, without it the device is waited on
+        */
+        bool updateBuffer(ImVec2 scale, const std::function<void(std::function<void()>)> &retire = nullptr);
 
         void updateParameters();
 
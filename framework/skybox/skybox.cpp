@@ -278,16 +278,15 @@ namespace xy
         VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
 
         // Vertex bindings an attributes
-        VkVertexInputBindingDescription vertexInputBinding = { 0, sizeof(vkglTF::Model::Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
-        std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-            { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
-            { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3 },
-            { 2, 0, VK_FORMAT_R32G32_SFLOAT, sizeof(float) * 6 },
-        };
+        // The skybox cube has a single vertex layout, only position, normal and uv0 are read
+        const vkglTF::VertexLayout &layout = models.skybox.vertexLayouts[0];
+        std::vector<VkVertexInputBindingDescription> vertexInputBindings = layout.inputBindings();
+        std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = layout.inputAttributes();
+        vertexInputAttributes.resize(3);
         VkPipelineVertexInputStateCreateInfo vertexInputStateCI{};
         vertexInputStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputStateCI.vertexBindingDescriptionCount = 1;
-        vertexInputStateCI.pVertexBindingDescriptions = &vertexInputBinding;
+        vertexInputStateCI.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInputBindings.size());
+        vertexInputStateCI.pVertexBindingDescriptions = vertexInputBindings.data();
         vertexInputStateCI.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
         vertexInputStateCI.pVertexAttributeDescriptions = vertexInputAttributes.data();
 
@@ -0,0 +1,582 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Sub-allocator of Vulkan device memory
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include "vulkan/allocator.h"
+
+#include <algorithm>
+
+#include "macros.h"
+#include "logger.h"
+
+namespace xy
+{
+
+    static const uint32_t NO_RANGE = UINT32_MAX;
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static uint32_t highestBit(uint64_t value)
+    {
+        uint32_t bit = 0;
+        while (value >>= 1) {
+            bit++;
+        }
+        return bit;
+    }
+
+    static uint32_t lowestBit(uint32_t value)
+    {
+        uint32_t bit = 0;
+        while ((value & 1) == 0) {
+            value >>= 1;
+            bit++;
+        }
+        return bit;
+    }
+
+    const char *memoryUsageName(MemoryUsage usage)
+    {
+        static const char *names[] = { "Geometry", "Texture", "Uniform", "Staging", "Attachment" };
+        return names[static_cast<uint32_t>(usage)];
+    }
+
+    /*
+        One VkDeviceMemory of a pool
+        TLSF blocks keep their ranges in a doubly linked list in address order, free ranges are also linked
+        into one of FL_COUNT x SL_COUNT size classes: the first level is the power of two of the size,
+        the second level splits it linearly, so finding a fitting free range is a couple of bit scans
+        Linear blocks only move a head forward and rewind it once every range is freed
+    */
+    class MemoryBlock
+    {
+    public:
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        uint8_t *mapped;
+        uint32_t pool;
+        bool linear;
+
+        MemoryBlock(VkDeviceMemory memory, VkDeviceSize size, void *mapped, uint32_t pool, bool linear) :
+            memory(memory), size(size), mapped(static_cast<uint8_t*>(mapped)), pool(pool), linear(linear)
+        {
+            for (uint32_t fl = 0; fl < FL_COUNT; fl++) {
+                for (uint32_t sl = 0; sl < SL_COUNT; sl++) {
+                    heads[fl][sl] = NO_RANGE;
+                }
+            }
+            if (!linear) {
+                ranges.push_back({ 0, size, NO_RANGE, NO_RANGE, NO_RANGE, NO_RANGE, true });
+                insertFree(0);
+            }
+        }
+
+        bool allocate(VkDeviceSize allocationSize, VkDeviceSize alignment, VkDeviceSize &offset, uint32_t &range)
+        {
+            if (linear) {
+                const VkDeviceSize start = alignUp(head, alignment);
+                if (start + allocationSize > size) {
+                    return false;
+                }
+                head = start + allocationSize;
+                offset = start;
+                range = 0;
+                liveCount++;
+                usedBytes += allocationSize;
+                return true;
+            }
+
+            // The first candidate may not fit once aligned, asking for the worst case padding always does
+            uint32_t r = findFree(allocationSize);
+            if (r != NO_RANGE && alignUp(ranges[r].offset, alignment) + allocationSize > ranges[r].offset + ranges[r].size) {
+                r = findFree(allocationSize + alignment - 1);
+            }
+            if (r == NO_RANGE) {
+                return false;
+            }
+            removeFree(r);
+
+            const VkDeviceSize aligned = alignUp(ranges[r].offset, alignment);
+            if (aligned > ranges[r].offset) {
+                // Padding in front of the allocation stays free
+                const uint32_t padding = newRange();
+                ranges[padding] = { ranges[r].offset, aligned - ranges[r].offset, ranges[r].prevPhysical, r, NO_RANGE, NO_RANGE, true };
+                if (ranges[r].prevPhysical != NO_RANGE) {
+                    ranges[ranges[r].prevPhysical].nextPhysical = padding;
+                }
+                ranges[r].prevPhysical = padding;
+                ranges[r].size -= ranges[padding].size;
+                ranges[r].offset = aligned;
+                insertFree(padding);
+            }
+            if (ranges[r].size - allocationSize >= MIN_SPLIT) {
+                const uint32_t tail = newRange();
+                ranges[tail] = { aligned + allocationSize, ranges[r].size - allocationSize, r, ranges[r].nextPhysical, NO_RANGE, NO_RANGE, true };
+                if (ranges[r].nextPhysical != NO_RANGE) {
+                    ranges[ranges[r].nextPhysical].prevPhysical = tail;
+                }
+                ranges[r].nextPhysical = tail;
+                ranges[r].size = allocationSize;
+                insertFree(tail);
+            }
+            ranges[r].free = false;
+            offset = aligned;
+            range = r;
+            liveCount++;
+            usedBytes += ranges[r].size;
+            return true;
+        }
+
+        void free(uint32_t r, VkDeviceSize allocationSize)
+        {
+            liveCount--;
+            if (linear) {
+                usedBytes -= allocationSize;
+                if (liveCount == 0) {
+                    head = 0;
+                }
+                return;
+            }
+
+            usedBytes -= ranges[r].size;
+            ranges[r].free = true;
+            // Merge with the free neighbours
+            const uint32_t prev = ranges[r].prevPhysical;
+            if (prev != NO_RANGE && ranges[prev].free) {
+                removeFree(prev);
+                ranges[prev].size += ranges[r].size;
+                ranges[prev].nextPhysical = ranges[r].nextPhysical;
+                if (ranges[r].nextPhysical != NO_RANGE) {
+                    ranges[ranges[r].nextPhysical].prevPhysical = prev;
+                }
+                releaseRange(r);
+                r = prev;
+            }
+            const uint32_t next = ranges[r].nextPhysical;
+            if (next != NO_RANGE && ranges[next].free) {
+                removeFree(next);
+                ranges[r].size += ranges[next].size;
+                ranges[r].nextPhysical = ranges[next].nextPhysical;
+                if (ranges[next].nextPhysical != NO_RANGE) {
+                    ranges[ranges[next].nextPhysical].prevPhysical = r;
+                }
+                releaseRange(next);
+            }
+            insertFree(r);
+        }
+
+        bool empty() const
+        {
+            return liveCount == 0;
+        }
+
+        VkDeviceSize used() const
+        {
+            return usedBytes;
+        }
+
+        /*
+            Free bytes and the largest free range
+        */
+        void freeSpace(VkDeviceSize &freeBytes, VkDeviceSize &largest) const
+        {
+            freeBytes = 0;
+            largest = 0;
+            if (linear) {
+                freeBytes = largest = size - head;
+                return;
+            }
+            for (const Range &range : ranges) {
+                if (range.free) {
+                    freeBytes += range.size;
+                    largest = std::max(largest, range.size);
+                }
+            }
+        }
+
+    private:
+        // Second level classes per power of two, sizes below 2^MIN_LOG2 share the first level 0
+        static const uint32_t SL_LOG2 = 4;
+        static const uint32_t SL_COUNT = 1 << SL_LOG2;
+        static const uint32_t MIN_LOG2 = 8;
+        static const uint32_t FL_COUNT = 32;
+        // Smaller tails are left inside the allocation
+        static const VkDeviceSize MIN_SPLIT = 16;
+
+        struct Range {
+            VkDeviceSize offset;
+            VkDeviceSize size;
+            uint32_t prevPhysical;
+            uint32_t nextPhysical;
+            uint32_t prevFree;
+            uint32_t nextFree;
+            bool free;
+        };
+
+        std::vector<Range> ranges;
+        std::vector<uint32_t> unusedRanges;
+        uint32_t flBitmap = 0;
+        uint32_t slBitmaps[FL_COUNT] = {};
+        uint32_t heads[FL_COUNT][SL_COUNT];
+
+        VkDeviceSize head = 0;
+        uint32_t liveCount = 0;
+        VkDeviceSize usedBytes = 0;
+
+        static void mapping(VkDeviceSize rangeSize, uint32_t &fl, uint32_t &sl)
+        {
+            if (rangeSize < (static_cast<VkDeviceSize>(1) << MIN_LOG2)) {
+                fl = 0;
+                sl = static_cast<uint32_t>(rangeSize >> (MIN_LOG2 - SL_LOG2));
+            } else {
+                const uint32_t log2 = highestBit(rangeSize);
+                fl = log2 - MIN_LOG2 + 1;
+                sl = static_cast<uint32_t>(rangeSize >> (log2 - SL_LOG2)) ^ SL_COUNT;
+            }
+        }
+
+        uint32_t findFree(VkDeviceSize rangeSize) const
+        {
+            // Round up to the next class, every range in it or above is large enough
+            if (rangeSize < (static_cast<VkDeviceSize>(1) << MIN_LOG2)) {
+                rangeSize += (static_cast<VkDeviceSize>(1) << (MIN_LOG2 - SL_LOG2)) - 1;
+            } else {
+                rangeSize += (static_cast<VkDeviceSize>(1) << (highestBit(rangeSize) - SL_LOG2)) - 1;
+            }
+            uint32_t fl, sl;
+            mapping(rangeSize, fl, sl);
+            if (fl >= FL_COUNT) {
+                return NO_RANGE;
+            }
+            uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+            if (slMap == 0) {
+                const uint32_t flMap = fl + 1 < FL_COUNT ? flBitmap & (~0u << (fl + 1)) : 0;
+                if (flMap == 0) {
+                    return NO_RANGE;
+                }
+                fl = lowestBit(flMap);
+                slMap = slBitmaps[fl];
+            }
+            return heads[fl][lowestBit(slMap)];
+        }
+
+        void insertFree(uint32_t r)
+        {
+            uint32_t fl, sl;
+            mapping(ranges[r].size, fl, sl);
+            ranges[r].prevFree = NO_RANGE;
+            ranges[r].nextFree = heads[fl][sl];
+            if (heads[fl][sl] != NO_RANGE) {
+                ranges[heads[fl][sl]].prevFree = r;
+            }
+            heads[fl][sl] = r;
+            slBitmaps[fl] |= 1u << sl;
+            flBitmap |= 1u << fl;
+        }
+
+        void removeFree(uint32_t r)
+        {
+            uint32_t fl, sl;
+            mapping(ranges[r].size, fl, sl);
+            if (ranges[r].prevFree != NO_RANGE) {
+                ranges[ranges[r].prevFree].nextFree = ranges[r].nextFree;
+            } else {
+                heads[fl][sl] = ranges[r].nextFree;
+            }
+            if (ranges[r].nextFree != NO_RANGE) {
+                ranges[ranges[r].nextFree].prevFree = ranges[r].prevFree;
+            }
+            if (heads[fl][sl] == NO_RANGE) {
+                slBitmaps[fl] &= ~(1u << sl);
+                if (slBitmaps[fl] == 0) {
+                    flBitmap &= ~(1u << fl);
+                }
+            }
+        }
+
+        uint32_t newRange()
+        {
+            if (!unusedRanges.empty()) {
+                const uint32_t r = unusedRanges.back();
+                unusedRanges.pop_back();
+                return r;
+            }
+            ranges.push_back({});
+            return static_cast<uint32_t>(ranges.size() - 1);
+        }
+
+        void releaseRange(uint32_t r)
+        {
+            ranges[r] = { 0, 0, NO_RANGE, NO_RANGE, NO_RANGE, NO_RANGE, false };
+            unusedRanges.push_back(r);
+        }
+    };
+
+    MemoryAllocator::MemoryAllocator()
+    {
+    }
+
+    MemoryAllocator::~MemoryAllocator()
+    {
+        destroy();
+    }
+
+    void MemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device)
+    {
+        this->device = device;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+
+        pools.clear();
+        for (uint32_t memoryType = 0; memoryType < memoryProperties.memoryTypeCount; memoryType++) {
+            // 64 MB blocks, an eighth of the heap on small heaps
+            const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+            const VkDeviceSize blockSize = std::min<VkDeviceSize>(64 * 1024 * 1024, alignUp(heapSize / 8, 1024 * 1024));
+            for (uint32_t kind = 0; kind < POOL_KIND_COUNT; kind++) {
+                pools.push_back({ memoryType, static_cast<PoolKind>(kind), blockSize, {} });
+            }
+        }
+    }
+
+    void MemoryAllocator::destroy()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Pool &pool : pools) {
+            for (auto &block : pool.blocks) {
+                if (!block->empty()) {
+                    LOGW("Device memory block of type {} still in use", pool.memoryType);
+                }
+                freeMemory(block->memory, pool.memoryType);
+            }
+            pool.blocks.clear();
+        }
+        pools.clear();
+    }
+
+    VkResult MemoryAllocator::allocateMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory &memory, void *&mapped)
+    {
+        VkMemoryAllocateInfo memAlloc{};
+        memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memAlloc.allocationSize = size;
+        memAlloc.memoryTypeIndex = memoryType;
+        VkResult result = vkAllocateMemory(device, &memAlloc, nullptr, &memory);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+        // Host visible memory is mapped once, a VkDeviceMemory can only be mapped once at a time
+        mapped = nullptr;
+        if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+            if (result != VK_SUCCESS) {
+                vkFreeMemory(device, memory, nullptr);
+                memory = VK_NULL_HANDLE;
+            }
+        }
+        return result;
+    }
+
+    void MemoryAllocator::freeMemory(VkDeviceMemory memory, uint32_t memoryType)
+    {
+        if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            vkUnmapMemory(device, memory);
+        }
+        vkFreeMemory(device, memory, nullptr);
+    }
+
+    VkResult MemoryAllocator::allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, MemoryUsage usage,
+        bool image, Allocation &allocation)
+    {
+        uint32_t memoryType = UINT32_MAX;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((requirements.memoryTypeBits & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                memoryType = i;
+                break;
+            }
+        }
+        if (memoryType == UINT32_MAX) {
+            LOGE("No memory type with properties {} for type bits {}", properties, requirements.memoryTypeBits);
+            return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+        }
+
+        // Ranges of non coherent memory are flushed on their own, they must not share an atom with a neighbour
+        VkDeviceSize size = requirements.size;
+        VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+        const VkMemoryPropertyFlags typeFlags = memoryProperties.memoryTypes[memoryType].propertyFlags;
+        if ((typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+            alignment = std::max(alignment, nonCoherentAtomSize);
+            size = alignUp(size, nonCoherentAtomSize);
+        }
+
+        allocation = Allocation();
+        allocation.size = size;
+        allocation.usage = usage;
+        allocation.memoryType = memoryType;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        const PoolKind kind = usage == MemoryUsage::STAGING ? POOL_LINEAR : (image ? POOL_IMAGE : POOL_BUFFER);
+        const uint32_t poolIndex = memoryType * POOL_KIND_COUNT + kind;
+        Pool &pool = pools[poolIndex];
+
+        if (size <= pool.blockSize / 2) {
+            MemoryBlock *block = nullptr;
+            for (auto &candidate : pool.blocks) {
+                if (candidate->allocate(size, alignment, allocation.offset, allocation.range)) {
+                    block = candidate.get();
+                    break;
+                }
+            }
+            if (!block) {
+                VkDeviceMemory memory;
+                void *mapped;
+                VkResult result = allocateMemory(memoryType, pool.blockSize, memory, mapped);
+                if (result != VK_SUCCESS) {
+                    LOGE("Failed to allocate a {} MB device memory block: {}", pool.blockSize >> 20, result);
+                    return result;
+                }
+                pool.blocks.push_back(std::make_unique<MemoryBlock>(memory, pool.blockSize, mapped, poolIndex, kind == POOL_LINEAR));
+                block = pool.blocks.back().get();
+                if (!block->allocate(size, alignment, allocation.offset, allocation.range)) {
+                    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+                }
+            }
+            allocation.block = block;
+            allocation.memory = block->memory;
+            allocation.mapped = block->mapped ? block->mapped + allocation.offset : nullptr;
+        } else {
+            VkResult result = allocateMemory(memoryType, size, allocation.memory, allocation.mapped);
+            if (result != VK_SUCCESS) {
+                LOGE("Failed to allocate {} bytes of device memory: {}", size, result);
+                return result;
+            }
+            dedicatedCount++;
+            dedicatedBytes += size;
+        }
+        allocationCount++;
+        usageBytes[static_cast<uint32_t>(usage)] += size;
+        return VK_SUCCESS;
+    }
+
+    VkResult MemoryAllocator::allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, MemoryUsage usage, Allocation &allocation)
+    {
+        VkMemoryRequirements memReqs;
+        vkGetBufferMemoryRequirements(device, buffer, &memReqs);
+        VkResult result = allocate(memReqs, properties, usage, false, allocation);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+        return vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+    }
+
+    VkResult MemoryAllocator::allocateImage(VkImage image, VkMemoryPropertyFlags properties, MemoryUsage usage, Allocation &allocation)
+    {
+        VkMemoryRequirements memReqs;
+        vkGetImageMemoryRequirements(device, image, &memReqs);
+        VkResult result = allocate(memReqs, properties, usage, true, allocation);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+        return vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+    }
+
+    void MemoryAllocator::free(Allocation &allocation)
+    {
+        if (allocation.memory == VK_NULL_HANDLE) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        allocationCount--;
+        usageBytes[static_cast<uint32_t>(allocation.usage)] -= allocation.size;
+        if (!allocation.block) {
+            freeMemory(allocation.memory, allocation.memoryType);
+            dedicatedCount--;
+            dedicatedBytes -= allocation.size;
+            allocation = Allocation();
+            return;
+        }
+
+        MemoryBlock *block = allocation.block;
+        block->free(allocation.range, allocation.size);
+        allocation = Allocation();
+        if (!block->empty()) {
+            return;
+        }
+        // Keep one empty block per pool around, so a model reload does not go back to the driver
+        Pool &pool = pools[block->pool];
+        for (auto it = pool.blocks.begin(); it != pool.blocks.end(); ++it) {
+            if (it->get() != block && (*it)->empty()) {
+                auto emptyBlock = std::find_if(pool.blocks.begin(), pool.blocks.end(),
+                    [block](const std::unique_ptr<MemoryBlock> &candidate) { return candidate.get() == block; });
+                freeMemory(block->memory, pool.memoryType);
+                pool.blocks.erase(emptyBlock);
+                return;
+            }
+        }
+    }
+
+    void MemoryAllocator::flush(const Allocation &allocation, VkDeviceSize offset, VkDeviceSize size)
+    {
+        if (allocation.memory == VK_NULL_HANDLE) {
+            return;
+        }
+        VkMappedMemoryRange mappedRange{};
+        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        mappedRange.memory = allocation.memory;
+        mappedRange.offset = allocation.offset + offset;
+        mappedRange.size = size == VK_WHOLE_SIZE ? allocation.size - offset : std::min(alignUp(size, nonCoherentAtomSize), allocation.size - offset);
+        VK_CHECK_RESULT(vkFlushMappedMemoryRanges(device, 1, &mappedRange));
+    }
+
+    MemoryAllocator::Stats MemoryAllocator::stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats stats;
+        VkDeviceSize freeBytes = 0;
+        VkDeviceSize largestFree = 0;
+        for (const Pool &pool : pools) {
+            for (const auto &block : pool.blocks) {
+                stats.blockCount++;
+                stats.reservedBytes += block->size;
+                stats.usedBytes += block->used();
+                if (pool.kind != POOL_LINEAR) {
+                    VkDeviceSize blockFree, blockLargest;
+                    block->freeSpace(blockFree, blockLargest);
+                    freeBytes += blockFree;
+                    largestFree += blockLargest;
+                }
+            }
+        }
+        // Summed over the blocks, one large free range per block is not fragmentation
+        stats.fragmentation = freeBytes > 0 ? 1.0f - static_cast<float>(largestFree) / static_cast<float>(freeBytes) : 0.0f;
+        stats.dedicatedCount = dedicatedCount;
+        stats.reservedBytes += dedicatedBytes;
+        stats.usedBytes += dedicatedBytes;
+        stats.allocationCount = allocationCount;
+        for (uint32_t u = 0; u < static_cast<uint32_t>(MemoryUsage::COUNT); u++) {
+            stats.usageBytes[u] = usageBytes[u];
+        }
+        return stats;
+    }
+
+    void MemoryAllocator::logStats()
+    {
+        const Stats current = stats();
+        LOGI("Device memory: {} allocations in {} blocks and {} dedicated, {:.2f} MB used of {:.2f} MB, fragmentation {:.2f}",
+            current.allocationCount, current.blockCount, current.dedicatedCount, current.usedBytes / 1048576.0,
+            current.reservedBytes / 1048576.0, current.fragmentation);
+        for (uint32_t u = 0; u < static_cast<uint32_t>(MemoryUsage::COUNT); u++) {
+            LOGI("    {}: {:.2f} MB", memoryUsageName(static_cast<MemoryUsage>(u)), current.usageBytes[u] / 1048576.0);
+        }
+    }
+
+}
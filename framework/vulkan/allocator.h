@@ -0,0 +1,130 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Sub-allocator of Vulkan device memory
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "vulkan/vulkan.h"
+
+namespace xy
+{
+
+    /*
+        What an allocation holds, only used for the statistics
+    */
+    enum class MemoryUsage : uint32_t { GEOMETRY, TEXTURE, UNIFORM, STAGING, ATTACHMENT, COUNT };
+
+    const char *memoryUsageName(MemoryUsage usage);
+
+    class MemoryBlock;
+
+    /*
+        A range of device memory handed out by the MemoryAllocator
+        Host visible memory stays mapped for the lifetime of its block, mapped points at the start of the range
+    */
+    struct Allocation {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void *mapped = nullptr;
+        MemoryUsage usage = MemoryUsage::GEOMETRY;
+        uint32_t memoryType = 0;
+        // Block and range inside it, no block for dedicated allocations
+        MemoryBlock *block = nullptr;
+        uint32_t range = 0;
+    };
+
+    /*
+        Device memory is allocated in large blocks per memory type and handed out in ranges:
+            - buffers and images get separate TLSF (two-level segregated fit) pools, so bufferImageGranularity never matters
+            - staging buffers come from linear pools, which rewind once all their ranges are freed
+            - allocations larger than half a block get their own VkDeviceMemory
+        All functions are thread safe
+    */
+    class MemoryAllocator
+    {
+    public:
+        struct Stats {
+            uint32_t blockCount = 0;
+            uint32_t dedicatedCount = 0;
+            uint32_t allocationCount = 0;
+            // Bytes of device memory allocated from the driver and bytes handed out of it
+            VkDeviceSize reservedBytes = 0;
+            VkDeviceSize usedBytes = 0;
+            // 1 - largest free range / free bytes over the TLSF blocks, 0 when all free memory is contiguous per block
+            float fragmentation = 0.0f;
+            VkDeviceSize usageBytes[static_cast<uint32_t>(MemoryUsage::COUNT)] = {};
+        };
+
+        MemoryAllocator();
+        ~MemoryAllocator();
+
+        void init(VkPhysicalDevice physicalDevice, VkDevice device);
+
+        /*
+            Free every block, all allocations have to be freed before
+        */
+        void destroy();
+
+        /*
+            Allocate memory for the requirements from a memory type with the property flags
+            Returns VK_ERROR_OUT_OF_DEVICE_MEMORY when no memory type fits or the driver allocation fails
+        */
+        VkResult allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, MemoryUsage usage,
+            bool image, Allocation &allocation);
+
+        /*
+            Allocate and bind the memory of a buffer or an image
+        */
+        VkResult allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, MemoryUsage usage, Allocation &allocation);
+        VkResult allocateImage(VkImage image, VkMemoryPropertyFlags properties, MemoryUsage usage, Allocation &allocation);
+
+        /*
+            Return an allocation, it is reset to empty, freeing an empty allocation does nothing
+        */
+        void free(Allocation &allocation);
+
+        /*
+            Make host writes to a non coherent allocation visible to the device
+        */
+        void flush(const Allocation &allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+        Stats stats();
+
+        void logStats();
+
+    private:
+        enum PoolKind { POOL_BUFFER, POOL_IMAGE, POOL_LINEAR, POOL_KIND_COUNT };
+
+        struct Pool {
+            uint32_t memoryType;
+            PoolKind kind;
+            VkDeviceSize blockSize;
+            std::vector<std::unique_ptr<MemoryBlock>> blocks;
+        };
+
+        VkDevice device = VK_NULL_HANDLE;
+        VkPhysicalDeviceMemoryProperties memoryProperties{};
+        VkDeviceSize nonCoherentAtomSize = 1;
+
+        std::mutex mutex;
+        std::vector<Pool> pools;
+        uint32_t dedicatedCount = 0;
+        VkDeviceSize dedicatedBytes = 0;
+        VkDeviceSize usageBytes[static_cast<uint32_t>(MemoryUsage::COUNT)] = {};
+        uint32_t allocationCount = 0;
+
+        VkResult allocateMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory &memory, void *&mapped);
+        void freeMemory(VkDeviceMemory memory, uint32_t memoryType);
+    };
+
+}
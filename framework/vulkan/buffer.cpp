@@ -18,46 +18,40 @@ namespace xy
     void Buffer::create(VulkanDevice *device, VkBufferUsageFlags usageFlags,
         VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, bool map)
     {
-        this->device = device->logicalDevice;
+        this->device = device;
         this->size = size;
         device->createBuffer(usageFlags, memoryPropertyFlags, size, &buffer, &memory);
         descriptor = { buffer, 0, size };
         if (map) {
-            VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, memory, 0, size, 0, &mapped));
+            this->map();
         }
     }
 
     void Buffer::destroy()
     {
-        if (mapped) {
-            unmap();
+        if (!device) {
+            return;
         }
-        vkDestroyBuffer(device, buffer, nullptr);
-        vkFreeMemory(device, memory, nullptr);
-        buffer = VK_NULL_HANDLE;
-        memory = VK_NULL_HANDLE;
+        unmap();
+        device->destroyBuffer(buffer, memory);
     }
 
+    /*
+        Host visible memory stays mapped by the allocator, mapping only hands out the pointer
+    */
     void Buffer::map()
     {
-        VK_CHECK_RESULT(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+        mapped = memory.mapped;
     }
 
     void Buffer::unmap()
     {
-        if (mapped) {
-            vkUnmapMemory(device, memory);
-            mapped = nullptr;
-        }
+        mapped = nullptr;
     }
 
     void Buffer::flush()
     {
-        VkMappedMemoryRange mappedRange{};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.size = size;
-        VK_CHECK_RESULT(vkFlushMappedMemoryRanges(device, 1, &mappedRange));
+        device->allocator.flush(memory, 0, size);
     }
 
 } //namespace xy
\ No newline at end of file
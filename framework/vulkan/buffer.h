@@ -22,10 +22,10 @@ namespace xy
         Vulkan buffer object
     */
     struct Buffer {
-        VkDevice device;
+        VulkanDevice *device = nullptr;
         VkBuffer buffer = VK_NULL_HANDLE;
         VkDeviceSize size = VK_WHOLE_SIZE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        Allocation memory;
         VkDescriptorBufferInfo descriptor;
         int32_t count = 0;
         void *mapped = nullptr;
@@ -16,6 +16,8 @@
 namespace xy
 {
 
+    static const VkDeviceSize stagingRingSize = 64 * 1024 * 1024;
+
     VulkanDevice::VulkanDevice(VkPhysicalDevice physicalDevice)
     {
         assert(physicalDevice);
@@ -41,6 +43,11 @@ namespace xy
         if (commandPool) {
             vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
         }
+        for (auto &threadCommandPool : threadCommandPools) {
+            vkDestroyCommandPool(logicalDevice, threadCommandPool.second, nullptr);
+        }
+        staging.destroy();
+        allocator.destroy();
         if (logicalDevice) {
             vkDestroyDevice(logicalDevice, nullptr);
         }
@@ -86,6 +93,20 @@ namespace xy
             }
         }
 
+        // Dedicated queue for transfer
+        // Try to find a queue family index that supports transfer but not graphics and compute
+        if (queueFlags & VK_QUEUE_TRANSFER_BIT)
+        {
+            for (uint32_t i = 0; i < static_cast<uint32_t>(queueFamilyProperties.size()); i++) {
+                if ((queueFamilyProperties[i].queueFlags & queueFlags) && ((queueFamilyProperties[i].queueFlags
+                    & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0))
+                {
+                    return i;
+                    break;
+                }
+            }
+        }
+
         // For other queue types or if no separate compute queue is present, return the first one to
         // support the requested flags
         for (uint32_t i = 0; i < static_cast<uint32_t>(queueFamilyProperties.size()); i++) {
@@ -142,6 +163,22 @@ namespace xy
             queueFamilyIndices.compute = queueFamilyIndices.graphics;
         }
 
+        // Dedicated transfer queue, only a transfer only family is worth a queue of its own,
+        // graphics and compute families implicitly support transfers and uploads use the graphics queue then
+        queueFamilyIndices.transfer = queueFamilyIndices.graphics;
+        if (requestedQueueTypes & VK_QUEUE_TRANSFER_BIT) {
+            uint32_t transfer = getQueueFamilyIndex(VK_QUEUE_TRANSFER_BIT);
+            if ((queueFamilyProperties[transfer].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0) {
+                queueFamilyIndices.transfer = transfer;
+                VkDeviceQueueCreateInfo queueInfo{};
+                queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+                queueInfo.queueFamilyIndex = queueFamilyIndices.transfer;
+                queueInfo.queueCount = 1;
+                queueInfo.pQueuePriorities = &defaultQueuePriority;
+                queueCreateInfos.push_back(queueInfo);
+            }
+        }
+
         // Create the logical device representation
         std::vector<const char*> deviceExtensions(enabledExtensions);
         deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
@@ -160,7 +197,14 @@ namespace xy
         VkResult result = vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &logicalDevice);
 
         if (result == VK_SUCCESS) {
+            vkGetDeviceQueue(logicalDevice, queueFamilyIndices.transfer, 0, &transferQueue);
+            if (dedicatedTransferQueue()) {
+                LOGI("Uploads use the dedicated transfer queue family {}", queueFamilyIndices.transfer);
+            }
             commandPool = createCommandPool(queueFamilyIndices.graphics);
+            commandPoolThread = std::this_thread::get_id();
+            allocator.init(physicalDevice, logicalDevice);
+            staging.init(this, stagingRingSize);
         }
 
         this->enabledFeatures = enabledFeatures;
@@ -168,8 +212,22 @@ namespace xy
         return result;
     }
 
+    /*
+        Buffers are accounted by what their usage flags say they hold
+    */
+    static MemoryUsage bufferMemoryUsage(VkBufferUsageFlags usageFlags)
+    {
+        if (usageFlags & (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT)) {
+            return MemoryUsage::GEOMETRY;
+        }
+        if (usageFlags & (VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) {
+            return MemoryUsage::UNIFORM;
+        }
+        return MemoryUsage::STAGING;
+    }
+
     VkResult VulkanDevice::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags,
-        VkDeviceSize size, VkBuffer *buffer, VkDeviceMemory *memory, void *data)
+        VkDeviceSize size, VkBuffer *buffer, Allocation *memory, void *data)
     {
         // Create the buffer handle
         VkBufferCreateInfo bufferCreateInfo{};
@@ -177,43 +235,40 @@ namespace xy
         bufferCreateInfo.usage = usageFlags;
         bufferCreateInfo.size = size;
         bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        const uint32_t sharedQueueFamilies[] = { queueFamilyIndices.graphics, queueFamilyIndices.transfer };
+        if ((usageFlags & VK_BUFFER_USAGE_TRANSFER_DST_BIT) && dedicatedTransferQueue()) {
+            bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferCreateInfo.queueFamilyIndexCount = 2;
+            bufferCreateInfo.pQueueFamilyIndices = sharedQueueFamilies;
+        }
         VK_CHECK_RESULT(vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr, buffer));
 
-        // Create the memory backing up the buffer handle
-        VkMemoryRequirements memReqs;
-        VkMemoryAllocateInfo memAlloc{};
-        memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        vkGetBufferMemoryRequirements(logicalDevice, *buffer, &memReqs);
-        memAlloc.allocationSize = memReqs.size;
-        // Find a memory type index that fits the properties of the buffer
-        memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-        VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, memory));
-        
-        // If a pointer to the buffer data has been passed, map the buffer and copy over the data
+        // Sub-allocate the memory backing up the buffer handle and attach it
+        VK_CHECK_RESULT(allocator.allocateBuffer(*buffer, memoryPropertyFlags, bufferMemoryUsage(usageFlags), *memory));
+
+        // If a pointer to the buffer data has been passed, copy it over through the persistent mapping
         if (data != nullptr)
         {
-            void *mapped;
-            VK_CHECK_RESULT(vkMapMemory(logicalDevice, *memory, 0, size, 0, &mapped));
-            memcpy(mapped, data, size);
+            memcpy(memory->mapped, data, size);
             // If host coherency hasn't been requested, do a manual flush to make writes visible
             if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
             {
-                VkMappedMemoryRange mappedRange{};
-                mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-                mappedRange.memory = *memory;
-                mappedRange.offset = 0;
-                mappedRange.size = size;
-                vkFlushMappedMemoryRanges(logicalDevice, 1, &mappedRange);
+                allocator.flush(*memory);
             }
-            vkUnmapMemory(logicalDevice, *memory);
         }
 
-        // Attach the memory to the buffer object
-        VK_CHECK_RESULT(vkBindBufferMemory(logicalDevice, *buffer, *memory, 0));
-
         return VK_SUCCESS;
     }
 
+    void VulkanDevice::destroyBuffer(VkBuffer &buffer, Allocation &memory)
+    {
+        if (buffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(logicalDevice, buffer, nullptr);
+            buffer = VK_NULL_HANDLE;
+        }
+        allocator.free(memory);
+    }
+
     VkCommandPool VulkanDevice::createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags createFlags)
     {
         VkCommandPoolCreateInfo cmdPoolInfo = {};
@@ -225,11 +280,53 @@ namespace xy
         return cmdPool;
     }
 
+    VkCommandPool VulkanDevice::threadCommandPool(uint32_t queueFamilyIndex)
+    {
+        const std::thread::id thread = std::this_thread::get_id();
+        if (thread == commandPoolThread && queueFamilyIndex == queueFamilyIndices.graphics) {
+            return commandPool;
+        }
+        std::lock_guard<std::mutex> lock(threadCommandPoolsMutex);
+        VkCommandPool &pool = threadCommandPools[{ thread, queueFamilyIndex }];
+        if (pool == VK_NULL_HANDLE) {
+            pool = createCommandPool(queueFamilyIndex);
+        }
+        return pool;
+    }
+
+    VkCommandPool VulkanDevice::threadCommandPool()
+    {
+        return threadCommandPool(queueFamilyIndices.graphics);
+    }
+
+    std::mutex &VulkanDevice::queueLock(VkQueue queue)
+    {
+        return (queue == transferQueue && dedicatedTransferQueue()) ? transferQueueMutex : queueMutex;
+    }
+
+    uint32_t VulkanDevice::queueFamily(VkQueue queue) const
+    {
+        return (queue == transferQueue && dedicatedTransferQueue()) ? queueFamilyIndices.transfer : queueFamilyIndices.graphics;
+    }
+
+    void VulkanDevice::waitIdle()
+    {
+        std::lock(queueMutex, transferQueueMutex);
+        std::lock_guard<std::mutex> lock(queueMutex, std::adopt_lock);
+        std::lock_guard<std::mutex> transferLock(transferQueueMutex, std::adopt_lock);
+        vkDeviceWaitIdle(logicalDevice);
+    }
+
     VkCommandBuffer VulkanDevice::createCommandBuffer(VkCommandBufferLevel level, bool begin)
+    {
+        return createCommandBuffer(level, queueFamilyIndices.graphics, begin);
+    }
+
+    VkCommandBuffer VulkanDevice::createCommandBuffer(VkCommandBufferLevel level, uint32_t queueFamilyIndex, bool begin)
     {
         VkCommandBufferAllocateInfo cmdBufAllocateInfo{};
         cmdBufAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        cmdBufAllocateInfo.commandPool = commandPool;
+        cmdBufAllocateInfo.commandPool = threadCommandPool(queueFamilyIndex);
         cmdBufAllocateInfo.level = level;
         cmdBufAllocateInfo.commandBufferCount = 1;
 
@@ -269,16 +366,154 @@ namespace xy
         VkFence fence;
         VK_CHECK_RESULT(vkCreateFence(logicalDevice, &fenceInfo, nullptr, &fence));
         
-        // Submit to the queue
-        VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+        // Submit to the queue, only the submission holds the lock, not the wait
+        {
+            std::lock_guard<std::mutex> lock(queueLock(queue));
+            VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+        }
         // Wait for the fence to signal that command buffer has finished executing
         VK_CHECK_RESULT(vkWaitForFences(logicalDevice, 1, &fence, VK_TRUE, 100000000000));
 
         vkDestroyFence(logicalDevice, fence, nullptr);
 
         if (free) {
-            vkFreeCommandBuffers(logicalDevice, commandPool, 1, &commandBuffer);
+            vkFreeCommandBuffers(logicalDevice, threadCommandPool(queueFamily(queue)), 1, &commandBuffer);
+        }
+    }
+
+    void VulkanDevice::flushCommandBuffers(const std::vector<VkCommandBuffer> &commandBuffers, VkQueue queue)
+    {
+        if (commandBuffers.empty()) {
+            return;
+        }
+        for (auto commandBuffer : commandBuffers) {
+            VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+        submitInfo.pCommandBuffers = commandBuffers.data();
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VkFence fence;
+        VK_CHECK_RESULT(vkCreateFence(logicalDevice, &fenceInfo, nullptr, &fence));
+
+        {
+            std::lock_guard<std::mutex> lock(queueLock(queue));
+            VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+        }
+        VK_CHECK_RESULT(vkWaitForFences(logicalDevice, 1, &fence, VK_TRUE, 100000000000));
+
+        vkDestroyFence(logicalDevice, fence, nullptr);
+    }
+
+    void VulkanDevice::submitUpload(const std::vector<VkCommandBuffer> &transferCommandBuffers,
+        const std::vector<VkCommandBuffer> &commandBuffers, VkQueue queue, VkFence fence, VkSemaphore *semaphore)
+    {
+        *semaphore = VK_NULL_HANDLE;
+        if (!dedicatedTransferQueue()) {
+            std::vector<VkCommandBuffer> all(transferCommandBuffers);
+            all.insert(all.end(), commandBuffers.begin(), commandBuffers.end());
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = static_cast<uint32_t>(all.size());
+            submitInfo.pCommandBuffers = all.data();
+            std::lock_guard<std::mutex> lock(queueMutex);
+            VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+            return;
+        }
+
+        // The copies signal a binary semaphore the consuming queue waits on, its submission carries the fence
+        // and so finishes after the copies, the acquire barriers and mip generation run in commandBuffers
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        VK_CHECK_RESULT(vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, semaphore));
+
+        VkSubmitInfo transferSubmitInfo{};
+        transferSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        transferSubmitInfo.commandBufferCount = static_cast<uint32_t>(transferCommandBuffers.size());
+        transferSubmitInfo.pCommandBuffers = transferCommandBuffers.data();
+        transferSubmitInfo.signalSemaphoreCount = 1;
+        transferSubmitInfo.pSignalSemaphores = semaphore;
+        {
+            std::lock_guard<std::mutex> lock(transferQueueMutex);
+            VK_CHECK_RESULT(vkQueueSubmit(transferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE));
         }
+
+        const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = semaphore;
+        submitInfo.pWaitDstStageMask = &waitStageMask;
+        submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+        submitInfo.pCommandBuffers = commandBuffers.data();
+        {
+            std::lock_guard<std::mutex> lock(queueLock(queue));
+            VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+        }
+    }
+
+    void VulkanDevice::flushUploadCommandBuffers(const std::vector<VkCommandBuffer> &transferCommandBuffers,
+        const std::vector<VkCommandBuffer> &commandBuffers, VkQueue queue)
+    {
+        if (transferCommandBuffers.empty() && commandBuffers.empty()) {
+            return;
+        }
+        for (auto commandBuffer : transferCommandBuffers) {
+            VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+        }
+        for (auto commandBuffer : commandBuffers) {
+            VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+        }
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VkFence fence;
+        VK_CHECK_RESULT(vkCreateFence(logicalDevice, &fenceInfo, nullptr, &fence));
+
+        VkSemaphore semaphore;
+        submitUpload(transferCommandBuffers, commandBuffers, queue, fence, &semaphore);
+        VK_CHECK_RESULT(vkWaitForFences(logicalDevice, 1, &fence, VK_TRUE, 100000000000));
+
+        vkDestroyFence(logicalDevice, fence, nullptr);
+        if (semaphore != VK_NULL_HANDLE) {
+            vkDestroySemaphore(logicalDevice, semaphore, nullptr);
+        }
+    }
+
+    void VulkanDevice::transferImageOwnership(VkCommandBuffer releaseCmd, VkCommandBuffer acquireCmd, VkImage image,
+        const VkImageSubresourceRange &subresourceRange, VkImageLayout oldLayout, VkImageLayout newLayout,
+        VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask)
+    {
+        VkImageMemoryBarrier imageMemoryBarrier{};
+        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageMemoryBarrier.oldLayout = oldLayout;
+        imageMemoryBarrier.newLayout = newLayout;
+        imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageMemoryBarrier.dstAccessMask = dstAccessMask;
+        imageMemoryBarrier.image = image;
+        imageMemoryBarrier.subresourceRange = subresourceRange;
+
+        if (!dedicatedTransferQueue()) {
+            assert(releaseCmd == acquireCmd);
+            vkCmdPipelineBarrier(releaseCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+            return;
+        }
+
+        // The release and the acquire carry the same layout transition, the transition happens once between them
+        imageMemoryBarrier.srcQueueFamilyIndex = queueFamilyIndices.transfer;
+        imageMemoryBarrier.dstQueueFamilyIndex = queueFamilyIndices.graphics;
+        imageMemoryBarrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(releaseCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+        imageMemoryBarrier.srcAccessMask = 0;
+        imageMemoryBarrier.dstAccessMask = dstAccessMask;
+        vkCmdPipelineBarrier(acquireCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
     }
 
 }  //namespace xy
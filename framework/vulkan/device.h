@@ -10,8 +10,14 @@
 
 #pragma once
 
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
 #include <vector>
 #include "vulkan/vulkan.h"
+#include "vulkan/allocator.h"
+#include "vulkan/stagingring.h"
 
 namespace xy
 {
@@ -26,9 +32,43 @@ namespace xy
         std::vector<VkQueueFamilyProperties> queueFamilyProperties;
         VkCommandPool commandPool = VK_NULL_HANDLE;
 
+        /*
+            Every buffer and image of the framework gets its memory from here
+        */
+        MemoryAllocator allocator;
+
+        /*
+            Uploads are staged through this ring with a StagingRing::Batch
+        */
+        StagingRing staging;
+
+        /*
+            Queues are shared by the render thread and the background loaders,
+            every submission, present and device wait has to hold this lock
+        */
+        std::mutex queueMutex;
+
+        /*
+            Uploads are copied on a queue of a transfer only family when the device has one, so streaming
+            does not queue up behind the frames, it is the graphics queue otherwise
+            The dedicated queue has its own lock, queueLock picks the lock guarding a queue
+        */
+        VkQueue transferQueue = VK_NULL_HANDLE;
+        std::mutex transferQueueMutex;
+
+        /*
+            Command pools can not be used from several threads at once, commandPool belongs to the thread
+            which created the device and is used for the graphics family, every other thread and family
+            gets its own pool on first use
+        */
+        std::thread::id commandPoolThread;
+        std::map<std::pair<std::thread::id, uint32_t>, VkCommandPool> threadCommandPools;
+        std::mutex threadCommandPoolsMutex;
+
         struct {
             uint32_t graphics;
             uint32_t compute;
+            uint32_t transfer;
         } queueFamilyIndices;
 
         operator VkDevice() { return logicalDevice; };
@@ -65,6 +105,8 @@ namespace xy
         *
         * @param queueFlags Queue flags to find a queue family index for
         *
+        * @note Compute and transfer prefer a family without graphics, transfer also one without compute
+        *
         * @return Index of the queue family index that matches the flags
         *
         * @throw Throws an exception if no queue family index could be found that supports the requested flags
@@ -81,7 +123,22 @@ namespace xy
         */
         VkResult createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures,
             std::vector<const char*> enabledExtensions,
-            VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+            VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
+
+        /**
+        * True when uploads run on a transfer family of their own and have to be handed over to the graphics family
+        */
+        bool dedicatedTransferQueue() const { return queueFamilyIndices.transfer != queueFamilyIndices.graphics; }
+
+        /**
+        * Get the lock to hold while submitting to a queue
+        */
+        std::mutex &queueLock(VkQueue queue);
+
+        /**
+        * Get the family index of the graphics or the transfer queue
+        */
+        uint32_t queueFamily(VkQueue queue) const;
 
         /**
         * Create a buffer on the device
@@ -90,13 +147,21 @@ namespace xy
         * @param memoryPropertyFlags Memory properties for this buffer (i.e. device local, host visible, coherent)
         * @param size Size of the buffer in byes
         * @param buffer Pointer to the buffer handle acquired by the function
-        * @param memory Pointer to the memory handle acquired by the function
+        * @param memory Pointer to the allocation acquired by the function, host visible allocations stay mapped
         * @param data Pointer to the data that should be copied to the buffer after creation (optional, if not set, no data is copied over)
         *
+        * @note Transfer destinations are shared by the graphics and the dedicated transfer family, so ranges of a buffer
+        *       in use can be uploaded without an ownership transfer
+        *
         * @return VK_SUCCESS if buffer handle and memory have been created and (optionally passed) data has been copied
         */
         VkResult createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags,
-            VkDeviceSize size, VkBuffer *buffer, VkDeviceMemory *memory, void *data = nullptr);
+            VkDeviceSize size, VkBuffer *buffer, Allocation *memory, void *data = nullptr);
+
+        /**
+        * Destroy a buffer created by createBuffer and return its memory
+        */
+        void destroyBuffer(VkBuffer &buffer, Allocation &memory);
 
         /** 
         * Create a command pool for allocation command buffers from
@@ -112,7 +177,22 @@ namespace xy
             VkCommandPoolCreateFlags createFlags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
         /**
-        * Allocate a command buffer from the command pool
+        * Get the command pool of the calling thread for a queue family, it is created on first use
+        */
+        VkCommandPool threadCommandPool(uint32_t queueFamilyIndex);
+
+        /**
+        * Get the command pool of the calling thread for the graphics family
+        */
+        VkCommandPool threadCommandPool();
+
+        /**
+        * Wait until all queues of the device are idle, holding the queue lock
+        */
+        void waitIdle();
+
+        /**
+        * Allocate a command buffer from the command pool of the calling thread
         *
         * @param level Level of the new command buffer (primary or secondary)
         * @param (Optional) begin If true, recording on the new command buffer will be started (vkBeginCommandBuffer) (Defaults to false)
@@ -121,6 +201,11 @@ namespace xy
         */
         VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, bool begin = false);
 
+        /**
+        * Allocate a command buffer for a queue family from the command pool of the calling thread
+        */
+        VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, uint32_t queueFamilyIndex, bool begin);
+
         void beginCommandBuffer(VkCommandBuffer commandBuffer);
 
         /**
@@ -131,8 +216,59 @@ namespace xy
         * @param free (Optional) Free the command buffer once it has been submitted (Defaults to true)
         *
         * @note The queue that the command buffer is submitted to must be from the same family index as the pool it was allocated from
+        * @note With free the command buffer has to come from the pool of the calling thread for that family, as createCommandBuffer allocates it
         * @note Uses a fence to ensure command buffer has finished executing
         */
         void flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free = true);
+
+        /**
+        * Finish recording of several command buffers and submit them to a queue in a single batch
+        *
+        * @param commandBuffers Command buffers to flush, they are not freed
+        * @param queue Queue to submit the command buffers to
+        *
+        * @note Uses one fence for the whole batch to wait until all command buffers have finished executing
+        */
+        void flushCommandBuffers(const std::vector<VkCommandBuffer> &commandBuffers, VkQueue queue);
+
+        /**
+        * Submit uploads recorded for the transfer family together with the command buffers of queue which consume them
+        *
+        * @param transferCommandBuffers Command buffers of the transfer family, they have to be ended
+        * @param commandBuffers Command buffers of the family of queue, they have to be ended and may be empty
+        * @param queue Queue which uses the uploaded resources
+        * @param fence Fence signaled once both submissions finished
+        * @param semaphore Set to the semaphore queue waits on for the copies, it has to be destroyed after the fence signaled
+        *
+        * @note Without a dedicated transfer queue everything is submitted to queue and no semaphore is created
+        */
+        void submitUpload(const std::vector<VkCommandBuffer> &transferCommandBuffers, const std::vector<VkCommandBuffer> &commandBuffers,
+            VkQueue queue, VkFence fence, VkSemaphore *semaphore);
+
+        /**
+        * Finish recording of uploads, submit them with submitUpload and wait until they have finished
+        *
+        * @note The command buffers are not freed
+        */
+        void flushUploadCommandBuffers(const std::vector<VkCommandBuffer> &transferCommandBuffers,
+            const std::vector<VkCommandBuffer> &commandBuffers, VkQueue queue);
+
+        /**
+        * Record the hand over of an image written by transfer commands to the graphics family
+        *
+        * @param releaseCmd Command buffer of the transfer family which wrote the image
+        * @param acquireCmd Command buffer of the graphics family which uses the image next
+        * @param image Image to hand over
+        * @param subresourceRange Subresources written by the transfer commands
+        * @param oldLayout Layout the image was written in
+        * @param newLayout Layout the image is used in
+        * @param dstAccessMask Accesses of the image on the graphics family
+        * @param dstStageMask Stages of these accesses
+        *
+        * @note Without a dedicated transfer queue both command buffers are the same and a single layout transition is recorded
+        */
+        void transferImageOwnership(VkCommandBuffer releaseCmd, VkCommandBuffer acquireCmd, VkImage image,
+            const VkImageSubresourceRange &subresourceRange, VkImageLayout oldLayout, VkImageLayout newLayout,
+            VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask);
     };
 }
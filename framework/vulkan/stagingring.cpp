@@ -0,0 +1,339 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Persistently mapped staging ring for uploads
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include "vulkan/stagingring.h"
+
+#include <cassert>
+
+#include "vulkan/device.h"
+#include "macros.h"
+#include "logger.h"
+
+namespace xy
+{
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    StagingRing::Submission::~Submission()
+    {
+        if (fence != VK_NULL_HANDLE) {
+            vkDestroyFence(device, fence, nullptr);
+        }
+        if (semaphore != VK_NULL_HANDLE) {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+    }
+
+    void StagingRing::init(VulkanDevice *device, VkDeviceSize size)
+    {
+        this->device = device;
+        this->size = size;
+        VK_CHECK_RESULT(device->createBuffer(
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            size,
+            &buffer,
+            &memory));
+        head = tail = used = 0;
+    }
+
+    void StagingRing::destroy()
+    {
+        if (!device) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reclaim();
+            if (!chunks.empty()) {
+                LOGW("Staging ring destroyed with {} bytes in use", used);
+            }
+            chunks.clear();
+        }
+        LOGI("Staging ring: {} submissions, {:.2f} MB staged, {} stalls, {} oversized",
+            statistics.submissions, statistics.stagedBytes / 1048576.0, statistics.stalls, statistics.oversized);
+        device->destroyBuffer(buffer, memory);
+        device = nullptr;
+    }
+
+    StagingRing::Stats StagingRing::stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return statistics;
+    }
+
+    VkDeviceSize StagingRing::maxAllocation() const
+    {
+        return size / 2;
+    }
+
+    void StagingRing::pushChunk(VkDeviceSize begin, VkDeviceSize end, const std::shared_ptr<Submission> &submission,
+        uint64_t allocation)
+    {
+        if (begin == end) {
+            return;
+        }
+        used += end - begin;
+        Chunk *last = chunks.empty() ? nullptr : &chunks.back();
+        if (last && last->submission == submission && last->end == begin && last->serial > submission->recordedSerial) {
+            last->end = end;
+            last->serial = allocation;
+        } else {
+            chunks.push_back({ begin, end, submission, allocation });
+        }
+    }
+
+    bool StagingRing::reserve(VkDeviceSize regionSize, VkDeviceSize alignment,
+        const std::shared_ptr<Submission> &submission, Region &region)
+    {
+        if (used == 0) {
+            head = tail = 0;
+        }
+        // Free space is [head, size) + [0, tail) while head is ahead of tail, [head, tail) after head wrapped
+        const uint64_t allocation = serial + 1;
+        VkDeviceSize offset = alignUp(head, alignment);
+        if (head >= tail && (used == 0 || head != tail)) {
+            if (offset + regionSize > size) {
+                if (regionSize > tail) {
+                    return false;
+                }
+                // The end of the ring is padding of this submission
+                pushChunk(head, size, submission, allocation);
+                head = 0;
+                offset = 0;
+            }
+        } else if (offset + regionSize > tail) {
+            return false;
+        }
+        pushChunk(head, offset + regionSize, submission, allocation);
+        head = offset + regionSize;
+        serial = allocation;
+
+        region.buffer = buffer;
+        region.offset = offset;
+        region.size = regionSize;
+        region.data = static_cast<uint8_t *>(memory.mapped) + offset;
+        statistics.stagedBytes += regionSize;
+        return true;
+    }
+
+    void StagingRing::reclaim()
+    {
+        while (!chunks.empty()) {
+            const Chunk &chunk = chunks.front();
+            if (!chunk.submission->submitted ||
+                vkGetFenceStatus(device->logicalDevice, chunk.submission->fence) != VK_SUCCESS) {
+                break;
+            }
+            tail = chunk.end;
+            used -= chunk.end - chunk.begin;
+            chunks.pop_front();
+        }
+        if (used == 0) {
+            head = tail = 0;
+        }
+    }
+
+    StagingRing::Batch::Batch(VulkanDevice *device, VkQueue queue)
+        : device(device), ring(device->staging), queue(queue)
+    {
+    }
+
+    StagingRing::Batch::~Batch()
+    {
+        flush();
+    }
+
+    void StagingRing::Batch::begin()
+    {
+        if (current == VK_NULL_HANDLE) {
+            current = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, device->queueFamilyIndices.transfer, true);
+        }
+        if (!submission) {
+            submission = std::make_shared<Submission>();
+            submission->device = device->logicalDevice;
+        }
+    }
+
+    VkCommandBuffer StagingRing::Batch::commandBuffer()
+    {
+        begin();
+        std::lock_guard<std::mutex> lock(ring.mutex);
+        submission->recordedSerial = ring.serial;
+        return current;
+    }
+
+    VkCommandBuffer StagingRing::Batch::graphicsCommandBuffer()
+    {
+        begin();
+        if (!device->dedicatedTransferQueue()) {
+            return current;
+        }
+        if (currentGraphics == VK_NULL_HANDLE) {
+            currentGraphics = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        }
+        return currentGraphics;
+    }
+
+    void StagingRing::Batch::releaseImage(VkImage image, const VkImageSubresourceRange &subresourceRange,
+        VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask)
+    {
+        device->transferImageOwnership(commandBuffer(), graphicsCommandBuffer(), image, subresourceRange,
+            oldLayout, newLayout, dstAccessMask, dstStageMask);
+    }
+
+    StagingRing::Region StagingRing::Batch::allocateOversized(VkDeviceSize size)
+    {
+        Region region;
+        std::pair<VkBuffer, Allocation> temporary;
+        VK_CHECK_RESULT(device->createBuffer(
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            size,
+            &temporary.first,
+            &temporary.second));
+        oversized.push_back(temporary);
+        region.buffer = temporary.first;
+        region.size = size;
+        region.data = static_cast<uint8_t *>(temporary.second.mapped);
+        std::lock_guard<std::mutex> lock(ring.mutex);
+        ring.statistics.stagedBytes += size;
+        ring.statistics.oversized++;
+        return region;
+    }
+
+    StagingRing::Region StagingRing::Batch::allocate(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        begin();
+        Region region;
+
+        // Large uploads would stall everything else staged through the ring, they get a buffer of their own
+        if (size > ring.maxAllocation()) {
+            return allocateOversized(size);
+        }
+
+        std::unique_lock<std::mutex> lock(ring.mutex);
+        bool stalled = false;
+        for (;;) {
+            ring.reclaim();
+            if (ring.reserve(size, alignment, submission, region)) {
+                break;
+            }
+            if (!stalled) {
+                ring.statistics.stalls++;
+                stalled = true;
+            }
+            // Ring full, wait for the oldest range, which may be waiting for this batch to submit
+            std::shared_ptr<Submission> oldest = ring.chunks.front().submission;
+            if (oldest == submission) {
+                // Only ranges with recorded copies go with the submission, the caller may still write to the
+                // others and record their copies later, they move on to the submission continuing the batch
+                bool recorded = false;
+                for (const Chunk &chunk : ring.chunks) {
+                    recorded |= chunk.submission == submission && chunk.serial <= submission->recordedSerial;
+                }
+                if (!recorded) {
+                    lock.unlock();
+                    return allocateOversized(size);
+                }
+                std::shared_ptr<Submission> next = std::make_shared<Submission>();
+                next->device = device->logicalDevice;
+                for (Chunk &chunk : ring.chunks) {
+                    if (chunk.submission == submission && chunk.serial > submission->recordedSerial) {
+                        chunk.submission = next;
+                    }
+                }
+                lock.unlock();
+                submit();
+                submission = next;
+                begin();
+                lock.lock();
+            } else if (!oldest->submitted) {
+                ring.submitted.wait(lock);
+            } else {
+                lock.unlock();
+                VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &oldest->fence, VK_TRUE, UINT64_MAX));
+                lock.lock();
+            }
+        }
+        return region;
+    }
+
+    void StagingRing::Batch::submit()
+    {
+        if (current == VK_NULL_HANDLE) {
+            return;
+        }
+        VK_CHECK_RESULT(vkEndCommandBuffer(current));
+        std::vector<VkCommandBuffer> graphicsCommandBuffers;
+        if (currentGraphics != VK_NULL_HANDLE) {
+            VK_CHECK_RESULT(vkEndCommandBuffer(currentGraphics));
+            graphicsCommandBuffers.push_back(currentGraphics);
+        }
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VkFence fence;
+        VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &fence));
+
+        // Even buffer only uploads go through queue, waiting for the semaphore makes the copies visible to it
+        VkSemaphore semaphore;
+        device->submitUpload({ current }, graphicsCommandBuffers, queue, fence, &semaphore);
+        {
+            std::lock_guard<std::mutex> lock(ring.mutex);
+            submission->fence = fence;
+            submission->semaphore = semaphore;
+            submission->submitted = true;
+            ring.statistics.submissions++;
+        }
+        ring.submitted.notify_all();
+
+        inFlight.push_back({ current, currentGraphics, std::move(submission), std::move(oversized) });
+        current = VK_NULL_HANDLE;
+        currentGraphics = VK_NULL_HANDLE;
+        submission = nullptr;
+        oversized.clear();
+
+        // Command buffers and oversized buffers of finished submissions are released on the way
+        release(false);
+    }
+
+    void StagingRing::Batch::flush()
+    {
+        submit();
+        release(true);
+    }
+
+    void StagingRing::Batch::release(bool wait)
+    {
+        size_t finished = 0;
+        for (; finished < inFlight.size(); finished++) {
+            VkFence fence = inFlight[finished].submission->fence;
+            if (wait) {
+                VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX));
+            } else if (vkGetFenceStatus(device->logicalDevice, fence) != VK_SUCCESS) {
+                break;
+            }
+            vkFreeCommandBuffers(device->logicalDevice, device->threadCommandPool(device->queueFamilyIndices.transfer), 1,
+                &inFlight[finished].commandBuffer);
+            if (inFlight[finished].graphicsCommandBuffer != VK_NULL_HANDLE) {
+                vkFreeCommandBuffers(device->logicalDevice, device->threadCommandPool(), 1, &inFlight[finished].graphicsCommandBuffer);
+            }
+            for (auto &temporary : inFlight[finished].oversized) {
+                device->destroyBuffer(temporary.first, temporary.second);
+            }
+        }
+        inFlight.erase(inFlight.begin(), inFlight.begin() + finished);
+    }
+
+}
@@ -0,0 +1,182 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Persistently mapped staging ring for uploads
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "vulkan/vulkan.h"
+#include "vulkan/allocator.h"
+
+namespace xy
+{
+    struct VulkanDevice;
+
+    /*
+        One host visible buffer every upload is staged through, it stays mapped for the lifetime of the device
+        Space is handed out in order and reclaimed once the fence of the submission reading it has signaled,
+        an upload is a memcpy into the ring plus copy regions recorded into a Batch
+    */
+    class StagingRing
+    {
+    public:
+        /*
+            Range of the ring, data points at offset in the mapped buffer
+        */
+        struct Region {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            uint8_t *data = nullptr;
+        };
+
+        struct Stats {
+            uint64_t submissions = 0;
+            uint64_t stagedBytes = 0;
+            // Allocations which waited for a fence and allocations too large for the ring
+            uint64_t stalls = 0;
+            uint64_t oversized = 0;
+        };
+
+        class Batch;
+
+        void init(VulkanDevice *device, VkDeviceSize size);
+
+        /*
+            Every batch has to be flushed before
+        */
+        void destroy();
+
+        Stats stats();
+
+        /*
+            Largest allocation served from the ring, larger ones get a buffer of their own
+        */
+        VkDeviceSize maxAllocation() const;
+
+    private:
+        struct Submission {
+            VkDevice device = VK_NULL_HANDLE;
+            VkFence fence = VK_NULL_HANDLE;
+            // Semaphore between the copies on the dedicated transfer queue and the graphics submission
+            VkSemaphore semaphore = VK_NULL_HANDLE;
+            // Ranges allocated up to this serial have their copies recorded, later ones may not be written yet
+            uint64_t recordedSerial = 0;
+            bool submitted = false;
+            ~Submission();
+        };
+
+        /*
+            Ranges in ring order, adjacent ranges of one submission are merged as long as none of their copies is recorded
+            serial is the allocation serial of the last range in the chunk
+        */
+        struct Chunk {
+            VkDeviceSize begin;
+            VkDeviceSize end;
+            std::shared_ptr<Submission> submission;
+            uint64_t serial;
+        };
+
+        VulkanDevice *device = nullptr;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation memory;
+        VkDeviceSize size = 0;
+
+        std::mutex mutex;
+        std::condition_variable submitted;
+        VkDeviceSize head = 0;
+        VkDeviceSize tail = 0;
+        VkDeviceSize used = 0;
+        uint64_t serial = 0;
+        std::deque<Chunk> chunks;
+        Stats statistics;
+
+        bool reserve(VkDeviceSize size, VkDeviceSize alignment, const std::shared_ptr<Submission> &submission, Region &region);
+        void pushChunk(VkDeviceSize begin, VkDeviceSize end, const std::shared_ptr<Submission> &submission, uint64_t allocation);
+        void reclaim();
+    };
+
+    /*
+        Copies recorded by one thread from ranges of the ring and submitted together
+        Allocate first and record into commandBuffer() afterwards, an allocation which finds the ring full
+        submits what was recorded so far and continues in a new command buffer
+        Ranges allocated since the last call of commandBuffer() are held across such a submission, when only
+        they fill the ring the allocation gets a buffer of its own
+        With a dedicated transfer queue the copies run there and queue waits for them before it runs
+        graphicsCommandBuffer(), images have to be handed over with releaseImage, buffers are shared
+        The destructor waits for everything submitted through the batch, a thread must not allocate
+        from a second batch while the first one holds ranges it has not submitted
+    */
+    class StagingRing::Batch
+    {
+    public:
+        Batch(VulkanDevice *device, VkQueue queue);
+        ~Batch();
+
+        Batch(const Batch &) = delete;
+        Batch &operator=(const Batch &) = delete;
+
+        Region allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+        /*
+            Command buffer the copies from allocated ranges are recorded into, the copies from every range
+            allocated so far have to be recorded into it
+        */
+        VkCommandBuffer commandBuffer();
+
+        /*
+            Command buffer of the graphics family for work on the uploads which needs it, like blits,
+            it runs after the copies and the image acquires, the same as commandBuffer() without a dedicated transfer queue
+        */
+        VkCommandBuffer graphicsCommandBuffer();
+
+        /*
+            Hand an image written by the copies over to the graphics family in its final layout
+        */
+        void releaseImage(VkImage image, const VkImageSubresourceRange &subresourceRange, VkImageLayout oldLayout,
+            VkImageLayout newLayout, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+        /*
+            Submit the recorded copies without waiting for them
+        */
+        void submit();
+
+        /*
+            Submit the recorded copies and wait until everything submitted through the batch has finished
+        */
+        void flush();
+
+    private:
+        struct InFlight {
+            VkCommandBuffer commandBuffer;
+            VkCommandBuffer graphicsCommandBuffer;
+            std::shared_ptr<Submission> submission;
+            std::vector<std::pair<VkBuffer, Allocation>> oversized;
+        };
+
+        VulkanDevice *device;
+        StagingRing &ring;
+        VkQueue queue;
+        VkCommandBuffer current = VK_NULL_HANDLE;
+        VkCommandBuffer currentGraphics = VK_NULL_HANDLE;
+        std::shared_ptr<Submission> submission;
+        std::vector<std::pair<VkBuffer, Allocation>> oversized;
+        std::vector<InFlight> inFlight;
+
+        void begin();
+        Region allocateOversized(VkDeviceSize size);
+        void release(bool wait);
+    };
+
+}
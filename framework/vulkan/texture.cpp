@@ -30,7 +30,7 @@ namespace xy
         {
             vkDestroySampler(device->logicalDevice, sampler, nullptr);
         }
-        vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+        device->allocator.free(deviceMemory);
     }
 
 }
@@ -23,7 +23,7 @@ namespace xy
         VulkanDevice *device;
         VkImage image = VK_NULL_HANDLE;
         VkImageLayout imageLayout;
-        VkDeviceMemory deviceMemory;
+        Allocation deviceMemory;
         VkImageView view;
         uint32_t width, height;
         uint32_t mipLevels;
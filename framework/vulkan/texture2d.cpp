@@ -39,42 +39,12 @@ namespace xy
         VkFormatProperties formatProperties;
         vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
 
-        VkMemoryAllocateInfo memAllocInfo{};
-        memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        VkMemoryRequirements memReqs;
 
-        // Use a separate command buffer for texture loading
-        VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-        // Create a host-visible staging buffer that contains the raw image data
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingMemory;
-
-        VkBufferCreateInfo bufferCreateInfo{};
-        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferCreateInfo.size = tex2D.size();
-        // This buffer is used as a transfer source for the buffer copy
-        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-        VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-        // Get memory requirements for the staging buffer (alignment, memory type bits)
-        vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-        memAllocInfo.allocationSize = memReqs.size;
-        // Get memory type index for a host visible buffer
-        memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-        VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-        VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-        // Copy texture data into staging buffer
-        uint8_t *data;
-        VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-        memcpy(data, tex2D.data(), tex2D.size());
-        vkUnmapMemory(device->logicalDevice, stagingMemory);
+        // Stage the raw image data in the staging ring of the device
+        StagingRing::Batch batch(device, copyQueue);
+        StagingRing::Region staging = batch.allocate(tex2D.size());
+        memcpy(staging.data, tex2D.data(), tex2D.size());
+        VkCommandBuffer copyCmd = batch.commandBuffer();
 
         // Setup buffer copy regions for each mip level
         std::vector<VkBufferImageCopy> bufferCopyRegions;
@@ -90,7 +60,7 @@ namespace xy
             bufferCopyRegion.imageExtent.width = static_cast<uint32_t>(tex2D[i].extent().x);
             bufferCopyRegion.imageExtent.height = static_cast<uint32_t>(tex2D[i].extent().y);
             bufferCopyRegion.imageExtent.depth = 1;
-            bufferCopyRegion.bufferOffset = offset;
+            bufferCopyRegion.bufferOffset = staging.offset + offset;
 
             bufferCopyRegions.push_back(bufferCopyRegion);
 
@@ -117,13 +87,7 @@ namespace xy
         }
         VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
-        vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-
-        memAllocInfo.allocationSize = memReqs.size;
-
-        memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-        VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+        VK_CHECK_RESULT(device->allocator.allocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryUsage::TEXTURE, deviceMemory));
 
         VkImageSubresourceRange subresourceRange = {};
         subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -149,7 +113,7 @@ namespace xy
         // Copy mip levels from staging buffer
         vkCmdCopyBufferToImage(
             copyCmd,
-            stagingBuffer,
+            staging.buffer,
             image,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             static_cast<uint32_t>(bufferCopyRegions.size()),
@@ -158,24 +122,9 @@ namespace xy
 
         // Change texture image layout to shader read after all mip levels have been copied
         this->imageLayout = imageLayout;
-        {
-            VkImageMemoryBarrier imageMemoryBarrier{};
-            imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imageMemoryBarrier.newLayout = imageLayout;
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            imageMemoryBarrier.image = image;
-            imageMemoryBarrier.subresourceRange = subresourceRange;
-            vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0,
-                nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-        }
-
-        device->flushCommandBuffer(copyCmd, copyQueue);
+        batch.releaseImage(image, subresourceRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout, VK_ACCESS_SHADER_READ_BIT);
 
-        // Clean up staging resources
-        vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-        vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+        batch.flush();
 
         VkSamplerCreateInfo samplerCreateInfo{};
         samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -229,41 +178,11 @@ namespace xy
         height = height;
         mipLevels = 1;
 
-        VkMemoryAllocateInfo memAllocInfo{};
-        memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        VkMemoryRequirements memReqs;
-        // Use a separate command buffer for texture loading
-        VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-        // Create a host-visible staging buffer that contains the raw image data
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingMemory;
-
-        VkBufferCreateInfo bufferCreateInfo{};
-        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferCreateInfo.size = bufferSize;
-        // This buffer is used as a transfer source for the buffer copy
-        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-        VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-        // Get memory requirements for the staging buffer (alignment, memory type bits)
-        vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-        memAllocInfo.allocationSize = memReqs.size;
-        // Get memory type index for a host visible buffer
-        memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-        VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-        VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-        // Copy texture data into staging buffer
-        uint8_t *data;
-        VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-        memcpy(data, buffer, bufferSize);
-        vkUnmapMemory(device->logicalDevice, stagingMemory);
+        // Stage the raw image data in the staging ring of the device
+        StagingRing::Batch batch(device, copyQueue);
+        StagingRing::Region staging = batch.allocate(bufferSize);
+        memcpy(staging.data, buffer, bufferSize);
+        VkCommandBuffer copyCmd = batch.commandBuffer();
 
         VkBufferImageCopy bufferCopyRegion = {};
         bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -273,7 +192,7 @@ namespace xy
         bufferCopyRegion.imageExtent.width = width;
         bufferCopyRegion.imageExtent.height = height;
         bufferCopyRegion.imageExtent.depth = 1;
-        bufferCopyRegion.bufferOffset = 0;
+        bufferCopyRegion.bufferOffset = staging.offset;
 
         // Create optimal tiled target image
         VkImageCreateInfo imageCreateInfo{};
@@ -295,14 +214,7 @@ namespace xy
         }
         VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
-        vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-
-        memAllocInfo.allocationSize = memReqs.size;
-
-        memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-        VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+        VK_CHECK_RESULT(device->allocator.allocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryUsage::TEXTURE, deviceMemory));
 
         VkImageSubresourceRange subresourceRange = {};
         subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -325,7 +237,7 @@ namespace xy
 
         vkCmdCopyBufferToImage(
             copyCmd,
-            stagingBuffer,
+            staging.buffer,
             image,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             1,
@@ -333,24 +245,9 @@ namespace xy
         );
 
         this->imageLayout = imageLayout;
-        {
-            VkImageMemoryBarrier imageMemoryBarrier{};
-            imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imageMemoryBarrier.newLayout = imageLayout;
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            imageMemoryBarrier.image = image;
-            imageMemoryBarrier.subresourceRange = subresourceRange;
-            vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-        }
-
-        device->flushCommandBuffer(copyCmd, copyQueue);
+        batch.releaseImage(image, subresourceRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout, VK_ACCESS_SHADER_READ_BIT);
 
-        // Clean up staging resources
-        vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-        vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+        batch.flush();
 
         // Create sampler
         VkSamplerCreateInfo samplerCreateInfo = {};
@@ -42,39 +42,12 @@ namespace xy
         height = static_cast<uint32_t>(texCube.extent().y);
         mipLevels = static_cast<uint32_t>(texCube.levels());
 
-        VkMemoryAllocateInfo memAllocInfo{};
-        memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        VkMemoryRequirements memReqs;
 
-        // Create a host-visible staging buffer that contains the raw image data
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingMemory;
-
-        VkBufferCreateInfo bufferCreateInfo{};
-        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferCreateInfo.size = texCube.size();
-        // This buffer is used as a transfer source for the buffer copy
-        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-        VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-        // Get memory requirements for the staging buffer (alignment, memory type bits)
-        vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-
-        memAllocInfo.allocationSize = memReqs.size;
-        // Get memory type index for a host visible buffer
-        memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-        VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-        VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-        // Copy texture data into staging buffer
-        uint8_t *data;
-        VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-        memcpy(data, texCube.data(), texCube.size());
-        vkUnmapMemory(device->logicalDevice, stagingMemory);
+        // Stage the raw image data in the staging ring of the device
+        StagingRing::Batch batch(device, copyQueue);
+        StagingRing::Region staging = batch.allocate(texCube.size());
+        memcpy(staging.data, texCube.data(), texCube.size());
+        VkCommandBuffer copyCmd = batch.commandBuffer();
 
         // Setup buffer copy regions for each face including all of it's miplevels
         std::vector<VkBufferImageCopy> bufferCopyRegions;
@@ -90,7 +63,7 @@ namespace xy
                 bufferCopyRegion.imageExtent.width = static_cast<uint32_t>(texCube[face][level].extent().x);
                 bufferCopyRegion.imageExtent.height = static_cast<uint32_t>(texCube[face][level].extent().y);
                 bufferCopyRegion.imageExtent.depth = 1;
-                bufferCopyRegion.bufferOffset = offset;
+                bufferCopyRegion.bufferOffset = staging.offset + offset;
 
                 bufferCopyRegions.push_back(bufferCopyRegion);
 
@@ -123,17 +96,7 @@ namespace xy
 
         VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
-        vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-
-        memAllocInfo.allocationSize = memReqs.size;
-        memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-        VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
-
-        // Use a separate command buffer for texture loading
-        VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        VK_CHECK_RESULT(device->allocator.allocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryUsage::TEXTURE, deviceMemory));
 
         // Image barrier for optimal image (target)
         // Set initial layout for all array layers (faces) of the optimal (target) tiled texture
@@ -159,7 +122,7 @@ namespace xy
         // Copy the cube map faces from the staging buffer to the optimal tiled image
         vkCmdCopyBufferToImage(
             copyCmd,
-            stagingBuffer,
+            staging.buffer,
             image,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             static_cast<uint32_t>(bufferCopyRegions.size()),
@@ -167,20 +130,9 @@ namespace xy
 
         // Change texture image layout to shader read after all faces have been copied
         this->imageLayout = imageLayout;
-        {
-            VkImageMemoryBarrier imageMemoryBarrier{};
-            imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imageMemoryBarrier.newLayout = imageLayout;
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            imageMemoryBarrier.image = image;
-            imageMemoryBarrier.subresourceRange = subresourceRange;
-            vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-        }
+        batch.releaseImage(image, subresourceRange, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout, VK_ACCESS_SHADER_READ_BIT);
 
-        device->flushCommandBuffer(copyCmd, copyQueue);
+        batch.flush();
 
         // Create sampler
         VkSamplerCreateInfo samplerCreateInfo{};
@@ -214,9 +166,6 @@ namespace xy
         viewCreateInfo.image = image;
         VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
 
-        // Clean up staging resources
-        vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-        vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
         // Update descriptor image info member that can be used for setting up descriptor sets
         updateDescriptor();
@@ -10,6 +10,22 @@
 
 #include "logger.h"
 
+static const char *shaderDirectory = "./../data/shaders/";
+
+/*
+    SPIR-V compiled by the build is in the build tree, the committed SPIR-V next to the GLSL
+*/
+static std::string shaderPath(const std::string &filename)
+{
+#if defined(SHADER_BINARY_DIR)
+    const std::string compiled = SHADER_BINARY_DIR + filename;
+    if (std::ifstream(compiled).is_open()) {
+        return compiled;
+    }
+#endif
+    return shaderDirectory + filename;
+}
+
 VkPipelineShaderStageCreateInfo loadShader(VkDevice device, std::string filename, VkShaderStageFlagBits stage)
 {
     VkPipelineShaderStageCreateInfo shaderStage{};
@@ -17,7 +33,7 @@ VkPipelineShaderStageCreateInfo loadShader(VkDevice device, std::string filename
     shaderStage.stage = stage;
     shaderStage.pName = "main";
 
-    std::ifstream is("./../data/shaders/" + filename, std::ios::binary | std::ios::in | std::ios::ate);
+    std::ifstream is(shaderPath(filename), std::ios::binary | std::ios::in | std::ios::ate);
 
     if (is.is_open()) {
         size_t size = is.tellg();
@@ -42,6 +58,12 @@ VkPipelineShaderStageCreateInfo loadShader(VkDevice device, std::string filename
     return shaderStage;
 }
 
+bool shaderAvailable(const std::string &filename)
+{
+    std::ifstream is(shaderPath(filename), std::ios::binary | std::ios::in | std::ios::ate);
+    return is.is_open() && is.tellg() > 0;
+}
+
 void readDirectory(const std::string& directory, const std::string &pattern,
     std::map<std::string, std::string> &filelist, bool recursive)
 {
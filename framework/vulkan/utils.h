@@ -18,5 +18,11 @@
 
 VkPipelineShaderStageCreateInfo loadShader(VkDevice device, std::string filename, VkShaderStageFlagBits stage);
 
+/*
+    True when the SPIR-V file loadShader reads exists, optional shader variants are checked with it
+    so a build without them falls back to another path instead of failing in loadShader
+*/
+bool shaderAvailable(const std::string &filename);
+
 void readDirectory(const std::string& directory, const std::string &pattern,
     std::map<std::string, std::string> &filelist, bool recursive);
\ No newline at end of file
@@ -412,7 +412,7 @@ namespace xy
         }
 
         // Flush device to make sure all resources can be freed 
-        vkDeviceWaitIdle(device);
+        vulkanDevice->waitIdle();
     }
 
     XyVulkanWindow::XyVulkanWindow()
@@ -434,16 +434,16 @@ namespace xy
         }
         vkDestroyImageView(device, depthStencil.view, nullptr);
         vkDestroyImage(device, depthStencil.image, nullptr);
-        vkFreeMemory(device, depthStencil.mem, nullptr);
+        vulkanDevice->allocator.free(depthStencil.mem);
         vkDestroyPipelineCache(device, pipelineCache, nullptr);
         vkDestroyCommandPool(device, cmdPool, nullptr);
         if (settings.multiSampling) {
             vkDestroyImage(device, multisampleTarget.color.image, nullptr);
             vkDestroyImageView(device, multisampleTarget.color.view, nullptr);
-            vkFreeMemory(device, multisampleTarget.color.memory, nullptr);
+            vulkanDevice->allocator.free(multisampleTarget.color.memory);
             vkDestroyImage(device, multisampleTarget.depth.image, nullptr);
             vkDestroyImageView(device, multisampleTarget.depth.view, nullptr);
-            vkFreeMemory(device, multisampleTarget.depth.memory, nullptr);
+            vulkanDevice->allocator.free(multisampleTarget.depth.memory);
         }
         delete vulkanDevice;
         if (settings.validation) {
@@ -496,6 +496,17 @@ namespace xy
         if (deviceFeatures.samplerAnisotropy) {
             enabledFeatures.samplerAnisotropy = VK_TRUE;
         }
+        // Lets the bindless material shader index its texture array per material
+        if (deviceFeatures.shaderSampledImageArrayDynamicIndexing) {
+            enabledFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        }
+        // Indirect draws select their draw data by the first instance, many of them are recorded with one call
+        if (deviceFeatures.drawIndirectFirstInstance) {
+            enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+        }
+        if (deviceFeatures.multiDrawIndirect) {
+            enabledFeatures.multiDrawIndirect = VK_TRUE;
+        }
         std::vector<const char*> enabledExtensions{};
         VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledExtensions);
         if (res != VK_SUCCESS) {
@@ -565,18 +576,14 @@ namespace xy
             imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
             VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &multisampleTarget.color.image));
 
+            // Transient targets can live in lazily allocated memory where the device has it
             VkMemoryRequirements memReqs;
             vkGetImageMemoryRequirements(device, multisampleTarget.color.image, &memReqs);
-            VkMemoryAllocateInfo memAllocInfo{};
-            memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            memAllocInfo.allocationSize = memReqs.size;
             VkBool32 lazyMemTypePresent;
-            memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemTypePresent);
-            if (!lazyMemTypePresent) {
-                memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-            }
-            VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &multisampleTarget.color.memory));
-            vkBindImageMemory(device, multisampleTarget.color.image, multisampleTarget.color.memory, 0);
+            vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemTypePresent);
+            VkMemoryPropertyFlags targetMemoryFlags = lazyMemTypePresent ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            VK_CHECK_RESULT(vulkanDevice->allocator.allocateImage(multisampleTarget.color.image, targetMemoryFlags,
+                MemoryUsage::ATTACHMENT, multisampleTarget.color.memory));
 
             // Create image view for the MSAA target
             VkImageViewCreateInfo imageViewCI{};
@@ -608,15 +615,8 @@ namespace xy
             imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
             VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &multisampleTarget.depth.image));
 
-            vkGetImageMemoryRequirements(device, multisampleTarget.depth.image, &memReqs);
-            memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            memAllocInfo.allocationSize = memReqs.size;
-            memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazyMemTypePresent);
-            if (!lazyMemTypePresent) {
-                memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-            }
-            VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &multisampleTarget.depth.memory));
-            vkBindImageMemory(device, multisampleTarget.depth.image, multisampleTarget.depth.memory, 0);
+            VK_CHECK_RESULT(vulkanDevice->allocator.allocateImage(multisampleTarget.depth.image, targetMemoryFlags,
+                MemoryUsage::ATTACHMENT, multisampleTarget.depth.memory));
 
             // Create image view for the MSAA target
             imageViewCI.image = multisampleTarget.depth.image;
@@ -648,12 +648,6 @@ namespace xy
         image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
         image.flags = 0;
 
-        VkMemoryAllocateInfo mem_alloc = {};
-        mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        mem_alloc.pNext = NULL;
-        mem_alloc.allocationSize = 0;
-        mem_alloc.memoryTypeIndex = 0;
-
         VkImageViewCreateInfo depthStencilView = {};
         depthStencilView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         depthStencilView.pNext = NULL;
@@ -667,13 +661,9 @@ namespace xy
         depthStencilView.subresourceRange.baseArrayLayer = 0;
         depthStencilView.subresourceRange.layerCount = 1;
 
-        VkMemoryRequirements memReqs;
         VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &depthStencil.image));
-        vkGetImageMemoryRequirements(device, depthStencil.image, &memReqs);
-        mem_alloc.allocationSize = memReqs.size;
-        mem_alloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        VK_CHECK_RESULT(vkAllocateMemory(device, &mem_alloc, nullptr, &depthStencil.mem));
-        VK_CHECK_RESULT(vkBindImageMemory(device, depthStencil.image, depthStencil.mem, 0));
+        VK_CHECK_RESULT(vulkanDevice->allocator.allocateImage(depthStencil.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            MemoryUsage::ATTACHMENT, depthStencil.mem));
 
         depthStencilView.image = depthStencil.image;
         VK_CHECK_RESULT(vkCreateImageView(device, &depthStencilView, nullptr, &depthStencil.view));
@@ -721,26 +711,26 @@ namespace xy
         }
         prepared = false;
 
-        vkDeviceWaitIdle(device);
+        vulkanDevice->waitIdle();
         width = destWidth;
         height = destHeight;
         setupSwapChain();
         if (settings.multiSampling) {
             vkDestroyImageView(device, multisampleTarget.color.view, nullptr);
             vkDestroyImage(device, multisampleTarget.color.image, nullptr);
-            vkFreeMemory(device, multisampleTarget.color.memory, nullptr);
+            vulkanDevice->allocator.free(multisampleTarget.color.memory);
             vkDestroyImageView(device, multisampleTarget.depth.view, nullptr);
             vkDestroyImage(device, multisampleTarget.depth.image, nullptr);
-            vkFreeMemory(device, multisampleTarget.depth.memory, nullptr);
+            vulkanDevice->allocator.free(multisampleTarget.depth.memory);
         }
         vkDestroyImageView(device, depthStencil.view, nullptr);
         vkDestroyImage(device, depthStencil.image, nullptr);
-        vkFreeMemory(device, depthStencil.mem, nullptr);
+        vulkanDevice->allocator.free(depthStencil.mem);
         for (uint32_t i = 0; i < frameBuffers.size(); i++) {
             vkDestroyFramebuffer(device, frameBuffers[i], nullptr);
         }
         setupFrameBuffer();
-        vkDeviceWaitIdle(device);
+        vulkanDevice->waitIdle();
 
         camera.updateAspectRatio((float)width / (float)height);
         windowResized();
@@ -37,12 +37,12 @@ namespace xy
             struct {
                 VkImage image;
                 VkImageView view;
-                VkDeviceMemory memory;
+                Allocation memory;
             } color;
             struct {
                 VkImage image;
                 VkImageView view;
-                VkDeviceMemory memory;
+                Allocation memory;
             } depth;
         } multisampleTarget;
 
@@ -96,7 +96,7 @@ namespace xy
         
         struct DepthStencil {
             VkImage image;
-            VkDeviceMemory mem;
+            Allocation mem;
             VkImageView view;
         } depthStencil;
 
@@ -0,0 +1,135 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Read only memory mapping of a whole file
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace xy
+{
+
+    /*
+        Maps a file read only into the address space, pages are brought in by the OS on first touch
+        and can be dropped again under memory pressure since they are backed by the file itself
+    */
+    class MappedFile
+    {
+    private:
+        const uint8_t  *mappedData = nullptr;
+        size_t          mappedSize = 0;
+#if defined(_WIN32)
+        HANDLE          fileHandle = INVALID_HANDLE_VALUE;
+        HANDLE          mappingHandle = nullptr;
+#endif
+
+    public:
+        MappedFile() = default;
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile()
+        {
+            close();
+        }
+
+        bool open(const std::string &filename)
+        {
+            close();
+#if defined(_WIN32)
+            fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (fileHandle == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+                close();
+                return false;
+            }
+            mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mappingHandle) {
+                close();
+                return false;
+            }
+            mappedData = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+            if (!mappedData) {
+                close();
+                return false;
+            }
+            mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                ::close(fd);
+                return false;
+            }
+            void *ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            // The mapping keeps its own reference to the file
+            ::close(fd);
+            if (ptr == MAP_FAILED) {
+                return false;
+            }
+            madvise(ptr, static_cast<size_t>(st.st_size), MADV_WILLNEED);
+            mappedData = static_cast<const uint8_t*>(ptr);
+            mappedSize = static_cast<size_t>(st.st_size);
+#endif
+            return true;
+        }
+
+        void close()
+        {
+#if defined(_WIN32)
+            if (mappedData) {
+                UnmapViewOfFile(mappedData);
+            }
+            if (mappingHandle) {
+                CloseHandle(mappingHandle);
+            }
+            if (fileHandle != INVALID_HANDLE_VALUE) {
+                CloseHandle(fileHandle);
+            }
+            mappingHandle = nullptr;
+            fileHandle = INVALID_HANDLE_VALUE;
+#else
+            if (mappedData) {
+                munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+            }
+#endif
+            mappedData = nullptr;
+            mappedSize = 0;
+        }
+
+        const uint8_t *data() const { return mappedData; }
+
+        size_t size() const { return mappedSize; }
+
+        bool isOpen() const { return mappedData != nullptr; }
+    };
+
+}
@@ -0,0 +1,144 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Define a fixed size worker pool for CPU heavy loading work
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xy
+{
+
+    class ThreadPool
+    {
+    private:
+        std::vector<std::thread>            workers;
+        std::deque<std::function<void()>>   jobs;
+        std::mutex                          mutex;
+        std::condition_variable             condition;
+        bool                                stopping = false;
+
+        void workerLoop()
+        {
+            for (;;) {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [this] { return stopping || !jobs.empty(); });
+                    if (stopping && jobs.empty()) {
+                        return;
+                    }
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                job();
+            }
+        }
+
+    public:
+        explicit ThreadPool(uint32_t threadCount = std::thread::hardware_concurrency())
+        {
+            threadCount = std::max(threadCount, 1u);
+            for (uint32_t i = 0; i < threadCount; i++) {
+                workers.emplace_back(&ThreadPool::workerLoop, this);
+            }
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            condition.notify_all();
+            for (auto &worker : workers) {
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        /*
+            Process wide pool shared by the loaders
+        */
+        static ThreadPool &shared()
+        {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        uint32_t size() const { return static_cast<uint32_t>(workers.size()); }
+
+        /*
+            Queue a job, it is run on one of the workers some time later
+        */
+        void enqueue(std::function<void()> job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(std::move(job));
+            }
+            condition.notify_one();
+        }
+
+        /*
+            Run fn(0) ... fn(count - 1) on the workers and return once every index has been processed.
+            The calling thread takes part in the work, so it is safe to call from inside a job.
+        */
+        void parallelFor(size_t count, const std::function<void(size_t)> &fn)
+        {
+            if (count == 0) {
+                return;
+            }
+            if (count == 1) {
+                fn(0);
+                return;
+            }
+
+            struct State {
+                std::atomic<size_t> next{0};
+                std::atomic<size_t> done{0};
+                std::mutex mutex;
+                std::condition_variable finished;
+            };
+            auto state = std::make_shared<State>();
+
+            auto run = [state, count, &fn]() {
+                size_t index;
+                while ((index = state->next.fetch_add(1)) < count) {
+                    fn(index);
+                    if (state->done.fetch_add(1) + 1 == count) {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        state->finished.notify_all();
+                    }
+                }
+            };
+
+            // Helpers which start after all indices are taken return without touching fn
+            size_t helpers = std::min(count - 1, static_cast<size_t>(size()));
+            for (size_t i = 0; i < helpers; i++) {
+                enqueue(run);
+            }
+            run();
+
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->finished.wait(lock, [&] { return state->done.load() == count; });
+        }
+    };
+
+} // namespace xy
@@ -22,6 +22,7 @@
 #include "gltf/textures.h"
 #include "filedialog.h"
 #include "logger.h"
+#include "threadpool.h"
 #include "vulkan/utils.h"
 #include "skybox/skybox.h"
 
@@ -30,7 +31,10 @@
 #include <glm/gtx/matrix_decompose.hpp>
 
 #include <limits.h>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <future>
 
 #ifdef __APPLE__
 #include "CoreFoundation/CoreFoundation.h"
@@ -141,6 +145,17 @@ public:
     std::map<std::string, std::string> environments;
     std::string selectedEnvironment = "papermill";
 
+    // One texture array and material buffer instead of a descriptor set per material
+    bool bindlessMaterials = true;
+    // One indirect call per group of primitives sharing their pipeline state, needs the bindless materials
+    bool indirectDraws = true;
+    // Skip primitives outside the view, on the CPU while recording or on the GPU for indirect draws
+    bool frustumCulling = true;
+    // Skip primitives hidden behind the ones visible in the last frame, needs the GPU culling
+    bool occlusionCulling = true;
+    // Skin the skinned meshes in a compute pass instead of the vertex shader
+    bool computeSkinning = true;
+
     // Parameters for UI
     UIRender *ui;
 
@@ -155,6 +170,31 @@ public:
 
     // Parameters for GLTF models
     GLTFRender* modelRenderer = nullptr;
+
+    /*
+        A model loading in the background, the current model keeps rendering until it is ready
+    */
+    struct ModelLoading {
+        std::string filename;
+        GLTFRender *renderer = nullptr;
+        std::future<bool> result;
+    };
+    std::unique_ptr<ModelLoading> modelLoading;
+
+    /*
+        Resources replaced at frameNumber, released once every frame slot has been waited for since
+    */
+    struct DeferredDeletion {
+        uint64_t frameNumber;
+        std::function<void()> release;
+    };
+    std::deque<DeferredDeletion> deletionQueue;
+    uint64_t frameNumber = 0;
+
+    // Command buffers are re-recorded lazily, when their swap chain image comes up next
+    std::vector<bool>    staleCommandBuffers;
+    // Fence of the last frame which rendered into each swap chain image
+    std::vector<VkFence> imageFences;
     int32_t debugViewInputs = 0;
     int32_t debugViewEquation = 0;
     int32_t animationIndex = 0;
@@ -172,6 +212,16 @@ public:
 
     ~VulkanExample()
     {
+        // The loading job still uses the device, wait for it before anything is torn down
+        if (modelLoading) {
+            modelLoading->result.wait();
+            delete modelLoading->renderer;
+        }
+        for (auto &deletion : deletionQueue) {
+            deletion.release();
+        }
+        deletionQueue.clear();
+
         for (auto buffer : uniformBufferParams) {
             buffer.destroy();
         }
@@ -206,6 +256,21 @@ public:
     }
 
     void recordCommandBuffers()
+    {
+        for (uint32_t i = 0; i < commandBuffers.size(); ++i) {
+            recordCommandBuffer(i);
+        }
+    }
+
+    /*
+        Mark all command buffers for re-recording, none of them may be pending when it is recorded again
+    */
+    void invalidateCommandBuffers()
+    {
+        std::fill(staleCommandBuffers.begin(), staleCommandBuffers.end(), true);
+    }
+
+    void recordCommandBuffer(uint32_t i)
     {
         VkCommandBufferBeginInfo cmdBufferBeginInfo{};
         cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -232,42 +297,44 @@ public:
         renderPassBeginInfo.clearValueCount = settings.multiSampling ? 3 : 2;
         renderPassBeginInfo.pClearValues = clearValues;
 
-        for (uint32_t i = 0; i < commandBuffers.size(); ++i) {
-            renderPassBeginInfo.framebuffer = frameBuffers[i];
+        renderPassBeginInfo.framebuffer = frameBuffers[i];
 
-            VkCommandBuffer currentCB = commandBuffers[i];
+        VkCommandBuffer currentCB = commandBuffers[i];
 
-            VK_CHECK_RESULT(vkBeginCommandBuffer(currentCB, &cmdBufferBeginInfo));
-            vkCmdBeginRenderPass(currentCB, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        VK_CHECK_RESULT(vkBeginCommandBuffer(currentCB, &cmdBufferBeginInfo));
+        if (modelRenderer) {
+            modelRenderer->recordCompute(currentCB, i);
+        }
+        vkCmdBeginRenderPass(currentCB, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-            VkViewport viewport{};
-            viewport.width = (float)width;
-            viewport.height = (float)height;
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-            vkCmdSetViewport(currentCB, 0, 1, &viewport);
+        VkViewport viewport{};
+        viewport.width = (float)width;
+        viewport.height = (float)height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(currentCB, 0, 1, &viewport);
 
-            VkRect2D scissor{};
-            scissor.extent = { width, height };
-            vkCmdSetScissor(currentCB, 0, 1, &scissor);
+        VkRect2D scissor{};
+        scissor.extent = { width, height };
+        vkCmdSetScissor(currentCB, 0, 1, &scissor);
 
-            VkDeviceSize offsets[1] = { 0 };
+        VkDeviceSize offsets[1] = { 0 };
 
-            if (displayBackground && skybox) {
-                skybox->recordCommandBuffers(currentCB, i);
-            }
+        if (displayBackground && skybox) {
+            skybox->recordCommandBuffers(currentCB, i);
+        }
 
-            // Models Rendering
-            if (modelRenderer)
-            {
-                modelRenderer->recordCommandBuffers(currentCB, i);
-            }
+        // Models Rendering
+        if (modelRenderer)
+        {
+            modelRenderer->recordCommandBuffers(currentCB, i);
+        }
 
-            ui->draw(currentCB);
+        ui->draw(currentCB);
 
-            vkCmdEndRenderPass(currentCB);
-            VK_CHECK_RESULT(vkEndCommandBuffer(currentCB));
-        }
+        vkCmdEndRenderPass(currentCB);
+        VK_CHECK_RESULT(vkEndCommandBuffer(currentCB));
+        staleCommandBuffers[i] = false;
     }
 
     void loadEnvironment(std::string filename)
@@ -351,14 +418,8 @@ public:
         imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
         imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
         VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &textures.lutBrdf.image));
-        VkMemoryRequirements memReqs;
-        vkGetImageMemoryRequirements(device, textures.lutBrdf.image, &memReqs);
-        VkMemoryAllocateInfo memAllocInfo{};
-        memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memAllocInfo.allocationSize = memReqs.size;
-        memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &textures.lutBrdf.deviceMemory));
-        VK_CHECK_RESULT(vkBindImageMemory(device, textures.lutBrdf.image, textures.lutBrdf.deviceMemory, 0));
+        VK_CHECK_RESULT(vulkanDevice->allocator.allocateImage(textures.lutBrdf.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            MemoryUsage::TEXTURE, textures.lutBrdf.deviceMemory));
 
         // View
         VkImageViewCreateInfo viewCI{};
@@ -635,14 +696,8 @@ public:
                 imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
                 imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
                 VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &cubemap.image));
-                VkMemoryRequirements memReqs;
-                vkGetImageMemoryRequirements(device, cubemap.image, &memReqs);
-                VkMemoryAllocateInfo memAllocInfo{};
-                memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-                memAllocInfo.allocationSize = memReqs.size;
-                memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-                VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &cubemap.deviceMemory));
-                VK_CHECK_RESULT(vkBindImageMemory(device, cubemap.image, cubemap.deviceMemory, 0));
+                VK_CHECK_RESULT(vulkanDevice->allocator.allocateImage(cubemap.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    MemoryUsage::TEXTURE, cubemap.deviceMemory));
 
                 // View
                 VkImageViewCreateInfo viewCI{};
@@ -722,7 +777,7 @@ public:
             struct Offscreen {
                 VkImage image;
                 VkImageView view;
-                VkDeviceMemory memory;
+                Allocation memory;
                 VkFramebuffer framebuffer;
             } offscreen;
 
@@ -744,14 +799,8 @@ public:
                 imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
                 imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
                 VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &offscreen.image));
-                VkMemoryRequirements memReqs;
-                vkGetImageMemoryRequirements(device, offscreen.image, &memReqs);
-                VkMemoryAllocateInfo memAllocInfo{};
-                memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-                memAllocInfo.allocationSize = memReqs.size;
-                memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-                VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &offscreen.memory));
-                VK_CHECK_RESULT(vkBindImageMemory(device, offscreen.image, offscreen.memory, 0));
+                VK_CHECK_RESULT(vulkanDevice->allocator.allocateImage(offscreen.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    MemoryUsage::ATTACHMENT, offscreen.memory));
 
                 // View
                 VkImageViewCreateInfo viewCI{};
@@ -907,13 +956,14 @@ public:
             dynamicStateCI.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
 
             // Vertex input state
-            VkVertexInputBindingDescription vertexInputBinding = { 0, sizeof(vkglTF::Model::Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
-            VkVertexInputAttributeDescription vertexInputAttribute = { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 };
+            const vkglTF::VertexLayout &layout = skybox->models.skybox.vertexLayouts[0];
+            std::vector<VkVertexInputBindingDescription> vertexInputBindings = layout.inputBindings();
+            VkVertexInputAttributeDescription vertexInputAttribute = layout.inputAttributes()[vkglTF::VertexLayout::POSITION];
 
             VkPipelineVertexInputStateCreateInfo vertexInputStateCI{};
             vertexInputStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-            vertexInputStateCI.vertexBindingDescriptionCount = 1;
-            vertexInputStateCI.pVertexBindingDescriptions = &vertexInputBinding;
+            vertexInputStateCI.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInputBindings.size());
+            vertexInputStateCI.pVertexBindingDescriptions = vertexInputBindings.data();
             vertexInputStateCI.vertexAttributeDescriptionCount = 1;
             vertexInputStateCI.pVertexAttributeDescriptions = &vertexInputAttribute;
 
@@ -1119,7 +1169,7 @@ public:
 
             vkDestroyRenderPass(device, renderpass, nullptr);
             vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
-            vkFreeMemory(device, offscreen.memory, nullptr);
+            vulkanDevice->allocator.free(offscreen.memory);
             vkDestroyImageView(device, offscreen.view, nullptr);
             vkDestroyImage(device, offscreen.image, nullptr);
             vkDestroyDescriptorPool(device, descriptorpool, nullptr);
@@ -1191,8 +1241,11 @@ public:
 
     void windowResized()
     {
+        if (modelRenderer) {
+            modelRenderer->setViewExtent(width, height);
+        }
         recordCommandBuffers();
-        vkDeviceWaitIdle(device);
+        vulkanDevice->waitIdle();
         updateUniformBuffers();
         updateOverlay();
     }
@@ -1213,6 +1266,8 @@ public:
         presentCompleteSemaphores.resize(renderAhead);
         renderCompleteSemaphores.resize(renderAhead);
         commandBuffers.resize(swapChain.imageCount);
+        staleCommandBuffers.resize(swapChain.imageCount, true);
+        imageFences.resize(swapChain.imageCount, VK_NULL_HANDLE);
         uniformBufferParams.resize(swapChain.imageCount);
 
         // Command buffer execution fences
@@ -1267,7 +1322,8 @@ public:
         if (static_cast<uint32_t>(mCurrentGizmoOperation) == 4 || selectedNode == nullptr)
             return;
 
-        glm::mat4 matrix = selectedNode->localMatrix();
+        vkglTF::Model *model = modelRenderer->getModel();
+        glm::mat4 matrix = model->transforms.localMatrix(selectedNode->transform);
         glm::vec3 scale;
         glm::quat rotation;
         glm::vec3 translation;
@@ -1277,14 +1333,10 @@ public:
             ImGuizmo::Manipulate(glm::value_ptr(view), glm::value_ptr(proj), mCurrentGizmoOperation, mCurrentGizmoMode, glm::value_ptr(matrix), NULL, NULL);
             if(ImGuizmo::IsUsing()) {
                 glm::decompose(matrix, scale, rotation, translation, skew, perspective);
-                selectedNode->translation = translation;
-                selectedNode->scale = scale;
-                selectedNode->rotation = rotation;
-
-                vkglTF::Model *model = modelRenderer->getModel();
-                for (auto& node : model->nodes) {
-                    node->update();
-                }
+                model->transforms.setTranslation(selectedNode->transform, translation);
+                model->transforms.setScale(selectedNode->transform, scale);
+                model->transforms.setRotation(selectedNode->transform, rotation);
+                model->updateTransforms();
 
             }
         }
@@ -1368,38 +1420,111 @@ public:
         modelRenderer->animationIndex = index + 1;
     }
 
+    /*
+        Start loading a model in the background, it replaces the current model once it is ready
+    */
     bool loadModel(std::string filename)
     {
-        if (!filename.empty()) {
-            vkDeviceWaitIdle(device);
-
-            // TODO: Models Rendering
-            GLTFRender *model = new GLTFRender(vulkanDevice, swapChain.imageCount, renderPass, queue,
-                pipelineCache, settings.sampleCount, &textures, &camera, &uniformBufferParams);
-            if(model->load(filename)) {
-                // Caculate the distance of camera
-                glm::mat4 aabb = model->getModel()->aabb;
-                float bestScale = (1.0f / std::max(aabb[0][0], std::max(aabb[1][1], aabb[2][2]))) * 0.5f;
-                float cameraDistance = 1.0f / bestScale;
-                camera.movementSpeed = cameraDistance / 20.0f;
-                camera.setPosition({ 0.0f, 0.0f, cameraDistance});
-                camera.setPerspective(45.0f, (float)width / (float)height, 0.1f, cameraDistance * 10.0f);
-
-                // Release resource of last model
-                selectedNode = nullptr; showGizmo = false;
-                if (modelRenderer) {
-                    delete modelRenderer;
-                }
+        if (filename.empty()) {
+            return false;
+        }
+        if (modelLoading) {
+            LOGW("Still loading {}, ignoring {}", modelLoading->filename, filename);
+            return false;
+        }
 
-                // Add new model to modelRender
-                modelRenderer = model;
-                setupDescriptors();
-                preparePipelines();
-                initSequencer(0);
-                return true;
+        modelLoading.reset(new ModelLoading());
+        modelLoading->filename = filename;
+        GLTFRender *renderer = new GLTFRender(vulkanDevice, swapChain.imageCount, renderPass, queue,
+            pipelineCache, settings.sampleCount, &textures, &camera, &uniformBufferParams);
+        modelLoading->renderer = renderer;
+        renderer->bindlessMaterials = bindlessMaterials;
+        renderer->indirectDraws = indirectDraws;
+        renderer->frustumCulling = frustumCulling;
+        renderer->occlusionCulling = occlusionCulling;
+        renderer->computeSkinning = computeSkinning;
+        renderer->setViewExtent(width, height);
+
+        // Everything up to the pipelines is built on a worker, the render thread only swaps the result in
+        auto job = std::make_shared<std::packaged_task<bool()>>([renderer, filename]() {
+            if (!renderer->load(filename)) {
+                return false;
+            }
+            // A streamed model reports the progress of its streaming job from here on
+            const bool streaming = renderer->getModel()->streamingDone.valid();
+            if (!streaming) {
+                renderer->getModel()->progress.set("Creating pipelines", 0.95f);
             }
+            renderer->setupDescriptors();
+            renderer->preparePipelines();
+            if (!streaming) {
+                renderer->getModel()->progress.set("Done", 1.0f);
+            }
+            return true;
+        });
+        modelLoading->result = job->get_future();
+        ThreadPool::shared().enqueue([job]() { (*job)(); });
+        return true;
+    }
+
+    /*
+        Swap in a model which finished loading, called at the start of a frame
+    */
+    void updateModelLoading()
+    {
+        if (!modelLoading ||
+            modelLoading->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        std::unique_ptr<ModelLoading> loading = std::move(modelLoading);
+        GLTFRender *model = loading->renderer;
+        if (!loading->result.get()) {
+            // Never recorded into a command buffer, nothing on the device uses it
+            LOGE("Failed to load {}", loading->filename);
+            delete model;
+            return;
+        }
+
+        // Caculate the distance of camera
+        glm::mat4 aabb = model->getModel()->aabb;
+        float bestScale = (1.0f / std::max(aabb[0][0], std::max(aabb[1][1], aabb[2][2]))) * 0.5f;
+        float cameraDistance = 1.0f / bestScale;
+        camera.movementSpeed = cameraDistance / 20.0f;
+        camera.setPosition({ 0.0f, 0.0f, cameraDistance});
+        camera.setPerspective(45.0f, (float)width / (float)height, 0.1f, cameraDistance * 10.0f);
+
+        // Release resource of last model, frames in flight may still draw it
+        selectedNode = nullptr; showGizmo = false;
+        mySequence.animation = nullptr;
+        if (modelRenderer) {
+            GLTFRender *retired = modelRenderer;
+            deferDeletion([retired]() { delete retired; });
+        }
+
+        // The window may have been resized while the model was loading, the device does not use it yet
+        model->setViewExtent(width, height);
+
+        // Add new model to modelRender
+        modelRenderer = model;
+        initSequencer(0);
+        invalidateCommandBuffers();
+        vulkanDevice->allocator.logStats();
+    }
+
+    void deferDeletion(std::function<void()> release)
+    {
+        deletionQueue.push_back({ frameNumber, std::move(release) });
+    }
+
+    /*
+        Release what was retired before all frames now in flight were submitted
+    */
+    void releaseRetired()
+    {
+        while (!deletionQueue.empty() && deletionQueue.front().frameNumber + renderAhead <= frameNumber) {
+            deletionQueue.front().release();
+            deletionQueue.pop_front();
         }
-        return false;
     }
 
     void showSequencer()
@@ -1446,15 +1571,21 @@ public:
             // switch (mCurrentGizmoOperation) {
             // case ImGuizmo::OPERATION::TRANSLATE:
                 ImGui::SameLine();
-                ImGui::InputFloat3(ICON_MDI_ARROW_ALL "Location", glm::value_ptr(mySequence.animation->samplers[index].outputsVec4[currentFrame]));
+                if (ImGui::InputFloat3(ICON_MDI_ARROW_ALL "Location", glm::value_ptr(mySequence.animation->samplers[index].outputsVec4[currentFrame]))) {
+                    mySequence.animation->tracks.build(*mySequence.animation);
+                }
             //     break;
             // case ImGuizmo::OPERATION::ROTATE:
                 ImGui::SameLine();
-                ImGui::InputFloat4(ICON_MDI_ROTATE_ORBIT "Rotation", glm::value_ptr(mySequence.animation->samplers[index].outputsVec4[currentFrame]));
+                if (ImGui::InputFloat4(ICON_MDI_ROTATE_ORBIT "Rotation", glm::value_ptr(mySequence.animation->samplers[index].outputsVec4[currentFrame]))) {
+                    mySequence.animation->tracks.build(*mySequence.animation);
+                }
             //     break;
             // case ImGuizmo::OPERATION::SCALE:
                 ImGui::SameLine();
-                ImGui::InputFloat3(ICON_MDI_ARROW_EXPAND_ALL "Scale", glm::value_ptr(mySequence.animation->samplers[index].outputsVec4[currentFrame]));
+                if (ImGui::InputFloat3(ICON_MDI_ARROW_EXPAND_ALL "Scale", glm::value_ptr(mySequence.animation->samplers[index].outputsVec4[currentFrame]))) {
+                    mySequence.animation->tracks.build(*mySequence.animation);
+                }
             //     break;
             // default:
             //     break;
@@ -1535,14 +1666,21 @@ public:
             std::string filename = "";
             std::vector<std::string> filelist = openFileDialog("Open glTF Model", "./../");
             if (!filelist.empty()) {
-                updateCBs = loadModel(filelist[0]);
+                loadModel(filelist[0]);
             }
         }
+        GLTFRender *progressRenderer = modelLoading ? modelLoading->renderer : modelRenderer;
+        if (progressRenderer && progressRenderer->getModel()->progress.fraction.load() < 1.0f) {
+            const vkglTF::Model::LoadingProgress &progress = progressRenderer->getModel()->progress;
+            ui->text("%s", progress.stage.load());
+            ImGui::ProgressBar(progress.fraction.load(), ImVec2(-1.0f, 0.0f));
+        }
 
         // Environment
         if (ui->header("Skybox")) {
-            if (ui->combo("Environment", selectedEnvironment, environments)) {
-                vkDeviceWaitIdle(device);
+            // The model being loaded references the environment maps, keep them until it is swapped in
+            if (!modelLoading && ui->combo("Environment", selectedEnvironment, environments)) {
+                vulkanDevice->waitIdle();
                 loadEnvironment(environments[selectedEnvironment]);
                 setupDescriptors();
                 updateCBs = true;
@@ -1579,6 +1717,54 @@ public:
             }
         }
 
+        if (modelRenderer && ui->header("Rendering")) {
+            const bool bindlessChanged = ui->checkbox("Bindless materials", &bindlessMaterials);
+            const bool indirectChanged = ui->checkbox("Indirect draws", &indirectDraws);
+            const bool cullingChanged = ui->checkbox("Frustum culling", &frustumCulling);
+            const bool occlusionChanged = ui->checkbox("Occlusion culling", &occlusionCulling);
+            bool skinningChanged = false;
+            if (modelRenderer->computeSkinningRequired()) {
+                ui->text("Compute skinning: on, the morph targets need it");
+            } else {
+                skinningChanged = ui->checkbox("Compute skinning", &computeSkinning);
+            }
+            if (bindlessChanged || indirectChanged || cullingChanged || occlusionChanged || skinningChanged) {
+                vulkanDevice->waitIdle();
+                modelRenderer->bindlessMaterials = bindlessMaterials;
+                modelRenderer->indirectDraws = indirectDraws;
+                modelRenderer->frustumCulling = frustumCulling;
+                modelRenderer->occlusionCulling = occlusionCulling;
+                modelRenderer->computeSkinning = computeSkinning;
+                modelRenderer->setupDescriptors();
+                modelRenderer->preparePipelines();
+                updateCBs = true;
+            }
+            ui->text("Materials: %s", modelRenderer->bindlessActive() ? "bindless" : "set per material");
+            ui->text("Draws: %s", modelRenderer->indirectActive() ? "indirect" : "per primitive");
+            ui->text("Skinning: %s", modelRenderer->computeSkinningActive() ? "compute" : "vertex shader");
+            ui->text("%u draws in %u calls recorded in %.3f ms", modelRenderer->recordStats.draws,
+                modelRenderer->recordStats.drawCalls, modelRenderer->recordStats.milliseconds);
+            if (!modelRenderer->indirectActive()) {
+                ui->text("%u set binds, %u push constants (%u, %u in tree order)", modelRenderer->recordStats.descriptorBinds,
+                    modelRenderer->recordStats.pushConstants, modelRenderer->recordStats.treeDescriptorBinds,
+                    modelRenderer->recordStats.treePushConstants);
+            }
+            ui->text("Visible %u / %u primitives (%s)", modelRenderer->cullStats.visible, modelRenderer->cullStats.total,
+                !modelRenderer->frustumCulling ? "not culled" : modelRenderer->gpuCullingActive() ? "GPU" : "CPU");
+            ui->text("Culled %u by frustum, %u by occlusion%s", modelRenderer->cullStats.frustumCulled,
+                modelRenderer->cullStats.occlusionCulled, modelRenderer->occlusionCullingActive() ? "" : " (off)");
+        }
+
+        if (ui->header("Device memory")) {
+            const MemoryAllocator::Stats stats = vulkanDevice->allocator.stats();
+            ui->text("%u blocks, %u dedicated", stats.blockCount, stats.dedicatedCount);
+            ui->text("%.1f / %.1f MB used", stats.usedBytes / 1048576.0, stats.reservedBytes / 1048576.0);
+            ui->text("Fragmentation %.2f", stats.fragmentation);
+            for (uint32_t u = 0; u < static_cast<uint32_t>(MemoryUsage::COUNT); u++) {
+                ui->text("%s: %.1f MB", memoryUsageName(static_cast<MemoryUsage>(u)), stats.usageBytes[u] / 1048576.0);
+            }
+        }
+
         if (modelRenderer) {
             if (ui->header("Gizmo")) {
                 ImGui::Checkbox("Enable", &showGizmo);
@@ -1622,7 +1808,7 @@ public:
 
         ImGui::Render();
 
-        if(ui->updateBuffer(ImVec2(xscale, yscale))) {
+        if(ui->updateBuffer(ImVec2(xscale, yscale), [this](std::function<void()> release) { deferDeletion(std::move(release)); })) {
             updateCBs = true;
         }
 
@@ -1631,9 +1817,7 @@ public:
         }
 
         if (updateCBs) {
-            vkDeviceWaitIdle(device);
-            recordCommandBuffers();
-            vkDeviceWaitIdle(device);
+            invalidateCommandBuffers();
         }
 
         if (updateShaderParams) {
@@ -1647,6 +1831,15 @@ public:
             return;
         }
 
+        updateModelLoading();
+        // Meshes and materials streamed in since the last frame
+        if (modelRenderer && modelRenderer->updateStreaming()) {
+            invalidateCommandBuffers();
+        }
+        // Command buffers culled on the CPU follow the camera
+        if (modelRenderer && modelRenderer->updateVisibility()) {
+            invalidateCommandBuffers();
+        }
         updateOverlay();
 
         VkResult res;
@@ -1654,7 +1847,7 @@ public:
         if (res != VK_SUCCESS) {
             LOGE("vkWaitForFences result {}", res);
         }
-        VK_CHECK_RESULT(vkResetFences(device, 1, &waitFences[frameIndex]));
+        releaseRetired();
 
         VkResult acquire = swapChain.acquireNextImage(presentCompleteSemaphores[frameIndex], &currentBuffer);
         if ((acquire == VK_ERROR_OUT_OF_DATE_KHR) || (acquire == VK_SUBOPTIMAL_KHR)) {
@@ -1664,6 +1857,19 @@ public:
             VK_CHECK_RESULT(acquire);
         }
 
+        // Another frame slot may still be rendering into this image with the same command buffer
+        if (imageFences[currentBuffer] != VK_NULL_HANDLE && imageFences[currentBuffer] != waitFences[frameIndex]) {
+            VK_CHECK_RESULT(vkWaitForFences(device, 1, &imageFences[currentBuffer], VK_TRUE, UINT64_MAX));
+        }
+        imageFences[currentBuffer] = waitFences[frameIndex];
+        if (modelRenderer) {
+            modelRenderer->collectCullStats(currentBuffer);
+        }
+        if (staleCommandBuffers[currentBuffer]) {
+            recordCommandBuffer(currentBuffer);
+        }
+        VK_CHECK_RESULT(vkResetFences(device, 1, &waitFences[frameIndex]));
+
         // Update UBOs
         updateUniformBuffers();
 
@@ -1677,9 +1883,14 @@ public:
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pCommandBuffers = &commandBuffers[currentBuffer];
         submitInfo.commandBufferCount = 1;
-        VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, waitFences[frameIndex]));
-
-        VkResult present = swapChain.queuePresent(queue, currentBuffer, renderCompleteSemaphores[frameIndex]);
+        VkResult present;
+        {
+            // Background loaders submit to the same queue
+            std::lock_guard<std::mutex> lock(vulkanDevice->queueMutex);
+            VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, waitFences[frameIndex]));
+            present = swapChain.queuePresent(queue, currentBuffer, renderCompleteSemaphores[frameIndex]);
+        }
+        frameNumber++;
         if (!((present == VK_SUCCESS) || (present == VK_SUBOPTIMAL_KHR))) {
             if (present == VK_ERROR_OUT_OF_DATE_KHR) {
                 windowResize();
@@ -1701,10 +1912,8 @@ public:
             modelRenderer->render(animationTimer);
         }
         updateParams();
-    
-        if (camera.updated) {
-            updateUniformBuffers();
-        }
+
+        // The buffers of the frame just submitted are in flight, the next frame writes its own after its fence
     }
 };
 
@@ -0,0 +1,218 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      AnimationTracks sampling against the per channel interpolation of the sampler outputs it replaced
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "gltf/model.h"
+#include "headlessdevice.h"
+#include "benchmark.h"
+
+using namespace vkglTF;
+
+/*
+    The animation with the most channels, its samplers and channels copied once per instance
+    The copies drive the same nodes, as many instances of one rig would drive nodes of their own
+*/
+static Animation instanceAnimation(const Model &model, uint32_t instances)
+{
+    const Animation *source = &model.animations[0];
+    for (const Animation &animation : model.animations) {
+        if (animation.channels.size() > source->channels.size()) {
+            source = &animation;
+        }
+    }
+    Animation animation;
+    animation.name = source->name;
+    animation.start = source->start;
+    animation.end = source->end;
+    for (uint32_t instance = 0; instance < instances; instance++) {
+        const uint32_t offset = static_cast<uint32_t>(animation.samplers.size());
+        for (AnimationSampler sampler : source->samplers) {
+            sampler.timeline += offset;
+            animation.samplers.push_back(sampler);
+        }
+        for (AnimationChannel channel : source->channels) {
+            if (channel.path != AnimationChannel::PathType::WEIGHTS) {
+                channel.samplerIndex += offset;
+                animation.channels.push_back(channel);
+            }
+        }
+    }
+    animation.tracks.build(animation);
+    return animation;
+}
+
+static void findKeys(Animation &animation, float time)
+{
+    for (size_t i = 0; i < animation.samplers.size(); i++) {
+        AnimationSampler &sampler = animation.samplers[i];
+        if (sampler.timeline == i) {
+            sampler.findKey(time);
+        }
+    }
+}
+
+/*
+    The channel loop of updateAnimation before the tracks: float keys of the sampler outputs, slerp for rotations
+*/
+static void sampleOutputs(Animation &animation, float time, TransformHierarchy &transforms)
+{
+    findKeys(animation, time);
+    for (const AnimationChannel &channel : animation.channels) {
+        const AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
+        const AnimationSampler &key = animation.samplers[sampler.timeline];
+        if (!key.active || sampler.inputs.size() > sampler.outputsVec4.size()) {
+            continue;
+        }
+        const size_t i = key.cursor;
+        const glm::vec4 &a = sampler.outputsVec4[i];
+        const glm::vec4 &b = sampler.outputsVec4[i + 1];
+        switch (channel.path) {
+        case AnimationChannel::PathType::TRANSLATION:
+            transforms.setTranslation(channel.node->transform, glm::vec3(glm::mix(a, b, key.u)));
+            break;
+        case AnimationChannel::PathType::SCALE:
+            transforms.setScale(channel.node->transform, glm::vec3(glm::mix(a, b, key.u)));
+            break;
+        case AnimationChannel::PathType::ROTATION: {
+            const glm::quat q1(a.w, a.x, a.y, a.z);
+            const glm::quat q2(b.w, b.x, b.y, b.z);
+            transforms.setRotation(channel.node->transform, glm::normalize(glm::slerp(q1, q2, key.u)));
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+static void sampleTracks(Animation &animation, float time, AnimationTracks::Pose &pose, TransformHierarchy &transforms)
+{
+    findKeys(animation, time);
+    animation.tracks.sample(animation, pose);
+    animation.tracks.apply(animation, pose, transforms);
+}
+
+struct Errors {
+    float translation = 0.0f;
+    float rotation = 0.0f;
+    float scale = 0.0f;
+};
+
+/*
+    Largest difference of the local transforms: units for translation and scale, radians for rotation
+*/
+static void compare(const TransformHierarchy &expected, const TransformHierarchy &actual, Errors &errors)
+{
+    for (uint32_t slot = 0; slot < expected.size(); slot++) {
+        const glm::vec3 t = glm::abs(expected.translations[slot] - actual.translations[slot]);
+        const glm::vec3 s = glm::abs(expected.scales[slot] - actual.scales[slot]);
+        errors.translation = std::max(errors.translation, std::max(t.x, std::max(t.y, t.z)));
+        errors.scale = std::max(errors.scale, std::max(s.x, std::max(s.y, s.z)));
+        // Nodes loaded without a rotation keep a zero quaternion, which never moves unless a track writes it
+        if (expected.rotations[slot] != actual.rotations[slot]) {
+            // Angle from the chord between the quaternions, acos of their dot product loses small angles
+            const glm::quat &a = expected.rotations[slot], &b = actual.rotations[slot];
+            const float chord = std::min(glm::length(a - b), glm::length(a + b));
+            errors.rotation = std::max(errors.rotation, 4.0f * std::asin(std::min(1.0f, 0.5f * chord)));
+        }
+    }
+}
+
+static bool run(Model &model, const std::string &name, uint32_t instances, bool check, int runs)
+{
+    Animation animation = instanceAnimation(model, instances);
+    AnimationTracks::Pose pose;
+    TransformHierarchy expected = model.transforms, actual = model.transforms;
+
+    // Every frame at 60 Hz through the animation, the tracks against the float keys
+    Errors errors;
+    const float frame = 1.0f / 60.0f;
+    for (float time = animation.start; time <= animation.end; time += frame) {
+        sampleOutputs(animation, time, expected);
+        sampleTracks(animation, time, pose, actual);
+        compare(expected, actual, errors);
+    }
+    const bool ok = errors.translation <= 1e-3f && errors.scale <= 1e-3f && errors.rotation <= 5e-3f;
+    if (!ok) {
+        printf("FAILED: %s x%u, max error translation %g, rotation %g rad, scale %g\n", name.c_str(), instances,
+            errors.translation, errors.rotation, errors.scale);
+    }
+    if (check) {
+        return ok;
+    }
+
+    float time = animation.start;
+    auto advance = [&] {
+        time += frame;
+        return time > animation.end ? (time = animation.start) : time;
+    };
+    const double outputsMs = bench::bestOf(runs, [&] { sampleOutputs(animation, advance(), expected); });
+    const double tracksMs = bench::bestOf(runs, [&] { sampleTracks(animation, advance(), pose, actual); });
+    const double channels = double(animation.channels.size());
+    printf("  %-10s x%-4u %6zu  %7.1f MB  %7.1f MB  %8.1fk  %8.1fk  %8.1e  %8.1e  %8.1e\n", name.c_str(), instances,
+        animation.channels.size(), animation.tracks.sourceBytes() / 1048576.0, animation.tracks.keyBytes() / 1048576.0,
+        channels / outputsMs / 1000.0, channels / tracksMs / 1000.0, errors.translation, errors.rotation, errors.scale);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    const bool check = bench::checkOnly(argc, argv);
+    std::vector<std::string> filenames;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            filenames.push_back(argv[i]);
+        }
+    }
+    if (filenames.empty()) {
+        filenames = { std::string(VK_EXAMPLE_DATA_DIR) + "models/BrainStem.glb", std::string(VK_EXAMPLE_DATA_DIR) + "models/Fox.glb" };
+    }
+
+    std::unique_ptr<xy::VulkanDevice> device = tools::createHeadlessDevice();
+    VkQueue queue;
+    vkGetDeviceQueue(device->logicalDevice, device->queueFamilyIndices.graphics, 0, &queue);
+
+    const int runs = check ? 2 : 20;
+    const std::vector<uint32_t> instanceCounts = check ? std::vector<uint32_t>{ 1, 100 } : std::vector<uint32_t>{ 1, 100, 500 };
+    printf("best of %d frames      channels  float keys  tracks    ch/ms old  ch/ms new  max error: t  r (rad)   s\n", runs);
+    bool ok = true;
+    for (const std::string &filename : filenames) {
+        Model model;
+        model.progressiveLoading = false;
+        model.cacheDirectory.clear();
+        model.loadFromFile(filename, device.get(), queue);
+        if (model.animations.empty()) {
+            printf("FAILED: %s has no animations\n", filename.c_str());
+            ok = false;
+            continue;
+        }
+        std::string name = filename.substr(filename.find_last_of("/\\") + 1);
+        name = name.substr(0, name.find_last_of('.'));
+        for (uint32_t instances : instanceCounts) {
+            ok &= run(model, name, instances, check, runs);
+        }
+        model.destroy(device->logicalDevice);
+    }
+    if (check && ok) {
+        printf("tracks match the float keys on every frame\n");
+    }
+    vkQueueWaitIdle(queue);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Timing and argument helpers shared by the benchmarks
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace bench
+{
+
+    /*
+        Best wall clock time of `runs` calls in milliseconds, the first call is a warm up
+    */
+    template <typename F>
+    double bestOf(int runs, F &&f)
+    {
+        f();
+        double best = std::numeric_limits<double>::max();
+        for (int i = 0; i < runs; i++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            f();
+            auto end = std::chrono::high_resolution_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        return best;
+    }
+
+    /*
+        `--check` runs the correctness checks on a small input only, as used by ctest
+    */
+    inline bool checkOnly(int argc, char **argv)
+    {
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--check") == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+        Keeps the optimizer from dropping a result
+    */
+    template <typename T>
+    inline void keep(const T &value)
+    {
+        static volatile T sink;
+        sink = value;
+    }
+
+}
@@ -0,0 +1,36 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Write a large synthetic Draco compressed .glb for draco_bench and the viewer
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "dracoasset.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        printf("usage: draco_asset <output.glb> [primitives = 256] [vertices per primitive = 65536]\n");
+        return 1;
+    }
+    const uint32_t primitives = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 10)) : 256;
+    const uint32_t vertices = argc > 3 ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 10)) : 65536;
+    std::vector<uint8_t> glb = tools::makeDracoAsset(primitives, vertices);
+    FILE *file = fopen(argv[1], "wb");
+    if (!file || fwrite(glb.data(), 1, glb.size(), file) != glb.size()) {
+        printf("failed to write %s\n", argv[1]);
+        if (file) {
+            fclose(file);
+        }
+        return 1;
+    }
+    fclose(file);
+    printf("%s: %u primitives of %u vertices, %.1f MB\n", argv[1], primitives, vertices, glb.size() / (1024.0 * 1024.0));
+    return 0;
+}
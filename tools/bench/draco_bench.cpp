@@ -0,0 +1,332 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Parallel Draco decoding of Model against the serial decode of tinygltf
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gltf/model.h"
+#include "threadpool.h"
+#include "draco/compression/decode.h"
+#include "draco/core/decoder_buffer.h"
+#include "dracoasset.h"
+#include "headlessdevice.h"
+#include "benchmark.h"
+
+/*
+    Either a .gltf/.glb file on disk or a synthetic .glb in memory
+*/
+struct Source {
+    std::string path;
+    std::vector<uint8_t> glb;
+};
+
+static bool keepEncoded(tinygltf::Image *image, const int, std::string *, std::string *, int, int,
+    const unsigned char *bytes, int size, void *)
+{
+    image->image.assign(bytes, bytes + size);
+    image->as_is = true;
+    return true;
+}
+
+static bool parse(const Source &source, tinygltf::Model &model, bool decodeDraco)
+{
+    tinygltf::TinyGLTF context;
+    context.SetImageLoader(keepEncoded, nullptr);
+    context.SetDecodeDraco(decodeDraco);
+    std::string error, warning;
+    bool loaded = false;
+    if (source.path.empty()) {
+        loaded = context.LoadBinaryFromMemory(&model, &error, &warning, source.glb.data(), source.glb.size(), "");
+    } else if (source.path.size() > 4 && source.path.compare(source.path.size() - 4, 4, ".glb") == 0) {
+        loaded = context.LoadBinaryFromFile(&model, &error, &warning, source.path);
+    } else {
+        loaded = context.LoadASCIIFromFile(&model, &error, &warning, source.path);
+    }
+    if (!loaded) {
+        printf("failed to parse %s: %s\n", source.path.empty() ? "synthetic asset" : source.path.c_str(), error.c_str());
+    }
+    return loaded;
+}
+
+/*
+    Value of component `c` of element `i` of an accessor, whatever its component type and stride
+*/
+static double accessorValue(const tinygltf::Model &model, const tinygltf::Accessor &accessor, size_t i, int c)
+{
+    const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
+    const int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+    const int components = tinygltf::GetNumComponentsInType(accessor.type);
+    const size_t stride = view.byteStride ? view.byteStride : size_t(componentSize * components);
+    const uint8_t *p = model.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset + i * stride + c * componentSize;
+    switch (accessor.componentType) {
+    case TINYGLTF_COMPONENT_TYPE_BYTE:              return *reinterpret_cast<const int8_t*>(p);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:     return *p;
+    case TINYGLTF_COMPONENT_TYPE_SHORT:             { int16_t v; memcpy(&v, p, 2); return v; }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:    { uint16_t v; memcpy(&v, p, 2); return v; }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:      { uint32_t v; memcpy(&v, p, 4); return v; }
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:             { float v; memcpy(&v, p, 4); return v; }
+    }
+    return 0.0;
+}
+
+/*
+    Every decoded accessor of the parallel decode holds exactly the values tinygltf decodes,
+    indices are compared by value as Model widens them to 32 bit
+*/
+static bool compare(const tinygltf::Model &reference, const tinygltf::Model &decoded)
+{
+    size_t checked = 0;
+    for (size_t m = 0; m < reference.meshes.size(); m++) {
+        for (size_t p = 0; p < reference.meshes[m].primitives.size(); p++) {
+            const tinygltf::Primitive &primitive = reference.meshes[m].primitives[p];
+            if (primitive.extensions.find("KHR_draco_mesh_compression") == primitive.extensions.end()) {
+                continue;
+            }
+            std::vector<int> accessors;
+            for (const auto &attribute : primitive.attributes) {
+                accessors.push_back(attribute.second);
+            }
+            if (primitive.indices > -1) {
+                accessors.push_back(primitive.indices);
+            }
+            for (int index : accessors) {
+                const tinygltf::Accessor &expected = reference.accessors[index];
+                const tinygltf::Accessor &actual = decoded.accessors[index];
+                const int components = tinygltf::GetNumComponentsInType(expected.type);
+                if (actual.count != expected.count || actual.bufferView < 0 || expected.bufferView < 0) {
+                    printf("mesh %zu primitive %zu accessor %d: %zu elements instead of %zu\n", m, p, index,
+                        actual.count, expected.count);
+                    return false;
+                }
+                for (size_t i = 0; i < expected.count; i++) {
+                    for (int c = 0; c < components; c++) {
+                        const double a = accessorValue(decoded, actual, i, c);
+                        const double e = accessorValue(reference, expected, i, c);
+                        if (memcmp(&a, &e, sizeof(double)) != 0) {
+                            printf("mesh %zu primitive %zu accessor %d element %zu component %d: %f != %f\n",
+                                m, p, index, i, c, a, e);
+                            return false;
+                        }
+                    }
+                }
+                checked += expected.count * components;
+            }
+        }
+    }
+    printf("  %zu decoded values identical to tinygltf\n", checked);
+    return true;
+}
+
+/*
+    Serial decode time of every compressed primitive, the tasks decodeDracoPrimitives spreads over the pool
+*/
+static std::vector<double> primitiveDecodeTimes(const tinygltf::Model &model)
+{
+    std::vector<double> times;
+    for (const tinygltf::Mesh &mesh : model.meshes) {
+        for (const tinygltf::Primitive &primitive : mesh.primitives) {
+            auto extension = primitive.extensions.find("KHR_draco_mesh_compression");
+            if (extension == primitive.extensions.end()) {
+                continue;
+            }
+            const tinygltf::BufferView &view = model.bufferViews[extension->second.Get("bufferView").Get<int>()];
+            const char *data = reinterpret_cast<const char*>(model.buffers[view.buffer].data.data() + view.byteOffset);
+            times.push_back(bench::bestOf(2, [&] {
+                draco::DecoderBuffer buffer;
+                buffer.Init(data, view.byteLength);
+                draco::Decoder decoder;
+                auto result = decoder.DecodeMeshFromBuffer(&buffer);
+                bench::keep(result.ok());
+            }));
+        }
+    }
+    return times;
+}
+
+static bool writeFile(const std::string &filename, const std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    const bool written = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (file) {
+        fclose(file);
+    }
+    if (!written) {
+        printf("failed to write %s\n", filename.c_str());
+    }
+    return written;
+}
+
+/*
+    The synthetic asset with the Draco payload of its first primitive overwritten: decodeDracoPrimitives leaves the
+    accessors of that primitive empty and decodes the others, loadFromFile loads it as a primitive without vertices
+*/
+static bool checkCorrupt(const tinygltf::Model &parsed, std::vector<uint8_t> glb)
+{
+    const tinygltf::Primitive &first = parsed.meshes[0].primitives[0];
+    const tinygltf::BufferView &view = parsed.bufferViews[first.extensions.at("KHR_draco_mesh_compression").Get("bufferView").Get<int>()];
+    uint32_t jsonLength;
+    memcpy(&jsonLength, glb.data() + 12, 4);
+    const size_t binStart = 12 + 8 + jsonLength + 8;
+    memset(glb.data() + binStart + view.byteOffset, 0xa5, view.byteLength);
+
+    Source source;
+    source.glb = glb;
+    tinygltf::Model corrupt;
+    if (!parse(source, corrupt, false)) {
+        return false;
+    }
+    vkglTF::Model decoder;
+    decoder.decodeDracoPrimitives(corrupt);
+    for (size_t m = 0; m < corrupt.meshes.size(); m++) {
+        for (const tinygltf::Primitive &primitive : corrupt.meshes[m].primitives) {
+            std::vector<int> accessors = { primitive.indices };
+            for (const auto &attribute : primitive.attributes) {
+                accessors.push_back(attribute.second);
+            }
+            for (int index : accessors) {
+                const tinygltf::Accessor &accessor = corrupt.accessors[index];
+                if (m == 0 && accessor.count != 0) {
+                    printf("FAILED: accessor %d of the corrupt primitive keeps %zu elements\n", index, accessor.count);
+                    return false;
+                }
+                if (m > 0 && (accessor.count == 0 || accessor.bufferView < 0)) {
+                    printf("FAILED: accessor %d of mesh %zu is not decoded\n", index, m);
+                    return false;
+                }
+            }
+        }
+    }
+
+    if (!writeFile("draco_corrupt.glb", glb)) {
+        return false;
+    }
+    std::unique_ptr<xy::VulkanDevice> device = tools::createHeadlessDevice();
+    VkQueue queue;
+    vkGetDeviceQueue(device->logicalDevice, device->queueFamilyIndices.graphics, 0, &queue);
+    vkglTF::Model model;
+    model.progressiveLoading = false;
+    model.cacheDirectory.clear();
+    model.loadFromFile("draco_corrupt.glb", device.get(), queue);
+    uint32_t empty = 0, loaded = 0;
+    for (vkglTF::Node *node : model.linearNodes) {
+        if (!node->mesh) {
+            continue;
+        }
+        for (vkglTF::Primitive *primitive : node->mesh->primitives) {
+            if (primitive->vertexCount == 0 && primitive->indexCount == 0) {
+                empty++;
+            } else if (primitive->vertexCount > 0 && primitive->indexCount > 0) {
+                loaded++;
+            }
+        }
+    }
+    model.destroy(device->logicalDevice);
+    vkQueueWaitIdle(queue);
+    if (empty != 1 || loaded + 1 != parsed.meshes.size()) {
+        printf("FAILED: corrupt asset loaded %u empty and %u complete primitives of %zu\n", empty, loaded,
+            parsed.meshes.size());
+        return false;
+    }
+    printf("  corrupt payload: the primitive is loaded empty, the other %u decode\n", loaded);
+    return true;
+}
+
+/*
+    Wall time of the decode tasks on `workers` cores, longest task first onto the least busy core
+    Ignores memory bandwidth, caches shared between the cores and the serial hand over of the results
+*/
+static double projectedTime(std::vector<double> times, uint32_t workers)
+{
+    std::sort(times.begin(), times.end(), std::greater<double>());
+    std::vector<double> load(workers, 0.0);
+    for (double t : times) {
+        *std::min_element(load.begin(), load.end()) += t;
+    }
+    return *std::max_element(load.begin(), load.end());
+}
+
+int main(int argc, char **argv)
+{
+    const bool check = bench::checkOnly(argc, argv);
+    Source source;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            source.path = argv[i];
+        }
+    }
+    if (source.path.empty()) {
+        const uint32_t primitives = check ? 16 : 256;
+        const uint32_t vertices = check ? 4096 : 65536;
+        printf("generating %u Draco primitives of %u vertices\n", primitives, vertices);
+        source.glb = tools::makeDracoAsset(primitives, vertices);
+        printf("  %.1f MB\n", source.glb.size() / (1024.0 * 1024.0));
+    }
+
+    // Parsing alone, then parsing with the serial decode of tinygltf, the difference is the decode
+    const int runs = check ? 1 : 3;
+    tinygltf::Model reference, decoded;
+    if (!parse(source, reference, true) || !parse(source, decoded, false)) {
+        return 1;
+    }
+    const double parseMs = bench::bestOf(runs, [&] {
+        tinygltf::Model model;
+        parse(source, model, false);
+    });
+    const double serialMs = bench::bestOf(runs, [&] {
+        tinygltf::Model model;
+        parse(source, model, true);
+    }) - parseMs;
+
+    // Model only reads the tinygltf model and the device is never touched
+    vkglTF::Model model;
+    const tinygltf::Model parsed = decoded;
+    model.decodeDracoPrimitives(decoded);
+    if (!compare(reference, decoded)) {
+        printf("FAILED: decodeDracoPrimitives differs from the tinygltf decode\n");
+        return 1;
+    }
+    const double parallelMs = bench::bestOf(runs, [&] {
+        tinygltf::Model copy = parsed;
+        model.decodeDracoPrimitives(copy);
+    }) - bench::bestOf(runs, [&] {
+        tinygltf::Model copy = parsed;
+        bench::keep(copy.buffers.size());
+    });
+    if (check) {
+        return (!source.path.empty() || checkCorrupt(parsed, source.glb)) ? 0 : 1;
+    }
+
+    const std::vector<double> times = primitiveDecodeTimes(parsed);
+    double sum = 0.0;
+    for (double t : times) {
+        sum += t;
+    }
+    const uint32_t threads = xy::ThreadPool::shared().size() + 1;
+    printf("%zu Draco primitives, best of %d runs, %u hardware threads\n", times.size(), runs,
+        std::thread::hardware_concurrency());
+    printf("  tinygltf serial decode        %9.2f ms\n", serialMs);
+    printf("  decodeDracoPrimitives         %9.2f ms  (%.2fx, %u threads)\n", parallelMs, serialMs / parallelMs, threads);
+    printf("  sum of primitive decodes      %9.2f ms  (longest %.2f ms)\n", sum, times.empty() ? 0.0 :
+        *std::max_element(times.begin(), times.end()));
+    printf("projected from the primitive decode times, not measured:\n");
+    for (uint32_t cores : { 2u, 4u, 8u, 16u }) {
+        const double ms = projectedTime(times, cores);
+        printf("  %2u cores                      %9.2f ms  (%.2fx)\n", cores, ms, sum / ms);
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      AnimationSampler::findKey against the scan from key 0 it replaced
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "gltf/model.h"
+#include "benchmark.h"
+
+using namespace vkglTF;
+
+static const float keyRate = 120.0f;
+
+/*
+    Channels of one animation, all samplers read the same input accessor as most exporters write them
+*/
+static std::vector<AnimationSampler> makeSamplers(size_t keys, size_t channels)
+{
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<AnimationSampler> samplers(channels);
+    for (AnimationSampler &sampler : samplers) {
+        sampler.interpolation = AnimationSampler::LINEAR;
+        sampler.inputs.resize(keys);
+        sampler.outputsVec4.resize(keys);
+        for (size_t k = 0; k < keys; k++) {
+            sampler.inputs[k] = float(k) / keyRate;
+            sampler.outputsVec4[k] = glm::vec4(unit(rng), unit(rng), unit(rng), unit(rng));
+        }
+        sampler.timeline = 0;
+    }
+    return samplers;
+}
+
+/*
+    The loop of updateAnimation before the cursor: every interval from key 0 is tested, the last one containing
+    time wins. Returns false when time is outside the inputs
+*/
+static bool scan(const AnimationSampler &sampler, float time, glm::vec4 &value)
+{
+    bool found = false;
+    for (size_t i = 0; i < sampler.inputs.size() - 1; i++) {
+        if ((time >= sampler.inputs[i]) && (time <= sampler.inputs[i + 1])) {
+            float u = std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]);
+            if (u <= 1.0f) {
+                value = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+static void scanFrame(const std::vector<AnimationSampler> &samplers, float time, std::vector<glm::vec4> &values)
+{
+    for (size_t c = 0; c < samplers.size(); c++) {
+        scan(samplers[c], time, values[c]);
+    }
+}
+
+/*
+    The lookup of updateAnimation now, once per timeline, every channel reads the cursor of its timeline
+*/
+static void cursorFrame(std::vector<AnimationSampler> &samplers, float time, std::vector<glm::vec4> &values)
+{
+    for (size_t i = 0; i < samplers.size(); i++) {
+        if (samplers[i].timeline == i) {
+            samplers[i].findKey(time);
+        }
+    }
+    for (size_t c = 0; c < samplers.size(); c++) {
+        const AnimationSampler &key = samplers[samplers[c].timeline];
+        if (key.active) {
+            values[c] = glm::mix(samplers[c].outputsVec4[key.cursor], samplers[c].outputsVec4[key.cursor + 1], key.u);
+        }
+    }
+}
+
+/*
+    findKey at time against the scan: the same keys are active, the interval contains time and the value matches.
+    On a key the scan takes the interval starting there and the cursor may keep the one ending there, both give
+    the value of the key up to rounding
+*/
+static bool checkKey(std::vector<AnimationSampler> &samplers, float time)
+{
+    std::vector<glm::vec4> values(samplers.size());
+    cursorFrame(samplers, time, values);
+    const AnimationSampler &key = samplers[0];
+    glm::vec4 expected;
+    const bool found = scan(key, time, expected);
+    if (found != key.active) {
+        printf("FAILED: time %g is %s the inputs, findKey says %s\n", time, found ? "inside" : "outside",
+            key.active ? "active" : "inactive");
+        return false;
+    }
+    if (!found) {
+        return true;
+    }
+    if (time < key.inputs[key.cursor] || time > key.inputs[key.cursor + 1] || key.u < 0.0f || key.u > 1.0f) {
+        printf("FAILED: time %g is not in interval %zu at %g\n", time, key.cursor, key.u);
+        return false;
+    }
+    for (size_t c = 0; c < samplers.size(); c++) {
+        scan(samplers[c], time, expected);
+        const glm::vec4 error = glm::abs(values[c] - expected);
+        if (std::max(std::max(error.x, error.y), std::max(error.z, error.w)) > 1e-5f) {
+            printf("FAILED: channel %zu at time %g differs from the scan\n", c, time);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    Playback at 60 Hz from before the first key to after the last one, then random scrubbing over the same range
+    with a fifth of the times exactly on a key
+*/
+static bool checkSamplers(std::vector<AnimationSampler> samplers, size_t lookups)
+{
+    const float end = samplers[0].inputs.back();
+    for (float time = -0.5f; time <= end + 0.5f; time += 1.0f / 60.0f) {
+        if (!checkKey(samplers, time)) {
+            return false;
+        }
+    }
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<float> range(-0.5f, end + 0.5f);
+    for (size_t i = 0; i < lookups; i++) {
+        const float time = (i % 5 == 0) ? samplers[0].inputs[rng() % samplers[0].inputs.size()] : range(rng);
+        if (!checkKey(samplers, time)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void run(size_t keys, size_t channels, int runs)
+{
+    std::vector<AnimationSampler> samplers = makeSamplers(keys, channels);
+    std::vector<glm::vec4> values(channels);
+    const float end = samplers[0].inputs.back();
+    float time = 0.0f;
+    auto advance = [&] {
+        time += 1.0f / 60.0f;
+        return time > end ? (time = 0.0f) : time;
+    };
+    const double scanMs = bench::bestOf(runs, [&] { scanFrame(samplers, advance(), values); });
+    const double cursorMs = bench::bestOf(runs, [&] { cursorFrame(samplers, advance(), values); });
+    bench::keep(values[0].x);
+    printf("  %7zu keys x %5zu channels  %10.4f  %10.5f\n", keys, channels, scanMs, cursorMs);
+}
+
+int main(int argc, char **argv)
+{
+    const bool check = bench::checkOnly(argc, argv);
+
+    // Every lookup is checked against the scan, on a short and on a long timeline
+    const size_t lookups = check ? 2000 : 100000;
+    if (!checkSamplers(makeSamplers(2, 4), lookups) || !checkSamplers(makeSamplers(300, 4), lookups) ||
+        !checkSamplers(makeSamplers(check ? 3000 : 30000, 1), lookups)) {
+        return 1;
+    }
+    printf("every result checked correct: playback and %zu random lookups on 2, 300 and %d keys\n", lookups,
+        check ? 3000 : 30000);
+
+    std::vector<AnimationSampler> samplers = makeSamplers(check ? 3000 : 30000, 1);
+    std::mt19937 rng(17);
+    std::uniform_real_distribution<float> range(0.0f, samplers[0].inputs.back());
+    std::vector<glm::vec4> values(1);
+    const size_t scrubs = check ? 1000 : 100000;
+    const double scrubMs = bench::bestOf(check ? 2 : 20, [&] {
+        for (size_t i = 0; i < scrubs; i++) {
+            cursorFrame(samplers, range(rng), values);
+        }
+    });
+    printf("random scrubbing: %.6f ms per lookup\n", scrubMs / scrubs);
+
+    const int runs = check ? 2 : 20;
+    printf("best of %d frames, keys at %g Hz      scan ms   cursor ms\n", runs, keyRate);
+    if (check) {
+        run(3000, 6, runs);
+        return 0;
+    }
+    run(30000, 1, runs);
+    run(30000, 60, runs);
+    run(120000, 60, runs);
+    run(300, 3000, runs);
+    return 0;
+}
@@ -0,0 +1,214 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Command buffer recording of GLTFRender in its material and draw modes
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <direct.h>
+#define chdir _chdir
+#else
+#include <unistd.h>
+#endif
+
+#include "gltf/render.h"
+#include "headlessdevice.h"
+#include "sceneasset.h"
+#include "vulkanstub.h"
+#include "benchmark.h"
+
+using namespace xy;
+
+/*
+    Material and draw path of one recording, frustum and occlusion culling are off so every primitive is drawn
+*/
+struct Mode {
+    const char *name;
+    bool bindless;
+    bool indirect;
+};
+
+static std::string absolutePath(const std::string &path)
+{
+#if defined(_WIN32)
+    char resolved[_MAX_PATH];
+    return _fullpath(resolved, path.c_str(), _MAX_PATH) ? resolved : path;
+#else
+    char *resolved = realpath(path.c_str(), nullptr);
+    std::string result = resolved ? resolved : path;
+    free(resolved);
+    return result;
+#endif
+}
+
+static bool writeFile(const std::string &filename, const std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    const bool written = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (file) {
+        fclose(file);
+    }
+    if (!written) {
+        printf("failed to write %s\n", filename.c_str());
+    }
+    return written;
+}
+
+/*
+    Only the compute skinning pass blends morph targets, a model with them has to keep it with computeSkinning off
+*/
+static bool checkMorphedSkinning(VulkanDevice *device, VkQueue queue, VkRenderPass renderPass)
+{
+    if (!writeFile("morph.glb", tools::makeSceneAsset(20, 10, 4, 1))) {
+        return false;
+    }
+    Textures textures;
+    Camera camera;
+    std::vector<Buffer> uniformBufferParams(1);
+    GLTFRender render(device, 1, renderPass, queue, VK_NULL_HANDLE, VK_SAMPLE_COUNT_1_BIT, &textures, &camera,
+        &uniformBufferParams);
+    render.getModel()->progressiveLoading = false;
+    render.getModel()->cacheDirectory.clear();
+    if (!render.load("morph.glb")) {
+        printf("failed to load morph.glb\n");
+        return false;
+    }
+    render.computeSkinning = false;
+    render.setupDescriptors();
+    render.preparePipelines();
+    const bool ok = render.computeSkinningRequired() && render.computeSkinningActive();
+    printf("morph targets with computeSkinning off: compute skinning %s\n", render.computeSkinningActive() ? "on" : "off");
+    if (!ok) {
+        printf("FAILED: the morph targets of morph.glb are not blended\n");
+    }
+    vkQueueWaitIdle(queue);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    const bool check = bench::checkOnly(argc, argv);
+    std::string filename;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            filename = absolutePath(argv[i]);
+        }
+    }
+
+    // loadShader reads ../data/shaders, the run directory has placeholders for all of them
+    if (chdir(TOOLS_RUN_DIR) != 0) {
+        printf("can not change to %s\n", TOOLS_RUN_DIR);
+        return 1;
+    }
+    if (filename.empty()) {
+        const uint32_t primitives = check ? 1000 : 10000;
+        printf("generating %u primitives, 10 per mesh, 100 materials\n", primitives);
+        std::vector<uint8_t> glb = tools::makeSceneAsset(primitives, 10, 100);
+        filename = "scene.glb";
+        if (!writeFile(filename, glb)) {
+            return 1;
+        }
+    }
+
+    std::unique_ptr<VulkanDevice> device = tools::createHeadlessDevice();
+    VkQueue queue;
+    vkGetDeviceQueue(device->logicalDevice, device->queueFamilyIndices.graphics, 0, &queue);
+    VkRenderPassCreateInfo renderPassCI{};
+    renderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    VkRenderPass renderPass;
+    VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassCI, nullptr, &renderPass));
+    const uint32_t frameCount = 3;
+    Textures textures;
+    Camera camera;
+    std::vector<Buffer> uniformBufferParams(frameCount);
+
+    int result = 0;
+    {
+        GLTFRender render(device.get(), frameCount, renderPass, queue, VK_NULL_HANDLE, VK_SAMPLE_COUNT_1_BIT,
+            &textures, &camera, &uniformBufferParams);
+        render.getModel()->progressiveLoading = false;
+        render.getModel()->cacheDirectory.clear();
+        if (!render.load(filename)) {
+            printf("failed to load %s\n", filename.c_str());
+            return 1;
+        }
+        render.setViewExtent(1280, 720);
+
+        size_t primitiveCount = 0;
+        for (const vkglTF::Node *node : render.getModel()->linearNodes) {
+            primitiveCount += node->mesh ? node->mesh->primitives.size() : 0;
+        }
+        printf("%s: %zu primitives of %zu materials\n", filename.c_str(), primitiveCount, render.getModel()->materials.size());
+
+        VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+        auto record = [&] {
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            vkBeginCommandBuffer(commandBuffer, &beginInfo);
+            render.recordCompute(commandBuffer, 0);
+            render.recordCommandBuffers(commandBuffer, 0);
+            vkEndCommandBuffer(commandBuffer);
+        };
+
+        const Mode modes[] = {
+            { "set per material", false, false },
+            { "bindless", true, false },
+            { "bindless indirect", true, true },
+        };
+        const int runs = check ? 2 : 20;
+        printf("best of %d recordings       ms  draw calls  pipelines  set binds  pushes  dispatches  (draw list binds  pushes: tree order -> sorted)\n", runs);
+        for (const Mode &mode : modes) {
+            render.bindlessMaterials = mode.bindless;
+            render.indirectDraws = mode.indirect;
+            render.frustumCulling = false;
+            render.occlusionCulling = false;
+            render.setupDescriptors();
+            render.preparePipelines();
+            if (render.bindlessActive() != mode.bindless || render.indirectActive() != mode.indirect) {
+                printf("FAILED: %s not available\n", mode.name);
+                result = 1;
+                continue;
+            }
+
+            // Counted on the second recording, the first one writes the indirect commands
+            record();
+            vkstub::resetCounters();
+            record();
+            const vkstub::Counters counters = vkstub::counters();
+            const GLTFRender::RecordStats stats = render.recordStats;
+            const double ms = bench::bestOf(runs, record);
+            printf("  %-22s %9.4f  %10llu  %9llu  %9llu  %6llu  %10llu", mode.name, ms,
+                (unsigned long long)(counters.draws + counters.indirectDraws), (unsigned long long)counters.bindPipeline,
+                (unsigned long long)counters.bindDescriptorSets, (unsigned long long)counters.pushConstants,
+                (unsigned long long)counters.dispatches);
+            if (!mode.indirect) {
+                printf("  (%u  %u -> %u  %u)", stats.treeDescriptorBinds, stats.treePushConstants, stats.descriptorBinds,
+                    stats.pushConstants);
+            }
+            printf("\n");
+
+            // Without indirect draws every primitive is one draw call
+            if (!mode.indirect && counters.draws != stats.draws) {
+                printf("FAILED: %llu draws recorded, %u counted by the renderer\n", (unsigned long long)counters.draws, stats.draws);
+                result = 1;
+            }
+        }
+        vkQueueWaitIdle(queue);
+    }
+    if (check && !checkMorphedSkinning(device.get(), queue, renderPass)) {
+        result = 1;
+    }
+    vkDestroyRenderPass(device->logicalDevice, renderPass, nullptr);
+    return result;
+}
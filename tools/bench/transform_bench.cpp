@@ -0,0 +1,211 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      TransformHierarchy updates against the walk to the root they replaced
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "gltf/transformhierarchy.h"
+#include "benchmark.h"
+
+using namespace vkglTF;
+
+/*
+    Nodes of the scene graph before the flattening, each world matrix walked up to the root (Node::getMatrix)
+*/
+struct Node {
+    Node *parent = nullptr;
+    glm::vec3 translation;
+    glm::quat rotation;
+    glm::vec3 scale;
+    glm::mat4 matrix;
+
+    glm::mat4 localMatrix() const
+    {
+        return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
+    }
+
+    glm::mat4 getMatrix() const
+    {
+        glm::mat4 m = localMatrix();
+        const Node *p = parent;
+        while (p) {
+            m = p->localMatrix() * m;
+            p = p->parent;
+        }
+        return m;
+    }
+};
+
+/*
+    The same hierarchy in both representations, and the slots an animation moves every frame
+*/
+struct Scene {
+    std::vector<Node> nodes;
+    TransformHierarchy hierarchy;
+    std::vector<uint32_t> animated;
+};
+
+static void addNode(Scene &scene, int32_t parent, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    const glm::vec3 translation(unit(rng), unit(rng) + 1.0f, unit(rng));
+    const glm::quat rotation = glm::angleAxis(unit(rng) * 3.0f, glm::normalize(glm::vec3(unit(rng), 1.0f, unit(rng))));
+    const glm::vec3 scale(1.0f + 0.1f * unit(rng));
+    Node node;
+    node.parent = parent >= 0 ? &scene.nodes[parent] : nullptr;
+    node.translation = translation;
+    node.rotation = rotation;
+    node.scale = scale;
+    node.matrix = glm::mat4(1.0f);
+    scene.nodes.push_back(node);
+    scene.hierarchy.add(parent, translation, rotation, scale, glm::mat4(1.0f));
+}
+
+/*
+    A skeleton of `joints` joints in one chain, every joint animated
+*/
+static Scene makeChain(uint32_t joints)
+{
+    std::mt19937 rng(3);
+    Scene scene;
+    scene.nodes.reserve(joints);
+    scene.hierarchy.reserve(joints);
+    for (uint32_t i = 0; i < joints; i++) {
+        addNode(scene, static_cast<int32_t>(i) - 1, rng);
+        scene.animated.push_back(i);
+    }
+    return scene;
+}
+
+/*
+    Groups of `groupSize` nodes under a root each, every `animatedEvery`th group has its root animated
+*/
+static Scene makeGroups(uint32_t groups, uint32_t groupSize, uint32_t animatedEvery)
+{
+    std::mt19937 rng(5);
+    Scene scene;
+    scene.nodes.reserve(size_t(groups) * groupSize);
+    scene.hierarchy.reserve(size_t(groups) * groupSize);
+    for (uint32_t group = 0; group < groups; group++) {
+        const int32_t root = static_cast<int32_t>(scene.nodes.size());
+        addNode(scene, -1, rng);
+        for (uint32_t i = 1; i < groupSize; i++) {
+            // Trees a few levels deep, every node below one added before it
+            addNode(scene, root + static_cast<int32_t>(rng() % i), rng);
+        }
+        if (group % animatedEvery == 0) {
+            scene.animated.push_back(root);
+        }
+    }
+    return scene;
+}
+
+static glm::quat framePose(uint32_t frame, uint32_t slot)
+{
+    return glm::angleAxis(0.01f * float(frame) + 0.001f * float(slot), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+/*
+    One frame of the old path: animate the nodes, then walk to the root for every node
+*/
+static void walkFrame(Scene &scene, std::vector<glm::mat4> &world, uint32_t frame)
+{
+    for (uint32_t slot : scene.animated) {
+        scene.nodes[slot].rotation = framePose(frame, slot);
+    }
+    for (size_t i = 0; i < scene.nodes.size(); i++) {
+        world[i] = scene.nodes[i].getMatrix();
+    }
+}
+
+static void hierarchyFrame(Scene &scene, uint32_t frame)
+{
+    for (uint32_t slot : scene.animated) {
+        scene.hierarchy.setRotation(slot, framePose(frame, slot));
+    }
+    scene.hierarchy.update();
+}
+
+/*
+    World matrices of every slot recomputed from scratch, in the order of the hierarchy: parent world times local
+*/
+static void recompute(const Scene &scene, std::vector<glm::mat4> &world)
+{
+    for (size_t i = 0; i < scene.nodes.size(); i++) {
+        const int32_t parent = scene.hierarchy.parents[i];
+        const glm::mat4 local = scene.nodes[i].localMatrix();
+        world[i] = parent >= 0 ? world[parent] * local : local;
+    }
+}
+
+static bool run(const char *name, Scene scene, uint32_t frames, int runs)
+{
+    std::vector<glm::mat4> walk(scene.nodes.size()), full(scene.nodes.size());
+    scene.hierarchy.update();
+
+    // Every frame, the dirty update has to give the full recompute bit for bit. The walk multiplies from the node up
+    // to the root, the other association order, so it only agrees up to rounding
+    bool ok = true;
+    float maxError = 0.0f;
+    for (uint32_t frame = 0; frame < frames && ok; frame++) {
+        walkFrame(scene, walk, frame);
+        hierarchyFrame(scene, frame);
+        recompute(scene, full);
+        for (size_t i = 0; i < full.size(); i++) {
+            if (memcmp(&full[i], &scene.hierarchy.worldMatrices[i], sizeof(glm::mat4)) != 0) {
+                printf("FAILED: %s, world matrix of node %zu differs from the full recompute in frame %u\n", name, i, frame);
+                ok = false;
+                break;
+            }
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 4; r++) {
+                    const float a = walk[i][c][r], b = full[i][c][r];
+                    maxError = std::max(maxError, std::abs(a - b) / std::max(1.0f, std::abs(a)));
+                }
+            }
+        }
+    }
+    if (maxError > 1e-4f) {
+        printf("FAILED: %s, world matrices differ from the walk by %g\n", name, maxError);
+        ok = false;
+    }
+
+    uint32_t frame = frames;
+    const double walkMs = bench::bestOf(runs, [&] { walkFrame(scene, walk, frame++); });
+    const double hierarchyMs = bench::bestOf(runs, [&] { hierarchyFrame(scene, frame++); });
+    bench::keep(walk[0][3][0]);
+    printf("  %-36s %8zu %9zu  %8.4f  %12.4f  %9.1e  %s\n", name, scene.nodes.size(), scene.animated.size(), walkMs,
+        hierarchyMs, maxError, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    const bool check = bench::checkOnly(argc, argv);
+    const uint32_t groups = check ? 100 : 1000;
+    const uint32_t frames = check ? 8 : 32;
+    const int runs = check ? 2 : 20;
+
+    printf("best of %d frames                        nodes  animated   walk ms  hierarchy ms  vs walk\n", runs);
+    bool ok = true;
+    ok &= run("128-joint chain, every joint", makeChain(128), frames, runs);
+    ok &= run("groups of 100, 1 of 100 animated", makeGroups(groups, 100, 100), frames, runs);
+    ok &= run("groups of 100, every group animated", makeGroups(groups, 100, 1), frames, runs);
+    return ok ? 0 : 1;
+}
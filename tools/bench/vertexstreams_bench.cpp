@@ -0,0 +1,220 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Vertex stream kernels against the per vertex conversion loop they replaced
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "gltf/vertexstreams.h"
+#include "tiny_gltf.h"
+#include "benchmark.h"
+
+using namespace vkglTF;
+
+/*
+    Tightly packed accessors of one primitive, as written by most exporters
+*/
+struct Attributes {
+    size_t count = 0;
+    std::vector<float> positions, normals, uv0, uv1, weights;
+    std::vector<uint16_t> joints;
+};
+
+static Attributes makeAttributes(size_t count)
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    Attributes a;
+    a.count = count;
+    a.positions.resize(count * 3);
+    a.normals.resize(count * 3);
+    a.uv0.resize(count * 2);
+    a.uv1.resize(count * 2);
+    a.joints.resize(count * 4);
+    a.weights.resize(count * 4);
+    for (size_t i = 0; i < count; i++) {
+        for (int c = 0; c < 3; c++) {
+            a.positions[i * 3 + c] = unit(rng) * 100.0f;
+            // Unnormalized, but never zero length
+            a.normals[i * 3 + c] = unit(rng) + (c == 2 ? 2.0f : 0.0f);
+        }
+        for (int c = 0; c < 2; c++) {
+            a.uv0[i * 2 + c] = unit(rng);
+            a.uv1[i * 2 + c] = unit(rng);
+        }
+        // Every 64th vertex has no weights at all and needs the fix up
+        bool empty = (i % 64) == 0;
+        for (int c = 0; c < 4; c++) {
+            a.joints[i * 4 + c] = static_cast<uint16_t>(rng() % 128);
+            a.weights[i * 4 + c] = empty ? 0.0f : (unit(rng) + 1.0f) * 0.125f;
+        }
+    }
+    return a;
+}
+
+/*
+    The loop of Model::loadNode before the stream kernels (one vertex at a time, pushed back)
+*/
+struct Vertex {
+    glm::vec3 pos;
+    glm::vec3 normal;
+    glm::vec2 uv0;
+    glm::vec2 uv1;
+    glm::vec4 joint0;
+    glm::vec4 weight0;
+};
+
+static void perVertexLoop(const Attributes &a, std::vector<Vertex> &vertexBuffer)
+{
+    const float *bufferPos = a.positions.data();
+    const float *bufferNormals = a.normals.data();
+    const float *bufferTexCoordSet0 = a.uv0.data();
+    const float *bufferTexCoordSet1 = a.uv1.data();
+    const uint16_t *bufferJoints = a.joints.data();
+    const float *bufferWeights = a.weights.data();
+    const int posByteStride = 3, normByteStride = 3, uv0ByteStride = 2, uv1ByteStride = 2;
+    const int jointByteStride = 4, weightByteStride = 4;
+    const bool hasSkin = true;
+    for (size_t v = 0; v < a.count; v++) {
+        Vertex vert{};
+        vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * posByteStride]), 1.0f);
+        vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * normByteStride]) : glm::vec3(0.0f)));
+        vert.uv0 = bufferTexCoordSet0 ? glm::make_vec2(&bufferTexCoordSet0[v * uv0ByteStride]) : glm::vec3(0.0f);
+        vert.uv1 = bufferTexCoordSet1 ? glm::make_vec2(&bufferTexCoordSet1[v * uv1ByteStride]) : glm::vec3(0.0f);
+        vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * jointByteStride])) : glm::vec4(0.0f);
+        vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * weightByteStride]) : glm::vec4(0.0f);
+        // Fix for all zero weights
+        if (glm::length(vert.weight0) == 0.0f) {
+            vert.weight0 = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+        }
+        vertexBuffer.push_back(vert);
+    }
+}
+
+/*
+    convertVertices of model.cpp for the full precision layout: main stream (position, normal, uv0, uv1)
+    and skin stream (joints, weights), all float
+*/
+static const uint32_t MainStride = 10 * sizeof(float);
+static const uint32_t SkinStride = 8 * sizeof(float);
+
+static void streamKernels(const Attributes &a, uint8_t *mainDst, uint8_t *skinDst)
+{
+    struct Source {
+        const uint8_t *data;
+        size_t byteStride;
+        int componentType;
+        uint32_t components;
+        bool skin;
+        uint32_t offset;
+    };
+    const Source sources[] = {
+        { reinterpret_cast<const uint8_t*>(a.positions.data()), 12, TINYGLTF_COMPONENT_TYPE_FLOAT, 3, false, 0 },
+        { reinterpret_cast<const uint8_t*>(a.normals.data()), 12, TINYGLTF_COMPONENT_TYPE_FLOAT, 3, false, 12 },
+        { reinterpret_cast<const uint8_t*>(a.uv0.data()), 8, TINYGLTF_COMPONENT_TYPE_FLOAT, 2, false, 24 },
+        { reinterpret_cast<const uint8_t*>(a.uv1.data()), 8, TINYGLTF_COMPONENT_TYPE_FLOAT, 2, false, 32 },
+        { reinterpret_cast<const uint8_t*>(a.joints.data()), 8, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, 4, true, 0 },
+        { reinterpret_cast<const uint8_t*>(a.weights.data()), 16, TINYGLTF_COMPONENT_TYPE_FLOAT, 4, true, 16 },
+    };
+    float columnData[4][streams::BlockSize];
+    float *columns[4] = { columnData[0], columnData[1], columnData[2], columnData[3] };
+    alignas(16) uint8_t mainBlock[streams::BlockSize * MainStride];
+    alignas(16) uint8_t skinBlock[streams::BlockSize * SkinStride];
+
+    for (size_t first = 0; first < a.count; first += streams::BlockSize) {
+        const size_t blockCount = std::min(streams::BlockSize, a.count - first);
+        for (uint32_t s = 0; s < 6; s++) {
+            const Source &source = sources[s];
+            const uint32_t stride = source.skin ? SkinStride : MainStride;
+            uint8_t *out = (source.skin ? skinBlock : mainBlock) + source.offset;
+            streams::gather(source.data + first * source.byteStride, source.byteStride, source.componentType, false,
+                source.components, blockCount, columns);
+            if (s == 1) {
+                streams::normalize3(columns[0], columns[1], columns[2], blockCount);
+            }
+            if (s == 5) {
+                streams::fixWeights(columns[0], columns[1], columns[2], columns[3], blockCount);
+            }
+            streams::encode(columns, source.components, blockCount, out, stride, streams::Encoding::FLOAT32);
+        }
+        streams::streamCopy(mainDst + first * MainStride, mainBlock, blockCount * MainStride);
+        streams::streamCopy(skinDst + first * SkinStride, skinBlock, blockCount * SkinStride);
+    }
+    streams::streamFence();
+}
+
+static bool nearlyEqual(float a, float b)
+{
+    return std::abs(a - b) <= 1e-6f * std::max(1.0f, std::abs(a));
+}
+
+/*
+    Both paths have to produce the same vertices
+*/
+static bool compare(const std::vector<Vertex> &reference, const uint8_t *mainData, const uint8_t *skinData)
+{
+    for (size_t i = 0; i < reference.size(); i++) {
+        float main[10], skin[8];
+        memcpy(main, mainData + i * MainStride, MainStride);
+        memcpy(skin, skinData + i * SkinStride, SkinStride);
+        const Vertex &v = reference[i];
+        const float expectedMain[10] = { v.pos.x, v.pos.y, v.pos.z, v.normal.x, v.normal.y, v.normal.z,
+            v.uv0.x, v.uv0.y, v.uv1.x, v.uv1.y };
+        const float expectedSkin[8] = { v.joint0.x, v.joint0.y, v.joint0.z, v.joint0.w,
+            v.weight0.x, v.weight0.y, v.weight0.z, v.weight0.w };
+        for (int c = 0; c < 10; c++) {
+            if (!nearlyEqual(main[c], expectedMain[c])) {
+                printf("vertex %zu main component %d: %f != %f\n", i, c, main[c], expectedMain[c]);
+                return false;
+            }
+        }
+        for (int c = 0; c < 8; c++) {
+            if (!nearlyEqual(skin[c], expectedSkin[c])) {
+                printf("vertex %zu skin component %d: %f != %f\n", i, c, skin[c], expectedSkin[c]);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const bool check = bench::checkOnly(argc, argv);
+    const size_t count = check ? 10007 : (1u << 20);
+    const int runs = check ? 1 : 7;
+
+    Attributes attributes = makeAttributes(count);
+    std::vector<uint8_t> mainData(count * MainStride + 64), skinData(count * SkinStride + 64);
+
+    std::vector<Vertex> reference;
+    double loopMs = bench::bestOf(runs, [&]() {
+        reference = std::vector<Vertex>();
+        perVertexLoop(attributes, reference);
+    });
+    double kernelMs = bench::bestOf(runs, [&]() {
+        streamKernels(attributes, mainData.data(), skinData.data());
+    });
+
+    if (!compare(reference, mainData.data(), skinData.data())) {
+        printf("FAILED: stream kernels (%s) differ from the per vertex loop\n", streams::instructionSet());
+        return 1;
+    }
+    printf("%zu vertices, best of %d runs, kernels: %s\n", count, runs, streams::instructionSet());
+    printf("  per vertex loop  %8.2f ms  %7.1f Mvertices/s\n", loopMs, count / loopMs / 1000.0);
+    printf("  stream kernels   %8.2f ms  %7.1f Mvertices/s  (%.2fx)\n", kernelMs, count / kernelMs / 1000.0,
+        loopMs / kernelMs);
+    return 0;
+}
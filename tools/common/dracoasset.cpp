@@ -0,0 +1,132 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Synthetic KHR_draco_mesh_compression assets
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include "dracoasset.h"
+#include "glb.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+#include <utility>
+
+#include "draco/compression/encode.h"
+#include "draco/mesh/mesh.h"
+
+namespace tools
+{
+
+    /*
+        Grid of side x side vertices, wrapped around a bumpy cylinder so every primitive has its own shape
+    */
+    static draco::EncoderBuffer encodeGrid(uint32_t side, uint32_t seed, float bounds[6])
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> noise(-0.02f, 0.02f);
+        const uint32_t count = side * side;
+        draco::Mesh mesh;
+        mesh.set_num_points(count);
+
+        draco::GeometryAttribute position, normal, texCoord;
+        position.Init(draco::GeometryAttribute::POSITION, nullptr, 3, draco::DT_FLOAT32, false, 3 * sizeof(float), 0);
+        normal.Init(draco::GeometryAttribute::NORMAL, nullptr, 3, draco::DT_FLOAT32, false, 3 * sizeof(float), 0);
+        texCoord.Init(draco::GeometryAttribute::TEX_COORD, nullptr, 2, draco::DT_FLOAT32, false, 2 * sizeof(float), 0);
+        const int positionId = mesh.AddAttribute(position, true, count);
+        const int normalId = mesh.AddAttribute(normal, true, count);
+        const int texCoordId = mesh.AddAttribute(texCoord, true, count);
+
+        std::fill(bounds, bounds + 3, 1e30f);
+        std::fill(bounds + 3, bounds + 6, -1e30f);
+        const float twoPi = 6.2831853f;
+        for (uint32_t y = 0; y < side; y++) {
+            for (uint32_t x = 0; x < side; x++) {
+                const float u = x / float(side - 1);
+                const float v = y / float(side - 1);
+                const float radius = 1.0f + 0.1f * std::sin(u * 9.0f + seed) * std::cos(v * 7.0f) + noise(rng);
+                const float p[3] = { radius * std::cos(u * twoPi), v * 2.0f - 1.0f, radius * std::sin(u * twoPi) };
+                const float n[3] = { std::cos(u * twoPi), 0.0f, std::sin(u * twoPi) };
+                const float t[2] = { u, v };
+                const draco::AttributeValueIndex index(y * side + x);
+                mesh.attribute(positionId)->SetAttributeValue(index, p);
+                mesh.attribute(normalId)->SetAttributeValue(index, n);
+                mesh.attribute(texCoordId)->SetAttributeValue(index, t);
+                for (int c = 0; c < 3; c++) {
+                    bounds[c] = std::min(bounds[c], p[c]);
+                    bounds[3 + c] = std::max(bounds[3 + c], p[c]);
+                }
+            }
+        }
+        for (uint32_t y = 0; y + 1 < side; y++) {
+            for (uint32_t x = 0; x + 1 < side; x++) {
+                const uint32_t i = y * side + x;
+                mesh.AddFace({ draco::PointIndex(i), draco::PointIndex(i + side), draco::PointIndex(i + 1) });
+                mesh.AddFace({ draco::PointIndex(i + 1), draco::PointIndex(i + side), draco::PointIndex(i + side + 1) });
+            }
+        }
+
+        // The quantization most exporters use
+        draco::Encoder encoder;
+        encoder.SetAttributeQuantization(draco::GeometryAttribute::POSITION, 14);
+        encoder.SetAttributeQuantization(draco::GeometryAttribute::NORMAL, 10);
+        encoder.SetAttributeQuantization(draco::GeometryAttribute::TEX_COORD, 12);
+        encoder.SetSpeedOptions(5, 5);
+        draco::EncoderBuffer buffer;
+        encoder.EncodeMeshToBuffer(mesh, &buffer);
+        return buffer;
+    }
+
+    std::vector<uint8_t> makeDracoAsset(uint32_t primitiveCount, uint32_t verticesPerPrimitive)
+    {
+        const uint32_t side = std::max(2u, static_cast<uint32_t>(std::sqrt(static_cast<double>(verticesPerPrimitive))));
+        const uint32_t vertexCount = side * side;
+        const uint32_t indexCount = (side - 1) * (side - 1) * 6;
+        const uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(primitiveCount))));
+
+        std::vector<uint8_t> bin;
+        std::string meshes, nodes, sceneNodes, accessors, bufferViews;
+        for (uint32_t p = 0; p < primitiveCount; p++) {
+            float bounds[6];
+            draco::EncoderBuffer encoded = encodeGrid(side, p + 1, bounds);
+            const size_t offset = bin.size();
+            bin.insert(bin.end(), encoded.data(), encoded.data() + encoded.size());
+            bin.resize((bin.size() + 3) & ~size_t(3), 0);
+
+            const std::string sep = p > 0 ? "," : "";
+            const uint32_t firstAccessor = p * 4;
+            bufferViews += sep + "{\"buffer\":0,\"byteOffset\":" + std::to_string(offset) +
+                ",\"byteLength\":" + std::to_string(encoded.size()) + "}";
+            char minMax[256];
+            snprintf(minMax, sizeof(minMax), "\"min\":[%.6f,%.6f,%.6f],\"max\":[%.6f,%.6f,%.6f]",
+                bounds[0], bounds[1], bounds[2], bounds[3], bounds[4], bounds[5]);
+            accessors += sep +
+                "{\"componentType\":5126,\"count\":" + std::to_string(vertexCount) + ",\"type\":\"VEC3\"," + minMax + "}," +
+                "{\"componentType\":5126,\"count\":" + std::to_string(vertexCount) + ",\"type\":\"VEC3\"}," +
+                "{\"componentType\":5126,\"count\":" + std::to_string(vertexCount) + ",\"type\":\"VEC2\"}," +
+                "{\"componentType\":5125,\"count\":" + std::to_string(indexCount) + ",\"type\":\"SCALAR\"}";
+            meshes += sep + "{\"primitives\":[{\"attributes\":{\"POSITION\":" + std::to_string(firstAccessor) +
+                ",\"NORMAL\":" + std::to_string(firstAccessor + 1) + ",\"TEXCOORD_0\":" + std::to_string(firstAccessor + 2) +
+                "},\"indices\":" + std::to_string(firstAccessor + 3) +
+                ",\"extensions\":{\"KHR_draco_mesh_compression\":{\"bufferView\":" + std::to_string(p) +
+                ",\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2}}}}]}";
+            nodes += sep + "{\"mesh\":" + std::to_string(p) + ",\"translation\":[" +
+                std::to_string(float(p % columns) * 3.0f) + ",0," + std::to_string(float(p / columns) * 3.0f) + "]}";
+            sceneNodes += sep + std::to_string(p);
+        }
+
+        std::string json = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"glTFViewer tools makeDracoAsset\"},"
+            "\"extensionsUsed\":[\"KHR_draco_mesh_compression\"],\"extensionsRequired\":[\"KHR_draco_mesh_compression\"],"
+            "\"scene\":0,\"scenes\":[{\"nodes\":[" + sceneNodes + "]}],\"nodes\":[" + nodes + "],\"meshes\":[" + meshes +
+            "],\"accessors\":[" + accessors + "],\"bufferViews\":[" + bufferViews +
+            "],\"buffers\":[{\"byteLength\":" + std::to_string(bin.size()) + "}]}";
+        return makeGlb(std::move(json), std::move(bin));
+    }
+
+}
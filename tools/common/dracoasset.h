@@ -0,0 +1,25 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Synthetic KHR_draco_mesh_compression assets
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace tools
+{
+
+    /*
+        Binary glTF with one node per primitive, each a Draco compressed noisy grid of about
+        `verticesPerPrimitive` vertices with positions, normals and texture coordinates
+    */
+    std::vector<uint8_t> makeDracoAsset(uint32_t primitiveCount, uint32_t verticesPerPrimitive);
+
+}
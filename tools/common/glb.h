@@ -0,0 +1,47 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Binary glTF container for the synthetic assets
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace tools
+{
+
+    /*
+        .glb of a JSON chunk and a BIN chunk, both padded to 4 bytes
+    */
+    inline std::vector<uint8_t> makeGlb(std::string json, std::vector<uint8_t> bin)
+    {
+        json.resize((json.size() + 3) & ~size_t(3), ' ');
+        bin.resize((bin.size() + 3) & ~size_t(3), 0);
+        auto append32 = [](std::vector<uint8_t> &out, uint32_t value) {
+            uint8_t bytes[4];
+            memcpy(bytes, &value, 4);
+            out.insert(out.end(), bytes, bytes + 4);
+        };
+        std::vector<uint8_t> glb;
+        glb.reserve(12 + 8 + json.size() + 8 + bin.size());
+        append32(glb, 0x46546C67);
+        append32(glb, 2);
+        append32(glb, static_cast<uint32_t>(12 + 8 + json.size() + 8 + bin.size()));
+        append32(glb, static_cast<uint32_t>(json.size()));
+        append32(glb, 0x4E4F534A);
+        glb.insert(glb.end(), json.begin(), json.end());
+        append32(glb, static_cast<uint32_t>(bin.size()));
+        append32(glb, 0x004E4942);
+        glb.insert(glb.end(), bin.begin(), bin.end());
+        return glb;
+    }
+
+}
@@ -0,0 +1,13 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      tinygltf and stb_image implementation for the tools, glTFViewer.cpp has it in the viewer
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#define TINYGLTF_IMPLEMENTATION
+
+#include "gltf/model.h"
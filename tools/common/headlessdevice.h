@@ -0,0 +1,38 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      VulkanDevice on the headless Vulkan stub
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "vulkan/device.h"
+#include "vulkan/macros.h"
+#include "vulkanstub.h"
+
+namespace tools
+{
+
+    /*
+        Logical device with the staging ring and allocator set up the way the viewer creates them
+    */
+    inline std::unique_ptr<xy::VulkanDevice> createHeadlessDevice(const vkstub::Config &config = {})
+    {
+        vkstub::configure(config);
+        std::unique_ptr<xy::VulkanDevice> device(new xy::VulkanDevice(vkstub::physicalDevice()));
+        VkPhysicalDeviceFeatures enabledFeatures{};
+        enabledFeatures.samplerAnisotropy = VK_TRUE;
+        enabledFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+        enabledFeatures.multiDrawIndirect = VK_TRUE;
+        VK_CHECK_RESULT(device->createLogicalDevice(enabledFeatures, {}));
+        return device;
+    }
+
+}
@@ -0,0 +1,134 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Synthetic scenes with many primitives and materials
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include "sceneasset.h"
+#include "glb.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+
+namespace tools
+{
+
+    template <typename T>
+    static void appendValues(std::vector<uint8_t> &out, const T *values, size_t count)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(values);
+        out.insert(out.end(), bytes, bytes + count * sizeof(T));
+    }
+
+    std::vector<uint8_t> makeSceneAsset(uint32_t primitiveCount, uint32_t primitivesPerMesh, uint32_t materialCount,
+        uint32_t morphedMeshes)
+    {
+        primitivesPerMesh = std::max(1u, primitivesPerMesh);
+        materialCount = std::max(1u, materialCount);
+        const uint32_t meshCount = (primitiveCount + primitivesPerMesh - 1) / primitivesPerMesh;
+        const uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(meshCount))));
+
+        // One unit cube with a face per primitive slot offset along y, every primitive of a mesh is a cube of its own
+        std::vector<uint8_t> bin;
+        std::string bufferViews, accessors;
+        for (uint32_t p = 0; p < primitivesPerMesh; p++) {
+            float positions[24 * 3], normals[24 * 3];
+            uint16_t indices[36];
+            const float y = 1.5f * p;
+            for (int face = 0; face < 6; face++) {
+                const int axis = face / 2;
+                const float sign = (face & 1) ? 1.0f : -1.0f;
+                for (int corner = 0; corner < 4; corner++) {
+                    float v[3];
+                    v[axis] = 0.5f * sign;
+                    v[(axis + 1) % 3] = (corner & 1) ? 0.5f : -0.5f;
+                    v[(axis + 2) % 3] = (corner & 2) ? 0.5f : -0.5f;
+                    v[1] += y;
+                    const int i = face * 4 + corner;
+                    memcpy(&positions[i * 3], v, sizeof(v));
+                    normals[i * 3 + 0] = axis == 0 ? sign : 0.0f;
+                    normals[i * 3 + 1] = axis == 1 ? sign : 0.0f;
+                    normals[i * 3 + 2] = axis == 2 ? sign : 0.0f;
+                }
+                const uint16_t base = static_cast<uint16_t>(face * 4);
+                const uint16_t quad[6] = { 0, 1, 2, 2, 1, 3 };
+                for (int i = 0; i < 6; i++) {
+                    indices[face * 6 + i] = base + quad[(face & 1) ? i : 5 - i];
+                }
+            }
+            const std::string sep = p > 0 ? "," : "";
+            char view[256];
+            snprintf(view, sizeof(view), "%s{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":288},"
+                "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":288},{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":72}",
+                sep.c_str(), bin.size(), bin.size() + 288, bin.size() + 576);
+            bufferViews += view;
+            appendValues(bin, positions, 24 * 3);
+            appendValues(bin, normals, 24 * 3);
+            appendValues(bin, indices, 36);
+            char accessor[512];
+            snprintf(accessor, sizeof(accessor), "%s{\"bufferView\":%u,\"componentType\":5126,\"count\":24,\"type\":\"VEC3\","
+                "\"min\":[-0.5,%.1f,-0.5],\"max\":[0.5,%.1f,0.5]},"
+                "{\"bufferView\":%u,\"componentType\":5126,\"count\":24,\"type\":\"VEC3\"},"
+                "{\"bufferView\":%u,\"componentType\":5123,\"count\":36,\"type\":\"SCALAR\"}",
+                sep.c_str(), p * 3, y - 0.5f, y + 0.5f, p * 3 + 1, p * 3 + 2);
+            accessors += accessor;
+        }
+
+        // Position deltas of the morph target, the same for every cube
+        const uint32_t morphAccessor = primitivesPerMesh * 3;
+        if (morphedMeshes > 0) {
+            float deltas[24 * 3];
+            for (int i = 0; i < 24; i++) {
+                deltas[i * 3 + 0] = 0.0f;
+                deltas[i * 3 + 1] = 0.25f;
+                deltas[i * 3 + 2] = 0.0f;
+            }
+            bufferViews += ",{\"buffer\":0,\"byteOffset\":" + std::to_string(bin.size()) + ",\"byteLength\":288}";
+            accessors += ",{\"bufferView\":" + std::to_string(morphAccessor) + ",\"componentType\":5126,\"count\":24,"
+                "\"type\":\"VEC3\",\"min\":[0,0.25,0],\"max\":[0,0.25,0]}";
+            appendValues(bin, deltas, 24 * 3);
+        }
+
+        std::string materials;
+        for (uint32_t m = 0; m < materialCount; m++) {
+            char material[256];
+            snprintf(material, sizeof(material), "%s{\"pbrMetallicRoughness\":{\"baseColorFactor\":[%.3f,%.3f,%.3f,%s]},"
+                "\"alphaMode\":\"%s\"}", m > 0 ? "," : "", (m % 7) / 6.0f, (m % 11) / 10.0f, (m % 13) / 12.0f,
+                m % 10 == 9 ? "0.5" : "1.0", m % 10 == 9 ? "BLEND" : "OPAQUE");
+            materials += material;
+        }
+
+        std::string meshes, nodes, sceneNodes;
+        uint32_t primitive = 0;
+        for (uint32_t mesh = 0; mesh < meshCount; mesh++) {
+            const bool morphed = mesh < morphedMeshes;
+            const std::string targets = morphed ? ",\"targets\":[{\"POSITION\":" + std::to_string(morphAccessor) + "}]" : "";
+            std::string primitives;
+            for (uint32_t p = 0; p < primitivesPerMesh && primitive < primitiveCount; p++, primitive++) {
+                primitives += (p > 0 ? "," : "") + std::string("{\"attributes\":{\"POSITION\":") + std::to_string(p * 3) +
+                    ",\"NORMAL\":" + std::to_string(p * 3 + 1) + "},\"indices\":" + std::to_string(p * 3 + 2) +
+                    ",\"material\":" + std::to_string(primitive % materialCount) + targets + "}";
+            }
+            const std::string sep = mesh > 0 ? "," : "";
+            meshes += sep + "{\"primitives\":[" + primitives + "]" + (morphed ? ",\"weights\":[0.5]" : "") + "}";
+            nodes += sep + "{\"mesh\":" + std::to_string(mesh) + ",\"translation\":[" +
+                std::to_string(float(mesh % columns) * 2.0f) + ",0," + std::to_string(float(mesh / columns) * 2.0f) + "]}";
+            sceneNodes += sep + std::to_string(mesh);
+        }
+
+        std::string json = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"glTFViewer tools makeSceneAsset\"},"
+            "\"scene\":0,\"scenes\":[{\"nodes\":[" + sceneNodes + "]}],\"nodes\":[" + nodes + "],\"meshes\":[" + meshes +
+            "],\"materials\":[" + materials + "],\"accessors\":[" + accessors + "],\"bufferViews\":[" + bufferViews +
+            "],\"buffers\":[{\"byteLength\":" + std::to_string(bin.size()) + "}]}";
+        return makeGlb(std::move(json), std::move(bin));
+    }
+
+}
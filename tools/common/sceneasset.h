@@ -0,0 +1,27 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Synthetic scenes with many primitives and materials
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace tools
+{
+
+    /*
+        Binary glTF of a grid of nodes, each with a mesh of `primitivesPerMesh` cubes, `primitiveCount` cubes in total
+        The materials are spread round robin over the primitives, every tenth one is alpha blended
+        The first `morphedMeshes` meshes have a morph target on each primitive, which lifts the cube at half weight
+    */
+    std::vector<uint8_t> makeSceneAsset(uint32_t primitiveCount, uint32_t primitivesPerMesh, uint32_t materialCount,
+        uint32_t morphedMeshes = 0);
+
+}
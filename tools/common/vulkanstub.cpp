@@ -0,0 +1,1041 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Headless stand-in for the Vulkan loader used by the tools
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include "vulkanstub.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    The opaque handle types of vulkan.h, defined here
+*/
+struct VkInstance_T {};
+struct VkPhysicalDevice_T {};
+struct VkSemaphore_T {};
+struct VkShaderModule_T {};
+struct VkPipelineLayout_T {};
+struct VkPipeline_T {};
+struct VkRenderPass_T {};
+struct VkFramebuffer_T {};
+struct VkSampler_T {};
+struct VkImageView_T {};
+struct VkDescriptorSetLayout_T {};
+struct VkDescriptorSet_T {};
+
+struct VkDeviceMemory_T {
+    uint8_t *data = nullptr;
+    VkDeviceSize size = 0;
+};
+
+struct VkBuffer_T {
+    VkDeviceSize size = 0;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+
+    uint8_t *data() const { return memory->data + offset; }
+};
+
+struct VkImage_T {
+    VkImageCreateInfo info{};
+};
+
+struct VkFence_T {
+    bool signaled = false;
+};
+
+/*
+    The buffer commands the GPU thread executes
+*/
+struct StubCommand {
+    enum Type { COPY, FILL, UPDATE } type;
+    VkBuffer src = VK_NULL_HANDLE;
+    VkBuffer dst = VK_NULL_HANDLE;
+    std::vector<VkBufferCopy> regions;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t value = 0;
+    std::vector<uint8_t> bytes;
+};
+
+struct VkCommandBuffer_T {
+    std::vector<StubCommand> commands;
+};
+
+struct VkCommandPool_T {
+    std::vector<VkCommandBuffer> commandBuffers;
+};
+
+struct VkDescriptorPool_T {
+    std::vector<VkDescriptorSet> sets;
+};
+
+struct VkQueue_T {
+    uint32_t family = 0;
+};
+
+struct VkDevice_T {
+    VkQueue_T queues[2];
+};
+
+namespace vkstub
+{
+
+    static struct {
+        std::atomic<uint64_t> submits{ 0 }, bindPipeline{ 0 }, bindDescriptorSets{ 0 }, descriptorSetsBound{ 0 };
+        std::atomic<uint64_t> pushConstants{ 0 }, pushConstantBytes{ 0 }, bindVertexBuffers{ 0 }, bindIndexBuffer{ 0 };
+        std::atomic<uint64_t> draws{ 0 }, indirectDraws{ 0 }, dispatches{ 0 }, copies{ 0 }, barriers{ 0 };
+        std::atomic<uint64_t> descriptorWrites{ 0 }, pipelines{ 0 };
+    } counting;
+
+    static struct {
+        std::atomic<int64_t> buffers{ 0 }, images{ 0 }, allocations{ 0 }, commandBuffers{ 0 }, fences{ 0 };
+    } live;
+
+    static Config config;
+    static VkPhysicalDevice_T thePhysicalDevice;
+
+    /*
+        Submissions are executed one after another, across all queues, which satisfies every semaphore
+        wait the framework makes
+    */
+    class Gpu
+    {
+    public:
+        struct Job {
+            std::vector<VkCommandBuffer> commandBuffers;
+            VkFence fence;
+            std::chrono::microseconds latency;
+        };
+
+        std::mutex mutex;
+        std::condition_variable queued;
+        std::condition_variable completed;
+
+        Gpu() : thread(&Gpu::run, this) {}
+
+        ~Gpu()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            queued.notify_all();
+            thread.join();
+        }
+
+        void submit(Job &&job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(std::move(job));
+                pending++;
+            }
+            queued.notify_all();
+        }
+
+        void waitIdle()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            completed.wait(lock, [this] { return pending == 0; });
+        }
+
+    private:
+        std::deque<Job> jobs;
+        size_t pending = 0;
+        bool stopping = false;
+        std::thread thread;
+
+        static void execute(const StubCommand &command)
+        {
+            switch (command.type) {
+            case StubCommand::COPY:
+                for (const VkBufferCopy &region : command.regions) {
+                    memcpy(command.dst->data() + region.dstOffset, command.src->data() + region.srcOffset, region.size);
+                }
+                break;
+            case StubCommand::FILL: {
+                VkDeviceSize size = command.size == VK_WHOLE_SIZE ? command.dst->size - command.offset : command.size;
+                for (VkDeviceSize i = 0; i + 4 <= size; i += 4) {
+                    memcpy(command.dst->data() + command.offset + i, &command.value, 4);
+                }
+                break;
+            }
+            case StubCommand::UPDATE:
+                memcpy(command.dst->data() + command.offset, command.bytes.data(), command.bytes.size());
+                break;
+            }
+        }
+
+        void run()
+        {
+            for (;;) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    queued.wait(lock, [this] { return stopping || !jobs.empty(); });
+                    if (jobs.empty()) {
+                        return;
+                    }
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                if (job.latency.count() > 0) {
+                    std::this_thread::sleep_for(job.latency);
+                }
+                for (VkCommandBuffer commandBuffer : job.commandBuffers) {
+                    for (const StubCommand &command : commandBuffer->commands) {
+                        execute(command);
+                    }
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (job.fence) {
+                        job.fence->signaled = true;
+                    }
+                    pending--;
+                }
+                completed.notify_all();
+            }
+        }
+    };
+
+    static Gpu &gpu()
+    {
+        static Gpu instance;
+        return instance;
+    }
+
+    void configure(const Config &newConfig)
+    {
+        config = newConfig;
+    }
+
+    VkPhysicalDevice physicalDevice()
+    {
+        return &thePhysicalDevice;
+    }
+
+    Counters counters()
+    {
+        Counters c;
+        c.submits = counting.submits;
+        c.bindPipeline = counting.bindPipeline;
+        c.bindDescriptorSets = counting.bindDescriptorSets;
+        c.descriptorSetsBound = counting.descriptorSetsBound;
+        c.pushConstants = counting.pushConstants;
+        c.pushConstantBytes = counting.pushConstantBytes;
+        c.bindVertexBuffers = counting.bindVertexBuffers;
+        c.bindIndexBuffer = counting.bindIndexBuffer;
+        c.draws = counting.draws;
+        c.indirectDraws = counting.indirectDraws;
+        c.dispatches = counting.dispatches;
+        c.copies = counting.copies;
+        c.barriers = counting.barriers;
+        c.descriptorWrites = counting.descriptorWrites;
+        c.pipelines = counting.pipelines;
+        return c;
+    }
+
+    void resetCounters()
+    {
+        for (std::atomic<uint64_t> *counter : { &counting.submits, &counting.bindPipeline, &counting.bindDescriptorSets,
+                &counting.descriptorSetsBound, &counting.pushConstants, &counting.pushConstantBytes,
+                &counting.bindVertexBuffers, &counting.bindIndexBuffer, &counting.draws, &counting.indirectDraws,
+                &counting.dispatches, &counting.copies, &counting.barriers, &counting.descriptorWrites,
+                &counting.pipelines }) {
+            *counter = 0;
+        }
+    }
+
+    const uint8_t *bufferData(VkBuffer buffer)
+    {
+        return buffer->data();
+    }
+
+    Objects objects()
+    {
+        Objects o;
+        o.buffers = live.buffers;
+        o.images = live.images;
+        o.allocations = live.allocations;
+        o.commandBuffers = live.commandBuffers;
+        o.fences = live.fences;
+        return o;
+    }
+
+    /*
+        Bytes per texel, block compressed formats are rounded up to one byte
+    */
+    static VkDeviceSize texelSize(VkFormat format)
+    {
+        switch (format) {
+        case VK_FORMAT_R8_UNORM:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R16_SFLOAT:
+            return 2;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            return (format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) ? 1 : 4;
+        }
+    }
+
+}
+
+using namespace vkstub;
+
+template <typename T>
+static VkResult createObject(T **handle)
+{
+    *handle = new T();
+    return VK_SUCCESS;
+}
+
+template <typename T>
+static void destroyObject(T *handle)
+{
+    delete handle;
+}
+
+extern "C" {
+
+/*
+    Physical device
+*/
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties *pProperties)
+{
+    *pProperties = {};
+    pProperties->apiVersion = VK_MAKE_VERSION(1, 0, VK_HEADER_VERSION);
+    pProperties->deviceType = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+    strcpy(pProperties->deviceName, "Headless stub device");
+    VkPhysicalDeviceLimits &limits = pProperties->limits;
+    limits.maxImageDimension2D = 16384;
+    limits.maxImageDimensionCube = 16384;
+    limits.maxImageArrayLayers = 2048;
+    limits.maxUniformBufferRange = 65536;
+    limits.maxStorageBufferRange = 1u << 30;
+    limits.maxPushConstantsSize = 256;
+    limits.maxMemoryAllocationCount = 4096;
+    limits.maxSamplerAllocationCount = 4000;
+    limits.bufferImageGranularity = 1024;
+    limits.maxBoundDescriptorSets = 8;
+    limits.maxPerStageDescriptorSamplers = 1u << 20;
+    limits.maxPerStageDescriptorUniformBuffers = 15;
+    limits.maxPerStageDescriptorStorageBuffers = 1u << 20;
+    limits.maxPerStageDescriptorSampledImages = 1u << 20;
+    limits.maxPerStageDescriptorStorageImages = 1u << 20;
+    limits.maxPerStageResources = 1u << 20;
+    limits.maxDescriptorSetSamplers = 1u << 20;
+    limits.maxDescriptorSetUniformBuffers = 90;
+    limits.maxDescriptorSetUniformBuffersDynamic = 15;
+    limits.maxDescriptorSetStorageBuffers = 1u << 20;
+    limits.maxDescriptorSetStorageBuffersDynamic = 16;
+    limits.maxDescriptorSetSampledImages = 1u << 20;
+    limits.maxDescriptorSetStorageImages = 1u << 20;
+    limits.maxVertexInputAttributes = 32;
+    limits.maxVertexInputBindings = 32;
+    limits.maxComputeSharedMemorySize = 32768;
+    limits.maxComputeWorkGroupCount[0] = limits.maxComputeWorkGroupCount[1] = limits.maxComputeWorkGroupCount[2] = 65535;
+    limits.maxComputeWorkGroupInvocations = 1024;
+    limits.maxComputeWorkGroupSize[0] = limits.maxComputeWorkGroupSize[1] = 1024;
+    limits.maxComputeWorkGroupSize[2] = 64;
+    limits.maxDrawIndexedIndexValue = 0xFFFFFFFFu;
+    limits.maxDrawIndirectCount = 0xFFFFFFFFu;
+    limits.maxSamplerAnisotropy = 16.0f;
+    limits.maxViewports = 16;
+    limits.maxViewportDimensions[0] = limits.maxViewportDimensions[1] = 16384;
+    limits.minMemoryMapAlignment = 64;
+    limits.minTexelBufferOffsetAlignment = 16;
+    limits.minUniformBufferOffsetAlignment = 256;
+    limits.minStorageBufferOffsetAlignment = 16;
+    limits.maxFramebufferWidth = limits.maxFramebufferHeight = 16384;
+    limits.maxFramebufferLayers = 2048;
+    limits.maxColorAttachments = 8;
+    limits.framebufferColorSampleCounts = limits.framebufferDepthSampleCounts = VK_SAMPLE_COUNT_1_BIT | VK_SAMPLE_COUNT_4_BIT;
+    limits.sampledImageColorSampleCounts = limits.sampledImageDepthSampleCounts = VK_SAMPLE_COUNT_1_BIT | VK_SAMPLE_COUNT_4_BIT;
+    limits.timestampComputeAndGraphics = VK_TRUE;
+    limits.timestampPeriod = 1.0f;
+    limits.optimalBufferCopyOffsetAlignment = 16;
+    limits.optimalBufferCopyRowPitchAlignment = 16;
+    limits.nonCoherentAtomSize = 64;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceFeatures(VkPhysicalDevice, VkPhysicalDeviceFeatures *pFeatures)
+{
+    // Everything is supported
+    VkBool32 *features = reinterpret_cast<VkBool32*>(pFeatures);
+    std::fill(features, features + sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32), VK_TRUE);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceFormatProperties(VkPhysicalDevice, VkFormat, VkFormatProperties *pFormatProperties)
+{
+    pFormatProperties->linearTilingFeatures = 0x1FFF;
+    pFormatProperties->optimalTilingFeatures = 0x1FFF;
+    pFormatProperties->bufferFeatures = 0x1FFF;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties *pMemoryProperties)
+{
+    *pMemoryProperties = {};
+    pMemoryProperties->memoryHeapCount = 2;
+    pMemoryProperties->memoryHeaps[0] = { 8ull << 30, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT };
+    pMemoryProperties->memoryHeaps[1] = { 16ull << 30, 0 };
+    pMemoryProperties->memoryTypeCount = 4;
+    pMemoryProperties->memoryTypes[0] = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0 };
+    pMemoryProperties->memoryTypes[1] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1 };
+    pMemoryProperties->memoryTypes[2] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+        VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 1 };
+    pMemoryProperties->memoryTypes[3] = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0 };
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice, uint32_t *pQueueFamilyPropertyCount,
+    VkQueueFamilyProperties *pQueueFamilyProperties)
+{
+    const uint32_t count = config.dedicatedTransferQueue ? 2 : 1;
+    if (pQueueFamilyProperties) {
+        const VkQueueFamilyProperties families[2] = {
+            { VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, 1, 64, { 1, 1, 1 } },
+            { VK_QUEUE_TRANSFER_BIT, 1, 64, { 1, 1, 1 } },
+        };
+        *pQueueFamilyPropertyCount = std::min(*pQueueFamilyPropertyCount, count);
+        std::copy(families, families + *pQueueFamilyPropertyCount, pQueueFamilyProperties);
+    } else {
+        *pQueueFamilyPropertyCount = count;
+    }
+}
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetInstanceProcAddr(VkInstance, const char*)
+{
+    return nullptr;
+}
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetDeviceProcAddr(VkDevice, const char*)
+{
+    return nullptr;
+}
+
+/*
+    Device and queues
+*/
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateDevice(VkPhysicalDevice, const VkDeviceCreateInfo*, const VkAllocationCallbacks*,
+    VkDevice *pDevice)
+{
+    VkDevice device = new VkDevice_T();
+    device->queues[0].family = 0;
+    device->queues[1].family = 1;
+    *pDevice = device;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyDevice(VkDevice device, const VkAllocationCallbacks*)
+{
+    gpu().waitIdle();
+    delete device;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetDeviceQueue(VkDevice device, uint32_t queueFamilyIndex, uint32_t, VkQueue *pQueue)
+{
+    *pQueue = &device->queues[std::min(queueFamilyIndex, 1u)];
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkQueueSubmit(VkQueue, uint32_t submitCount, const VkSubmitInfo *pSubmits, VkFence fence)
+{
+    Gpu::Job job;
+    for (uint32_t s = 0; s < submitCount; s++) {
+        job.commandBuffers.insert(job.commandBuffers.end(), pSubmits[s].pCommandBuffers,
+            pSubmits[s].pCommandBuffers + pSubmits[s].commandBufferCount);
+    }
+    job.fence = fence;
+    job.latency = config.submitLatency;
+    counting.submits++;
+    gpu().submit(std::move(job));
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkQueueWaitIdle(VkQueue)
+{
+    gpu().waitIdle();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkDeviceWaitIdle(VkDevice)
+{
+    gpu().waitIdle();
+    return VK_SUCCESS;
+}
+
+/*
+    Memory
+*/
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo *pAllocateInfo, const VkAllocationCallbacks*,
+    VkDeviceMemory *pMemory)
+{
+    uint8_t *data = static_cast<uint8_t*>(malloc(static_cast<size_t>(pAllocateInfo->allocationSize)));
+    if (!data) {
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+    VkDeviceMemory memory = new VkDeviceMemory_T();
+    memory->data = data;
+    memory->size = pAllocateInfo->allocationSize;
+    *pMemory = memory;
+    live.allocations++;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*)
+{
+    if (memory) {
+        free(memory->data);
+        delete memory;
+        live.allocations--;
+    }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize, VkMemoryMapFlags,
+    void **ppData)
+{
+    *ppData = memory->data + offset;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkUnmapMemory(VkDevice, VkDeviceMemory)
+{
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkFlushMappedMemoryRanges(VkDevice, uint32_t, const VkMappedMemoryRange*)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkInvalidateMappedMemoryRanges(VkDevice, uint32_t, const VkMappedMemoryRange*)
+{
+    return VK_SUCCESS;
+}
+
+/*
+    Buffers and images
+*/
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice, const VkBufferCreateInfo *pCreateInfo, const VkAllocationCallbacks*,
+    VkBuffer *pBuffer)
+{
+    VkBuffer buffer = new VkBuffer_T();
+    buffer->size = pCreateInfo->size;
+    *pBuffer = buffer;
+    live.buffers++;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer buffer, const VkAllocationCallbacks*)
+{
+    if (buffer) {
+        delete buffer;
+        live.buffers--;
+    }
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(VkDevice, VkBuffer buffer, VkMemoryRequirements *pMemoryRequirements)
+{
+    pMemoryRequirements->alignment = 256;
+    pMemoryRequirements->size = (buffer->size + 255) / 256 * 256;
+    pMemoryRequirements->memoryTypeBits = 0xF;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize memoryOffset)
+{
+    buffer->memory = memory;
+    buffer->offset = memoryOffset;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImage(VkDevice, const VkImageCreateInfo *pCreateInfo, const VkAllocationCallbacks*,
+    VkImage *pImage)
+{
+    VkImage image = new VkImage_T();
+    image->info = *pCreateInfo;
+    *pImage = image;
+    live.images++;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImage(VkDevice, VkImage image, const VkAllocationCallbacks*)
+{
+    if (image) {
+        delete image;
+        live.images--;
+    }
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements(VkDevice, VkImage image, VkMemoryRequirements *pMemoryRequirements)
+{
+    const VkImageCreateInfo &info = image->info;
+    VkDeviceSize size = 0;
+    for (uint32_t level = 0; level < std::max(info.mipLevels, 1u); level++) {
+        VkDeviceSize width = std::max(info.extent.width >> level, 1u);
+        VkDeviceSize height = std::max(info.extent.height >> level, 1u);
+        VkDeviceSize depth = std::max(info.extent.depth >> level, 1u);
+        size += width * height * depth;
+    }
+    size *= std::max(info.arrayLayers, 1u) * texelSize(info.format);
+    pMemoryRequirements->alignment = 4096;
+    pMemoryRequirements->size = (size + 4095) / 4096 * 4096;
+    pMemoryRequirements->memoryTypeBits = 0xF;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindImageMemory(VkDevice, VkImage, VkDeviceMemory, VkDeviceSize)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImageView(VkDevice, const VkImageViewCreateInfo*, const VkAllocationCallbacks*,
+    VkImageView *pView)
+{
+    return createObject(pView);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImageView(VkDevice, VkImageView imageView, const VkAllocationCallbacks*)
+{
+    destroyObject(imageView);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateSampler(VkDevice, const VkSamplerCreateInfo*, const VkAllocationCallbacks*,
+    VkSampler *pSampler)
+{
+    return createObject(pSampler);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroySampler(VkDevice, VkSampler sampler, const VkAllocationCallbacks*)
+{
+    destroyObject(sampler);
+}
+
+/*
+    Synchronization
+*/
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateFence(VkDevice, const VkFenceCreateInfo *pCreateInfo, const VkAllocationCallbacks*,
+    VkFence *pFence)
+{
+    VkFence fence = new VkFence_T();
+    fence->signaled = (pCreateInfo->flags & VK_FENCE_CREATE_SIGNALED_BIT) != 0;
+    *pFence = fence;
+    live.fences++;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyFence(VkDevice, VkFence fence, const VkAllocationCallbacks*)
+{
+    if (fence) {
+        delete fence;
+        live.fences--;
+    }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkGetFenceStatus(VkDevice, VkFence fence)
+{
+    std::lock_guard<std::mutex> lock(gpu().mutex);
+    return fence->signaled ? VK_SUCCESS : VK_NOT_READY;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkResetFences(VkDevice, uint32_t fenceCount, const VkFence *pFences)
+{
+    std::lock_guard<std::mutex> lock(gpu().mutex);
+    for (uint32_t i = 0; i < fenceCount; i++) {
+        pFences[i]->signaled = false;
+    }
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkWaitForFences(VkDevice, uint32_t fenceCount, const VkFence *pFences, VkBool32 waitAll,
+    uint64_t timeout)
+{
+    Gpu &g = gpu();
+    auto done = [&]() {
+        uint32_t signaled = 0;
+        for (uint32_t i = 0; i < fenceCount; i++) {
+            signaled += pFences[i]->signaled ? 1 : 0;
+        }
+        return waitAll ? signaled == fenceCount : signaled > 0;
+    };
+    std::unique_lock<std::mutex> lock(g.mutex);
+    if (timeout >= static_cast<uint64_t>(std::chrono::nanoseconds::max().count())) {
+        g.completed.wait(lock, done);
+        return VK_SUCCESS;
+    }
+    return g.completed.wait_for(lock, std::chrono::nanoseconds(timeout), done) ? VK_SUCCESS : VK_TIMEOUT;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateSemaphore(VkDevice, const VkSemaphoreCreateInfo*, const VkAllocationCallbacks*,
+    VkSemaphore *pSemaphore)
+{
+    return createObject(pSemaphore);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroySemaphore(VkDevice, VkSemaphore semaphore, const VkAllocationCallbacks*)
+{
+    destroyObject(semaphore);
+}
+
+/*
+    Command pools and buffers
+*/
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateCommandPool(VkDevice, const VkCommandPoolCreateInfo*, const VkAllocationCallbacks*,
+    VkCommandPool *pCommandPool)
+{
+    return createObject(pCommandPool);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyCommandPool(VkDevice, VkCommandPool commandPool, const VkAllocationCallbacks*)
+{
+    if (commandPool) {
+        live.commandBuffers -= static_cast<int64_t>(commandPool->commandBuffers.size());
+        for (VkCommandBuffer commandBuffer : commandPool->commandBuffers) {
+            delete commandBuffer;
+        }
+        delete commandPool;
+    }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkResetCommandPool(VkDevice, VkCommandPool commandPool, VkCommandPoolResetFlags)
+{
+    for (VkCommandBuffer commandBuffer : commandPool->commandBuffers) {
+        commandBuffer->commands.clear();
+    }
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateCommandBuffers(VkDevice, const VkCommandBufferAllocateInfo *pAllocateInfo,
+    VkCommandBuffer *pCommandBuffers)
+{
+    for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; i++) {
+        pCommandBuffers[i] = new VkCommandBuffer_T();
+        pAllocateInfo->commandPool->commandBuffers.push_back(pCommandBuffers[i]);
+    }
+    live.commandBuffers += pAllocateInfo->commandBufferCount;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeCommandBuffers(VkDevice, VkCommandPool commandPool, uint32_t commandBufferCount,
+    const VkCommandBuffer *pCommandBuffers)
+{
+    for (uint32_t i = 0; i < commandBufferCount; i++) {
+        auto &pooled = commandPool->commandBuffers;
+        auto it = std::find(pooled.begin(), pooled.end(), pCommandBuffers[i]);
+        if (it != pooled.end()) {
+            pooled.erase(it);
+            delete pCommandBuffers[i];
+            live.commandBuffers--;
+        }
+    }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo*)
+{
+    commandBuffer->commands.clear();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkEndCommandBuffer(VkCommandBuffer)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkResetCommandBuffer(VkCommandBuffer commandBuffer, VkCommandBufferResetFlags)
+{
+    commandBuffer->commands.clear();
+    return VK_SUCCESS;
+}
+
+/*
+    Pipelines and descriptors
+*/
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateShaderModule(VkDevice, const VkShaderModuleCreateInfo*, const VkAllocationCallbacks*,
+    VkShaderModule *pShaderModule)
+{
+    return createObject(pShaderModule);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyShaderModule(VkDevice, VkShaderModule shaderModule, const VkAllocationCallbacks*)
+{
+    destroyObject(shaderModule);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreatePipelineLayout(VkDevice, const VkPipelineLayoutCreateInfo*, const VkAllocationCallbacks*,
+    VkPipelineLayout *pPipelineLayout)
+{
+    return createObject(pPipelineLayout);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyPipelineLayout(VkDevice, VkPipelineLayout pipelineLayout, const VkAllocationCallbacks*)
+{
+    destroyObject(pipelineLayout);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateGraphicsPipelines(VkDevice, VkPipelineCache, uint32_t createInfoCount,
+    const VkGraphicsPipelineCreateInfo*, const VkAllocationCallbacks*, VkPipeline *pPipelines)
+{
+    for (uint32_t i = 0; i < createInfoCount; i++) {
+        createObject(&pPipelines[i]);
+    }
+    counting.pipelines += createInfoCount;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateComputePipelines(VkDevice, VkPipelineCache, uint32_t createInfoCount,
+    const VkComputePipelineCreateInfo*, const VkAllocationCallbacks*, VkPipeline *pPipelines)
+{
+    for (uint32_t i = 0; i < createInfoCount; i++) {
+        createObject(&pPipelines[i]);
+    }
+    counting.pipelines += createInfoCount;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyPipeline(VkDevice, VkPipeline pipeline, const VkAllocationCallbacks*)
+{
+    destroyObject(pipeline);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateRenderPass(VkDevice, const VkRenderPassCreateInfo*, const VkAllocationCallbacks*,
+    VkRenderPass *pRenderPass)
+{
+    return createObject(pRenderPass);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyRenderPass(VkDevice, VkRenderPass renderPass, const VkAllocationCallbacks*)
+{
+    destroyObject(renderPass);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateFramebuffer(VkDevice, const VkFramebufferCreateInfo*, const VkAllocationCallbacks*,
+    VkFramebuffer *pFramebuffer)
+{
+    return createObject(pFramebuffer);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyFramebuffer(VkDevice, VkFramebuffer framebuffer, const VkAllocationCallbacks*)
+{
+    destroyObject(framebuffer);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateDescriptorSetLayout(VkDevice, const VkDescriptorSetLayoutCreateInfo*,
+    const VkAllocationCallbacks*, VkDescriptorSetLayout *pSetLayout)
+{
+    return createObject(pSetLayout);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyDescriptorSetLayout(VkDevice, VkDescriptorSetLayout descriptorSetLayout,
+    const VkAllocationCallbacks*)
+{
+    destroyObject(descriptorSetLayout);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateDescriptorPool(VkDevice, const VkDescriptorPoolCreateInfo*, const VkAllocationCallbacks*,
+    VkDescriptorPool *pDescriptorPool)
+{
+    return createObject(pDescriptorPool);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkResetDescriptorPool(VkDevice, VkDescriptorPool descriptorPool, VkDescriptorPoolResetFlags)
+{
+    for (VkDescriptorSet set : descriptorPool->sets) {
+        delete set;
+    }
+    descriptorPool->sets.clear();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyDescriptorPool(VkDevice device, VkDescriptorPool descriptorPool, const VkAllocationCallbacks*)
+{
+    if (descriptorPool) {
+        vkResetDescriptorPool(device, descriptorPool, 0);
+        delete descriptorPool;
+    }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateDescriptorSets(VkDevice, const VkDescriptorSetAllocateInfo *pAllocateInfo,
+    VkDescriptorSet *pDescriptorSets)
+{
+    for (uint32_t i = 0; i < pAllocateInfo->descriptorSetCount; i++) {
+        pDescriptorSets[i] = new VkDescriptorSet_T();
+        pAllocateInfo->descriptorPool->sets.push_back(pDescriptorSets[i]);
+    }
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkFreeDescriptorSets(VkDevice, VkDescriptorPool descriptorPool, uint32_t descriptorSetCount,
+    const VkDescriptorSet *pDescriptorSets)
+{
+    for (uint32_t i = 0; i < descriptorSetCount; i++) {
+        auto &sets = descriptorPool->sets;
+        auto it = std::find(sets.begin(), sets.end(), pDescriptorSets[i]);
+        if (it != sets.end()) {
+            sets.erase(it);
+            delete pDescriptorSets[i];
+        }
+    }
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkUpdateDescriptorSets(VkDevice, uint32_t descriptorWriteCount, const VkWriteDescriptorSet*,
+    uint32_t, const VkCopyDescriptorSet*)
+{
+    counting.descriptorWrites += descriptorWriteCount;
+}
+
+/*
+    Commands
+*/
+
+VKAPI_ATTR void VKAPI_CALL vkCmdCopyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer,
+    uint32_t regionCount, const VkBufferCopy *pRegions)
+{
+    StubCommand command{ StubCommand::COPY };
+    command.src = srcBuffer;
+    command.dst = dstBuffer;
+    command.regions.assign(pRegions, pRegions + regionCount);
+    commandBuffer->commands.push_back(std::move(command));
+    counting.copies++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdFillBuffer(VkCommandBuffer commandBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset,
+    VkDeviceSize size, uint32_t data)
+{
+    StubCommand command{ StubCommand::FILL };
+    command.dst = dstBuffer;
+    command.offset = dstOffset;
+    command.size = size;
+    command.value = data;
+    commandBuffer->commands.push_back(std::move(command));
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdUpdateBuffer(VkCommandBuffer commandBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset,
+    VkDeviceSize dataSize, const void *pData)
+{
+    StubCommand command{ StubCommand::UPDATE };
+    command.dst = dstBuffer;
+    command.offset = dstOffset;
+    command.bytes.assign(static_cast<const uint8_t*>(pData), static_cast<const uint8_t*>(pData) + dataSize);
+    commandBuffer->commands.push_back(std::move(command));
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdCopyBufferToImage(VkCommandBuffer, VkBuffer, VkImage, VkImageLayout, uint32_t,
+    const VkBufferImageCopy*)
+{
+    counting.copies++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdCopyImageToBuffer(VkCommandBuffer, VkImage, VkImageLayout, VkBuffer, uint32_t,
+    const VkBufferImageCopy*)
+{
+    counting.copies++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBlitImage(VkCommandBuffer, VkImage, VkImageLayout, VkImage, VkImageLayout, uint32_t,
+    const VkImageBlit*, VkFilter)
+{
+    counting.copies++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPipelineBarrier(VkCommandBuffer, VkPipelineStageFlags, VkPipelineStageFlags, VkDependencyFlags,
+    uint32_t, const VkMemoryBarrier*, uint32_t, const VkBufferMemoryBarrier*, uint32_t, const VkImageMemoryBarrier*)
+{
+    counting.barriers++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBeginRenderPass(VkCommandBuffer, const VkRenderPassBeginInfo*, VkSubpassContents)
+{
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdEndRenderPass(VkCommandBuffer)
+{
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdSetViewport(VkCommandBuffer, uint32_t, uint32_t, const VkViewport*)
+{
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdSetScissor(VkCommandBuffer, uint32_t, uint32_t, const VkRect2D*)
+{
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindPipeline(VkCommandBuffer, VkPipelineBindPoint, VkPipeline)
+{
+    counting.bindPipeline++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindDescriptorSets(VkCommandBuffer, VkPipelineBindPoint, VkPipelineLayout, uint32_t,
+    uint32_t descriptorSetCount, const VkDescriptorSet*, uint32_t, const uint32_t*)
+{
+    counting.bindDescriptorSets++;
+    counting.descriptorSetsBound += descriptorSetCount;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPushConstants(VkCommandBuffer, VkPipelineLayout, VkShaderStageFlags, uint32_t, uint32_t size,
+    const void*)
+{
+    counting.pushConstants++;
+    counting.pushConstantBytes += size;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindVertexBuffers(VkCommandBuffer, uint32_t, uint32_t, const VkBuffer*, const VkDeviceSize*)
+{
+    counting.bindVertexBuffers++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindIndexBuffer(VkCommandBuffer, VkBuffer, VkDeviceSize, VkIndexType)
+{
+    counting.bindIndexBuffer++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDraw(VkCommandBuffer, uint32_t, uint32_t, uint32_t, uint32_t)
+{
+    counting.draws++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDrawIndexed(VkCommandBuffer, uint32_t, uint32_t, uint32_t, int32_t, uint32_t)
+{
+    counting.draws++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDrawIndirect(VkCommandBuffer, VkBuffer, VkDeviceSize, uint32_t, uint32_t)
+{
+    counting.indirectDraws++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDrawIndexedIndirect(VkCommandBuffer, VkBuffer, VkDeviceSize, uint32_t, uint32_t)
+{
+    counting.indirectDraws++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDispatch(VkCommandBuffer, uint32_t, uint32_t, uint32_t)
+{
+    counting.dispatches++;
+}
+
+}
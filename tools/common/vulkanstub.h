@@ -0,0 +1,83 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Headless stand-in for the Vulkan loader used by the tools
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+/*
+    Implements the Vulkan entry points the framework calls without a GPU: every memory type is host memory,
+    submissions run in order on a thread of their own (the "GPU") which executes buffer copies, fills and
+    updates and then signals the fence, everything else is recorded as a counter only
+    Shaders are never run, images have memory but copies into them are not executed
+*/
+namespace vkstub
+{
+
+    struct Config {
+        // A transfer only queue family next to the graphics, compute and transfer one
+        bool dedicatedTransferQueue = false;
+        // Time the GPU thread spends on every submission before it executes it
+        std::chrono::microseconds submitLatency{ 0 };
+    };
+
+    /*
+        Applies to queue families reported afterwards and to submissions made afterwards
+    */
+    void configure(const Config &config);
+
+    VkPhysicalDevice physicalDevice();
+
+    /*
+        Commands recorded into command buffers and a few device calls, summed over all threads
+    */
+    struct Counters {
+        uint64_t submits = 0;
+        uint64_t bindPipeline = 0;
+        uint64_t bindDescriptorSets = 0;
+        uint64_t descriptorSetsBound = 0;
+        uint64_t pushConstants = 0;
+        uint64_t pushConstantBytes = 0;
+        uint64_t bindVertexBuffers = 0;
+        uint64_t bindIndexBuffer = 0;
+        uint64_t draws = 0;
+        uint64_t indirectDraws = 0;
+        uint64_t dispatches = 0;
+        uint64_t copies = 0;
+        uint64_t barriers = 0;
+        uint64_t descriptorWrites = 0;
+        uint64_t pipelines = 0;
+    };
+
+    Counters counters();
+
+    void resetCounters();
+
+    /*
+        Memory backing a buffer, what the copies executed so far have written
+    */
+    const uint8_t *bufferData(VkBuffer buffer);
+
+    /*
+        Number of live buffers, images and memory allocations, to find leaks
+    */
+    struct Objects {
+        int64_t buffers = 0;
+        int64_t images = 0;
+        int64_t allocations = 0;
+        int64_t commandBuffers = 0;
+        int64_t fences = 0;
+    };
+
+    Objects objects();
+
+}
@@ -0,0 +1,517 @@
+/* Copyright (c) 2021-2021, Xuanyi Technologies
+ *
+ * Features:
+ *      Stress test of StagingRing on the headless Vulkan stub
+ *
+ * Version:
+ *      2021.02.10  initial
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vulkan/device.h"
+#include "vulkan/stagingring.h"
+#include "gltf/model.h"
+#include "glb.h"
+#include "headlessdevice.h"
+#include "vulkanstub.h"
+#include "benchmark.h"
+
+using xy::StagingRing;
+
+#define CHECK(condition)                                                        \
+    if (!(condition)) {                                                         \
+        printf("  %s:%d: %s failed\n", __FILE__, __LINE__, #condition);         \
+        return false;                                                           \
+    }
+
+// Small enough that every test wraps it and runs out of space
+static const VkDeviceSize RingSize = 1024 * 1024;
+
+/*
+    One upload: bytes derived from seed, copied from the ring to dstOffset in dst
+*/
+struct Upload {
+    VkBuffer dst;
+    VkDeviceSize dstOffset;
+    VkDeviceSize size;
+    uint32_t seed;
+};
+
+static uint8_t patternByte(uint32_t seed, VkDeviceSize i)
+{
+    uint32_t x = seed * 2654435761u + static_cast<uint32_t>(i) * 40503u;
+    return static_cast<uint8_t>(x ^ (x >> 13) ^ (x >> 24));
+}
+
+static StagingRing::Region upload(StagingRing::Batch &batch, const Upload &upload, VkDeviceSize alignment = 16)
+{
+    StagingRing::Region region = batch.allocate(upload.size, alignment);
+    for (VkDeviceSize i = 0; i < upload.size; i++) {
+        region.data[i] = patternByte(upload.seed, i);
+    }
+    // Allocating may have submitted the batch, the copy goes into the command buffer current now
+    VkBufferCopy copy{ region.offset, upload.dstOffset, upload.size };
+    vkCmdCopyBuffer(batch.commandBuffer(), region.buffer, upload.dst, 1, &copy);
+    return region;
+}
+
+/*
+    What the copies left in the destination, a range of the ring reused too early shows up here
+*/
+static bool verify(const std::vector<Upload> &uploads)
+{
+    for (const Upload &u : uploads) {
+        const uint8_t *data = vkstub::bufferData(u.dst) + u.dstOffset;
+        for (VkDeviceSize i = 0; i < u.size; i++) {
+            if (data[i] != patternByte(u.seed, i)) {
+                printf("  upload %u of %llu bytes differs at byte %llu\n", u.seed, (unsigned long long)u.size,
+                    (unsigned long long)i);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+struct Destination {
+    xy::VulkanDevice *device;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    xy::Allocation memory;
+
+    Destination(xy::VulkanDevice *device, VkDeviceSize size) : device(device)
+    {
+        VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size, &buffer, &memory));
+    }
+
+    ~Destination()
+    {
+        device->destroyBuffer(buffer, memory);
+    }
+};
+
+static void setLatency(const vkstub::Config &config, std::chrono::microseconds latency)
+{
+    vkstub::Config c = config;
+    c.submitLatency = latency;
+    vkstub::configure(c);
+}
+
+/*
+    Submitting after every upload wraps the ring over and over
+*/
+static bool wrapAround(xy::VulkanDevice *device, const vkstub::Config &config)
+{
+    setLatency(config, std::chrono::microseconds(500));
+    Destination dst(device, 8 * RingSize);
+    std::vector<Upload> uploads;
+    uint32_t wraps = 0;
+    {
+        StagingRing::Batch batch(device, device->transferQueue);
+        VkDeviceSize previous = 0;
+        for (uint32_t i = 0; i < 64; i++) {
+            uploads.push_back({ dst.buffer, i * 101000ull, 100000 + i, i });
+            StagingRing::Region region = upload(batch, uploads.back());
+            wraps += region.offset < previous;
+            previous = region.offset;
+            batch.submit();
+        }
+    }
+    CHECK(wraps >= 4);
+    CHECK(verify(uploads));
+    return true;
+}
+
+/*
+    Once the fences of a full ring have signaled its space is reclaimed without waiting
+*/
+static bool reclaim(xy::VulkanDevice *device, const vkstub::Config &config)
+{
+    setLatency(config, std::chrono::microseconds(0));
+    Destination dst(device, RingSize);
+    std::vector<Upload> uploads = {
+        { dst.buffer, 0, RingSize / 2, 1 },
+        { dst.buffer, RingSize / 2, RingSize / 2 - 4096, 2 },
+    };
+    {
+        StagingRing::Batch batch(device, device->transferQueue);
+        upload(batch, uploads[0]);
+        batch.submit();
+        upload(batch, uploads[1]);
+    }
+    CHECK(verify(uploads));
+    const StagingRing::Stats before = device->staging.stats();
+    {
+        StagingRing::Batch batch(device, device->transferQueue);
+        uploads = { { dst.buffer, 0, RingSize / 2, 3 } };
+        StagingRing::Region region = upload(batch, uploads[0]);
+        // An empty ring starts over at the beginning
+        CHECK(region.offset == 0);
+    }
+    CHECK(device->staging.stats().stalls == before.stalls);
+    CHECK(verify(uploads));
+    return true;
+}
+
+/*
+    A full ring whose oldest range is submitted waits for that fence, then reuses the range
+*/
+static bool stallOnFence(xy::VulkanDevice *device, const vkstub::Config &config)
+{
+    setLatency(config, std::chrono::milliseconds(30));
+    Destination dst(device, 2 * RingSize);
+    std::vector<Upload> uploads = {
+        { dst.buffer, 0, RingSize / 2, 11 },
+        { dst.buffer, RingSize / 2, RingSize / 2, 12 },
+        { dst.buffer, RingSize, RingSize / 4, 13 },
+    };
+    const StagingRing::Stats before = device->staging.stats();
+    {
+        StagingRing::Batch batch(device, device->transferQueue);
+        upload(batch, uploads[0]);
+        batch.submit();
+        upload(batch, uploads[1]);
+        batch.submit();
+        auto start = std::chrono::steady_clock::now();
+        StagingRing::Region region = upload(batch, uploads[2]);
+        auto waited = std::chrono::steady_clock::now() - start;
+        CHECK(region.offset == 0);
+        CHECK(waited >= std::chrono::milliseconds(20));
+    }
+    const StagingRing::Stats after = device->staging.stats();
+    CHECK(after.stalls == before.stalls + 1);
+    CHECK(after.submissions == before.submissions + 3);
+    CHECK(verify(uploads));
+    return true;
+}
+
+/*
+    More than half the ring gets a buffer of its own, released with the submission
+*/
+static bool oversized(xy::VulkanDevice *device, const vkstub::Config &config)
+{
+    // Long enough that the first submission is still in flight when the buffers are counted
+    setLatency(config, std::chrono::milliseconds(20));
+    Destination dst(device, 4 * RingSize);
+    const vkstub::Objects objects = vkstub::objects();
+    const StagingRing::Stats before = device->staging.stats();
+    std::vector<Upload> uploads = {
+        { dst.buffer, 0, 1024, 21 },
+        { dst.buffer, 1024, RingSize / 2 + 1, 22 },
+        { dst.buffer, 2 * RingSize, 3 * RingSize / 2, 23 },
+    };
+    {
+        StagingRing::Batch batch(device, device->transferQueue);
+        StagingRing::Region small = upload(batch, uploads[0]);
+        StagingRing::Region large = upload(batch, uploads[1]);
+        batch.submit();
+        StagingRing::Region larger = upload(batch, uploads[2]);
+        CHECK(large.buffer != small.buffer && larger.buffer != small.buffer && large.buffer != larger.buffer);
+        CHECK(large.offset == 0);
+        CHECK(vkstub::objects().buffers == objects.buffers + 2);
+    }
+    CHECK(vkstub::objects().buffers == objects.buffers);
+    CHECK(device->staging.stats().oversized == before.oversized + 2);
+    CHECK(verify(uploads));
+    return true;
+}
+
+/*
+    A full ring whose oldest range belongs to a batch of another thread which has not submitted yet
+    waits until that batch submits
+*/
+static bool waitForOtherBatch(xy::VulkanDevice *device, const vkstub::Config &config)
+{
+    setLatency(config, std::chrono::microseconds(0));
+    Destination dst(device, 2 * RingSize);
+    std::vector<Upload> uploads = {
+        { dst.buffer, 0, RingSize / 2, 31 },
+        { dst.buffer, RingSize / 2, RingSize / 2 - 4096, 32 },
+        { dst.buffer, RingSize, RingSize / 4, 33 },
+    };
+    const StagingRing::Stats before = device->staging.stats();
+    std::atomic<bool> done{ false };
+    {
+        StagingRing::Batch batch(device, device->transferQueue);
+        upload(batch, uploads[0]);
+        upload(batch, uploads[1]);
+        std::thread other([&] {
+            StagingRing::Batch otherBatch(device, device->transferQueue);
+            upload(otherBatch, uploads[2]);
+            done = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        const bool waiting = !done;
+        batch.submit();
+        other.join();
+        CHECK(waiting);
+        CHECK(done);
+    }
+    CHECK(device->staging.stats().stalls == before.stalls + 1);
+    CHECK(verify(uploads));
+    return true;
+}
+
+/*
+    A batch whose own unsubmitted ranges fill the ring submits them and carries on in a new command buffer
+*/
+static bool selfSubmit(xy::VulkanDevice *device, const vkstub::Config &config)
+{
+    setLatency(config, std::chrono::milliseconds(5));
+    Destination dst(device, 2 * RingSize);
+    std::vector<Upload> uploads = {
+        { dst.buffer, 0, RingSize / 2, 41 },
+        { dst.buffer, RingSize / 2, RingSize / 2 - 4096, 42 },
+        { dst.buffer, RingSize, RingSize / 4, 43 },
+    };
+    const StagingRing::Stats before = device->staging.stats();
+    {
+        StagingRing::Batch batch(device, device->transferQueue);
+        upload(batch, uploads[0]);
+        upload(batch, uploads[1]);
+        CHECK(device->staging.stats().submissions == before.submissions);
+        StagingRing::Region region = upload(batch, uploads[2]);
+        CHECK(device->staging.stats().submissions == before.submissions + 1);
+        CHECK(region.offset == 0);
+    }
+    CHECK(device->staging.stats().submissions == before.submissions + 2);
+    CHECK(device->staging.stats().stalls == before.stalls + 1);
+    CHECK(verify(uploads));
+    return true;
+}
+
+static bool overlap(const StagingRing::Region &a, const StagingRing::Region &b)
+{
+    return a.buffer == b.buffer && a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+
+/*
+    Ranges allocated before their copies are recorded, like the vertex and index staging of a model, are not
+    given away by a submission the next allocation makes to free the ring
+*/
+static bool allocateBeforeRecord(xy::VulkanDevice *device, const vkstub::Config &config)
+{
+    setLatency(config, std::chrono::milliseconds(5));
+    Destination dst(device, 2 * RingSize);
+    const VkDeviceSize step = RingSize / 16;
+    // Only the recorded range is freed, the second pending range does not fit in front of the first one
+    // and gets a buffer of its own, then the recorded range is large enough for it
+    const VkDeviceSize recordedSizes[2] = { 5 * step, 7 * step };
+    const VkDeviceSize pendingSizes[2][2] = { { 7 * step, 6 * step }, { 5 * step, 6 * step } };
+    const bool expectOversized[2] = { true, false };
+    uint32_t seed = 50;
+    for (uint32_t c = 0; c < 2; c++) {
+        std::vector<Upload> uploads = {
+            { dst.buffer, 0, recordedSizes[c], seed++ },
+            { dst.buffer, recordedSizes[c], pendingSizes[c][0], seed++ },
+            { dst.buffer, recordedSizes[c] + pendingSizes[c][0], pendingSizes[c][1], seed++ },
+        };
+        const StagingRing::Stats before = device->staging.stats();
+        {
+            StagingRing::Batch batch(device, device->transferQueue);
+            upload(batch, uploads[0]);
+            StagingRing::Region regions[2] = { batch.allocate(uploads[1].size), batch.allocate(uploads[2].size) };
+            CHECK(!overlap(regions[0], regions[1]));
+            CHECK(device->staging.stats().submissions == before.submissions + 1);
+            CHECK(device->staging.stats().oversized == before.oversized + (expectOversized[c] ? 1 : 0));
+            if (!expectOversized[c]) {
+                CHECK(regions[1].offset == 0);
+            }
+            for (uint32_t r = 0; r < 2; r++) {
+                const Upload &u = uploads[r + 1];
+                for (VkDeviceSize i = 0; i < u.size; i++) {
+                    regions[r].data[i] = patternByte(u.seed, i);
+                }
+            }
+            VkCommandBuffer copyCmd = batch.commandBuffer();
+            for (uint32_t r = 0; r < 2; r++) {
+                VkBufferCopy copy{ regions[r].offset, uploads[r + 1].dstOffset, uploads[r + 1].size };
+                vkCmdCopyBuffer(copyCmd, regions[r].buffer, dst.buffer, 1, &copy);
+            }
+        }
+        CHECK(verify(uploads));
+    }
+    return true;
+}
+
+/*
+    Threads uploading a random mix of sizes and alignments, submitting at random points
+*/
+static bool stress(xy::VulkanDevice *device, const vkstub::Config &config, uint32_t threadCount, uint32_t uploadsPerThread)
+{
+    setLatency(config, std::chrono::microseconds(200));
+    const vkstub::Objects objects = vkstub::objects();
+    const StagingRing::Stats before = device->staging.stats();
+
+    // Planned up front so the destinations can be sized
+    struct Plan {
+        std::vector<Upload> uploads;
+        std::vector<VkDeviceSize> alignments;
+        std::vector<bool> submitAfter;
+        VkDeviceSize size = 0;
+    };
+    std::vector<Plan> plans(threadCount);
+    std::vector<std::unique_ptr<Destination>> destinations;
+    for (uint32_t t = 0; t < threadCount; t++) {
+        std::mt19937 rng(t + 1);
+        Plan &plan = plans[t];
+        for (uint32_t i = 0; i < uploadsPerThread; i++) {
+            const uint32_t kind = rng() % 1000;
+            VkDeviceSize size;
+            if (kind < 925) {
+                size = 1 + rng() % 4096;
+            } else if (kind < 975) {
+                size = 16384 + rng() % (RingSize / 4);
+            } else if (kind < 995) {
+                size = RingSize / 4 + rng() % (RingSize / 4);
+            } else {
+                size = RingSize / 2 + 1 + rng() % (RingSize / 2);
+            }
+            const VkDeviceSize alignments[] = { 1, 4, 16, 256 };
+            plan.uploads.push_back({ VK_NULL_HANDLE, plan.size, size, t * uploadsPerThread + i });
+            plan.alignments.push_back(alignments[rng() % 4]);
+            plan.submitAfter.push_back(rng() % 16 == 0);
+            plan.size += size;
+        }
+        destinations.emplace_back(new Destination(device, plan.size));
+        for (Upload &u : plan.uploads) {
+            u.dst = destinations.back()->buffer;
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < threadCount; t++) {
+        threads.emplace_back([&, t] {
+            StagingRing::Batch batch(device, device->transferQueue);
+            for (size_t i = 0; i < plans[t].uploads.size(); i++) {
+                upload(batch, plans[t].uploads[i], plans[t].alignments[i]);
+                if (plans[t].submitAfter[i]) {
+                    batch.submit();
+                }
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    const StagingRing::Stats after = device->staging.stats();
+    printf("  %u threads x %u uploads: %llu submissions, %.1f MB staged, %llu stalls, %llu oversized\n",
+        threadCount, uploadsPerThread, (unsigned long long)(after.submissions - before.submissions),
+        (after.stagedBytes - before.stagedBytes) / 1048576.0, (unsigned long long)(after.stalls - before.stalls),
+        (unsigned long long)(after.oversized - before.oversized));
+    CHECK(after.stalls > before.stalls);
+    CHECK(after.oversized > before.oversized);
+    for (const Plan &plan : plans) {
+        CHECK(verify(plan.uploads));
+    }
+    destinations.clear();
+    CHECK(vkstub::objects().buffers == objects.buffers);
+    CHECK(vkstub::objects().commandBuffers == objects.commandBuffers);
+    return true;
+}
+
+/*
+    Uncompressed 32 bit TGA, which stb_image decodes like the PNG and JPEG images of real assets
+*/
+static std::vector<uint8_t> makeTga(uint16_t width, uint16_t height, uint32_t seed)
+{
+    std::vector<uint8_t> tga(18 + size_t(width) * height * 4);
+    tga[2] = 2;
+    memcpy(&tga[12], &width, 2);
+    memcpy(&tga[14], &height, 2);
+    tga[16] = 32;
+    tga[17] = 0x28;
+    for (size_t i = 18; i < tga.size(); i++) {
+        tga[i] = patternByte(seed, i);
+    }
+    return tga;
+}
+
+/*
+    Textures of four times the ring loaded through loadFromFile: the images are staged in groups the ring serves,
+    none of them in a buffer of its own
+*/
+static bool textureGroups(xy::VulkanDevice *device, const vkstub::Config &config)
+{
+    vkstub::configure(config);
+    const uint16_t side = 256;
+    const uint32_t imageCount = static_cast<uint32_t>(4 * RingSize / (side * side * 4));
+    std::string images, textures, bufferViews;
+    std::vector<uint8_t> bin;
+    for (uint32_t i = 0; i < imageCount; i++) {
+        const std::vector<uint8_t> tga = makeTga(side, side, 50 + i);
+        const std::string sep = i ? "," : "";
+        bufferViews += sep + "{\"buffer\":0,\"byteOffset\":" + std::to_string(bin.size()) + ",\"byteLength\":" +
+            std::to_string(tga.size()) + "}";
+        images += sep + "{\"bufferView\":" + std::to_string(i) + ",\"mimeType\":\"image/x-tga\"}";
+        textures += sep + "{\"source\":" + std::to_string(i) + "}";
+        bin.insert(bin.end(), tga.begin(), tga.end());
+        bin.resize((bin.size() + 3) & ~size_t(3), 0);
+    }
+    const std::string json = "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[]}],\"images\":[" +
+        images + "],\"textures\":[" + textures + "],\"bufferViews\":[" + bufferViews + "],\"buffers\":[{\"byteLength\":" +
+        std::to_string(bin.size()) + "}]}";
+    const std::vector<uint8_t> glb = tools::makeGlb(json, bin);
+    FILE *file = fopen("textures.glb", "wb");
+    CHECK(file && fwrite(glb.data(), 1, glb.size(), file) == glb.size());
+    fclose(file);
+
+    const StagingRing::Stats before = device->staging.stats();
+    vkglTF::Model model;
+    model.progressiveLoading = false;
+    model.cacheDirectory.clear();
+    model.loadFromFile("textures.glb", device, device->transferQueue);
+    const StagingRing::Stats after = device->staging.stats();
+    printf("  %u images of %u x %u: %llu submissions, %.1f MB staged, %llu oversized\n", imageCount, side, side,
+        (unsigned long long)(after.submissions - before.submissions), (after.stagedBytes - before.stagedBytes) / 1048576.0,
+        (unsigned long long)(after.oversized - before.oversized));
+    CHECK(model.textures.size() == imageCount);
+    for (const vkglTF::Texture &texture : model.textures) {
+        CHECK(texture.width == side && texture.height == side);
+    }
+    CHECK(after.oversized == before.oversized);
+    CHECK(after.submissions >= before.submissions + 8);
+    model.destroy(device->logicalDevice);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const bool check = bench::checkOnly(argc, argv);
+    bool passed = true;
+    for (bool dedicated : { false, true }) {
+        vkstub::Config config;
+        config.dedicatedTransferQueue = dedicated;
+        std::unique_ptr<xy::VulkanDevice> device = tools::createHeadlessDevice(config);
+        CHECK(device->dedicatedTransferQueue() == dedicated);
+        device->staging.destroy();
+        device->staging.init(device.get(), RingSize);
+
+        printf("%s\n", dedicated ? "dedicated transfer queue" : "graphics queue");
+        auto run = [&](const char *name, bool result) {
+            printf("  %-24s %s\n", name, result ? "ok" : "FAILED");
+            passed = passed && result;
+        };
+        run("wrap around", wrapAround(device.get(), config));
+        run("reclaim", reclaim(device.get(), config));
+        run("stall on fence", stallOnFence(device.get(), config));
+        run("oversized", oversized(device.get(), config));
+        run("wait for other batch", waitForOtherBatch(device.get(), config));
+        run("self submit", selfSubmit(device.get(), config));
+        run("allocate before record", allocateBeforeRecord(device.get(), config));
+        run("texture groups", textureGroups(device.get(), config));
+        run("stress", stress(device.get(), config, 4, check ? 2000 : 20000));
+    }
+    return passed ? 0 : 1;
+}